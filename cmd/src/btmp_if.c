@@ -39,7 +39,6 @@
 
 static bt_status_t status;
 static int bt_try_enable = 0; /* 0: try to disable; 1: try to enable */
-static char log_buf[1024];
 static LOG_TYPE log_type;
 static int log_fd = -1;
 
@@ -149,9 +148,34 @@ static void adapter_state_changed(bt_state_t state)
 
 }
 
+/* Output an already formatted line, no need for another pass through vsnprintf */
+static void btmp_log_str(const char *str)
+{
+    if (log_type == LOG_STD)
+        fprintf(stdout, "%s\n", str);
+    else if (log_type == LOG_SKT && log_fd >= 0)
+        write(log_fd, str, strlen(str));
+}
+
 static void dut_mode_recv(uint8_t evtcode, char *buf)
 {
-    btmp_log(buf);
+    btmp_log_str(buf);
+}
+
+static void dut_mode_result(const bt_mp_result_t *result)
+{
+    char text[BT_MP_RESULT_TEXT_MAX];
+
+    /* text is only rendered here, and only for an attached text client */
+    if (log_type == LOG_SKT && log_fd < 0)
+        return;
+
+    if (result->type == BT_MP_RESULT_TEXT) {
+        btmp_log_str((const char *)result->data);
+    } else {
+        sBtInterface->op_render(result, text);
+        btmp_log_str(text);
+    }
 }
 
 static bt_callbacks_t bt_callbacks = {
@@ -159,6 +183,7 @@ static bt_callbacks_t bt_callbacks = {
     adapter_state_changed,
     NULL, /* thread_evt_cb */
     dut_mode_recv, /*dut_mode_recv_cb */
+    dut_mode_result, /* dut_mode_result_cb */
 };
 
 /*******************************************************************************
@@ -166,10 +191,11 @@ static bt_callbacks_t bt_callbacks = {
  *******************************************************************************/
 void btmp_log_std(const char *fmt_str, ...)
 {
+    char log_buf[BT_MP_RESULT_TEXT_MAX];
     va_list ap;
 
     va_start(ap, fmt_str);
-    vsnprintf(log_buf, 1024, fmt_str, ap);
+    vsnprintf(log_buf, sizeof(log_buf), fmt_str, ap);
     va_end(ap);
 
     fprintf(stdout, "%s\n", log_buf);
@@ -177,21 +203,25 @@ void btmp_log_std(const char *fmt_str, ...)
 
 void btmp_log_skt(const char *fmt_str, ...)
 {
+    char log_buf[BT_MP_RESULT_TEXT_MAX];
     va_list ap;
 
     va_start(ap, fmt_str);
-    vsnprintf(log_buf, 1024, fmt_str, ap);
+    vsnprintf(log_buf, sizeof(log_buf), fmt_str, ap);
     va_end(ap);
 
     write(log_fd, log_buf, strlen(log_buf));
 }
 
+/* Console/socket output, called from the console and the HAL callback threads,
+ * so every caller formats on its own stack */
 void btmp_log(const char *fmt_str, ...)
 {
+    char log_buf[BT_MP_RESULT_TEXT_MAX];
     va_list ap;
 
     va_start(ap, fmt_str);
-    vsnprintf(log_buf, 1024, fmt_str, ap);
+    vsnprintf(log_buf, sizeof(log_buf), fmt_str, ap);
     va_end(ap);
 
     if (log_type == LOG_STD)
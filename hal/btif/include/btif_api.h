@@ -96,4 +96,16 @@ bt_status_t btif_shutdown_bluetooth(void);
 *******************************************************************************/
 bt_status_t btif_dut_mode_send(uint16_t opcode, uint8_t *buf, uint8_t len);
 
+/*******************************************************************************
+**
+** Function         btif_dut_mode_release
+**
+** Description     Releases a received event handed to the MP layer by
+**                 btif_mp_rx_data_ind
+**
+** Returns          void
+**
+*******************************************************************************/
+void btif_dut_mode_release(void *p_handle);
+
 #endif /* BTIF_API_H */
@@ -52,6 +52,7 @@ char bt_dev_node[DEV_NODE_NAME_MAXLEN] = {0};
 /************************************************************************************
 **  Static functions
 ************************************************************************************/
+static void hal_op_stream(BT_MODULE *pBtModule, int Item, uint8_t Type, const void *pData, uint16_t Len);
 
 /************************************************************************************
 **  Externs
@@ -96,6 +97,7 @@ int hal_init(bt_callbacks_t *callbacks, bt_hci_if_t hci_if, const char *dev_node
 
     /* init mp module */
     bt_mp_module_init(&BaseInterfaceModuleMemory, &BtModuleMemory);
+    BtModuleMemory.StreamResult = hal_op_stream;
 
     /* init btif */
     btif_init_bluetooth();
@@ -111,6 +113,11 @@ int hal_enable(void)
     if (hal_interface_ready() == FALSE)
         return BT_STATUS_NOT_READY;
 
+    /* the controller behind the node may have changed while disabled */
+    pthread_mutex_lock(&BtModuleMemory.HciLock);
+    BTDevice_InvalidateChipInfo(BtModuleMemory.pBtDevice);
+    pthread_mutex_unlock(&BtModuleMemory.HciLock);
+
     return btif_enable_bluetooth(bt_hci_if, bt_dev_node);
 }
 
@@ -138,30 +145,83 @@ void hal_cleanup(void)
 }
 
 extern void btu_hcif_mp_notify_event(BT_HDR *p_msg);
+extern void bte_main_hci_log_dump(void);
+
+/* Buffer for one result record: opcode, record length, record, payload */
+#define HAL_OP_BUF_SIZE(len)    (sizeof(BT_HDR) + 3 + sizeof(bt_mp_result_t) + (len))
+
+/* opcode, record length, record, payload; btif points data back at the payload */
+static void hal_op_post(BT_HDR *p_buf, const bt_mp_result_t *p_result)
+{
+    char *p = (char *)(p_buf + 1);
+
+    p_buf->offset = 0;
+
+    UINT8_TO_STREAM(p, p_result->opcode);
+    UINT16_TO_STREAM(p, sizeof(*p_result) + p_result->len);
+
+    memcpy(p, p_result, sizeof(*p_result));
+    memcpy(p + sizeof(*p_result), p_result->data, p_result->len);
+
+    btu_hcif_mp_notify_event(p_buf);
+}
+
+/* Hand back one intermediate record of a long running Exec item, ahead of
+ * its final status. Runs on the caller of hal_op_send. */
+static void hal_op_stream(BT_MODULE *pBtModule, int Item, uint8_t Type, const void *pData, uint16_t Len)
+{
+    BT_HDR *p_buf;
+    bt_mp_result_t result;
+
+    (void)pBtModule;
+
+    if (HAL_OP_BUF_SIZE(Len) > GKI_MAX_BUF_SIZE) {
+        SYSLOGW("hal_op_stream: %u bytes too long, item %d result dropped", Len, Item);
+        return;
+    }
+
+    p_buf = (BT_HDR *)GKI_getbuf((UINT16)HAL_OP_BUF_SIZE(Len));
+    if (p_buf == NULL) {
+        SYSLOGW("hal_op_stream: no buffer, item %d result dropped", Item);
+        return;
+    }
+
+    result.opcode = BT_MP_OP_USER_DEF_Exec;
+    result.type = Type;
+    result.status = BT_FUNCTION_SUCCESS;
+    result.item = Item;
+    result.len = Len;
+    result.data = pData;
+
+    hal_op_post(p_buf, &result);
+
+    GKI_freebuf(p_buf);
+}
 
 int hal_op_send(uint16_t opcode, char *buf)
 {
-    BT_HDR *p_buf = NULL;
-    char *p = NULL;
-    uint16_t buf_len = 0;
-    char buf_cb[1024] = {0};
+    BT_HDR *p_buf;
+    char buf_cb[BT_MP_RESULT_TEXT_MAX] = {0};
+    BT_DEVICE_REPORT report;
+    bt_mp_result_t result;
     int ret = 0;
 
-    p_buf = (BT_HDR *)GKI_getbuf(sizeof(BT_HDR) + 1024);
-    p_buf->offset = 0;
-    p = (char *)(p_buf + 1);
-    memset(p, 0, 1024);
+    /* text by default, Exec and Report hand back binary records */
+    result.opcode = opcode;
+    result.type = BT_MP_RESULT_TEXT;
+    result.item = -1;
 
     SYSLOGI("hal_op_send: opcode[0x%02x], buf[%s]", opcode, buf);
 
     /* sanity check */
-    if (hal_interface_ready() == FALSE) {
-        GKI_freebuf(p_buf);
+    if (hal_interface_ready() == FALSE)
         return BT_STATUS_NOT_READY;
-    }
 
-    /* get chip type */
-    if (BtModuleMemory.pBtDevice->pBTInfo->ChipType == RTK_BT_CHIP_ID_UNKNOWCHIP)
+    /* one op at a time on the HCI, the RX sampler shares it */
+    pthread_mutex_lock(&BtModuleMemory.HciLock);
+
+    /* resolve the chip once, until the next enable, reset or download */
+    if (!BtModuleMemory.pBtDevice->ChipInfoValid)
         BTDevice_GetBTChipVersionInfo(BtModuleMemory.pBtDevice);
 
     switch (opcode) {
@@ -182,11 +242,11 @@ int hal_op_send(uint16_t opcode, char *buf)
         break;
 
     case BT_MP_OP_USER_DEF_Exec:
-        ret = BT_Exec(&BtModuleMemory, buf, buf_cb);
+        ret = BT_ExecResult(&BtModuleMemory, buf, &result);
         break;
 
     case BT_MP_OP_USER_DEF_Report:
-        ret = BT_Report(&BtModuleMemory, buf, buf_cb);
+        ret = BT_ReportResult(&BtModuleMemory, buf, &result, &report);
         break;
 
     case BT_MP_OP_USER_DEF_RegRW:
@@ -210,16 +270,26 @@ int hal_op_send(uint16_t opcode, char *buf)
         break;
     }
 
-    buf_len = strlen(buf_cb);
+    pthread_mutex_unlock(&BtModuleMemory.HciLock);
 
-    UINT8_TO_STREAM(p, opcode);
-    UINT16_TO_STREAM(p, buf_len);
+    if (result.type == BT_MP_RESULT_TEXT) {
+        result.status = ret;
+        result.len = strlen(buf_cb) + 1;
+        result.data = buf_cb;
+    }
 
-    SYSLOGI("buf_cb: %s, buf_len %d", buf_cb, buf_len);
+    /* keep the HCI traffic that led up to a failed step */
+    if (result.status != BT_FUNCTION_SUCCESS)
+        bte_main_hci_log_dump();
 
-    memcpy(p, buf_cb, buf_len);
+    /* sized now that the result is known */
+    p_buf = (BT_HDR *)GKI_getbuf((UINT16)HAL_OP_BUF_SIZE(result.len));
+    if (p_buf == NULL) {
+        SYSLOGE("hal_op_send: no buffer, opcode[0x%02x] result dropped", opcode);
+        return BT_STATUS_NOMEM;
+    }
 
-    btu_hcif_mp_notify_event(p_buf);
+    hal_op_post(p_buf, &result);
 
     GKI_freebuf(p_buf);
 
@@ -232,7 +302,8 @@ static const bt_interface_t bluetoothInterface = {
     hal_enable,
     hal_disable,
     hal_cleanup,
-    hal_op_send
+    hal_op_send,
+    BT_RenderResult
 };
 
 
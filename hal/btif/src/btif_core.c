@@ -37,6 +37,8 @@
 #include <dirent.h>
 #include <ctype.h>
 
+/* ahead of hcidefs.h, whose HCI_ macros clash with the MP enums */
+#include "bt_mp_api.h"
 #include "btif_api.h"
 
 #include "gki.h"
@@ -66,6 +68,11 @@ UINT8 btif_trace_level = BT_TRACE_LEVEL_VERBOSE;
 
 #define BTIF_TASK_STR        ((INT8 *) "BTIF")
 
+/* Deliver MP events from the HCI thread */
+#ifndef BTIF_MP_FAST_EVT_INCLUDED
+#define BTIF_MP_FAST_EVT_INCLUDED   TRUE
+#endif
+
 /************************************************************************************
 **  Local type definitions
 ************************************************************************************/
@@ -223,30 +230,45 @@ int btif_is_enabled(void)
     return (btif_core_state == BTIF_CORE_STATE_ENABLED);
 }
 
-static void btif_mp_rx_data_ind(uint8_t evtcode, uint8_t *buf, uint8_t len)
+static void btif_mp_rx_data_ind(BT_HDR *p_msg, uint8_t evtcode, uint8_t len)
 {
-    int i;
-    uint8_t *pEvtBuf = BaseInterfaceModuleMemory.evtBuffer;
+    SYSLOGI("<-- HCI EVENT event code: 0x%x %d", evtcode, len);
 
-    BaseInterfaceModuleMemory.evtLen = sizeof(evtcode) + sizeof(len) + len;
+    /* MP layer reads the event in place and releases it when done */
+    GKI_holdbuf(p_msg);
 
-    SYSLOGI("<-- HCI EVENT event code: 0x%x %d", evtcode, len);
+    bt_transport_post_event(&BaseInterfaceModuleMemory, p_msg,
+            (uint8_t *)(p_msg + 1) + p_msg->offset,
+            sizeof(evtcode) + sizeof(len) + len);
+}
 
-/*
-    for( i = 0 ; i < len; i++ )
-    {
-        SYSLOGI("0x%x ",buf[i]);
-    }
-*/
 
-    UINT8_TO_STREAM(pEvtBuf, evtcode);
-    UINT8_TO_STREAM(pEvtBuf, len);
+#if (BTIF_MP_FAST_EVT_INCLUDED == TRUE)
+/*******************************************************************************
+**
+** Function         btif_mp_fast_evt
+**
+** Description      btu fast-path hook, runs on the HCI receive thread. Hands
+**                  every event MP listens to directly to the MP layer,
+**                  saving the btu_task and btif_task hops. Taking them all
+**                  here keeps them in the order they arrived, the MP layer
+**                  only holds the latest one.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void btif_mp_fast_evt(BT_HDR *p_msg)
+{
+    UINT8   *p = (UINT8 *)(p_msg + 1) + p_msg->offset;
+    UINT8   hci_evt_code;
+    UINT8   hci_evt_len;
 
-    memcpy(pEvtBuf, buf, len);
+    STREAM_TO_UINT8  (hci_evt_code, p);
+    STREAM_TO_UINT8  (hci_evt_len, p);
 
-    bt_transport_signal_event(&BaseInterfaceModuleMemory, MP_TRANSPORT_EVENT_RX_HCIEVT);
+    btif_mp_rx_data_ind(p_msg, hci_evt_code, hci_evt_len);
 }
-
+#endif
 
 static bt_status_t btif_mp_test_evt(void* msg)
 {
@@ -260,7 +282,7 @@ static bt_status_t btif_mp_test_evt(void* msg)
 
     SYSLOGI("%s: evtcode[0x%02x]", __FUNCTION__, hci_evt_code);
 
-    btif_mp_rx_data_ind(hci_evt_code, (uint8_t*)p, hci_evt_len);
+    btif_mp_rx_data_ind(p_msg, hci_evt_code, hci_evt_len);
 
     return BT_STATUS_SUCCESS;
 }
@@ -268,19 +290,75 @@ static bt_status_t btif_mp_test_evt(void* msg)
 static bt_status_t btif_mp_notify_evt(void* msg)
 {
     BT_HDR *p_msg = (BT_HDR *)msg;
-    char   *p = (char *)(p_msg + 1);
+    UINT8  *p = (UINT8 *)(p_msg + 1);
     UINT8 opcode;
     UINT16 param_len;
+    bt_mp_result_t result;
+    BT_DEVICE_REPORT report;
+    BT_SWEEP_POINT sweep[BT_SWEEP_MAX_POINTS];
+    BT_LE_MATRIX_CELL cell;
+    BT_THERMAL_SAMPLE thermal[BT_THERMAL_HISTORY];
+    char text[BT_MP_RESULT_TEXT_MAX];
+
+    STREAM_TO_UINT8  (opcode, p);
+    STREAM_TO_UINT16 (param_len, p);
+
+    if (param_len < sizeof(result))
+        return BT_STATUS_FAIL;
 
-    opcode = *((uint8_t *)p);
-    param_len = *((uint8_t *)p + 1) + *((uint8_t *)p + 2) * 0x100;
-    p += 3;
+    memcpy(&result, p, sizeof(result));
+    result.data = p + sizeof(result);
 
-    p[param_len] = '\0'; /* must allocate extra 1 byte */
+    /* the message is sized to the payload, never read past it */
+    if (result.len > param_len - sizeof(result))
+        return BT_STATUS_FAIL;
 
-    SYSLOGI("%s: opcode[0x%02x], params[%u]", __FUNCTION__, opcode, param_len);
+    SYSLOGI("%s: opcode[0x%02x], type[%u], status[0x%02x]", __FUNCTION__, opcode,
+            result.type, result.status);
 
-    HAL_CBACK(bt_hal_cbacks, dut_mode_recv_cb, opcode, p);
+    if (result.type == BT_MP_RESULT_REPORT)
+    {
+        if (result.len < sizeof(report))
+            return BT_STATUS_FAIL;
+
+        /* the payload sits unaligned in the message, hand out a proper copy */
+        memcpy(&report, result.data, sizeof(report));
+        report.pBTInfo = &report.BTInfoMemory;
+        result.data = &report;
+    }
+    else if (result.type == BT_MP_RESULT_SWEEP)
+    {
+        if (result.len > sizeof(sweep))
+            result.len = sizeof(sweep);
+        memcpy(sweep, result.data, result.len);
+        result.data = sweep;
+    }
+    else if (result.type == BT_MP_RESULT_LE_CELL)
+    {
+        if (result.len > sizeof(cell))
+            result.len = sizeof(cell);
+        memcpy(&cell, result.data, result.len);
+        result.data = &cell;
+    }
+    else if (result.type == BT_MP_RESULT_THERMAL)
+    {
+        if (result.len > sizeof(thermal))
+            result.len = sizeof(thermal);
+        memcpy(thermal, result.data, result.len);
+        result.data = thermal;
+    }
+
+    /* clients taking records render text themselves, if at all */
+    if (bt_hal_cbacks && (bt_hal_cbacks->size >= sizeof(bt_callbacks_t)) &&
+        bt_hal_cbacks->dut_mode_result_cb)
+    {
+        HAL_CBACK(bt_hal_cbacks, dut_mode_result_cb, &result);
+        return BT_STATUS_SUCCESS;
+    }
+
+    BT_RenderResult(&result, text);
+
+    HAL_CBACK(bt_hal_cbacks, dut_mode_recv_cb, opcode, text);
 
     return BT_STATUS_SUCCESS;
 }
@@ -361,7 +439,11 @@ static void btif_task(UINT32 params)
                         break;
 
                     default:
-                        SYSLOGE("unhandled btif event (%d)", p_msg->event & BT_EVT_MASK);
+                        /* received HCI events btu shares with us as they are */
+                        if ((p_msg->event & BT_EVT_MASK) == BT_EVT_TO_BTU_HCI_EVT)
+                            btif_mp_test_evt(p_msg);
+                        else
+                            SYSLOGE("unhandled btif event (%d)", p_msg->event & BT_EVT_MASK);
                         break;
                 }
 
@@ -415,6 +497,10 @@ bt_status_t btif_init_bluetooth()
 
     bte_main_boot_entry();
 
+#if (BTIF_MP_FAST_EVT_INCLUDED == TRUE)
+    btu_hcif_register_fast_evt_cback(btif_mp_fast_evt);
+#endif
+
     /* start btif task */
     status = GKI_create_task(btif_task, BTIF_TASK, BTIF_TASK_STR,
                 (UINT16 *) ((UINT8 *)btif_task_stack + BTIF_TASK_STACK_SIZE),
@@ -630,3 +716,19 @@ bt_status_t btif_dut_mode_send(uint16_t opcode, uint8_t *buf, uint8_t len)
 
     return BT_STATUS_SUCCESS;
 }
+
+/*******************************************************************************
+**
+** Function         btif_dut_mode_release
+**
+** Description     Releases a received event handed to the MP layer by
+**                 btif_mp_rx_data_ind
+**
+** Returns          void
+**
+*******************************************************************************/
+void btif_dut_mode_release(void *p_handle)
+{
+    if (p_handle != NULL)
+        GKI_freebuf(p_handle);
+}
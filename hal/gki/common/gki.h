@@ -406,6 +406,7 @@ GKI_API extern UINT8   GKI_create_pool (UINT16, UINT16, UINT8, void *);
 GKI_API extern void    GKI_delete_pool (UINT8);
 GKI_API extern void   *GKI_find_buf_start (void *);
 GKI_API extern void    GKI_freebuf (void *);
+GKI_API extern void    GKI_holdbuf (void *);
 GKI_API extern void   *GKI_getbuf (UINT16);
 GKI_API extern UINT16  GKI_get_buf_size (void *);
 GKI_API extern void   *GKI_getpoolbuf (UINT8);
@@ -15,6 +15,7 @@
  *  limitations under the License.
  *
  ******************************************************************************/
+#include <string.h>
 #include "gki_int.h"
 
 #if (GKI_NUM_TOTAL_BUF_POOLS > 16)
@@ -23,6 +24,199 @@
 
 static void gki_add_to_pool_list(UINT8 pool_id);
 static void gki_remove_from_pool_list(UINT8 pool_id);
+static void gki_build_size_classes(void);
+
+#if (GKI_BUF_MAG_SIZE > 0)
+/* Per-thread cache ("magazine") of free buffers for each pool. No other
+** thread can get at a buffer in a magazine, so the pool statistics count it
+** as in use (mag_cnt) rather than free. */
+typedef struct
+{
+    UINT32          gen[GKI_NUM_TOTAL_BUF_POOLS];   /* gki_buf_gen the entries belong to */
+    UINT8           count[GKI_NUM_TOTAL_BUF_POOLS];
+    BUFFER_HDR_T    *p_buf[GKI_NUM_TOTAL_BUF_POOLS][GKI_BUF_MAG_SIZE];
+} tGKI_BUF_MAG;
+
+/* Bumped whenever a pool's memory goes away, invalidating every magazine
+** entry for it. Kept outside gki_cb so GKI_init does not reset it. */
+static UINT32 gki_buf_gen[GKI_NUM_TOTAL_BUF_POOLS];
+
+static pthread_once_t gki_buf_mag_once = PTHREAD_ONCE_INIT;
+static pthread_key_t gki_buf_mag_key;
+static __thread tGKI_BUF_MAG *gki_buf_mag;
+#endif
+
+/*******************************************************************************
+**
+** Function         gki_freeq_index
+**
+** Description      Convert a buffer header of a pool to its index in the pool
+**
+** Returns          index, GKI_FREEQ_NIL for NULL or a header outside the pool
+**
+*******************************************************************************/
+static UINT32 gki_freeq_index (UINT8 id, BUFFER_HDR_T *p_hdr)
+{
+    tGKI_COM_CB *p_cb = &gki_cb.com;
+
+    if ((UINT8 *)p_hdr < p_cb->pool_start[id] || (UINT8 *)p_hdr >= p_cb->pool_end[id])
+        return (GKI_FREEQ_NIL);
+
+    return ((UINT32)((UINT8 *)p_hdr - p_cb->pool_start[id]) / p_cb->pool_size[id]);
+}
+
+#define GKI_FREEQ_HDR(id, idx)  ((BUFFER_HDR_T *)(gki_cb.com.pool_start[id] + \
+                                    (idx) * gki_cb.com.pool_size[id]))
+#define GKI_FREEQ_NEXT_TAG(h)   (((h) + (GKI_FREEQ_IDX_MASK + 1)) & ~GKI_FREEQ_IDX_MASK)
+
+/*******************************************************************************
+**
+** Function         gki_freeq_pop
+**
+** Description      Take up to max buffers off a pool's free list with a single
+**                  compare-and-swap. Every change of the list head bumps its
+**                  tag, so a stale walk of the list can never be committed.
+**
+** Returns          number of buffers stored in pp_hdr
+**
+*******************************************************************************/
+static UINT8 gki_freeq_pop (UINT8 id, BUFFER_HDR_T **pp_hdr, UINT8 max)
+{
+    FREE_QUEUE_T    *Q = &gki_cb.com.freeq[id];
+    UINT32          head, idx;
+    UINT8           n;
+
+    do
+    {
+        head = Q->free_head;
+        idx  = head & GKI_FREEQ_IDX_MASK;
+
+        for (n = 0; (n < max) && (idx != GKI_FREEQ_NIL); n++)
+        {
+            pp_hdr[n] = GKI_FREEQ_HDR(id, idx);
+            idx = gki_freeq_index(id, pp_hdr[n]->p_next);
+        }
+
+        if (n == 0)
+            return (0);
+    } while (!__sync_bool_compare_and_swap(&Q->free_head, head, GKI_FREEQ_NEXT_TAG(head) | idx));
+
+    return (n);
+}
+
+/*******************************************************************************
+**
+** Function         gki_freeq_push
+**
+** Description      Put count buffers back on a pool's free list with a single
+**                  compare-and-swap
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_freeq_push (UINT8 id, BUFFER_HDR_T **pp_hdr, UINT8 count)
+{
+    FREE_QUEUE_T    *Q = &gki_cb.com.freeq[id];
+    UINT32          head, idx;
+    UINT8           i;
+
+    for (i = 1; i < count; i++)
+        pp_hdr[i - 1]->p_next = pp_hdr[i];
+
+    do
+    {
+        head = Q->free_head;
+        idx  = head & GKI_FREEQ_IDX_MASK;
+        pp_hdr[count - 1]->p_next = (idx == GKI_FREEQ_NIL) ? NULL : GKI_FREEQ_HDR(id, idx);
+    } while (!__sync_bool_compare_and_swap(&Q->free_head, head,
+                                           GKI_FREEQ_NEXT_TAG(head) | gki_freeq_index(id, pp_hdr[0])));
+}
+
+#define GKI_MBOX_NEXT(p_hdr)    (*(BUFFER_HDR_T * volatile *)&(p_hdr)->p_next)
+
+/*******************************************************************************
+**
+** Function         gki_mbox_push
+**
+** Description      Append a buffer to a task mailbox. Safe against any number
+**                  of concurrent senders and the reader.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_mbox_push (GKI_MBOX *p_mb, BUFFER_HDR_T *p_hdr)
+{
+    BUFFER_HDR_T    *p_prev;
+
+    p_hdr->p_next = NULL;
+    __sync_synchronize();
+
+    p_prev = __sync_lock_test_and_set(&p_mb->p_head, p_hdr);
+
+    /* Until this store the reader sees the list end at p_prev */
+    GKI_MBOX_NEXT(p_prev) = p_hdr;
+}
+
+/*******************************************************************************
+**
+** Function         gki_mbox_pop
+**
+** Description      Take the oldest buffer off a task mailbox. Only the task
+**                  owning the mailbox may call this.
+**
+** Returns          NULL if the mailbox is empty or the only buffer in it is
+**                  still being linked in by its sender, whose event follows.
+**
+*******************************************************************************/
+static BUFFER_HDR_T *gki_mbox_pop (GKI_MBOX *p_mb)
+{
+    BUFFER_HDR_T    *p_tail = p_mb->p_tail;
+    BUFFER_HDR_T    *p_next = GKI_MBOX_NEXT(p_tail);
+
+    if (p_tail == &p_mb->stub)
+    {
+        if (p_next == NULL)
+            return (NULL);
+
+        p_mb->p_tail = p_next;
+        p_tail = p_next;
+        p_next = GKI_MBOX_NEXT(p_next);
+    }
+
+    if (p_next == NULL)
+    {
+        /* p_tail is the last buffer: park the stub behind it so it can go */
+        if (p_tail != *(BUFFER_HDR_T * volatile *)&p_mb->p_head)
+            return (NULL);
+
+        gki_mbox_push(p_mb, &p_mb->stub);
+
+        p_next = GKI_MBOX_NEXT(p_tail);
+        if (p_next == NULL)
+            return (NULL);
+    }
+
+    __sync_synchronize();
+    p_mb->p_tail = p_next;
+
+    return (p_tail);
+}
+
+/*******************************************************************************
+**
+** Function         gki_mbox_is_empty
+**
+** Description      Check a task mailbox from its owning task
+**
+** Returns          TRUE if GKI_read_mbox would find nothing
+**
+*******************************************************************************/
+BOOLEAN gki_mbox_is_empty (UINT8 task_id, UINT8 mbox)
+{
+    GKI_MBOX    *p_mb = &gki_cb.com.OSTaskQ[task_id][mbox];
+
+    return ((p_mb->p_tail == &p_mb->stub) && (GKI_MBOX_NEXT(&p_mb->stub) == NULL));
+}
 
 /*******************************************************************************
 **
@@ -48,6 +242,10 @@ static void gki_init_free_queue (UINT8 id, UINT16 size, UINT16 total, void *p_me
     tempsize = (INT32)ALIGN_POOL(size);
     act_size = (UINT16)(tempsize + BUFFER_PADDING_SIZE);
 
+    /* The free list addresses buffers by a 16 bit index */
+    if (total > GKI_FREEQ_MAX_BUFS)
+        total = GKI_FREEQ_MAX_BUFS;
+
     /* Remember pool start and end addresses */
 // btla-specific ++
     if(p_mem)
@@ -59,17 +257,18 @@ static void gki_init_free_queue (UINT8 id, UINT16 size, UINT16 total, void *p_me
 
     p_cb->pool_size[id]  = act_size;
 
+    p_cb->freeq[id].free_head = GKI_FREEQ_NIL;
     p_cb->freeq[id].size      = (UINT16) tempsize;
     p_cb->freeq[id].total     = total;
     p_cb->freeq[id].cur_cnt   = 0;
     p_cb->freeq[id].max_cnt   = 0;
+    p_cb->freeq[id].mag_cnt   = 0;
 
     /* Initialize  index table */
 // btla-specific ++
-    if(p_mem)
+    if(p_mem && total)
     {
         hdr = (BUFFER_HDR_T *)p_mem;
-        p_cb->freeq[id].p_first = hdr;
         for (i = 0; i < total; i++)
         {
             hdr->task_id = GKI_INVALID_TASK;
@@ -82,7 +281,10 @@ static void gki_init_free_queue (UINT8 id, UINT16 size, UINT16 total, void *p_me
             hdr1->p_next = hdr;
         }
         hdr1->p_next = NULL;
-        p_cb->freeq[id].p_last = hdr1;
+
+        /* Publish the list only once the buffers are in place */
+        __sync_synchronize();
+        p_cb->freeq[id].free_head = 0;
     }
 // btla-specific --
     return;
@@ -96,9 +298,9 @@ static BOOLEAN gki_alloc_free_queue(UINT8 id)
     tGKI_COM_CB *p_cb = &gki_cb.com;
     GKI_TRACE("\ngki_alloc_free_queue in, id:%d \n", (int)id );
 
-    Q = &p_cb->freeq[p_cb->pool_list[id]];
+    Q = &p_cb->freeq[id];
 
-    if(Q->p_first == 0)
+    if(p_cb->pool_start[id] == NULL)
     {
         void* p_mem = GKI_os_malloc((Q->size + BUFFER_PADDING_SIZE) * Q->total);
         if(p_mem)
@@ -110,9 +312,10 @@ static BOOLEAN gki_alloc_free_queue(UINT8 id)
             return TRUE;
         }
         GKI_exception (GKI_ERROR_BUF_SIZE_TOOBIG, "gki_alloc_free_queue: Not enough memory");
+        return FALSE;
     }
-    GKI_TRACE("\ngki_alloc_free_queue out failed, id:%d\n", id);
-    return FALSE;
+    GKI_TRACE("\ngki_alloc_free_queue out, id:%d already allocated\n", id);
+    return TRUE;
 }
 
 void gki_dealloc_free_queue(void)
@@ -124,12 +327,15 @@ void gki_dealloc_free_queue(void)
     {
         if ( 0 < p_cb->freeq[i].max_cnt )
         {
+#if (GKI_BUF_MAG_SIZE > 0)
+            gki_buf_gen[i]++;
+#endif
             GKI_os_free(p_cb->pool_start[i]);
 
+            p_cb->freeq[i].free_head = GKI_FREEQ_NIL;
             p_cb->freeq[i].cur_cnt   = 0;
             p_cb->freeq[i].max_cnt   = 0;
-            p_cb->freeq[i].p_first   = NULL;
-            p_cb->freeq[i].p_last    = NULL;
+            p_cb->freeq[i].mag_cnt   = 0;
 
             p_cb->pool_start[i] = NULL;
             p_cb->pool_end[i]   = NULL;
@@ -141,6 +347,272 @@ void gki_dealloc_free_queue(void)
 #endif
 // btla-specific --
 
+/*******************************************************************************
+**
+** Function         gki_count_alloc
+**
+** Description      Account a buffer handed out to the application
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_count_alloc (FREE_QUEUE_T *Q)
+{
+    UINT16  cur = __sync_add_and_fetch(&Q->cur_cnt, 1);
+    UINT16  max;
+
+    while ((max = Q->max_cnt) < cur)
+    {
+        if (__sync_bool_compare_and_swap(&Q->max_cnt, max, cur))
+            break;
+    }
+}
+
+/*******************************************************************************
+**
+** Function         gki_count_free
+**
+** Description      Account a buffer returned by the application
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_count_free (FREE_QUEUE_T *Q)
+{
+    UINT16  cur;
+
+    while ((cur = Q->cur_cnt) > 0)
+    {
+        if (__sync_bool_compare_and_swap(&Q->cur_cnt, cur, cur - 1))
+            break;
+    }
+}
+
+#if (GKI_BUF_MAG_SIZE > 0)
+/*******************************************************************************
+**
+** Function         gki_buf_mag_exit
+**
+** Description      Thread exit destructor, hands the thread's cached buffers
+**                  back to their pools
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_buf_mag_exit (void *p)
+{
+    tGKI_BUF_MAG    *p_mag = (tGKI_BUF_MAG *)p;
+    UINT8           id;
+
+    for (id = 0; id < GKI_NUM_TOTAL_BUF_POOLS; id++)
+    {
+        if (p_mag->count[id] && (p_mag->gen[id] == gki_buf_gen[id]))
+        {
+            gki_freeq_push(id, p_mag->p_buf[id], p_mag->count[id]);
+            __sync_sub_and_fetch(&gki_cb.com.freeq[id].mag_cnt, p_mag->count[id]);
+        }
+    }
+
+    gki_buf_mag = NULL;
+    GKI_os_free(p_mag);
+}
+
+static void gki_buf_mag_key_init (void)
+{
+    pthread_key_create(&gki_buf_mag_key, gki_buf_mag_exit);
+}
+
+/*******************************************************************************
+**
+** Function         gki_buf_mag_get
+**
+** Description      Get the calling thread's magazine for a pool, creating it
+**                  on first use and dropping entries from a freed pool
+**
+** Returns          the magazine, NULL if the pool is too small to be cached
+**                  or memory is short
+**
+*******************************************************************************/
+static tGKI_BUF_MAG *gki_buf_mag_get (UINT8 id, UINT8 *p_cap)
+{
+    tGKI_BUF_MAG    *p_mag = gki_buf_mag;
+    UINT16          cap = gki_cb.com.freeq[id].total >> 4;
+
+    if (cap > GKI_BUF_MAG_SIZE)
+        cap = GKI_BUF_MAG_SIZE;
+
+    /* a magazine of one never batches anything */
+    if (cap < 2)
+        return (NULL);
+
+    if (p_mag == NULL)
+    {
+        pthread_once(&gki_buf_mag_once, gki_buf_mag_key_init);
+
+        if ((p_mag = (tGKI_BUF_MAG *)GKI_os_malloc(sizeof(tGKI_BUF_MAG))) == NULL)
+            return (NULL);
+
+        memset(p_mag, 0, sizeof(tGKI_BUF_MAG));
+        pthread_setspecific(gki_buf_mag_key, p_mag);
+        gki_buf_mag = p_mag;
+    }
+
+    if (p_mag->gen[id] != gki_buf_gen[id])
+    {
+        p_mag->gen[id]   = gki_buf_gen[id];
+        p_mag->count[id] = 0;
+    }
+
+    *p_cap = (UINT8)cap;
+    return (p_mag);
+}
+#endif
+
+/*******************************************************************************
+**
+** Function         gki_get_from_pool
+**
+** Description      Take a free buffer from a pool: from the calling thread's
+**                  magazine, which is refilled half way from the pool's free
+**                  list when empty, or straight from the free list for pools
+**                  too small to cache.
+**
+** Returns          buffer header, NULL if the pool is exhausted
+**
+*******************************************************************************/
+static BUFFER_HDR_T *gki_get_from_pool (UINT8 id)
+{
+    tGKI_COM_CB     *p_cb = &gki_cb.com;
+    BUFFER_HDR_T    *p_hdr = NULL;
+#if (GKI_BUF_MAG_SIZE > 0)
+    tGKI_BUF_MAG    *p_mag;
+    UINT8           cap;
+#endif
+
+// btla-specific ++
+#ifdef GKI_USE_DEFERED_ALLOC_BUF_POOLS
+    if (p_cb->pool_start[id] == NULL)
+    {
+        BOOLEAN ok;
+
+        GKI_disable();
+        ok = gki_alloc_free_queue(id);
+        GKI_enable();
+
+        if (!ok)
+            return (NULL);
+    }
+#endif
+// btla-specific --
+
+#if (GKI_BUF_MAG_SIZE > 0)
+    if ((p_mag = gki_buf_mag_get(id, &cap)) != NULL)
+    {
+        if (p_mag->count[id] == 0)
+        {
+            p_mag->count[id] = gki_freeq_pop(id, p_mag->p_buf[id], cap / 2);
+            __sync_add_and_fetch(&p_cb->freeq[id].mag_cnt, p_mag->count[id]);
+        }
+
+        if (p_mag->count[id] == 0)
+            return (NULL);
+
+        p_hdr = p_mag->p_buf[id][--p_mag->count[id]];
+        __sync_sub_and_fetch(&p_cb->freeq[id].mag_cnt, 1);
+    }
+    else
+#endif
+    if (gki_freeq_pop(id, &p_hdr, 1) == 0)
+        return (NULL);
+
+    gki_count_alloc(&p_cb->freeq[id]);
+
+    p_hdr->task_id = GKI_get_taskid();
+
+    p_hdr->status  = BUF_STATUS_UNLINKED;
+    p_hdr->p_next  = NULL;
+    p_hdr->ref_cnt = 0;
+
+    return (p_hdr);
+}
+
+/*******************************************************************************
+**
+** Function         gki_put_to_pool
+**
+** Description      Give a buffer back to its pool, through the calling
+**                  thread's magazine when the pool is cached. A full
+**                  magazine first drains half of itself to the free list.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_put_to_pool (BUFFER_HDR_T *p_hdr)
+{
+    UINT8           id = p_hdr->q_id;
+#if (GKI_BUF_MAG_SIZE > 0)
+    tGKI_BUF_MAG    *p_mag;
+    UINT8           cap;
+#endif
+
+    p_hdr->p_next  = NULL;
+    p_hdr->status  = BUF_STATUS_FREE;
+    p_hdr->task_id = GKI_INVALID_TASK;
+
+    gki_count_free(&gki_cb.com.freeq[id]);
+
+#if (GKI_BUF_MAG_SIZE > 0)
+    if ((p_mag = gki_buf_mag_get(id, &cap)) != NULL)
+    {
+        if (p_mag->count[id] >= cap)
+        {
+            p_mag->count[id] = cap / 2;
+            gki_freeq_push(id, &p_mag->p_buf[id][cap / 2], (UINT8)(cap - cap / 2));
+            __sync_sub_and_fetch(&gki_cb.com.freeq[id].mag_cnt, cap - cap / 2);
+        }
+
+        p_mag->p_buf[id][p_mag->count[id]++] = p_hdr;
+        __sync_add_and_fetch(&gki_cb.com.freeq[id].mag_cnt, 1);
+        return;
+    }
+#endif
+
+    gki_freeq_push(id, &p_hdr, 1);
+}
+
+/*******************************************************************************
+**
+** Function         gki_build_size_classes
+**
+** Description      Rebuild the size class table GKI_getbuf starts its search
+**                  from. Entry n holds the first pool_list index whose pool
+**                  can fit a request of (n << GKI_SIZE_CLASS_SHIFT) + 1 bytes,
+**                  so no earlier pool can fit any size of that class.
+**                  Called whenever pool_list changes.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_build_size_classes(void)
+{
+    tGKI_COM_CB *p_cb = &gki_cb.com;
+    UINT32      n, min_size;
+    UINT8       i = 0;
+
+    for (n = 0; n < GKI_SIZE_CLASS_NUM; n++)
+    {
+        min_size = (n << GKI_SIZE_CLASS_SHIFT) + 1;
+
+        for (i = 0; i < p_cb->curr_total_no_of_pools; i++)
+        {
+            if (min_size <= p_cb->freeq[p_cb->pool_list[i]].size)
+                break;
+        }
+
+        p_cb->size_class[n] = i;
+    }
+}
+
 /*******************************************************************************
 **
 ** Function         gki_buffer_init
@@ -161,8 +633,9 @@ void gki_buffer_init(void)
     {
         for (mb = 0; mb < NUM_TASK_MBOX; mb++)
         {
-            p_cb->OSTaskQFirst[tt][mb] = NULL;
-            p_cb->OSTaskQLast [tt][mb] = NULL;
+            p_cb->OSTaskQ[tt][mb].stub.p_next = NULL;
+            p_cb->OSTaskQ[tt][mb].p_head = &p_cb->OSTaskQ[tt][mb].stub;
+            p_cb->OSTaskQ[tt][mb].p_tail = &p_cb->OSTaskQ[tt][mb].stub;
         }
     }
 
@@ -172,12 +645,12 @@ void gki_buffer_init(void)
         p_cb->pool_end[tt]   = NULL;
         p_cb->pool_size[tt]  = 0;
 
-        p_cb->freeq[tt].p_first = 0;
-        p_cb->freeq[tt].p_last  = 0;
+        p_cb->freeq[tt].free_head = GKI_FREEQ_NIL;
         p_cb->freeq[tt].size    = 0;
         p_cb->freeq[tt].total   = 0;
         p_cb->freeq[tt].cur_cnt = 0;
         p_cb->freeq[tt].max_cnt = 0;
+        p_cb->freeq[tt].mag_cnt = 0;
     }
 
     /* Use default from target.h */
@@ -325,6 +798,7 @@ void gki_buffer_init(void)
     }
 
     p_cb->curr_total_no_of_pools = GKI_NUM_FIXED_BUF_POOLS;
+    gki_build_size_classes();
 
     return;
 }
@@ -366,8 +840,7 @@ void GKI_init_q (BUFFER_Q *p_q)
 *******************************************************************************/
 void *GKI_getbuf (UINT16 size)
 {
-    UINT8         i;
-    FREE_QUEUE_T  *Q;
+    UINT8         i, id;
     BUFFER_HDR_T  *p_hdr;
     tGKI_COM_CB *p_cb = &gki_cb.com;
 
@@ -377,8 +850,10 @@ void *GKI_getbuf (UINT16 size)
         return (NULL);
     }
 
-    /* Find the first buffer pool that is public that can hold the desired size */
-    for (i=0; i < p_cb->curr_total_no_of_pools; i++)
+    /* Find the first buffer pool that can hold the desired size, starting
+     * from the first one that fits the size class */
+    for (i = p_cb->size_class[(size - 1) >> GKI_SIZE_CLASS_SHIFT];
+         i < p_cb->curr_total_no_of_pools; i++)
     {
         if ( size <= p_cb->freeq[p_cb->pool_list[i]].size )
             break;
@@ -390,48 +865,20 @@ void *GKI_getbuf (UINT16 size)
         return (NULL);
     }
 
-    /* Make sure the buffers aren't disturbed til finished with allocation */
-    GKI_disable();
-
     /* search the public buffer pools that are big enough to hold the size
      * until a free buffer is found */
     for ( ; i < p_cb->curr_total_no_of_pools; i++)
     {
+        id = p_cb->pool_list[i];
+
         /* Only look at PUBLIC buffer pools (bypass RESTRICTED pools) */
-        if (((UINT16)1 << p_cb->pool_list[i]) & p_cb->pool_access_mask)
+        if (((UINT16)1 << id) & p_cb->pool_access_mask)
             continue;
 
-        Q = &p_cb->freeq[p_cb->pool_list[i]];
-        if(Q->cur_cnt < Q->total)
-        {
-// btla-specific ++
-        #ifdef GKI_USE_DEFERED_ALLOC_BUF_POOLS
-            if(Q->p_first == 0 && gki_alloc_free_queue(i) != TRUE)
-                return NULL;
-        #endif
-// btla-specific --
-            p_hdr = Q->p_first;
-            Q->p_first = p_hdr->p_next;
-
-            if (!Q->p_first)
-                Q->p_last = NULL;
-
-            if(++Q->cur_cnt > Q->max_cnt)
-                Q->max_cnt = Q->cur_cnt;
-
-            GKI_enable();
-
-            p_hdr->task_id = GKI_get_taskid();
-
-            p_hdr->status  = BUF_STATUS_UNLINKED;
-            p_hdr->p_next  = NULL;
-            p_hdr->Type    = 0;
+        if ((p_hdr = gki_get_from_pool(id)) != NULL)
             return ((void *) ((UINT8 *)p_hdr + BUFFER_HDR_SIZE));
-        }
     }
 
-    GKI_enable();
-
     return (NULL);
 }
 
@@ -453,48 +900,16 @@ void *GKI_getbuf (UINT16 size)
 *******************************************************************************/
 void *GKI_getpoolbuf (UINT8 pool_id)
 {
-    FREE_QUEUE_T  *Q;
     BUFFER_HDR_T  *p_hdr;
     tGKI_COM_CB *p_cb = &gki_cb.com;
 
     if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS)
         return (NULL);
 
-    /* Make sure the buffers aren't disturbed til finished with allocation */
-    GKI_disable();
-
-    Q = &p_cb->freeq[pool_id];
-    if(Q->cur_cnt < Q->total)
-    {
-// btla-specific ++
-#ifdef GKI_USE_DEFERED_ALLOC_BUF_POOLS
-        if(Q->p_first == 0 && gki_alloc_free_queue(pool_id) != TRUE)
-            return NULL;
-#endif
-// btla-specific --
-        p_hdr = Q->p_first;
-        Q->p_first = p_hdr->p_next;
-
-        if (!Q->p_first)
-            Q->p_last = NULL;
-
-        if(++Q->cur_cnt > Q->max_cnt)
-            Q->max_cnt = Q->cur_cnt;
-
-        GKI_enable();
-
-
-        p_hdr->task_id = GKI_get_taskid();
-
-        p_hdr->status  = BUF_STATUS_UNLINKED;
-        p_hdr->p_next  = NULL;
-        p_hdr->Type    = 0;
-
+    if ((p_hdr = gki_get_from_pool(pool_id)) != NULL)
         return ((void *) ((UINT8 *)p_hdr + BUFFER_HDR_SIZE));
-    }
 
     /* If here, no buffers in the specified pool */
-    GKI_enable();
 
     /* try for free buffers in public pools */
     return (GKI_getbuf(p_cb->freeq[pool_id].size));
@@ -514,8 +929,8 @@ void *GKI_getpoolbuf (UINT8 pool_id)
 *******************************************************************************/
 void GKI_freebuf (void *p_buf)
 {
-    FREE_QUEUE_T    *Q;
     BUFFER_HDR_T    *p_hdr;
+    UINT8           ref_cnt;
 
 #if (GKI_ENABLE_BUF_CORRUPTION_CHECK == TRUE)
     if (!p_buf || gki_chk_buf_damage(p_buf))
@@ -527,6 +942,14 @@ void GKI_freebuf (void *p_buf)
 
     p_hdr = (BUFFER_HDR_T *) ((UINT8 *)p_buf - BUFFER_HDR_SIZE);
 
+    /* A shared buffer may still be queued for another holder; only drop
+    ** this reference. */
+    while ((ref_cnt = p_hdr->ref_cnt) > 0)
+    {
+        if (__sync_bool_compare_and_swap(&p_hdr->ref_cnt, ref_cnt, ref_cnt - 1))
+            return;
+    }
+
     if (p_hdr->status != BUF_STATUS_UNLINKED)
     {
         GKI_exception(GKI_ERROR_FREEBUF_BUF_LINKED, "Freeing Linked Buf");
@@ -539,26 +962,43 @@ void GKI_freebuf (void *p_buf)
         return;
     }
 
-    GKI_disable();
-
     /*
     ** Release the buffer
     */
-    Q  = &gki_cb.com.freeq[p_hdr->q_id];
-    if (Q->p_last)
-        Q->p_last->p_next = p_hdr;
-    else
-        Q->p_first = p_hdr;
+    gki_put_to_pool(p_hdr);
+    return;
+}
 
-    Q->p_last      = p_hdr;
-    p_hdr->p_next  = NULL;
-    p_hdr->status  = BUF_STATUS_FREE;
-    p_hdr->task_id = GKI_INVALID_TASK;
-    if (Q->cur_cnt > 0)
-        Q->cur_cnt--;
 
-    GKI_enable();
-    return;
+/*******************************************************************************
+**
+** Function         GKI_holdbuf
+**
+** Description      Called by an application to take an extra reference on a
+**                  buffer, so that it can be passed on to another task
+**                  without copying. Every holder releases its reference with
+**                  GKI_freebuf; the buffer returns to its pool on the last one.
+**
+** Parameters       p_buf - (input) address of the beginning of a buffer.
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_holdbuf (void *p_buf)
+{
+    BUFFER_HDR_T    *p_hdr;
+
+#if (GKI_ENABLE_BUF_CORRUPTION_CHECK == TRUE)
+    if (!p_buf || gki_chk_buf_damage(p_buf))
+    {
+        GKI_exception(GKI_ERROR_BUF_CORRUPTED, "Hold - Buf Corrupted");
+        return;
+    }
+#endif
+
+    p_hdr = (BUFFER_HDR_T *) ((UINT8 *)p_buf - BUFFER_HDR_SIZE);
+
+    __sync_fetch_and_add(&p_hdr->ref_cnt, 1);
 }
 
 
@@ -659,21 +1099,10 @@ void GKI_send_msg (UINT8 task_id, UINT8 mbox, void *msg)
         return;
     }
 
-    GKI_disable();
-
-    if (p_cb->OSTaskQFirst[task_id][mbox])
-        p_cb->OSTaskQLast[task_id][mbox]->p_next = p_hdr;
-    else
-        p_cb->OSTaskQFirst[task_id][mbox] = p_hdr;
-
-    p_cb->OSTaskQLast[task_id][mbox] = p_hdr;
-
-    p_hdr->p_next = NULL;
     p_hdr->status = BUF_STATUS_QUEUED;
     p_hdr->task_id = task_id;
 
-
-    GKI_enable();
+    gki_mbox_push(&p_cb->OSTaskQ[task_id][mbox], p_hdr);
 
     GKI_send_event(task_id, (UINT16)EVENT_MASK(mbox));
 
@@ -701,21 +1130,16 @@ void *GKI_read_mbox (UINT8 mbox)
     if ((task_id >= GKI_MAX_TASKS) || (mbox >= NUM_TASK_MBOX))
         return (NULL);
 
-    GKI_disable();
+    p_hdr = gki_mbox_pop(&gki_cb.com.OSTaskQ[task_id][mbox]);
 
-    if (gki_cb.com.OSTaskQFirst[task_id][mbox])
+    if (p_hdr)
     {
-        p_hdr = gki_cb.com.OSTaskQFirst[task_id][mbox];
-        gki_cb.com.OSTaskQFirst[task_id][mbox] = p_hdr->p_next;
-
         p_hdr->p_next = NULL;
         p_hdr->status = BUF_STATUS_UNLINKED;
 
         p_buf = (UINT8 *)p_hdr + BUFFER_HDR_SIZE;
     }
 
-    GKI_enable();
-
     return (p_buf);
 }
 
@@ -1159,30 +1583,21 @@ static void gki_remove_from_pool_list(UINT8 pool_id)
 *******************************************************************************/
 void *GKI_igetpoolbuf (UINT8 pool_id)
 {
-    FREE_QUEUE_T  *Q;
     BUFFER_HDR_T  *p_hdr;
 
     if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS)
         return (NULL);
 
-
-    Q = &gki_cb.com.freeq[pool_id];
-    if(Q->cur_cnt < Q->total)
+    /* No thread magazine here, take the buffer straight off the free list */
+    if (gki_freeq_pop(pool_id, &p_hdr, 1))
     {
-        p_hdr = Q->p_first;
-        Q->p_first = p_hdr->p_next;
-
-        if (!Q->p_first)
-            Q->p_last = NULL;
-
-        if(++Q->cur_cnt > Q->max_cnt)
-            Q->max_cnt = Q->cur_cnt;
+        gki_count_alloc(&gki_cb.com.freeq[pool_id]);
 
         p_hdr->task_id = GKI_get_taskid();
 
         p_hdr->status  = BUF_STATUS_UNLINKED;
         p_hdr->p_next  = NULL;
-        p_hdr->Type    = 0;
+        p_hdr->ref_cnt = 0;
 
         return ((void *) ((UINT8 *)p_hdr + BUFFER_HDR_SIZE));
     }
@@ -1225,13 +1640,17 @@ UINT16 GKI_poolcount (UINT8 pool_id)
 UINT16 GKI_poolfreecount (UINT8 pool_id)
 {
     FREE_QUEUE_T  *Q;
+    UINT32        used;
 
     if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS)
         return (0);
 
     Q  = &gki_cb.com.freeq[pool_id];
 
-    return ((UINT16)(Q->total - Q->cur_cnt));
+    /* buffers in a magazine are only free to the thread holding them */
+    used = Q->cur_cnt + Q->mag_cnt;
+
+    return ((UINT16)((used < Q->total) ? Q->total - used : 0));
 }
 
 /*******************************************************************************
@@ -1302,17 +1721,11 @@ void GKI_isend_msg (UINT8 task_id, UINT8 mbox, void *msg)
         return;
     }
 
-    if (p_cb->OSTaskQFirst[task_id][mbox])
-        p_cb->OSTaskQLast[task_id][mbox]->p_next = p_hdr;
-    else
-        p_cb->OSTaskQFirst[task_id][mbox] = p_hdr;
-
-    p_cb->OSTaskQLast[task_id][mbox] = p_hdr;
-
-    p_hdr->p_next = NULL;
     p_hdr->status = BUF_STATUS_QUEUED;
     p_hdr->task_id = task_id;
 
+    gki_mbox_push(&p_cb->OSTaskQ[task_id][mbox], p_hdr);
+
     GKI_isend_event(task_id, (UINT16)EVENT_MASK(mbox));
 
     return;
@@ -1372,6 +1785,7 @@ UINT8 GKI_create_pool (UINT16 size, UINT16 count, UINT8 permission, void *p_mem_
         gki_add_to_pool_list(xx);
         (void) GKI_set_pool_permission (xx, permission);
         p_cb->curr_total_no_of_pools++;
+        gki_build_size_classes();
 
         return (xx);
     }
@@ -1405,12 +1819,16 @@ void GKI_delete_pool (UINT8 pool_id)
 
     if (!Q->cur_cnt)
     {
+#if (GKI_BUF_MAG_SIZE > 0)
+        /* buffers still cached by threads now belong to no pool */
+        gki_buf_gen[pool_id]++;
+#endif
+        Q->free_head = GKI_FREEQ_NIL;
         Q->size      = 0;
         Q->total     = 0;
         Q->cur_cnt   = 0;
         Q->max_cnt   = 0;
-        Q->p_first   = NULL;
-        Q->p_last    = NULL;
+        Q->mag_cnt   = 0;
 
         GKI_os_free (p_cb->pool_start[pool_id]);
 
@@ -1420,6 +1838,7 @@ void GKI_delete_pool (UINT8 pool_id)
 
         gki_remove_from_pool_list(pool_id);
         p_cb->curr_total_no_of_pools--;
+        gki_build_size_classes();
     }
     else
         GKI_exception(GKI_ERROR_DELETE_POOL_BAD_QID, "Deleting bad pool");
@@ -1464,6 +1883,7 @@ UINT16 GKI_get_pool_bufsize (UINT8 pool_id)
 UINT16 GKI_poolutilization (UINT8 pool_id)
 {
     FREE_QUEUE_T  *Q;
+    UINT32        used;
 
     if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS)
         return (100);
@@ -1473,5 +1893,9 @@ UINT16 GKI_poolutilization (UINT8 pool_id)
     if (Q->total == 0)
         return (100);
 
-    return ((Q->cur_cnt * 100) / Q->total);
+    used = Q->cur_cnt + Q->mag_cnt;
+    if (used > Q->total)
+        used = Q->total;
+
+    return ((used * 100) / Q->total);
 }
@@ -62,17 +62,27 @@ typedef struct _buffer_hdr
 	UINT8   q_id;                 /* id of the queue */
 	UINT8   task_id;              /* task which allocated the buffer*/
     UINT8   status;               /* FREE, UNLINKED or QUEUED */
-	UINT8   Type;
+	UINT8   ref_cnt;              /* extra holders, see GKI_holdbuf */
 } BUFFER_HDR_T;
 
+/* Task mailbox: intrusive multi-producer/single-consumer list linked through
+ * p_next. Senders only swap themselves in at p_head, the owning task reads
+ * from p_tail, so neither side takes a lock. */
+typedef struct
+{
+    BUFFER_HDR_T    *p_head;    /* last buffer sent */
+    BUFFER_HDR_T    *p_tail;    /* next buffer to read, owning task only */
+    BUFFER_HDR_T    stub;       /* keeps the list non-empty */
+} GKI_MBOX;
+
 typedef struct _free_queue
 {
-	BUFFER_HDR_T *p_first;      /* first buffer in the queue */
-    BUFFER_HDR_T *p_last;       /* last buffer in the queue */
+    UINT32       free_head;     /* lock-free free list, ABA tag << 16 | index of first buffer */
 	UINT16		 size;          /* size of the buffers in the pool */
 	UINT16		 total;         /* toatal number of buffers */
 	UINT16		 cur_cnt;       /* number of  buffers currently allocated */
 	UINT16		 max_cnt;       /* maximum number of buffers allocated at any time */
+	UINT16		 mag_cnt;       /* free buffers parked in thread magazines, out of reach of other threads */
 } FREE_QUEUE_T;
 
 
@@ -88,10 +98,30 @@ typedef struct _free_queue
 #define BUF_STATUS_UNLINKED 1
 #define BUF_STATUS_QUEUED   2
 
+/* Free list head encoding, see FREE_QUEUE_T */
+#define GKI_FREEQ_IDX_MASK  0x0000FFFF
+#define GKI_FREEQ_NIL       0xFFFF                                  /* empty list */
+#define GKI_FREEQ_MAX_BUFS  (GKI_FREEQ_NIL - 1)
+
+/* GKI_getbuf size classes, one lookup entry per 32 bytes of requested size */
+#define GKI_SIZE_CLASS_SHIFT    5
+#define GKI_SIZE_CLASS_NUM      ((MAX_USER_BUF_SIZE >> GKI_SIZE_CLASS_SHIFT) + 1)
+
 // btla-specific ++
 #define GKI_USE_DEFERED_ALLOC_BUF_POOLS
 // btla-specific --
 
+/* Task timer, see GKI_start_timer
+*/
+typedef struct
+{
+    UINT32  expiry;             /* absolute tick the timer expires at */
+    INT32   reload;             /* period in ticks, 0 for a one-shot timer */
+    UINT8   heap_pos;           /* index in OSTmrHeap, GKI_TMR_NOT_ARMED if stopped */
+} GKI_TASK_TMR;
+
+#define GKI_TMR_NOT_ARMED   0xFF
+
 /* Exception related structures (Used in debug mode only)
 */
 #if (GKI_DEBUG == TRUE)
@@ -266,41 +296,22 @@ typedef struct
 
     /* Timer related variables
     */
-    INT32   OSTicksTilExp;      /* Number of ticks till next timer expires */
+    INT32   OSTicksTilExp;      /* Number of ticks till next timer expires, as of the last update */
 #if (defined(GKI_DELAY_STOP_SYS_TICK) && (GKI_DELAY_STOP_SYS_TICK > 0))
     UINT32  OSTicksTilStop;     /* inactivity delay timer; OS Ticks till stopping system tick */
 #endif
-    INT32   OSNumOrigTicks;     /* Number of ticks between last timer expiration to the next one */
 
     INT32   OSWaitTmr   [GKI_MAX_TASKS];  /* ticks the task has to wait, for specific events */
 
-    /* Only take up space timers used in the system (GKI_NUM_TIMERS defined in target.h) */
-#if (GKI_NUM_TIMERS > 0)
-    INT32   OSTaskTmr0  [GKI_MAX_TASKS];
-    INT32   OSTaskTmr0R [GKI_MAX_TASKS];
-#endif
-
-#if (GKI_NUM_TIMERS > 1)
-    INT32   OSTaskTmr1  [GKI_MAX_TASKS];
-    INT32   OSTaskTmr1R [GKI_MAX_TASKS];
-#endif
-
-#if (GKI_NUM_TIMERS > 2)
-    INT32   OSTaskTmr2  [GKI_MAX_TASKS];
-    INT32   OSTaskTmr2R [GKI_MAX_TASKS];
-#endif
-
-#if (GKI_NUM_TIMERS > 3)
-    INT32   OSTaskTmr3  [GKI_MAX_TASKS];
-    INT32   OSTaskTmr3R [GKI_MAX_TASKS];
-#endif
-
-
+    /* Task timers. Armed ones sit in a min-heap ordered by absolute expiry
+     * tick, so an update only looks at the ones that are due. */
+    GKI_TASK_TMR OSTaskTmr[GKI_MAX_TASKS][GKI_NUM_TIMERS];
+    UINT8   OSTmrHeap[GKI_MAX_TASKS * GKI_NUM_TIMERS];    /* task_id * GKI_NUM_TIMERS + timer number */
+    UINT8   OSTmrHeapSize;
 
     /* Buffer related variables
     */
-    BUFFER_HDR_T    *OSTaskQFirst[GKI_MAX_TASKS][NUM_TASK_MBOX]; /* array of pointers to the first event in the task mailbox */
-    BUFFER_HDR_T    *OSTaskQLast [GKI_MAX_TASKS][NUM_TASK_MBOX]; /* array of pointers to the last event in the task mailbox */
+    GKI_MBOX        OSTaskQ[GKI_MAX_TASKS][NUM_TASK_MBOX];      /* task mailboxes */
 
     /* Define the buffer pool management variables
     */
@@ -321,6 +332,7 @@ typedef struct
     UINT16      pool_access_mask;                   /* Bits are set if the corresponding buffer pool is a restricted pool */
     UINT8       pool_list[GKI_NUM_TOTAL_BUF_POOLS]; /* buffer pools arranged in the order of size */
     UINT8       curr_total_no_of_pools;             /* number of fixed buf pools + current number of dynamic pools */
+    UINT8       size_class[GKI_SIZE_CLASS_NUM];     /* first pool_list index that can fit each size class */
 
     BOOLEAN     timer_nesting;                      /* flag to prevent timer interrupt nesting */
 
@@ -347,8 +359,15 @@ extern "C" {
 GKI_API extern BOOLEAN   gki_chk_buf_damage(void *);
 extern BOOLEAN   gki_chk_buf_owner(void *);
 extern void      gki_buffer_init (void);
+extern BOOLEAN   gki_mbox_is_empty (UINT8 task_id, UINT8 mbox);
 extern void      gki_timers_init(void);
-extern void      gki_adjust_timer_count (INT32);
+extern void      gki_timers_stop_task (UINT8 task_id);
+extern INT32     gki_timers_ticks_to_next (void);
+
+/* Provided by the OS layer for tickless timing
+*/
+extern UINT32    gki_tick_now (void);
+extern void      gki_timer_rearm (void);
 
 #ifdef GKI_USE_DEFERED_ALLOC_BUF_POOLS
 extern void      gki_dealloc_free_queue(void);
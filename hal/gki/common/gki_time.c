@@ -17,6 +17,7 @@
  ******************************************************************************/
 
 
+#include <string.h>
 #include "gki_int.h"
 
 #ifndef BT_ERROR_TRACE_0
@@ -29,10 +30,122 @@
 #endif
 
 
-#define GKI_NO_NEW_TMRS_STARTED (0x7fffffffL)   /* Largest signed positive timer count */
 #define GKI_UNUSED_LIST_ENTRY   (0x80000000L)   /* Marks an unused timer list entry (initial value) */
 #define GKI_MAX_INT32           (0x7fffffffL)
 
+#if (GKI_MAX_TASKS * GKI_NUM_TIMERS >= GKI_TMR_NOT_ARMED)
+#error Too many task timers for the timer heap!
+#endif
+
+/* TRUE if tick a is before tick b, allowing for wrap around */
+#define GKI_TICK_BEFORE(a, b)   ((INT32)((a) - (b)) < 0)
+
+#define GKI_TMR_OF(id)          (&gki_cb.com.OSTaskTmr[(id) / GKI_NUM_TIMERS][(id) % GKI_NUM_TIMERS])
+
+/*******************************************************************************
+**
+** Function         gki_tmr_heap_set
+**
+** Description      Place timer id at heap position pos
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_tmr_heap_set (UINT8 pos, UINT8 id)
+{
+    gki_cb.com.OSTmrHeap[pos] = id;
+    GKI_TMR_OF(id)->heap_pos = pos;
+}
+
+/*******************************************************************************
+**
+** Function         gki_tmr_heap_fix
+**
+** Description      Move the timer at heap position pos up or down until the
+**                  heap is ordered by expiry again
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_tmr_heap_fix (UINT8 pos)
+{
+    UINT8   *heap = gki_cb.com.OSTmrHeap;
+    UINT8   size = gki_cb.com.OSTmrHeapSize;
+    UINT8   id = heap[pos];
+    UINT32  expiry = GKI_TMR_OF(id)->expiry;
+    UINT8   child;
+
+    while (pos > 0 && GKI_TICK_BEFORE(expiry, GKI_TMR_OF(heap[(pos - 1) / 2])->expiry))
+    {
+        gki_tmr_heap_set(pos, heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+
+    while ((child = (UINT8)(2 * pos + 1)) < size)
+    {
+        if (child + 1 < size &&
+            GKI_TICK_BEFORE(GKI_TMR_OF(heap[child + 1])->expiry, GKI_TMR_OF(heap[child])->expiry))
+            child++;
+
+        if (!GKI_TICK_BEFORE(GKI_TMR_OF(heap[child])->expiry, expiry))
+            break;
+
+        gki_tmr_heap_set(pos, heap[child]);
+        pos = child;
+    }
+
+    gki_tmr_heap_set(pos, id);
+}
+
+/*******************************************************************************
+**
+** Function         gki_tmr_arm
+**
+** Description      Insert timer id in the heap, or reorder it if it is already
+**                  armed, after its expiry changed. Called with GKI disabled.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_tmr_arm (UINT8 id)
+{
+    GKI_TASK_TMR *p_tmr = GKI_TMR_OF(id);
+
+    if (p_tmr->heap_pos == GKI_TMR_NOT_ARMED)
+        gki_tmr_heap_set(gki_cb.com.OSTmrHeapSize++, id);
+
+    gki_tmr_heap_fix(p_tmr->heap_pos);
+}
+
+/*******************************************************************************
+**
+** Function         gki_tmr_disarm
+**
+** Description      Remove timer id from the heap. Called with GKI disabled.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_tmr_disarm (UINT8 id)
+{
+    GKI_TASK_TMR *p_tmr = GKI_TMR_OF(id);
+    UINT8         pos = p_tmr->heap_pos;
+    UINT8         last;
+
+    if (pos == GKI_TMR_NOT_ARMED)
+        return;
+
+    p_tmr->heap_pos = GKI_TMR_NOT_ARMED;
+    p_tmr->reload   = 0;
+
+    last = gki_cb.com.OSTmrHeap[--gki_cb.com.OSTmrHeapSize];
+    if (last != id)
+    {
+        gki_tmr_heap_set(pos, last);
+        gki_tmr_heap_fix(pos);
+    }
+}
+
 /*******************************************************************************
 **
 ** Function         gki_timers_init
@@ -45,10 +158,9 @@
 *******************************************************************************/
 void gki_timers_init(void)
 {
-    UINT8   tt;
+    UINT8   tt, tn;
 
     gki_cb.com.OSTicksTilExp = 0;       /* Remaining time (of OSTimeCurTimeout) before next timer expires */
-    gki_cb.com.OSNumOrigTicks = 0;
 #if (defined(GKI_DELAY_STOP_SYS_TICK) && (GKI_DELAY_STOP_SYS_TICK > 0))
     gki_cb.com.OSTicksTilStop = 0;      /* clear inactivity delay timer */
 #endif
@@ -57,26 +169,14 @@ void gki_timers_init(void)
     {
         gki_cb.com.OSWaitTmr   [tt] = 0;
 
-#if (GKI_NUM_TIMERS > 0)
-        gki_cb.com.OSTaskTmr0  [tt] = 0;
-        gki_cb.com.OSTaskTmr0R [tt] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 1)
-        gki_cb.com.OSTaskTmr1  [tt] = 0;
-        gki_cb.com.OSTaskTmr1R [tt] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 2)
-        gki_cb.com.OSTaskTmr2  [tt] = 0;
-        gki_cb.com.OSTaskTmr2R [tt] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 3)
-        gki_cb.com.OSTaskTmr3  [tt] = 0;
-        gki_cb.com.OSTaskTmr3R [tt] = 0;
-#endif
+        for (tn = 0; tn < GKI_NUM_TIMERS; tn++)
+        {
+            gki_cb.com.OSTaskTmr[tt][tn].expiry   = 0;
+            gki_cb.com.OSTaskTmr[tt][tn].reload   = 0;
+            gki_cb.com.OSTaskTmr[tt][tn].heap_pos = GKI_TMR_NOT_ARMED;
+        }
     }
+    gki_cb.com.OSTmrHeapSize = 0;
 
     for (tt = 0; tt < GKI_MAX_TIMER_QUEUES; tt++)
     {
@@ -101,41 +201,68 @@ void gki_timers_init(void)
 *******************************************************************************/
 BOOLEAN gki_timers_is_timer_running(void)
 {
-    UINT8   tt;
-    for (tt = 0; tt < GKI_MAX_TASKS; tt++)
-    {
+    return (gki_cb.com.OSTmrHeapSize != 0);
+}
 
-#if (GKI_NUM_TIMERS > 0)
-        if(gki_cb.com.OSTaskTmr0  [tt])
-        {
-            return TRUE;
-        }
-#endif
+/*******************************************************************************
+**
+** Function         gki_timers_stop_task
+**
+** Description      Stop all timers of a task that is going away
+**
+** Returns          void
+**
+*******************************************************************************/
+void gki_timers_stop_task (UINT8 task_id)
+{
+    UINT8   tn;
 
-#if (GKI_NUM_TIMERS > 1)
-        if(gki_cb.com.OSTaskTmr1  [tt] )
-        {
-            return TRUE;
-        }
-#endif
+    GKI_disable();
+    for (tn = 0; tn < GKI_NUM_TIMERS; tn++)
+        gki_tmr_disarm((UINT8)(task_id * GKI_NUM_TIMERS + tn));
+    GKI_enable();
+}
 
-#if (GKI_NUM_TIMERS > 2)
-        if(gki_cb.com.OSTaskTmr2  [tt] )
-        {
-            return TRUE;
-        }
-#endif
+/*******************************************************************************
+**
+** Function         gki_timers_ticks_to_next
+**
+** Description      Called by the OS timer thread to find out how long it can
+**                  sleep before GKI_timer_update has work to do: the next
+**                  timer expiry, or the end of the system tick stop delay.
+**
+** Returns          ticks from now, 0 if already due, -1 if nothing is pending
+**
+*******************************************************************************/
+INT32 gki_timers_ticks_to_next (void)
+{
+    INT32   ticks = -1;
+    UINT32  now = gki_tick_now();
 
-#if (GKI_NUM_TIMERS > 3)
-        if(gki_cb.com.OSTaskTmr3  [tt] )
-        {
-            return TRUE;
-        }
-#endif
+    GKI_disable();
+
+    if (gki_cb.com.OSTmrHeapSize)
+    {
+        ticks = (INT32)(GKI_TMR_OF(gki_cb.com.OSTmrHeap[0])->expiry - now);
+        if (ticks < 0)
+            ticks = 0;
     }
 
-    return FALSE;
+#if (defined(GKI_DELAY_STOP_SYS_TICK) && (GKI_DELAY_STOP_SYS_TICK > 0))
+    if (gki_cb.com.OSTicksTilStop)
+    {
+        INT32 stop = (INT32)gki_cb.com.OSTicksTilStop - (INT32)(now - gki_cb.com.OSTicks);
+
+        if (stop < 0)
+            stop = 0;
+        if (ticks < 0 || stop < ticks)
+            ticks = stop;
+    }
+#endif
+
+    GKI_enable();
 
+    return (ticks);
 }
 
 /*******************************************************************************
@@ -149,7 +276,7 @@ BOOLEAN gki_timers_is_timer_running(void)
 *******************************************************************************/
 UINT32  GKI_get_tick_count(void)
 {
-    return gki_cb.com.OSTicks;
+    return gki_tick_now();
 }
 
 
@@ -172,7 +299,14 @@ UINT32  GKI_get_tick_count(void)
 *******************************************************************************/
 INT32    GKI_ready_to_sleep (void)
 {
-    return (gki_cb.com.OSTicksTilExp);
+    INT32   ticks = 0;
+
+    GKI_disable();
+    if (gki_cb.com.OSTmrHeapSize)
+        ticks = (INT32)(GKI_TMR_OF(gki_cb.com.OSTmrHeap[0])->expiry - gki_tick_now());
+    GKI_enable();
+
+    return (ticks);
 }
 
 
@@ -197,22 +331,18 @@ INT32    GKI_ready_to_sleep (void)
 *******************************************************************************/
 void GKI_start_timer (UINT8 tnum, INT32 ticks, BOOLEAN is_continuous)
 {
-    INT32   reload;
-    INT32   orig_ticks;
     UINT8   task_id = GKI_get_taskid();
-    BOOLEAN bad_timer = FALSE;
+    UINT8   id;
+    BOOLEAN first;
+
+    /* Timer number is bad, so do not use */
+    if (tnum >= GKI_NUM_TIMERS)
+        return;
 
     if (ticks <= 0)
         ticks = 1;
 
-    orig_ticks = ticks;     /* save the ticks in case adjustment is necessary */
-
-
-    /* If continuous timer, set reload, else set it to 0 */
-    if (is_continuous)
-        reload = ticks;
-    else
-        reload = 0;
+    id = (UINT8)(task_id * GKI_NUM_TIMERS + tnum);
 
     GKI_disable();
 
@@ -238,59 +368,21 @@ void GKI_start_timer (UINT8 tnum, INT32 ticks, BOOLEAN is_continuous)
         }
 #endif
     }
-    /* Add the time since the last task timer update.
-    ** Note that this works when no timers are active since
-    ** both OSNumOrigTicks and OSTicksTilExp are 0.
-    */
-    if (GKI_MAX_INT32 - (gki_cb.com.OSNumOrigTicks - gki_cb.com.OSTicksTilExp) > ticks)
-    {
-        ticks += gki_cb.com.OSNumOrigTicks - gki_cb.com.OSTicksTilExp;
-    }
-    else
-        ticks = GKI_MAX_INT32;
-
-    switch (tnum)
-    {
-#if (GKI_NUM_TIMERS > 0)
-        case TIMER_0:
-            gki_cb.com.OSTaskTmr0R[task_id] = reload;
-            gki_cb.com.OSTaskTmr0 [task_id] = ticks;
-            break;
-#endif
-
-#if (GKI_NUM_TIMERS > 1)
-        case TIMER_1:
-            gki_cb.com.OSTaskTmr1R[task_id] = reload;
-            gki_cb.com.OSTaskTmr1 [task_id] = ticks;
-            break;
-#endif
 
-#if (GKI_NUM_TIMERS > 2)
-        case TIMER_2:
-            gki_cb.com.OSTaskTmr2R[task_id] = reload;
-            gki_cb.com.OSTaskTmr2 [task_id] = ticks;
-            break;
-#endif
-
-#if (GKI_NUM_TIMERS > 3)
-        case TIMER_3:
-            gki_cb.com.OSTaskTmr3R[task_id] = reload;
-            gki_cb.com.OSTaskTmr3 [task_id] = ticks;
-            break;
-#endif
-        default:
-            bad_timer = TRUE;       /* Timer number is bad, so do not use */
-    }
+    /* If continuous timer, set reload, else set it to 0 */
+    gki_cb.com.OSTaskTmr[task_id][tnum].reload = is_continuous ? ticks : 0;
+    gki_cb.com.OSTaskTmr[task_id][tnum].expiry = gki_tick_now() + (UINT32)ticks;
+    gki_tmr_arm(id);
 
-    /* Update the expiration timeout if a legitimate timer */
-    if (!bad_timer)
-    {
-        /* Only update the timeout value if it is less than any other newly started timers */
-        gki_adjust_timer_count (orig_ticks);
-    }
+    first = (gki_cb.com.OSTmrHeap[0] == id);
+    if (first)
+        gki_cb.com.OSTicksTilExp = ticks;
 
     GKI_enable();
 
+    /* the timer thread may be asleep until a later expiry */
+    if (first)
+        gki_timer_rearm();
 }
 
 /*******************************************************************************
@@ -310,39 +402,13 @@ void GKI_stop_timer (UINT8 tnum)
 {
     UINT8  task_id = GKI_get_taskid();
 
-    switch (tnum)
-    {
-#if (GKI_NUM_TIMERS > 0)
-        case TIMER_0:
-            gki_cb.com.OSTaskTmr0R[task_id] = 0;
-            gki_cb.com.OSTaskTmr0 [task_id] = 0;
-            break;
-#endif
-
-#if (GKI_NUM_TIMERS > 1)
-        case TIMER_1:
-            gki_cb.com.OSTaskTmr1R[task_id] = 0;
-            gki_cb.com.OSTaskTmr1 [task_id] = 0;
-            break;
-#endif
-
-#if (GKI_NUM_TIMERS > 2)
-        case TIMER_2:
-            gki_cb.com.OSTaskTmr2R[task_id] = 0;
-            gki_cb.com.OSTaskTmr2 [task_id] = 0;
-            break;
-#endif
-
-#if (GKI_NUM_TIMERS > 3)
-        case TIMER_3:
-            gki_cb.com.OSTaskTmr3R[task_id] = 0;
-            gki_cb.com.OSTaskTmr3 [task_id] = 0;
-            break;
-#endif
-    }
+    if (tnum >= GKI_NUM_TIMERS)
+        return;
 
     GKI_disable();
 
+    gki_tmr_disarm((UINT8)(task_id * GKI_NUM_TIMERS + tnum));
+
     if (gki_timers_is_timer_running() == FALSE)
     {
         if (gki_cb.com.p_tick_cb)
@@ -373,12 +439,15 @@ void GKI_stop_timer (UINT8 tnum)
 ** Function         GKI_timer_update
 **
 ** Description      This function is called by an OS to drive the GKI's timers.
-**                  It is typically called at every system tick to
-**                  update the timers for all tasks, and check for timeouts.
+**                  The Linux timer thread is tickless: it sleeps until
+**                  gki_timers_ticks_to_next says something is due and then
+**                  passes in every tick that elapsed meanwhile.
 **
-**                  Note: It has been designed to also allow for variable tick updates
-**                      so that systems with strict power savings requirements can
-**                      have the update occur at variable intervals.
+**                  Timers expire against absolute ticks, so only the ones
+**                  at the top of the timer heap are looked at. A continuous
+**                  timer reloads from its previous expiry so it does not
+**                  drift; if whole periods were missed it fires once and
+**                  restarts from now.
 **
 ** Parameters:      ticks_since_last_update - (input) This is the number of TICKS that have
 **                          occurred since the last time GKI_timer_update was called.
@@ -388,17 +457,14 @@ void GKI_stop_timer (UINT8 tnum)
 *******************************************************************************/
 void GKI_timer_update (INT32 ticks_since_last_update)
 {
-    UINT8   task_id;
-    long    next_expiration;        /* Holds the next soonest expiration time after this update */
+    UINT16  expired[GKI_MAX_TASKS];
+    UINT8   task_id, id;
+    UINT32  now;
+    GKI_TASK_TMR *p_tmr;
 
     /* Increment the number of ticks used for time stamps */
     gki_cb.com.OSTicks += ticks_since_last_update;
 
-    /* If any timers are running in any tasks, decrement the remaining time til
-     * the timer updates need to take place (next expiration occurs)
-     */
-    gki_cb.com.OSTicksTilExp -= ticks_since_last_update;
-
     /* Don't allow timer interrupt nesting */
     if (gki_cb.com.timer_nesting)
         return;
@@ -425,156 +491,53 @@ void GKI_timer_update (INT32 ticks_since_last_update)
     }
 #endif
 
-    /* No need to update the ticks if no timeout has occurred */
-    if (gki_cb.com.OSTicksTilExp > 0)
-    {
-        gki_cb.com.timer_nesting = 0;
-        return;
-    }
+    memset(expired, 0, sizeof(expired));
+    now = gki_cb.com.OSTicks;
 
-    next_expiration = GKI_NO_NEW_TMRS_STARTED;
-
-    /* If here then gki_cb.com.OSTicksTilExp <= 0. If negative, then increase gki_cb.com.OSNumOrigTicks
-       to account for the difference so timer updates below are decremented by the full number
-       of ticks. gki_cb.com.OSNumOrigTicks is reset at the bottom of this function so changing this
-       value only affects the timer updates below
-     */
-    gki_cb.com.OSNumOrigTicks -= gki_cb.com.OSTicksTilExp;
-
-#if GKI_TIMER_LIST_NOPREEMPT == TRUE
-    /* Protect this section because if a GKI_timer_stop happens between:
-     *   - gki_cb.com.OSTaskTmr0[task_id] -= gki_cb.com.OSNumOrigTicks;
-     *   - gki_cb.com.OSTaskTmr0[task_id] = gki_cb.com.OSTaskTmr0R[task_id];
-     * then the timer may appear stopped while it is about to be reloaded.
-     * Note: Not needed if this function cannot be preempted (typical).
-     */
+    /* The heap is shared with GKI_start_timer/GKI_stop_timer on other tasks */
     GKI_disable();
-#endif
 
-    /* Check for OS Task Timers */
-    for (task_id = 0; task_id < GKI_MAX_TASKS; task_id++)
+    while (gki_cb.com.OSTmrHeapSize)
     {
-        if (gki_cb.com.OSWaitTmr[task_id] > 0) /* If timer is running */
-        {
-            gki_cb.com.OSWaitTmr[task_id] -= gki_cb.com.OSNumOrigTicks;
-            if (gki_cb.com.OSWaitTmr[task_id] <= 0)
-            {
-                /* Timer Expired */
-                gki_cb.com.OSRdyTbl[task_id] = TASK_READY;
-            }
-        }
-
-#if (GKI_NUM_TIMERS > 0)
-         /* If any timer is running, decrement */
-        if (gki_cb.com.OSTaskTmr0[task_id] > 0)
-        {
-            gki_cb.com.OSTaskTmr0[task_id] -= gki_cb.com.OSNumOrigTicks;
+        id = gki_cb.com.OSTmrHeap[0];
+        p_tmr = GKI_TMR_OF(id);
 
-            if (gki_cb.com.OSTaskTmr0[task_id] <= 0)
-            {
-                /* Reload timer and set Timer 0 Expired event mask */
-                gki_cb.com.OSTaskTmr0[task_id] = gki_cb.com.OSTaskTmr0R[task_id];
-
-#if (defined(GKI_TIMER_UPDATES_FROM_ISR) &&  GKI_TIMER_UPDATES_FROM_ISR == TRUE)
-                GKI_isend_event (task_id, TIMER_0_EVT_MASK);
-#else
-                GKI_send_event (task_id, TIMER_0_EVT_MASK);
-#endif
-            }
-        }
+        if (GKI_TICK_BEFORE(now, p_tmr->expiry))
+            break;
 
-        /* Check to see if this timer is the next one to expire */
-        if (gki_cb.com.OSTaskTmr0[task_id] > 0 && gki_cb.com.OSTaskTmr0[task_id] < next_expiration)
-            next_expiration = gki_cb.com.OSTaskTmr0[task_id];
-#endif
+        expired[id / GKI_NUM_TIMERS] |= (UINT16)(TIMER_0_EVT_MASK << (id % GKI_NUM_TIMERS));
 
-#if (GKI_NUM_TIMERS > 1)
-         /* If any timer is running, decrement */
-        if (gki_cb.com.OSTaskTmr1[task_id] > 0)
+        if (p_tmr->reload)
         {
-            gki_cb.com.OSTaskTmr1[task_id] -= gki_cb.com.OSNumOrigTicks;
-
-            if (gki_cb.com.OSTaskTmr1[task_id] <= 0)
-            {
-                /* Reload timer and set Timer 1 Expired event mask */
-                gki_cb.com.OSTaskTmr1[task_id] = gki_cb.com.OSTaskTmr1R[task_id];
-
-#if (defined(GKI_TIMER_UPDATES_FROM_ISR) &&  GKI_TIMER_UPDATES_FROM_ISR == TRUE)
-                GKI_isend_event (task_id, TIMER_1_EVT_MASK);
-#else
-                GKI_send_event (task_id, TIMER_1_EVT_MASK);
-#endif
-            }
+            /* Reload timer */
+            p_tmr->expiry += (UINT32)p_tmr->reload;
+            if (!GKI_TICK_BEFORE(now, p_tmr->expiry))
+                p_tmr->expiry = now + (UINT32)p_tmr->reload;
+            gki_tmr_heap_fix(0);
         }
+        else
+            gki_tmr_disarm(id);
+    }
 
-        /* Check to see if this timer is the next one to expire */
-        if (gki_cb.com.OSTaskTmr1[task_id] > 0 && gki_cb.com.OSTaskTmr1[task_id] < next_expiration)
-            next_expiration = gki_cb.com.OSTaskTmr1[task_id];
-#endif
-
-#if (GKI_NUM_TIMERS > 2)
-         /* If any timer is running, decrement */
-        if (gki_cb.com.OSTaskTmr2[task_id] > 0)
-        {
-            gki_cb.com.OSTaskTmr2[task_id] -= gki_cb.com.OSNumOrigTicks;
-
-            if (gki_cb.com.OSTaskTmr2[task_id] <= 0)
-            {
-                /* Reload timer and set Timer 2 Expired event mask */
-                gki_cb.com.OSTaskTmr2[task_id] = gki_cb.com.OSTaskTmr2R[task_id];
-
-#if (defined(GKI_TIMER_UPDATES_FROM_ISR) &&  GKI_TIMER_UPDATES_FROM_ISR == TRUE)
-                GKI_isend_event (task_id, TIMER_2_EVT_MASK);
-#else
-                GKI_send_event (task_id, TIMER_2_EVT_MASK);
-#endif
-            }
-        }
+    /* Set the next timer experation value if there is one to start */
+    if (gki_cb.com.OSTmrHeapSize)
+        gki_cb.com.OSTicksTilExp = (INT32)(GKI_TMR_OF(gki_cb.com.OSTmrHeap[0])->expiry - now);
+    else
+        gki_cb.com.OSTicksTilExp = 0;
 
-        /* Check to see if this timer is the next one to expire */
-        if (gki_cb.com.OSTaskTmr2[task_id] > 0 && gki_cb.com.OSTaskTmr2[task_id] < next_expiration)
-            next_expiration = gki_cb.com.OSTaskTmr2[task_id];
-#endif
+    GKI_enable();
 
-#if (GKI_NUM_TIMERS > 3)
-         /* If any timer is running, decrement */
-        if (gki_cb.com.OSTaskTmr3[task_id] > 0)
+    /* Set the Timer Expired event masks */
+    for (task_id = 0; task_id < GKI_MAX_TASKS; task_id++)
+    {
+        if (expired[task_id])
         {
-            gki_cb.com.OSTaskTmr3[task_id] -= gki_cb.com.OSNumOrigTicks;
-
-            if (gki_cb.com.OSTaskTmr3[task_id] <= 0)
-            {
-                /* Reload timer and set Timer 3 Expired event mask */
-                gki_cb.com.OSTaskTmr3[task_id] = gki_cb.com.OSTaskTmr3R[task_id];
-
 #if (defined(GKI_TIMER_UPDATES_FROM_ISR) &&  GKI_TIMER_UPDATES_FROM_ISR == TRUE)
-                GKI_isend_event (task_id, TIMER_3_EVT_MASK);
+            GKI_isend_event (task_id, expired[task_id]);
 #else
-                GKI_send_event (task_id, TIMER_3_EVT_MASK);
+            GKI_send_event (task_id, expired[task_id]);
 #endif
-            }
         }
-
-        /* Check to see if this timer is the next one to expire */
-        if (gki_cb.com.OSTaskTmr3[task_id] > 0 && gki_cb.com.OSTaskTmr3[task_id] < next_expiration)
-            next_expiration = gki_cb.com.OSTaskTmr3[task_id];
-#endif
-
-    }
-
-#if GKI_TIMER_LIST_NOPREEMPT == TRUE
-    /* End the critical section */
-    GKI_enable();
-#endif
-
-    /* Set the next timer experation value if there is one to start */
-    if (next_expiration < GKI_NO_NEW_TMRS_STARTED)
-    {
-        gki_cb.com.OSTicksTilExp = gki_cb.com.OSNumOrigTicks = next_expiration;
-    }
-    else
-    {
-        gki_cb.com.OSTicksTilExp = gki_cb.com.OSNumOrigTicks = 0;
     }
 
     gki_cb.com.timer_nesting = 0;
@@ -988,36 +951,3 @@ void GKI_remove_from_timer_list (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT  *p
 
     return;
 }
-
-
-/*******************************************************************************
-**
-** Function         gki_adjust_timer_count
-**
-** Description      This function is called whenever a new timer or GKI_wait occurs
-**                  to adjust (if necessary) the current time til the first expiration.
-**                  This only needs to make an adjustment if the new timer (in ticks) is
-**                  less than the number of ticks remaining on the current timer.
-**
-** Parameters:      ticks - (input) number of system ticks of the new timer entry
-**
-**                  NOTE:  This routine MUST be called while interrupts are disabled to
-**                          avoid updates while adjusting the timer variables.
-**
-** Returns          void
-**
-*******************************************************************************/
-void gki_adjust_timer_count (INT32 ticks)
-{
-    if (ticks > 0)
-    {
-        /* See if the new timer expires before the current first expiration */
-        if (gki_cb.com.OSNumOrigTicks == 0 || (ticks < gki_cb.com.OSTicksTilExp && gki_cb.com.OSTicksTilExp > 0))
-        {
-            gki_cb.com.OSNumOrigTicks = (gki_cb.com.OSNumOrigTicks - gki_cb.com.OSTicksTilExp) + ticks;
-            gki_cb.com.OSTicksTilExp = ticks;
-        }
-    }
-
-    return;
-}
@@ -72,13 +72,14 @@ typedef struct
 {
     pthread_mutex_t     GKI_mutex;
     pthread_t           thread_id[GKI_MAX_TASKS];
-    pthread_mutex_t     thread_evt_mutex[GKI_MAX_TASKS];
-    pthread_cond_t      thread_evt_cond[GKI_MAX_TASKS];
+    int                 evt_futex[GKI_MAX_TASKS];    /* GKI_wait sleeps on it, bumped to wake the task */
+    int                 evt_sleeping[GKI_MAX_TASKS]; /* events a parked task waits for, 0 while it runs */
     pthread_mutex_t     thread_timeout_mutex[GKI_MAX_TASKS];
     pthread_cond_t      thread_timeout_cond[GKI_MAX_TASKS];
     int                 no_timer_suspend;   /* 1: no suspend, 0 stop calling GKI_timer_update() */
     pthread_mutex_t     gki_timer_mutex;
     pthread_cond_t      gki_timer_cond;
+    UINT32              timer_seq;          /* bumped on every timer thread wakeup request */
 #if (GKI_DEBUG == TRUE)
     pthread_mutex_t     GKI_trace_mutex;
 #endif
@@ -31,10 +31,13 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/times.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <linux/sched.h>
 #include <pthread.h>  /* must be 1st header defined  */
 #include <time.h>
@@ -68,6 +71,9 @@
 /* works only for 1ms to 1000ms heart beat ranges */
 #define LINUX_SEC (1000/TICKS_PER_SEC)
 
+/* length of a GKI tick */
+#define GKI_TICK_NS (NSEC_PER_SEC / TICKS_PER_SEC)
+
 #define LOCK(m)  pthread_mutex_lock(&m)
 #define UNLOCK(m) pthread_mutex_unlock(&m)
 #define INIT(m) pthread_mutex_init(&m, NULL)
@@ -174,13 +180,14 @@ void gki_task_entry(UINT32 params)
 void GKI_init(void)
 {
     pthread_mutexattr_t attr;
+    pthread_condattr_t  cond_attr;
     tGKI_OS             *p_os;
 
     memset (&gki_cb, 0, sizeof (gki_cb));
 
     gki_buffer_init();
     gki_timers_init();
-    gki_cb.com.OSTicks = (UINT32) times(0);
+    gki_cb.com.OSTicks = gki_tick_now();
 
     pthread_mutexattr_init(&attr);
 
@@ -199,10 +206,67 @@ void GKI_init(void)
     /* Initialiase GKI_timer_update suspend variables & mutexes to be in running state.
      * this works too even if GKI_NO_TICK_STOP is defined in btld.txt */
     p_os->no_timer_suspend = GKI_TIMER_TICK_RUN_COND;
+    p_os->timer_seq = 0;
     pthread_mutex_init(&p_os->gki_timer_mutex, NULL);
-#ifndef NO_GKI_RUN_RETURN
-    pthread_cond_init(&p_os->gki_timer_cond, NULL);
-#endif
+
+    /* timer deadlines are absolute CLOCK_MONOTONIC times */
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p_os->gki_timer_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+}
+
+/*******************************************************************************
+**
+** Function         gki_clock_ns
+**
+** Description      Read CLOCK_MONOTONIC, the time base of all GKI timers
+**
+** Returns          nanoseconds
+**
+*******************************************************************************/
+static uint64_t gki_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec);
+}
+
+/*******************************************************************************
+**
+** Function         gki_tick_now
+**
+** Description      Current time in GKI ticks. Unlike OSTicks, which only
+**                  moves when GKI_timer_update runs, this is always current.
+**
+** Returns          ticks
+**
+*******************************************************************************/
+UINT32 gki_tick_now(void)
+{
+    return ((UINT32)(gki_clock_ns() / GKI_TICK_NS));
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_rearm
+**
+** Description      Wake the timer thread so it recomputes its deadline, after
+**                  a timer was started that expires before the one it sleeps
+**                  for
+**
+** Returns          void
+**
+*******************************************************************************/
+void gki_timer_rearm(void)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+
+    pthread_mutex_lock(&p_os->gki_timer_mutex);
+    p_os->timer_seq++;
+    pthread_cond_signal(&p_os->gki_timer_cond);
+    pthread_mutex_unlock(&p_os->gki_timer_mutex);
 }
 
 
@@ -263,9 +327,10 @@ UINT8 GKI_create_task (TASKPTR task_entry, UINT8 task_id, INT8 *taskname, UINT16
     gki_cb.com.OSWaitTmr[task_id]   = 0;
     gki_cb.com.OSWaitEvt[task_id]   = 0;
 
-    /* Initialize mutex and condition variable objects for events and timeouts */
-    pthread_mutex_init(&gki_cb.os.thread_evt_mutex[task_id], NULL);
-    pthread_cond_init (&gki_cb.os.thread_evt_cond[task_id], NULL);
+    gki_cb.os.evt_futex[task_id]    = 0;
+    gki_cb.os.evt_sleeping[task_id] = 0;
+
+    /* Initialize mutex and condition variable objects for timeouts */
     pthread_mutex_init(&gki_cb.os.thread_timeout_mutex[task_id], NULL);
     pthread_cond_init (&gki_cb.os.thread_timeout_cond[task_id], NULL);
 
@@ -341,28 +406,10 @@ void GKI_destroy_task(UINT8 task_id)
         gki_cb.com.OSRdyTbl[task_id] = TASK_DEAD;
 
         /* paranoi settings, make sure that we do not execute any mailbox events */
-        gki_cb.com.OSWaitEvt[task_id] &= ~(TASK_MBOX_0_EVT_MASK|TASK_MBOX_1_EVT_MASK|
-                                            TASK_MBOX_2_EVT_MASK|TASK_MBOX_3_EVT_MASK);
+        __sync_fetch_and_and(&gki_cb.com.OSWaitEvt[task_id], ~(TASK_MBOX_0_EVT_MASK|TASK_MBOX_1_EVT_MASK|
+                                                              TASK_MBOX_2_EVT_MASK|TASK_MBOX_3_EVT_MASK));
 
-#if (GKI_NUM_TIMERS > 0)
-        gki_cb.com.OSTaskTmr0R[task_id] = 0;
-        gki_cb.com.OSTaskTmr0 [task_id] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 1)
-        gki_cb.com.OSTaskTmr1R[task_id] = 0;
-        gki_cb.com.OSTaskTmr1 [task_id] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 2)
-        gki_cb.com.OSTaskTmr2R[task_id] = 0;
-        gki_cb.com.OSTaskTmr2 [task_id] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 3)
-        gki_cb.com.OSTaskTmr3R[task_id] = 0;
-        gki_cb.com.OSTaskTmr3 [task_id] = 0;
-#endif
+        gki_timers_stop_task(task_id);
 
         GKI_send_event(task_id, EVENT_MASK(GKI_SHUTDOWN_EVT));
 
@@ -415,28 +462,10 @@ void GKI_task_self_cleanup(UINT8 task_id)
     if (gki_cb.com.OSRdyTbl[task_id] != TASK_DEAD)
     {
         /* paranoi settings, make sure that we do not execute any mailbox events */
-        gki_cb.com.OSWaitEvt[task_id] &= ~(TASK_MBOX_0_EVT_MASK|TASK_MBOX_1_EVT_MASK|
-                                            TASK_MBOX_2_EVT_MASK|TASK_MBOX_3_EVT_MASK);
+        __sync_fetch_and_and(&gki_cb.com.OSWaitEvt[task_id], ~(TASK_MBOX_0_EVT_MASK|TASK_MBOX_1_EVT_MASK|
+                                                              TASK_MBOX_2_EVT_MASK|TASK_MBOX_3_EVT_MASK));
 
-#if (GKI_NUM_TIMERS > 0)
-        gki_cb.com.OSTaskTmr0R[task_id] = 0;
-        gki_cb.com.OSTaskTmr0 [task_id] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 1)
-        gki_cb.com.OSTaskTmr1R[task_id] = 0;
-        gki_cb.com.OSTaskTmr1 [task_id] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 2)
-        gki_cb.com.OSTaskTmr2R[task_id] = 0;
-        gki_cb.com.OSTaskTmr2 [task_id] = 0;
-#endif
-
-#if (GKI_NUM_TIMERS > 3)
-        gki_cb.com.OSTaskTmr3R[task_id] = 0;
-        gki_cb.com.OSTaskTmr3 [task_id] = 0;
-#endif
+        gki_timers_stop_task(task_id);
 
         GKI_exit_task(task_id);
 
@@ -483,8 +512,8 @@ void GKI_shutdown(void)
             gki_cb.com.OSRdyTbl[task_id - 1] = TASK_DEAD;
 
             /* paranoi settings, make sure that we do not execute any mailbox events */
-            gki_cb.com.OSWaitEvt[task_id-1] &= ~(TASK_MBOX_0_EVT_MASK|TASK_MBOX_1_EVT_MASK|
-                                                TASK_MBOX_2_EVT_MASK|TASK_MBOX_3_EVT_MASK);
+            __sync_fetch_and_and(&gki_cb.com.OSWaitEvt[task_id-1], ~(TASK_MBOX_0_EVT_MASK|TASK_MBOX_1_EVT_MASK|
+                                                                    TASK_MBOX_2_EVT_MASK|TASK_MBOX_3_EVT_MASK));
             GKI_send_event(task_id - 1, EVENT_MASK(GKI_SHUTDOWN_EVT));
 
 #if ( FALSE == GKI_PTHREAD_JOINABLE )
@@ -519,7 +548,10 @@ void GKI_shutdown(void)
 #endif
 
 #ifdef NO_GKI_RUN_RETURN
+    pthread_mutex_lock( &gki_cb.os.gki_timer_mutex );
     shutdown_timer = 1;
+    pthread_cond_signal( &gki_cb.os.gki_timer_cond );
+    pthread_mutex_unlock( &gki_cb.os.gki_timer_mutex );
 #endif
     if (g_GkiTimerWakeLockOn)
     {
@@ -552,16 +584,10 @@ void gki_system_tick_start_stop_cback(BOOLEAN start)
         /* gki_system_tick_start_stop_cback() maybe called even so it was already stopped! */
         if (GKI_TIMER_TICK_RUN_COND == *p_run_cond)
         {
-#ifdef NO_GKI_RUN_RETURN
-            /* take free mutex to block timer thread */
+            /* the timer thread parks on gki_timer_cond once it sees this */
             pthread_mutex_lock(&p_os->gki_timer_mutex);
-#endif
-            /* this can lead to a race condition. however as we only read this variable in the
-             * timer loop we should be fine with this approach. otherwise uncomment below mutexes.
-             */
-            /* GKI_disable(); */
             *p_run_cond = GKI_TIMER_TICK_STOP_COND;
-            /* GKI_enable(); */
+            pthread_mutex_unlock(&p_os->gki_timer_mutex);
 
             GKI_TIMER_TRACE(">>> STOP GKI_timer_update(), wake_lock_count:%d", --wake_lock_count);
 
@@ -575,15 +601,12 @@ void gki_system_tick_start_stop_cback(BOOLEAN start)
         //acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
 
         g_GkiTimerWakeLockOn = 1;
-        *p_run_cond = GKI_TIMER_TICK_RUN_COND;
 
-#ifdef NO_GKI_RUN_RETURN
-        pthread_mutex_unlock( &p_os->gki_timer_mutex );
-#else
         pthread_mutex_lock( &p_os->gki_timer_mutex );
+        *p_run_cond = GKI_TIMER_TICK_RUN_COND;
+        p_os->timer_seq++;
         pthread_cond_signal( &p_os->gki_timer_cond );
         pthread_mutex_unlock( &p_os->gki_timer_mutex );
-#endif
 
         GKI_TIMER_TRACE(">>> START GKI_timer_update(), wake_lock_count:%d", ++wake_lock_count );
     }
@@ -606,104 +629,64 @@ void gki_system_tick_start_stop_cback(BOOLEAN start)
 #ifdef NO_GKI_RUN_RETURN
 void* timer_thread(void *arg)
 {
-    int timeout_ns=0;
-    struct timespec timeout;
-    struct timespec previous = {0,0};
-    struct timespec current;
-    int err;
-    int delta_ns;
-    int restart;
+    struct timespec deadline;
+    uint64_t        wake_ns;
+    INT32           ticks;
+    UINT32          seq;
     tGKI_OS         *p_os = &gki_cb.os;
     int  *p_run_cond = &p_os->no_timer_suspend;
 
-    /* Indicate that tick is just starting */
-    restart = 1;
-
     prctl(PR_SET_NAME, (unsigned long)"gki timer", 0, 0, 0);
 
+    /* Tickless: sleep until the next timer is due instead of waking up on
+     * every GKI tick, and hand GKI_timer_update all ticks elapsed meanwhile */
     while(!shutdown_timer)
     {
+        pthread_mutex_lock(&p_os->gki_timer_mutex);
+
         /* If the timer has been stopped (no SW timer running) */
-        if (*p_run_cond == GKI_TIMER_TICK_STOP_COND)
+        while (!shutdown_timer && (*p_run_cond == GKI_TIMER_TICK_STOP_COND))
         {
-            /*
-             * We will lock/wait on GKI_timer_mutex.
-             * This mutex will be unlocked when timer is re-started
-             */
-            GKI_TRACE("GKI_run lock mutex");
-            pthread_mutex_lock(&p_os->gki_timer_mutex);
-
-            /* We are here because the mutex has been released by timer cback */
-            /* Let's release it for future use */
-            GKI_TRACE("GKI_run unlock mutex");
-            pthread_mutex_unlock(&p_os->gki_timer_mutex);
-
-            /* Indicate that tick is just starting */
-            restart = 1;
+            GKI_TIMER_TRACE(">>> SUSPENDED GKI_timer_update()");
+            pthread_cond_wait(&p_os->gki_timer_cond, &p_os->gki_timer_mutex);
         }
+        seq = p_os->timer_seq;
 
-        /* Get time */
-        clock_gettime(CLOCK_MONOTONIC, &current);
-
-        /* Check if tick was just restarted, indicating to the compiler that this is
-         * unlikely to happen (to help branch prediction) */
-        if (__unlikely(restart))
-        {
-            /* Clear the restart indication */
-            restart = 0;
-
-            timeout_ns = (GKI_TICKS_TO_MS(1) * 1000000);
-        }
-        else
-        {
-            /* Compute time elapsed since last sleep start */
-            delta_ns = current.tv_nsec - previous.tv_nsec;
-            delta_ns += (current.tv_sec - previous.tv_sec) * 1000000000;
-
-            /* Compute next timeout:
-             *    timeout = (next theoretical expiration) - current time
-             *    timeout = (previous time + timeout + delay) - current time
-             *    timeout = timeout + delay - (current time - previous time)
-             *    timeout += delay - delta */
-            timeout_ns += (GKI_TICKS_TO_MS(1) * 1000000) - delta_ns;
-        }
-        /* Save the current time for next iteration */
-        previous = current;
+        pthread_mutex_unlock(&p_os->gki_timer_mutex);
 
-        timeout.tv_sec = 0;
+        if (shutdown_timer)
+            break;
 
-        /* Sleep until next theoretical tick time.  In case of excessive
-           elapsed time since last theoretical tick expiration, it is
-           possible that the timeout value is negative.  To protect
-           against this error, we set minimum sleep time to 10% of the
-           tick period.  We indicate to compiler that this is unlikely to
-           happen (to help branch prediction) */
+        /* Not under gki_timer_mutex: GKI_start_timer takes the two locks the
+         * other way round. timer_seq catches a rearm in between. */
+        ticks = gki_timers_ticks_to_next();
 
-        if (__unlikely(timeout_ns < ((GKI_TICKS_TO_MS(1) * 1000000) * 0.1)))
+        if (ticks != 0)
         {
-            timeout.tv_nsec = (GKI_TICKS_TO_MS(1) * 1000000) * 0.1;
+            pthread_mutex_lock(&p_os->gki_timer_mutex);
 
-            /* Print error message if tick really got delayed
-               (more than 5 ticks) */
-            if (timeout_ns < GKI_TICKS_TO_MS(-5) * 1000000)
+            if (!shutdown_timer && (seq == p_os->timer_seq))
             {
-                GKI_ERROR_LOG("tick delayed > 5 slots (%d,%d) -- cpu overload ? ",
-                        timeout_ns, GKI_TICKS_TO_MS(-5) * 1000000);
+                if (ticks < 0)
+                {
+                    pthread_cond_wait(&p_os->gki_timer_cond, &p_os->gki_timer_mutex);
+                }
+                else
+                {
+                    /* wake exactly on the tick boundary of the expiry */
+                    wake_ns = ((gki_clock_ns() / GKI_TICK_NS) + ticks) * GKI_TICK_NS;
+                    deadline.tv_sec  = wake_ns / NSEC_PER_SEC;
+                    deadline.tv_nsec = wake_ns % NSEC_PER_SEC;
+
+                    pthread_cond_timedwait(&p_os->gki_timer_cond, &p_os->gki_timer_mutex, &deadline);
+                }
             }
-        }
-        else
-        {
-            timeout.tv_nsec = timeout_ns;
-        }
 
-        do
-        {
-            /* [u]sleep can't be used because it uses SIGALRM */
-            err = nanosleep(&timeout, &timeout);
-        } while (err < 0 && errno == EINTR);
+            pthread_mutex_unlock(&p_os->gki_timer_mutex);
+        }
 
-        /* Increment the GKI time value by one tick and update internal timers */
-        GKI_timer_update(1);
+        /* Advance the GKI time by the elapsed ticks and update internal timers */
+        GKI_timer_update((INT32)(gki_tick_now() - gki_cb.com.OSTicks));
     }
     GKI_TRACE("gki_ulinux: Exiting timer_thread");
     pthread_exit(NULL);
@@ -762,7 +745,9 @@ static void gki_set_timer_scheduling( void )
 void GKI_freeze()
 {
 #ifdef NO_GKI_RUN_RETURN
+   pthread_mutex_lock( &gki_cb.os.gki_timer_mutex );
    shutdown_timer = 1;
+   pthread_cond_signal( &gki_cb.os.gki_timer_cond );
    pthread_mutex_unlock( &gki_cb.os.gki_timer_mutex );
    /* Ensure that the timer thread exits */
    pthread_join(timer_thread_id, NULL);
@@ -830,7 +815,7 @@ void GKI_run (void *p_task_id)
             /* the unit should be alsways 1 (1 tick). only if you vary for some reason heart beat tick
              * e.g. power saving you may want to provide more ticks
              */
-            GKI_timer_update( 1 );
+            GKI_timer_update( (INT32)(gki_tick_now() - gki_cb.com.OSTicks) );
             /* BT_TRACE_2( TRACE_LAYER_HCI, TRACE_TYPE_DEBUG, "update: tv_sec: %d, tv_nsec: %d", delay.tv_sec, delay.tv_nsec ); */
         } while ( GKI_TIMER_TICK_RUN_COND == *p_run_cond );
 
@@ -905,6 +890,9 @@ UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
 {
     UINT16 evt;
     UINT8 rtask;
+    UINT8 mbox;
+    int seq;
+    int *p_futex;
     struct timespec abstime = { 0, 0 };
 
     int sec;
@@ -916,9 +904,6 @@ UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
 
     gki_cb.com.OSWaitForEvt[rtask] = flag;
 
-    /* protect OSWaitEvt[rtask] from modification from an other thread */
-    pthread_mutex_lock(&gki_cb.os.thread_evt_mutex[rtask]);
-
     if (!(gki_cb.com.OSWaitEvt[rtask] & flag))
     {
         if (timeout)
@@ -929,44 +914,48 @@ UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
             sec = timeout / 1000;
             nano_sec = (timeout % 1000) * NANOSEC_PER_MILLISEC;
             abstime.tv_nsec += nano_sec;
-            if (abstime.tv_nsec > NSEC_PER_SEC)
+            if (abstime.tv_nsec >= NSEC_PER_SEC)
             {
                 abstime.tv_sec += (abstime.tv_nsec / NSEC_PER_SEC);
                 abstime.tv_nsec = abstime.tv_nsec % NSEC_PER_SEC;
             }
             abstime.tv_sec += sec;
+        }
 
-            pthread_cond_timedwait_monotonic(&gki_cb.os.thread_evt_cond[rtask],
-                    &gki_cb.os.thread_evt_mutex[rtask], &abstime);
+        p_futex = &gki_cb.os.evt_futex[rtask];
 
-        }
-        else
+        for (;;)
         {
-            pthread_cond_wait(&gki_cb.os.thread_evt_cond[rtask], &gki_cb.os.thread_evt_mutex[rtask]);
+            /* Announce the sleep before the last look at the events, a sender
+             * sets its event before looking at evt_sleeping. Either it sees us
+             * parked and bumps the futex, or we see its event here. */
+            seq = *(volatile int *)p_futex;
+            gki_cb.os.evt_sleeping[rtask] = flag;
+            __sync_synchronize();
+
+            if ((*(volatile UINT16 *)&gki_cb.com.OSWaitEvt[rtask] & flag) ||
+                (gki_cb.com.OSRdyTbl[rtask] == TASK_DEAD))
+                break;
+
+            if ((syscall(SYS_futex, p_futex, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, seq,
+                         timeout ? &abstime : NULL, NULL, FUTEX_BITSET_MATCH_ANY) < 0) &&
+                (errno == ETIMEDOUT))
+                break;
         }
 
-        /* TODO: check, this is probably neither not needed depending on phtread_cond_wait() implmentation,
-         e.g. it looks like it is implemented as a counter in which case multiple cond_signal
-         should NOT be lost! */
-
-        /* we are waking up after waiting for some events, so refresh variables
-           no need to call GKI_disable() here as we know that we will have some events as we've been waking
-           up after condition pending or timeout */
+        gki_cb.os.evt_sleeping[rtask] = 0;
 
-        if (gki_cb.com.OSTaskQFirst[rtask][0])
-            gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_0_EVT_MASK;
-        if (gki_cb.com.OSTaskQFirst[rtask][1])
-            gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_1_EVT_MASK;
-        if (gki_cb.com.OSTaskQFirst[rtask][2])
-            gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_2_EVT_MASK;
-        if (gki_cb.com.OSTaskQFirst[rtask][3])
-            gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_3_EVT_MASK;
+        /* we are waking up after waiting for some events, refresh the mailbox
+           events in case a sender's event got cleared while it was in flight */
+        for (mbox = 0; mbox < NUM_TASK_MBOX; mbox++)
+        {
+            if (!gki_mbox_is_empty(rtask, mbox))
+                __sync_fetch_and_or(&gki_cb.com.OSWaitEvt[rtask], EVENT_MASK(mbox));
+        }
 
         if (gki_cb.com.OSRdyTbl[rtask] == TASK_DEAD)
         {
             gki_cb.com.OSWaitEvt[rtask] = 0;
-            /* unlock thread_evt_mutex as pthread_cond_wait() does auto lock when cond is met */
-            pthread_mutex_unlock(&gki_cb.os.thread_evt_mutex[rtask]);
             return (EVENT_MASK(GKI_SHUTDOWN_EVT));
         }
     }
@@ -974,14 +963,8 @@ UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
     /* Clear the wait for event mask */
     gki_cb.com.OSWaitForEvt[rtask] = 0;
 
-    /* Return only those bits which user wants... */
-    evt = gki_cb.com.OSWaitEvt[rtask] & flag;
-
-    /* Clear only those bits which user wants... */
-    gki_cb.com.OSWaitEvt[rtask] &= ~flag;
-
-    /* unlock thread_evt_mutex as pthread_cond_wait() does auto lock mutex when cond is met */
-    pthread_mutex_unlock(&gki_cb.os.thread_evt_mutex[rtask]);
+    /* Return and clear only those bits which user wants... */
+    evt = __sync_fetch_and_and(&gki_cb.com.OSWaitEvt[rtask], (UINT16)~flag) & flag;
 
     GKI_TRACE("GKI_wait %d %x %d %x done", (int)rtask, (int)flag, (int)timeout, (int)evt);
     return (evt);
@@ -1055,15 +1038,17 @@ UINT8 GKI_send_event (UINT8 task_id, UINT16 event)
     /* use efficient coding to avoid pipeline stalls */
     if (task_id < GKI_MAX_TASKS)
     {
-        /* protect OSWaitEvt[task_id] from manipulation in GKI_wait() */
-        pthread_mutex_lock(&gki_cb.os.thread_evt_mutex[task_id]);
-
-        /* Set the event bit */
-        gki_cb.com.OSWaitEvt[task_id] |= event;
-
-        pthread_cond_signal(&gki_cb.os.thread_evt_cond[task_id]);
+        /* Set the event bit, a full barrier against GKI_wait() parking */
+        __sync_fetch_and_or(&gki_cb.com.OSWaitEvt[task_id], event);
 
-        pthread_mutex_unlock(&gki_cb.os.thread_evt_mutex[task_id]);
+        /* Only enter the kernel if the task sleeps on this event */
+        if ((*(volatile int *)&gki_cb.os.evt_sleeping[task_id] & event) ||
+            (gki_cb.com.OSRdyTbl[task_id] == TASK_DEAD))
+        {
+            __sync_fetch_and_add(&gki_cb.os.evt_futex[task_id], 1);
+            syscall(SYS_futex, &gki_cb.os.evt_futex[task_id], FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1,
+                    NULL, NULL, 0);
+        }
 
         GKI_TRACE("GKI_send_event %d %x done", task_id, event);
         return ( GKI_SUCCESS );
@@ -1290,8 +1275,7 @@ INT8 *GKI_get_time_stamp (INT8 *tbuf)
     UINT32 h_time;
     INT8   *p_out = tbuf;
 
-    gki_cb.com.OSTicks = times(0);
-    ms_time = GKI_TICKS_TO_MS(gki_cb.com.OSTicks);
+    ms_time = GKI_TICKS_TO_MS(gki_tick_now());
     s_time  = ms_time/100;   /* 100 Ticks per second */
     m_time  = s_time/60;
     h_time  = m_time/60;
@@ -1456,8 +1440,6 @@ void GKI_exit_task (UINT8 task_id)
     gki_cb.com.OSRdyTbl[task_id] = TASK_DEAD;
 
     /* Destroy mutex and condition variable objects */
-    pthread_mutex_destroy(&gki_cb.os.thread_evt_mutex[task_id]);
-    pthread_cond_destroy (&gki_cb.os.thread_evt_cond[task_id]);
     pthread_mutex_destroy(&gki_cb.os.thread_timeout_mutex[task_id]);
     pthread_cond_destroy (&gki_cb.os.thread_timeout_cond[task_id]);
 
@@ -64,6 +64,13 @@
 #endif
 #endif  // (BTHC_LINUX_BASE_POLICY != SCHED_NORMAL)
 
+/* Run read -> parse -> dispatch, tx and the transport timers on the
+ * bt_hc_worker thread's epoll loop instead of a separate userial reader
+ * and timer thread */
+#ifndef BTHC_EVENT_LOOP
+#define BTHC_EVENT_LOOP FALSE
+#endif
+
 #ifndef BTHC_USERIAL_READ_MEM_SIZE
 #define BTHC_USERIAL_READ_MEM_SIZE (1024)
 #endif
@@ -72,11 +79,58 @@
 #define BTSNOOPDISP_INCLUDED TRUE
 #endif
 
+/* Bytes of snoop records staged in memory before the writer thread puts
+ * them to the file, must be a power of 2 */
+#ifndef BTSNOOP_BUF_SIZE
+#define BTSNOOP_BUF_SIZE (256 * 1024)
+#endif
+
+/* Longest a record waits in memory before it reaches the file */
+#ifndef BTSNOOP_FLUSH_MS
+#define BTSNOOP_FLUSH_MS 500
+#endif
+
+/* Start a new snoop file once the current one reaches this size, 0 never */
+#ifndef BTSNOOP_ROTATE_SIZE
+#define BTSNOOP_ROTATE_SIZE (16 * 1024 * 1024)
+#endif
+
+/* Rotated files kept next to the current one as <file>.1 .. <file>.N */
+#ifndef BTSNOOP_ROTATE_FILES
+#define BTSNOOP_ROTATE_FILES 3
+#endif
+
+/* HCI traffic kept by the flight recorder, must be a power of 2 */
+#ifndef BTSNOOP_FLIGHT_SIZE
+#define BTSNOOP_FLIGHT_SIZE (4 * 1024 * 1024)
+#endif
+
+/* Flight recorder dumps kept as <file>.1 .. <file>.N, oldest overwritten */
+#ifndef BTSNOOP_DUMP_FILES
+#define BTSNOOP_DUMP_FILES 4
+#endif
+
+/* Dumps asked for within this long of the last one are skipped */
+#ifndef BTSNOOP_DUMP_MIN_MS
+#define BTSNOOP_DUMP_MIN_MS 10000
+#endif
+
 /* Disable external parser for production */
 #ifndef BTSNOOP_EXT_PARSER_INCLUDED
 #define BTSNOOP_EXT_PARSER_INCLUDED FALSE
 #endif
 
+/* Packets queued for the external parser before new ones are dropped,
+ * must be a power of 2 */
+#ifndef BTSNOOP_EXT_SLOTS
+#define BTSNOOP_EXT_SLOTS 256
+#endif
+
+/* Longest packet, type byte included, passed to the external parser */
+#ifndef BTSNOOP_EXT_SLOT_SIZE
+#define BTSNOOP_EXT_SLOT_SIZE 1040
+#endif
+
 /* Host/Controller lib internal event ID */
 #define HC_EVENT_PRELOAD               0x0001
 #define HC_EVENT_POSTLOAD              0x0002
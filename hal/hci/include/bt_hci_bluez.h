@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 
 #ifndef AF_BLUETOOTH
@@ -57,6 +58,10 @@ extern "C" {
 #define SOL_BLUETOOTH   274
 #endif
 
+/* HCI socket channels */
+#define HCI_CHANNEL_RAW     0
+#define HCI_CHANNEL_USER    1
+
 struct sockaddr_hci {
     sa_family_t hci_family;
     unsigned short  hci_dev;
@@ -125,6 +130,21 @@ enum {
 #define HCI_EVENT_PKT       0x04
 #define HCI_VENDOR_PKT      0xff
 
+/* HCI events the MP tool consumes */
+#define EVT_CMD_COMPLETE    0x0E
+#define EVT_CMD_STATUS      0x0F
+#define EVT_HARDWARE_ERROR  0x10
+#define EVT_VENDOR          0xFF
+
+/* and the inquiry and remote name events of the search exist command */
+#define EVT_INQUIRY_COMPLETE                0x01
+#define EVT_INQUIRY_RESULT                  0x02
+#define EVT_REMOTE_NAME_REQ_COMPLETE        0x07
+#define EVT_INQUIRY_RESULT_WITH_RSSI        0x22
+#define EVT_EXTENDED_INQUIRY_RESULT         0x2F
+#define EVT_REMOTE_HOST_FEATURES_NOTIFY     0x3D
+#define EVT_INQUIRY_RESPONSE_NOTIFY         0x56
+
 /* --------  HCI Packet structures  -------- */
 #define HCI_TYPE_LEN    1
 
@@ -254,12 +274,19 @@ static inline void hci_filter_all_events(struct hci_filter *f)
     memset((void *) f->event_mask, 0xff, sizeof(f->event_mask));
 }
 
+static inline void hci_filter_set_event(int e, struct hci_filter *f)
+{
+    hci_set_bit((e & HCI_FLT_EVENT_BITS), &f->event_mask);
+}
+
 /* Exposed bluez hci interfaces */
 int hci_devid(const char *str);
 int hci_open_dev(int dev_id);
 int hci_close_dev(int dd);
 int hci_bluez_read(int dd, void *pbuf, size_t plen);
 int hci_bluez_write(int dd, void *pbuf, uint16_t plen);
+int hci_bluez_read_batch(int dd, struct iovec *iov, uint16_t *lens, int count);
+int hci_bluez_write_batch(int dd, struct iovec *iov, int count);
 
 #ifdef __cplusplus
 }
@@ -57,6 +57,8 @@ typedef enum {
 typedef enum {
     BT_HC_LOGGING_OFF,
     BT_HC_LOGGING_ON,
+    BT_HC_LOGGING_FLIGHT,   /* keep recent traffic in memory only */
+    BT_HC_LOGGING_DUMP,     /* write the flight recorder out */
 } bt_hc_logging_state_t;
 
 /** Result of write request */
@@ -187,7 +189,8 @@ typedef struct {
     /** Controls receive flow */
     int (*set_rxflow)(bt_rx_flow_state_t state);
 
-    /** Controls HCI logging on/off */
+    /** Controls HCI logging on/off. With BT_HC_LOGGING_FLIGHT p_path names
+     *  where dumps go, with BT_HC_LOGGING_DUMP it may override that. */
     int (*logging)(bt_hc_logging_state_t state, char *p_path);
 
     /** Closes the interface */
@@ -46,6 +46,17 @@ Notes:
 
 #define RTB_QUEUE_ID_LENGTH          64
 
+///RTK_BUFFERs are carved from per size class pools, see RtbAllocate
+///buffers added to a pool at a time once it runs dry
+#ifndef RTB_POOL_SLAB_ITEMS
+#define RTB_POOL_SLAB_ITEMS          8
+#endif
+
+///poison freed buffers and check them again on allocation
+#ifndef RTB_POOL_DEBUG
+#define RTB_POOL_DEBUG               FALSE
+#endif
+
 /*----------------------------------------------------------------------------------
     STRUCTURE DEFINITION
 ----------------------------------------------------------------------------------*/
@@ -351,4 +362,42 @@ EXTERN RTK_BUFFER*
 	IN RTK_BUFFER* pDataBuffer
 	);
 
+/**
+    Usage of one RTK_BUFFER pool size class
+    \param  Size            : data bytes, headroom included, a buffer of the class holds
+    \param  Total           : buffers carved so far
+    \param  InUse           : buffers currently allocated
+    \param  HighWater       : most buffers ever allocated at once
+    \param  Allocs          : allocations served
+*/
+typedef struct _RTB_POOL_STATS{
+    uint32_t Size;
+    uint32_t Total;
+    uint32_t InUse;
+    uint32_t HighWater;
+    uint32_t Allocs;
+} RTB_POOL_STATS;
+
+/**
+    Get the usage of the RTK_BUFFER pools.
+    \param [OUT]    pStats           <RTB_POOL_STATS*>       : array filled per size class
+    \param [IN]     MaxClasses       <uint32_t>              : entries pStats has room for
+    \param [OUT]    pOversize        <uint32_t*>             : if not NULL, allocations too big for any class
+    \return number of size classes
+*/
+EXTERN uint32_t
+RtbPoolGetStats(
+    OUT RTB_POOL_STATS* pStats,
+    IN  uint32_t        MaxClasses,
+    OUT uint32_t*       pOversize
+    );
+
+/**
+    Log the usage of the RTK_BUFFER pools.
+*/
+EXTERN void
+RtbPoolDumpStats(
+    void
+    );
+
 #endif //_INC_SKBUFF_H
@@ -0,0 +1,154 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2014 Realsil Corporation.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      bt_timer.h
+ *
+ *  Description:   Shared timer service for the HCI transport and vendor
+ *                 library. All timers hang off one hashed timer wheel that
+ *                 is driven by a single timerfd on a single thread.
+ *
+ ******************************************************************************/
+
+#ifndef BT_TIMER_H
+#define BT_TIMER_H
+
+#include <stdint.h>
+#include "bt_list.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Wheel resolution, timeouts are rounded up to a whole number of ticks */
+#ifndef BT_TIMER_TICK_MS
+#define BT_TIMER_TICK_MS 10
+#endif
+
+/* Number of wheel slots, must be a power of 2 */
+#ifndef BT_TIMER_WHEEL_SIZE
+#define BT_TIMER_WHEEL_SIZE 256
+#endif
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef void (*tBT_TIMER_CBACK)(void *p_context);
+
+typedef struct {
+    RT_LIST_ENTRY   node;           /* link in the wheel slot */
+    uint32_t        expiry;         /* absolute tick of next expiry */
+    uint32_t        period;         /* reload in ticks, 0 for one-shot */
+    tBT_TIMER_CBACK p_cback;
+    void            *p_context;
+    uint8_t         active;
+} tBT_TIMER;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        bt_timer_init
+**
+** Description     Create the timerfd and, if own_thread, start the timer
+**                 service thread. Otherwise the caller polls bt_timer_get_fd
+**                 and calls bt_timer_service. Calling it again while the
+**                 service runs is harmless.
+**
+** Returns         0 on success, -1 otherwise
+**
+*******************************************************************************/
+int bt_timer_init(uint8_t own_thread);
+
+/*******************************************************************************
+**
+** Function        bt_timer_cleanup
+**
+** Description     Stop the timer service thread. Timers still armed are
+**                 dropped without firing.
+**
+** Returns         None
+**
+*******************************************************************************/
+void bt_timer_cleanup(void);
+
+/*******************************************************************************
+**
+** Function        bt_timer_get_fd
+**
+** Description     Descriptor that turns readable when bt_timer_service has
+**                 ticks to process
+**
+** Returns         File descriptor, -1 if the service is not running
+**
+*******************************************************************************/
+int bt_timer_get_fd(void);
+
+/*******************************************************************************
+**
+** Function        bt_timer_service
+**
+** Description     Advance the wheel by however many ticks the timerfd
+**                 reports and run the expired callbacks. Does not block.
+**
+** Returns         None
+**
+*******************************************************************************/
+void bt_timer_service(void);
+
+/*******************************************************************************
+**
+** Function        bt_timer_setup
+**
+** Description     Bind a callback to a timer. The callback runs on the timer
+**                 service thread and may start or stop any timer, including
+**                 its own.
+**
+** Returns         None
+**
+*******************************************************************************/
+void bt_timer_setup(tBT_TIMER *p_timer, tBT_TIMER_CBACK p_cback, void *p_context);
+
+/*******************************************************************************
+**
+** Function        bt_timer_start
+**
+** Description     (Re)arm a timer to expire after timeout_ms. A periodic
+**                 timer reloads with the same timeout until stopped.
+**
+** Returns         0 on success, -1 otherwise
+**
+*******************************************************************************/
+int bt_timer_start(tBT_TIMER *p_timer, uint32_t timeout_ms, uint8_t periodic);
+
+/*******************************************************************************
+**
+** Function        bt_timer_stop
+**
+** Description     Disarm a timer. Does nothing if it is not armed.
+**
+** Returns         None
+**
+*******************************************************************************/
+void bt_timer_stop(tBT_TIMER *p_timer);
+
+#endif /* BT_TIMER_H */
@@ -48,6 +48,9 @@ typedef void (*tHCI_CLEANUP)(void);
 /* Send HCI command/data to the transport */
 typedef void (*tHCI_SEND)(HC_BT_HDR *p_msg);
 
+/* Frame a batch of HCI command/data and flush it to the transport at once */
+typedef void (*tHCI_SEND_BATCH)(HC_BT_HDR **pp_msg, int count);
+
 /* Handler for HCI upstream path */
 typedef uint16_t (*tHCI_RCV)(void);
 
@@ -69,6 +72,7 @@ typedef struct {
     tHCI_INIT init;
     tHCI_CLEANUP cleanup;
     tHCI_SEND send;
+    tHCI_SEND_BATCH send_batch;
     tHCI_SEND_INT send_int_cmd;
     tHCI_ACL_DATA_LEN_HDLR get_acl_max_len;
 #ifdef HCI_USE_MCT
@@ -28,6 +28,7 @@
 #define USERIAL_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 typedef enum {
     USERIAL_OP_INIT,
@@ -69,6 +70,31 @@ uint8_t userial_open(void);
 *******************************************************************************/
 uint16_t  userial_read(uint16_t msg_id, uint8_t *p_buffer, uint16_t len);
 
+/*******************************************************************************
+**
+** Function        userial_get_poll_fd
+**
+** Description     Pollable descriptor that turns readable when userial_poll
+**                 has work to do
+**
+** Returns         File descriptor, -1 if the port is not open
+**
+*******************************************************************************/
+int userial_get_poll_fd(void);
+
+/*******************************************************************************
+**
+** Function        userial_poll
+**
+** Description     Non-blocking single pass of the reader for callers that
+**                 run their own event loop (BTHC_EVENT_LOOP)
+**
+** Returns         -1: port error or closed
+**                 >=0: numbers of packets added to the rx ring
+**
+*******************************************************************************/
+int userial_poll(void);
+
 /*******************************************************************************
 **
 ** Function        userial_write
@@ -81,6 +107,20 @@ uint16_t  userial_read(uint16_t msg_id, uint8_t *p_buffer, uint16_t len);
 *******************************************************************************/
 uint16_t userial_write(uint16_t msg_id, uint8_t *p_data, uint16_t len);
 
+/*******************************************************************************
+**
+** Function        userial_write_batch
+**
+** Description     Write count framed packets, one per iovec, with a single
+**                 gathered write where the port allows it. Packet sockets
+**                 keep every iovec a separate packet.
+**
+** Returns         Number of packets completely written to the userial port.
+**                 This may be less than count.
+**
+*******************************************************************************/
+int userial_write_batch(uint16_t msg_id, struct iovec *iov, int count);
+
 /*******************************************************************************
 **
 ** Function        userial_close
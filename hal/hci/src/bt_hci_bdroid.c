@@ -29,13 +29,18 @@
 
 #include <string.h>
 #include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "bt_hci_bdroid.h"
 #include "bt_vendor_lib.h"
 #include "utils.h"
 #include "hci.h"
 #include "userial.h"
+#include "bt_timer.h"
 #include "bt_utils.h"
 #include "bluetoothmp.h"
 #include "bt_syslog.h"
@@ -50,6 +55,12 @@
 #define BTHCDBG(param, ...) {}
 #endif
 
+/* epoll tags of the BTHC_EVENT_LOOP worker */
+#define BTHC_LOOP_DOORBELL      0
+#define BTHC_LOOP_TIMER         1
+#define BTHC_LOOP_PORT          2
+#define BTHC_LOOP_MAX_EVENTS    3
+
 /******************************************************************************
 **  Externs
 ******************************************************************************/
@@ -66,6 +77,8 @@ void lpm_allow_bt_device_sleep(void);
 void lpm_wake_assert(void);
 void init_vnd_if(unsigned char *local_bdaddr, bt_hci_if_t hci_if, const char *dev_node);
 void btsnoop_open(char *p_path);
+void btsnoop_open_flight(char *p_path);
+int btsnoop_dump(char *p_path);
 void btsnoop_close(void);
 
 /******************************************************************************
@@ -87,6 +100,8 @@ typedef struct
     pthread_t       worker_thread;
     pthread_mutex_t mutex;
     pthread_cond_t  cond;
+    int             epoll_fd;       /* BTHC_EVENT_LOOP only */
+    int             event_fd;       /* BTHC_EVENT_LOOP doorbell */
 } bt_hc_cb_t;
 
 /******************************************************************************
@@ -106,10 +121,16 @@ static void *bt_hc_worker_thread(void *arg);
 
 void bthc_signal_event(uint16_t event)
 {
+#if (BTHC_EVENT_LOOP == TRUE)
+    __sync_fetch_and_or(&ready_events, event);
+    if (eventfd_write(hc_cb.event_fd, 1) < 0)
+        SYSLOGE("bthc_signal_event: eventfd_write failed, errno: %d", errno);
+#else
     pthread_mutex_lock(&hc_cb.mutex);
     ready_events |= event;
     pthread_cond_signal(&hc_cb.cond);
     pthread_mutex_unlock(&hc_cb.mutex);
+#endif
 }
 
 /*****************************************************************************
@@ -135,6 +156,12 @@ static int init(const bt_hc_callbacks_t *p_cb, unsigned char *local_bdaddr,
     /* store reference to user callbacks */
     bt_hc_cbacks = (bt_hc_callbacks_t *)p_cb;
 
+    /* transport and vendor timers all run on the shared timer wheel */
+    if (bt_timer_init(BTHC_EVENT_LOOP == TRUE ? FALSE : TRUE) < 0) {
+        SYSLOGE("Init failed to start the timer service!");
+        return BT_HC_STATUS_FAIL;
+    }
+
     init_vnd_if(local_bdaddr, hci_if, dev_node);
 
     utils_init();
@@ -168,6 +195,16 @@ static int init(const bt_hc_callbacks_t *p_cb, unsigned char *local_bdaddr,
     pthread_cond_init(&hc_cb.cond, NULL);
     pthread_attr_init(&thread_attr);
 
+#if (BTHC_EVENT_LOOP == TRUE)
+    hc_cb.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    hc_cb.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (hc_cb.epoll_fd < 0 || hc_cb.event_fd < 0) {
+        SYSLOGE("Init failed to set up the event loop, errno: %d", errno);
+        lib_running = 0;
+        return BT_HC_STATUS_FAIL;
+    }
+#endif
+
     if (pthread_create(&hc_cb.worker_thread, &thread_attr, \
                        bt_hc_worker_thread, NULL) != 0) {
         SYSLOGE("pthread_create failed!");
@@ -282,14 +319,25 @@ static int logging(bt_hc_logging_state_t state, char *p_path)
 {
     BTHCDBG("logging %d, path = %s", state, p_path);
 
-    if (state == BT_HC_LOGGING_ON)
+    switch (state)
     {
-        if (p_path != NULL)
-            btsnoop_open(p_path);
-    }
-    else
-    {
-        btsnoop_close();
+        case BT_HC_LOGGING_ON:
+            if (p_path != NULL)
+                btsnoop_open(p_path);
+            break;
+
+        case BT_HC_LOGGING_FLIGHT:
+            if (p_path != NULL)
+                btsnoop_open_flight(p_path);
+            break;
+
+        case BT_HC_LOGGING_DUMP:
+            btsnoop_dump(p_path);
+            break;
+
+        default:
+            btsnoop_close();
+            break;
     }
 
     return BT_HC_STATUS_SUCCESS;
@@ -316,9 +364,17 @@ static void cleanup( void )
     if (bt_vnd_if)
         bt_vnd_if->cleanup();
 
+    bt_timer_cleanup();
+
     pthread_cond_destroy(&hc_cb.cond);
     pthread_mutex_destroy(&hc_cb.mutex);
 
+#if (BTHC_EVENT_LOOP == TRUE)
+    close(hc_cb.epoll_fd);
+    close(hc_cb.event_fd);
+    hc_cb.epoll_fd = hc_cb.event_fd = -1;
+#endif
+
     bt_hc_cbacks = NULL;
 }
 
@@ -337,134 +393,248 @@ static const bt_hc_interface_t bluetoothHCLibInterface = {
 };
 
 
+/*******************************************************************************
+**
+** Function        bt_hc_process_events
+**
+** Description     Handle one round of ready HC events on the worker thread
+**
+** Returns         TRUE if HC_EVENT_EXIT was raised
+**
+*******************************************************************************/
+static uint8_t bt_hc_process_events(uint16_t events)
+{
+    HC_BT_HDR *p_msg, *p_next_msg;
+
+#ifndef HCI_USE_MCT
+    if (events & HC_EVENT_RX)
+    {
+        p_hci_if->rcv();
+
+        if ((tx_cmd_pkts_pending == TRUE) && (*num_hci_cmd_pkts > 0))
+        {
+            /* Got HCI Cmd Credits from Controller.
+             * Prepare to send prior pending Cmd packets in the
+             * following HC_EVENT_TX session.
+             */
+            events |= HC_EVENT_TX;
+        }
+    }
+#endif
+
+    if (events & HC_EVENT_PRELOAD) {
+        int ret = userial_open();
+        if (ret == FALSE) {
+            if (bt_hc_cbacks)
+                bt_hc_cbacks->preload_cb(NULL, BT_HC_PRELOAD_FAIL);
+        } else {
+            /* Calling vendor-specific part */
+            if (bt_vnd_if) {
+                bt_vnd_if->op(BT_VND_OP_FW_CFG, NULL);
+            } else {
+                if (bt_hc_cbacks)
+                    bt_hc_cbacks->preload_cb(NULL, BT_HC_PRELOAD_FAIL);
+            }
+        }
+    }
+
+    if (events & HC_EVENT_POSTLOAD)
+    {
+        /* Start from SCO related H/W configuration, if SCO configuration
+         * is required. Then, follow with reading requests of getting
+         * ACL data length for both BR/EDR and LE.
+         */
+        int result = -1;
+
+        /* Calling vendor-specific part */
+        if (bt_vnd_if)
+            result = bt_vnd_if->op(BT_VND_OP_SCO_CFG, NULL);
+
+        if (result == -1)
+            p_hci_if->get_acl_max_len();
+    }
+
+    if (events & HC_EVENT_TX)
+    {
+        /*
+         *  We will go through every packets in the tx queue.
+         *  Fine to clear tx_cmd_pkts_pending.
+         */
+        tx_cmd_pkts_pending = FALSE;
+        HC_BT_HDR * sending_msg_que[64];
+        int sending_msg_count = 0;
+        int sending_hci_cmd_pkts_count = 0;
+        utils_lock();
+        p_next_msg = tx_q.p_first;
+        while (p_next_msg &&
+               sending_msg_count < (int)(sizeof(sending_msg_que)/sizeof(sending_msg_que[0])))
+        {
+            if ((p_next_msg->event & MSG_EVT_MASK)==MSG_STACK_TO_HC_HCI_CMD)
+            {
+                /*
+                 *  if we have used up controller's outstanding HCI command
+                 *  credits (normally is 1), skip all HCI command packets in
+                 *  the queue.
+                 *  The pending command packets will be sent once controller
+                 *  gives back us credits through CommandCompleteEvent or
+                 *  CommandStatusEvent.
+                 */
+                if ((tx_cmd_pkts_pending == TRUE) ||
+                    (sending_hci_cmd_pkts_count >= *num_hci_cmd_pkts))
+                {
+                    tx_cmd_pkts_pending = TRUE;
+                    p_next_msg = utils_getnext(p_next_msg);
+                    continue;
+                }
+                sending_hci_cmd_pkts_count++;
+            }
+
+            p_msg = p_next_msg;
+            p_next_msg = utils_getnext(p_msg);
+            utils_remove_from_queue_unlocked(&tx_q, p_msg);
+            sending_msg_que[sending_msg_count++] = p_msg;
+        }
+        utils_unlock();
+        /* Frame the whole batch and flush it to the port at once */
+        if (sending_msg_count > 0)
+            p_hci_if->send_batch(sending_msg_que, sending_msg_count);
+        if (tx_cmd_pkts_pending == TRUE)
+            BTHCDBG("Used up Tx Cmd credits");
+
+    }
+
+    return (events & HC_EVENT_EXIT) ? TRUE : FALSE;
+}
+
+#if (BTHC_EVENT_LOOP == TRUE)
+/*******************************************************************************
+**
+** Function        bt_hc_loop_add
+**
+** Description     Add a descriptor to the worker's epoll set
+**
+** Returns         None
+**
+*******************************************************************************/
+static void bt_hc_loop_add(int fd, uint32_t tag)
+{
+    struct epoll_event ev;
+
+    if (fd < 0)
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = tag;
+    if (epoll_ctl(hc_cb.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno != EEXIST)
+        SYSLOGE("bt_hc_loop_add: epoll_ctl(%d) failed, errno: %d", fd, errno);
+}
+
 /*******************************************************************************
 **
 ** Function        bt_hc_worker_thread
 **
-** Description     Mian worker thread
+** Description     Mian worker thread, event loop flavour. One epoll set
+**                 covers the HC doorbell, the transport timer wheel and the
+**                 port, so received bytes are read, parsed and dispatched
+**                 here without a hand-off from a reader thread.
 **
 ** Returns         void *
 **
 *******************************************************************************/
 static void *bt_hc_worker_thread(void *arg)
 {
+    struct epoll_event evs[BTHC_LOOP_MAX_EVENTS];
     uint16_t events;
-    HC_BT_HDR *p_msg, *p_next_msg;
+    eventfd_t val;
+    int n, i;
 
     SYSLOGI("bt_hc_worker_thread started");
     prctl(PR_SET_NAME, (unsigned long)"bt_hc_worker", 0, 0, 0);
     tx_cmd_pkts_pending = FALSE;
 
+    bt_hc_loop_add(hc_cb.event_fd, BTHC_LOOP_DOORBELL);
+    bt_hc_loop_add(bt_timer_get_fd(), BTHC_LOOP_TIMER);
+
     while (lib_running)
     {
-        pthread_mutex_lock(&hc_cb.mutex);
-        while (ready_events == 0)
+        n = epoll_wait(hc_cb.epoll_fd, evs, BTHC_LOOP_MAX_EVENTS, -1);
+        if (n < 0)
         {
-            pthread_cond_wait(&hc_cb.cond, &hc_cb.mutex);
+            if (errno == EINTR)
+                continue;
+            SYSLOGE("bt_hc_worker_thread: epoll_wait failed, errno: %d", errno);
+            break;
         }
-        events = ready_events;
-        ready_events = 0;
-        pthread_mutex_unlock(&hc_cb.mutex);
 
-#ifndef HCI_USE_MCT
-        if (events & HC_EVENT_RX)
+        events = 0;
+        for (i = 0; i < n; i++)
         {
-            p_hci_if->rcv();
-
-            if ((tx_cmd_pkts_pending == TRUE) && (*num_hci_cmd_pkts > 0))
+            switch (evs[i].data.u32)
             {
-                /* Got HCI Cmd Credits from Controller.
-                 * Prepare to send prior pending Cmd packets in the
-                 * following HC_EVENT_TX session.
-                 */
-                events |= HC_EVENT_TX;
+            case BTHC_LOOP_DOORBELL:
+                eventfd_read(hc_cb.event_fd, &val);
+                break;
+            case BTHC_LOOP_TIMER:
+                bt_timer_service();
+                break;
+            case BTHC_LOOP_PORT:
+                if (userial_poll() > 0)
+                    events |= HC_EVENT_RX;
+                break;
             }
         }
-#endif
 
-        if (events & HC_EVENT_PRELOAD) {
-            int ret = userial_open();
-            if (ret == FALSE) {
-                if (bt_hc_cbacks)
-                    bt_hc_cbacks->preload_cb(NULL, BT_HC_PRELOAD_FAIL);
-            } else {
-                /* Calling vendor-specific part */
-                if (bt_vnd_if) {
-                    bt_vnd_if->op(BT_VND_OP_FW_CFG, NULL);
-                } else {
-                    if (bt_hc_cbacks)
-                        bt_hc_cbacks->preload_cb(NULL, BT_HC_PRELOAD_FAIL);
-                }
-            }
-        }
+        events |= __sync_fetch_and_and(&ready_events, 0);
+        if (events == 0)
+            continue;
 
-        if (events & HC_EVENT_POSTLOAD)
-        {
-            /* Start from SCO related H/W configuration, if SCO configuration
-             * is required. Then, follow with reading requests of getting
-             * ACL data length for both BR/EDR and LE.
-             */
-            int result = -1;
+        if (bt_hc_process_events(events))
+            break;
 
-            /* Calling vendor-specific part */
-            if (bt_vnd_if)
-                result = bt_vnd_if->op(BT_VND_OP_SCO_CFG, NULL);
+        /* (Re)opened by HC_EVENT_PRELOAD, a closed port drops out of the
+         * epoll set by itself. A reopened port often gets the same fd
+         * number back, so add it after every preload. */
+        if (events & HC_EVENT_PRELOAD)
+            bt_hc_loop_add(userial_get_poll_fd(), BTHC_LOOP_PORT);
+    }
 
-            if (result == -1)
-                p_hci_if->get_acl_max_len();
-        }
+    SYSLOGI("bt_hc_worker_thread exiting");
 
-        if (events & HC_EVENT_TX)
-        {
-            /*
-             *  We will go through every packets in the tx queue.
-             *  Fine to clear tx_cmd_pkts_pending.
-             */
-            tx_cmd_pkts_pending = FALSE;
-            HC_BT_HDR * sending_msg_que[64];
-            int sending_msg_count = 0;
-            int sending_hci_cmd_pkts_count = 0;
-            utils_lock();
-            p_next_msg = tx_q.p_first;
-            while (p_next_msg &&
-                   sending_msg_count < (int)(sizeof(sending_msg_que)/sizeof(sending_msg_que[0])))
-            {
-                if ((p_next_msg->event & MSG_EVT_MASK)==MSG_STACK_TO_HC_HCI_CMD)
-                {
-                    /*
-                     *  if we have used up controller's outstanding HCI command
-                     *  credits (normally is 1), skip all HCI command packets in
-                     *  the queue.
-                     *  The pending command packets will be sent once controller
-                     *  gives back us credits through CommandCompleteEvent or
-                     *  CommandStatusEvent.
-                     */
-                    if ((tx_cmd_pkts_pending == TRUE) ||
-                        (sending_hci_cmd_pkts_count >= *num_hci_cmd_pkts))
-                    {
-                        tx_cmd_pkts_pending = TRUE;
-                        p_next_msg = utils_getnext(p_next_msg);
-                        continue;
-                    }
-                    sending_hci_cmd_pkts_count++;
-                }
+    pthread_exit(NULL);
 
-                p_msg = p_next_msg;
-                p_next_msg = utils_getnext(p_msg);
-                utils_remove_from_queue_unlocked(&tx_q, p_msg);
-                sending_msg_que[sending_msg_count++] = p_msg;
-            }
-            utils_unlock();
-            int i;
-            for(i = 0; i < sending_msg_count; i++)
-                p_hci_if->send(sending_msg_que[i]);
-            if (tx_cmd_pkts_pending == TRUE)
-                BTHCDBG("Used up Tx Cmd credits");
+    return NULL;    // compiler friendly
+}
+#else
+/*******************************************************************************
+**
+** Function        bt_hc_worker_thread
+**
+** Description     Mian worker thread
+**
+** Returns         void *
+**
+*******************************************************************************/
+static void *bt_hc_worker_thread(void *arg)
+{
+    uint16_t events;
 
-        }
+    SYSLOGI("bt_hc_worker_thread started");
+    prctl(PR_SET_NAME, (unsigned long)"bt_hc_worker", 0, 0, 0);
+    tx_cmd_pkts_pending = FALSE;
 
+    while (lib_running)
+    {
+        pthread_mutex_lock(&hc_cb.mutex);
+        while (ready_events == 0)
+        {
+            pthread_cond_wait(&hc_cb.cond, &hc_cb.mutex);
+        }
+        events = ready_events;
+        ready_events = 0;
+        pthread_mutex_unlock(&hc_cb.mutex);
 
-        if (events & HC_EVENT_EXIT)
+        if (bt_hc_process_events(events))
             break;
     }
 
@@ -474,6 +644,7 @@ static void *bt_hc_worker_thread(void *arg)
 
     return NULL;    // compiler friendly
 }
+#endif
 
 
 /*******************************************************************************
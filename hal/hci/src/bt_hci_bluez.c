@@ -33,11 +33,29 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 
 #include "bt_syslog.h"
 #include "bt_hci_bluez.h"
 #include "bt_types.h"
+#include "user_config.h"
+
+/* Take the controller away from the kernel stack with HCI_CHANNEL_USER,
+ * fall back to a filtered raw socket if that is not possible */
+#ifndef HCI_BLUEZ_USER_CHANNEL
+#define HCI_BLUEZ_USER_CHANNEL TRUE
+#endif
+
+/* Max packets moved by one hci_bluez_read_batch()/hci_bluez_write_batch() */
+#define HCI_BLUEZ_BATCH_MAX 16
+
+/* State of the exclusively opened device, restored on hci_close_dev() */
+static struct {
+    int      dd;
+    int      dev_id;
+    uint8_t  was_up;
+} hci_user_cb = { -1, -1, 0 };
 
 static int bachk(const char *str)
 {
@@ -196,6 +214,82 @@ int hci_devid(const char *str)
     return id;
 }
 
+/* Issue a device ioctl through a throwaway control socket */
+static int hci_dev_ctl(int dev_id, unsigned long req)
+{
+    int ctl, ret;
+
+    ctl = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
+    if (ctl < 0)
+        return -1;
+
+    ret = ioctl(ctl, req, dev_id);
+    if (ret < 0 && req == HCIDEVUP && errno == EALREADY)
+        ret = 0;
+
+    close(ctl);
+    return ret;
+}
+
+static int hci_dev_is_up(int dev_id)
+{
+    struct hci_dev_info di = { .dev_id = dev_id };
+    int ctl, up = 0;
+
+    ctl = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
+    if (ctl < 0)
+        return 0;
+
+    if (ioctl(ctl, HCIGETDEVINFO, (void *) &di) == 0)
+        up = hci_test_bit(HCI_UP, &di.flags) ? 1 : 0;
+
+    close(ctl);
+    return up;
+}
+
+/* Open HCI device on the user channel.
+ * The kernel only grants it while the device is down, so the device is
+ * taken down here and brought back up by hci_close_dev() if it was up.
+ * Returns device descriptor (dd). */
+static int hci_open_user_channel(int dev_id)
+{
+    struct sockaddr_hci a;
+    uint8_t was_up;
+    int dd;
+
+    was_up = hci_dev_is_up(dev_id);
+    if (was_up && hci_dev_ctl(dev_id, HCIDEVDOWN) < 0) {
+        SYSLOGW("HCI user channel: hci%d down failed: %s", dev_id, strerror(errno));
+        return -1;
+    }
+
+    dd = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
+    if (dd < 0)
+        goto restore;
+
+    memset(&a, 0, sizeof(a));
+    a.hci_family = AF_BLUETOOTH;
+    a.hci_dev = dev_id;
+    a.hci_channel = HCI_CHANNEL_USER;
+    if (bind(dd, (struct sockaddr *) &a, sizeof(a)) < 0) {
+        SYSLOGW("HCI user channel: bind hci%d failed: %s", dev_id, strerror(errno));
+        close(dd);
+        goto restore;
+    }
+
+    hci_user_cb.dd = dd;
+    hci_user_cb.dev_id = dev_id;
+    hci_user_cb.was_up = was_up;
+
+    SYSLOGI("HCI user channel: hci%d opened exclusively", dev_id);
+    return dd;
+
+restore:
+    if (was_up)
+        hci_dev_ctl(dev_id, HCIDEVUP);
+    return -1;
+}
+
 /* Open HCI device.
  * Returns device descriptor (dd). */
 int hci_open_dev(int dev_id)
@@ -204,6 +298,15 @@ int hci_open_dev(int dev_id)
     struct hci_filter flt;
     int dd;
 
+#if (HCI_BLUEZ_USER_CHANNEL == TRUE)
+    if (dev_id >= 0) {
+        dd = hci_open_user_channel(dev_id);
+        if (dd >= 0)
+            return dd;
+        SYSLOGW("HCI user channel unavailable, sharing hci%d with the kernel", dev_id);
+    }
+#endif
+
     /* Create HCI socket */
     dd = socket(AF_BLUETOOTH, SOCK_RAW, BTPROTO_HCI);
     if (dd < 0)
@@ -218,10 +321,22 @@ int hci_open_dev(int dev_id)
         goto failed;
     }
 
-    /* Setup filter */
+    /* Setup filter, only the events the MP path consumes */
     hci_filter_clear(&flt);
     hci_filter_set_ptype(HCI_EVENT_PKT, &flt);
-    hci_filter_all_events(&flt);
+    hci_filter_set_event(EVT_CMD_COMPLETE, &flt);
+    hci_filter_set_event(EVT_CMD_STATUS, &flt);
+    hci_filter_set_event(EVT_HARDWARE_ERROR, &flt);
+    hci_filter_set_event(EVT_VENDOR, &flt);
+#if (MP_TOOL_COMMAND_SEARCH_EXIST_PERMISSION == 1)
+    hci_filter_set_event(EVT_INQUIRY_COMPLETE, &flt);
+    hci_filter_set_event(EVT_INQUIRY_RESULT, &flt);
+    hci_filter_set_event(EVT_REMOTE_NAME_REQ_COMPLETE, &flt);
+    hci_filter_set_event(EVT_INQUIRY_RESULT_WITH_RSSI, &flt);
+    hci_filter_set_event(EVT_EXTENDED_INQUIRY_RESULT, &flt);
+    hci_filter_set_event(EVT_REMOTE_HOST_FEATURES_NOTIFY, &flt);
+    hci_filter_set_event(EVT_INQUIRY_RESPONSE_NOTIFY, &flt);
+#endif
     if (setsockopt(dd, SOL_HCI, HCI_FILTER, &flt, sizeof(flt)) < 0) {
         SYSLOGE("HCI filter setup failed");
         goto failed;
@@ -236,7 +351,34 @@ failed:
 
 int hci_close_dev(int dd)
 {
-    return close(dd);
+    int ret, dev_id;
+
+    ret = close(dd);
+
+    if (dd >= 0 && dd == hci_user_cb.dd) {
+        dev_id = hci_user_cb.dev_id;
+        hci_user_cb.dd = -1;
+        hci_user_cb.dev_id = -1;
+
+        /* Hand the controller back to the kernel stack */
+        if (hci_user_cb.was_up && hci_dev_ctl(dev_id, HCIDEVUP) < 0)
+            SYSLOGE("HCI user channel: failed to restore hci%d: %s",
+                    dev_id, strerror(errno));
+        hci_user_cb.was_up = 0;
+    }
+
+    return ret;
+}
+
+/* Port may be non-blocking; park until it is ready instead of spinning */
+static void hci_bluez_wait(int dd, short events)
+{
+    struct pollfd pfd;
+
+    pfd.fd = dd;
+    pfd.events = events;
+    pfd.revents = 0;
+    poll(&pfd, 1, -1);
 }
 
 int hci_bluez_read(int dd, void *pbuf, size_t plen)
@@ -244,8 +386,12 @@ int hci_bluez_read(int dd, void *pbuf, size_t plen)
     int ret;
 
     while ((ret = read(dd, pbuf, plen)) < 0) {
-        if (errno == EAGAIN || errno == EINTR)
+        if (errno == EINTR)
             continue;
+        if (errno == EAGAIN) {
+            hci_bluez_wait(dd, POLLIN);
+            continue;
+        }
         break;
     }
 
@@ -257,10 +403,77 @@ int hci_bluez_write(int dd, void *pbuf, uint16_t plen)
     int ret;
 
     while ((ret = write(dd, pbuf, plen)) < 0) {
-        if (errno == EAGAIN || errno == EINTR)
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN) {
+            hci_bluez_wait(dd, POLLOUT);
             continue;
+        }
         break;
     }
 
     return ret;
 }
+
+/* Fetch up to count queued packets with one recvmmsg(), one packet per
+ * iovec. Never blocks. Returns the number of packets with their lengths
+ * in lens, or -1 with errno set (EAGAIN when nothing is queued). */
+int hci_bluez_read_batch(int dd, struct iovec *iov, uint16_t *lens, int count)
+{
+    struct mmsghdr msgs[HCI_BLUEZ_BATCH_MAX];
+    int i, ret;
+
+    if (count > HCI_BLUEZ_BATCH_MAX)
+        count = HCI_BLUEZ_BATCH_MAX;
+
+    memset(msgs, 0, count * sizeof(struct mmsghdr));
+    for (i = 0; i < count; i++) {
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    do {
+        ret = recvmmsg(dd, msgs, count, MSG_DONTWAIT, NULL);
+    } while (ret < 0 && errno == EINTR);
+
+    for (i = 0; i < ret; i++)
+        lens[i] = (uint16_t)msgs[i].msg_len;
+
+    return ret;
+}
+
+/* Send count packets, one per iovec, with as few sendmmsg() calls as the
+ * socket allows. Each iovec stays a separate HCI packet. Returns the
+ * number of packets sent, or -1 if none could be. */
+int hci_bluez_write_batch(int dd, struct iovec *iov, int count)
+{
+    struct mmsghdr msgs[HCI_BLUEZ_BATCH_MAX];
+    int i, n, ret, sent = 0;
+
+    while (sent < count) {
+        n = count - sent;
+        if (n > HCI_BLUEZ_BATCH_MAX)
+            n = HCI_BLUEZ_BATCH_MAX;
+
+        memset(msgs, 0, n * sizeof(struct mmsghdr));
+        for (i = 0; i < n; i++) {
+            msgs[i].msg_hdr.msg_iov = &iov[sent + i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        ret = sendmmsg(dd, msgs, n, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN) {
+                hci_bluez_wait(dd, POLLOUT);
+                continue;
+            }
+            break;
+        }
+
+        sent += ret;
+    }
+
+    return sent ? sent : -1;
+}
@@ -24,7 +24,9 @@ Notes:
 #include <termios.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stddef.h>
 
+#include "bt_syslog.h"
 #include "bt_hci_bdroid.h"
 #include "hci.h"
 #include "userial.h"
@@ -48,6 +50,48 @@ Notes:
 //do alignment with RTB_ALIGN
 #define RTB_DATA_ALIGN(_Length)     ((_Length + (RTB_ALIGN - 1)) & (~(RTB_ALIGN - 1)))
 
+///largest H5 frame (0xFFF + 4 + 2) the rx path allocates
+#define RTB_H5_RX_FRAME_LEN     0x1005
+
+///pool size classes, data bytes with headroom:
+///     control and link packets, HCI commands and events in SLIP form,
+///     ACL frames in SLIP form, H5 rx frame with the default headroom
+static const uint32_t RtbPoolSize[] = { 128, 576, 2112, RTB_DATA_ALIGN(RTB_H5_RX_FRAME_LEN + DEFAULT_HEADER_SIZE) };
+
+#define RTB_POOL_CLASSES    (sizeof(RtbPoolSize) / sizeof(RtbPoolSize[0]))
+
+///class of a buffer too big for any pool, malloc'ed and freed every time
+#define RTB_POOL_NONE       0xFF
+
+#define RTB_POOL_POISON     0x6B
+
+/**
+    Pool bookkeeping in front of every RTK_BUFFER, the data buffer follows it
+*/
+typedef struct _RTB_POOL_ITEM{
+    struct _RTB_POOL_ITEM* Next;
+    uint8_t Class;
+    uint8_t InUse;
+    RTK_BUFFER Rtb;
+} RTB_POOL_ITEM;
+
+#define RTB_POOL_ITEM_HDR_SIZE      RTB_DATA_ALIGN(sizeof(RTB_POOL_ITEM))
+
+typedef struct _RTB_POOL{
+    pthread_mutex_t Lock;
+    RTB_POOL_ITEM* FreeList;
+    RTB_POOL_STATS Stats;
+} RTB_POOL;
+
+static RTB_POOL RtbPool[RTB_POOL_CLASSES] = {
+    { PTHREAD_MUTEX_INITIALIZER, NULL, { 0 } },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, { 0 } },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, { 0 } },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, { 0 } },
+};
+
+static volatile uint32_t RtbPoolOversize;
+
 //****************************************************************************
 // FUNCTION
 //****************************************************************************
@@ -65,9 +109,116 @@ RtbQueueIsEmpty(
     return  RtkQueueHead->QueueLen > 0 ? FALSE : TRUE;
 }
 
+/**
+    Carve a slab of RTB_POOL_SLAB_ITEMS buffers for a pool. Called with the pool lock held.
+    \return TRUE if the pool got new buffers
+*/
+static unsigned char
+RtbPoolGrow(
+    uint8_t Class
+    )
+{
+    uint32_t ItemSize = RTB_POOL_ITEM_HDR_SIZE + RtbPoolSize[Class];
+    uint8_t* Slab;
+    RTB_POOL_ITEM* Item;
+    int i;
+
+    //slabs are never returned, the pools only grow to the high water mark
+    Slab = malloc(ItemSize * RTB_POOL_SLAB_ITEMS);
+    if (Slab == NULL)
+        return FALSE;
+
+    for (i = 0; i < RTB_POOL_SLAB_ITEMS; i++)
+    {
+        Item = (RTB_POOL_ITEM*)(Slab + i * ItemSize);
+        Item->Class = Class;
+        Item->InUse = FALSE;
+#if (RTB_POOL_DEBUG == TRUE)
+        memset((uint8_t*)Item + RTB_POOL_ITEM_HDR_SIZE, RTB_POOL_POISON, RtbPoolSize[Class]);
+#endif
+        Item->Next = RtbPool[Class].FreeList;
+        RtbPool[Class].FreeList = Item;
+    }
+
+    RtbPool[Class].Stats.Total += RTB_POOL_SLAB_ITEMS;
+    return TRUE;
+}
+
+/**
+    Take a buffer with at least BufferLen data bytes from the smallest pool that fits,
+    or from the heap if none does.
+    \return pool item, NULL if out of memory
+*/
+static RTB_POOL_ITEM*
+RtbPoolGet(
+    uint32_t BufferLen
+    )
+{
+    RTB_POOL_ITEM* Item = NULL;
+    RTB_POOL* Pool;
+    uint8_t Class;
+
+    for (Class = 0; Class < RTB_POOL_CLASSES; Class++)
+    {
+        if (BufferLen <= RtbPoolSize[Class])
+            break;
+    }
+
+    if (Class == RTB_POOL_CLASSES)
+    {
+        __sync_fetch_and_add(&RtbPoolOversize, 1);
+        Item = malloc(RTB_POOL_ITEM_HDR_SIZE + BufferLen);
+        if (Item)
+        {
+            Item->Class = RTB_POOL_NONE;
+            Item->InUse = TRUE;
+        }
+        return Item;
+    }
+
+    Pool = &RtbPool[Class];
+    pthread_mutex_lock(&Pool->Lock);
+
+    if ((Pool->FreeList != NULL) || RtbPoolGrow(Class))
+    {
+        Item = Pool->FreeList;
+        Pool->FreeList = Item->Next;
+        Item->InUse = TRUE;
+
+        Pool->Stats.Allocs++;
+        if (++Pool->Stats.InUse > Pool->Stats.HighWater)
+            Pool->Stats.HighWater = Pool->Stats.InUse;
+    }
+
+    pthread_mutex_unlock(&Pool->Lock);
+
+#if (RTB_POOL_DEBUG == TRUE)
+    if (Item)
+    {
+        uint8_t* Data = (uint8_t*)Item + RTB_POOL_ITEM_HDR_SIZE;
+        uint32_t i;
+
+        //anything but poison was written after the buffer was freed
+        for (i = 0; i < RtbPoolSize[Class]; i++)
+        {
+            if (Data[i] != RTB_POOL_POISON)
+            {
+                SYSLOGE("RtbAllocate: buffer %p of class %u written at offset %u after free",
+                        &Item->Rtb, Class, i);
+                break;
+            }
+        }
+    }
+#endif
+
+    return Item;
+}
+
 /**
     Allocate a RTK_BUFFER with specified data length and reserved headroom.
     If caller does not know actual headroom to reserve for further usage, specify it to zero to use default value.
+    The header and data buffer come in one piece from a size class pool, the heap is only
+    touched while a pool grows towards its high water mark.
     \param [IN]     Length            <uint32_t>        : current data buffer length to allcated
     \param [IN]     HeadRoom     <uint32_t>         : if caller knows reserved head space, set it; otherwise set 0 to use default value
     \return pointer to RTK_BUFFER if succeed, null otherwise
@@ -78,42 +229,26 @@ RtbAllocate(
     uint32_t HeadRoom
     )
 {
-    RTK_BUFFER* Rtb = NULL;
-    ///Rtb buffer length:
-    ///     RTK_BUFFER   48
-    ///     HeadRoom      HeadRomm or 12
-    ///     Length
-    ///memory size: 48 + Length + 12(default) + 8*2(header for each memory) ---> a multiple of 8
-    ///example:       (48 + 8)+ (300 + 12 + 8) = 372
-    Rtb = malloc( sizeof(RTK_BUFFER) );
-    if(Rtb)
-    {
-        uint32_t BufferLen = HeadRoom ? (Length + HeadRoom) : (Length + DEFAULT_HEADER_SIZE);
-        BufferLen = RTB_DATA_ALIGN(BufferLen);
-        Rtb->Head = malloc(BufferLen);
-        if(Rtb->Head)
-        {
-            Rtb->HeadRoom = HeadRoom ? HeadRoom : DEFAULT_HEADER_SIZE;
-            Rtb->Data = Rtb->Head + Rtb->HeadRoom;
-            Rtb->End = Rtb->Data;
-            Rtb->Tail = Rtb->End + Length;
-            Rtb->Length = 0;
-            ListInitializeHeader(&Rtb->List);
-            Rtb->RefCount = 1;
-            return Rtb;
-        }
-    }
+    RTB_POOL_ITEM* Item;
+    RTK_BUFFER* Rtb;
+    uint32_t BufferLen = HeadRoom ? (Length + HeadRoom) : (Length + DEFAULT_HEADER_SIZE);
 
-    if (Rtb)
-    {
-        if (Rtb->Head)
-        {
-            free(Rtb->Head);
-        }
+    BufferLen = RTB_DATA_ALIGN(BufferLen);
 
-        free(Rtb);
-    }
-    return NULL;
+    Item = RtbPoolGet(BufferLen);
+    if (Item == NULL)
+        return NULL;
+
+    Rtb = &Item->Rtb;
+    Rtb->Head = (uint8_t*)Item + RTB_POOL_ITEM_HDR_SIZE;
+    Rtb->HeadRoom = HeadRoom ? HeadRoom : DEFAULT_HEADER_SIZE;
+    Rtb->Data = Rtb->Head + Rtb->HeadRoom;
+    Rtb->End = Rtb->Data;
+    Rtb->Tail = Rtb->End + Length;
+    Rtb->Length = 0;
+    ListInitializeHeader(&Rtb->List);
+    Rtb->RefCount = 1;
+    return Rtb;
 }
 
 
@@ -126,12 +261,79 @@ RtbFree(
     RTK_BUFFER* RtkBuffer
 )
 {
-    if(RtkBuffer)
+    RTB_POOL_ITEM* Item;
+    RTB_POOL* Pool;
+
+    if (RtkBuffer == NULL)
+        return;
+
+    Item = (RTB_POOL_ITEM*)((uint8_t*)RtkBuffer - offsetof(RTB_POOL_ITEM, Rtb));
+
+    if (Item->Class == RTB_POOL_NONE)
     {
-        free(RtkBuffer->Head);
-        free(RtkBuffer);
+        free(Item);
+        return;
     }
-    return;
+
+    if (!Item->InUse)
+    {
+        SYSLOGE("RtbFree: buffer %p freed twice", RtkBuffer);
+        return;
+    }
+
+#if (RTB_POOL_DEBUG == TRUE)
+    memset(RtkBuffer->Head, RTB_POOL_POISON, RtbPoolSize[Item->Class]);
+#endif
+
+    Pool = &RtbPool[Item->Class];
+    pthread_mutex_lock(&Pool->Lock);
+    Item->InUse = FALSE;
+    Item->Next = Pool->FreeList;
+    Pool->FreeList = Item;
+    Pool->Stats.InUse--;
+    pthread_mutex_unlock(&Pool->Lock);
+}
+
+uint32_t
+RtbPoolGetStats(
+    RTB_POOL_STATS* pStats,
+    uint32_t        MaxClasses,
+    uint32_t*       pOversize
+    )
+{
+    uint32_t Class;
+
+    for (Class = 0; (Class < RTB_POOL_CLASSES) && (Class < MaxClasses); Class++)
+    {
+        pthread_mutex_lock(&RtbPool[Class].Lock);
+        pStats[Class] = RtbPool[Class].Stats;
+        pthread_mutex_unlock(&RtbPool[Class].Lock);
+        pStats[Class].Size = RtbPoolSize[Class];
+    }
+
+    if (pOversize)
+        *pOversize = RtbPoolOversize;
+
+    return RTB_POOL_CLASSES;
+}
+
+void
+RtbPoolDumpStats(
+    void
+    )
+{
+    RTB_POOL_STATS Stats[RTB_POOL_CLASSES];
+    uint32_t Oversize, Class;
+
+    RtbPoolGetStats(Stats, RTB_POOL_CLASSES, &Oversize);
+
+    for (Class = 0; Class < RTB_POOL_CLASSES; Class++)
+    {
+        SYSLOGI("rtb pool %4u: total %u, in use %u, high water %u, allocs %u",
+                Stats[Class].Size, Stats[Class].Total, Stats[Class].InUse,
+                Stats[Class].HighWater, Stats[Class].Allocs);
+    }
+    SYSLOGI("rtb pool: %u allocations too big for any pool", Oversize);
 }
 
 /**
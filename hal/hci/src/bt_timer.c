@@ -0,0 +1,481 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2014 Realsil Corporation.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      bt_timer.c
+ *
+ *  Description:   Hashed timer wheel driven by one timerfd
+ *
+ *  A timer lives in slot (expiry & BT_TIMER_WHEEL_MASK) so start and stop are
+ *  a list insert/unlink under the wheel lock. The timerfd only ticks while at
+ *  least one timer is armed; the service thread disarms it once the wheel
+ *  drains, so stopping a timer never costs a syscall.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_timer"
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "bt_syslog.h"
+#include "bt_hci_bdroid.h"
+#include "bt_timer.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#ifndef BT_TIMER_DBG
+#define BT_TIMER_DBG FALSE
+#endif
+
+#if (BT_TIMER_DBG == TRUE)
+#define BTTIMERDBG(param, ...) {SYSLOGD(param, ## __VA_ARGS__);}
+#else
+#define BTTIMERDBG(param, ...) {}
+#endif
+
+#define BT_TIMER_WHEEL_MASK (BT_TIMER_WHEEL_SIZE - 1)
+
+/* Signed distance keeps expiry checks valid across tick wraparound */
+#define BT_TIMER_DUE(now, expiry) ((int32_t)((now) - (expiry)) >= 0)
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct {
+    int             timer_fd;
+    int             event_fd;
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    uint32_t        now;            /* last tick processed */
+    uint32_t        count;          /* timers linked into the wheel */
+    uint8_t         armed;          /* timerfd is ticking */
+    uint8_t         own_thread;     /* bt_timer_thread drives the wheel */
+    RT_LIST_HEAD    wheel[BT_TIMER_WHEEL_SIZE];
+} tBT_TIMER_CB;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static tBT_TIMER_CB bt_timer_cb = {
+    .timer_fd = -1,
+    .event_fd = -1,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+static volatile uint8_t bt_timer_running = 0;
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        bt_timer_arm
+**
+** Description     Start or stop the periodic wheel tick. Wheel lock held.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void bt_timer_arm(uint8_t on)
+{
+    struct itimerspec ts;
+
+    memset(&ts, 0, sizeof(ts));
+    if (on)
+    {
+        ts.it_value.tv_nsec = BT_TIMER_TICK_MS * 1000000L;
+        ts.it_interval = ts.it_value;
+    }
+
+    if (timerfd_settime(bt_timer_cb.timer_fd, 0, &ts, NULL) < 0)
+    {
+        SYSLOGE("bt_timer_arm(%d): timerfd_settime failed, errno: %d", on, errno);
+        return;
+    }
+
+    bt_timer_cb.armed = on;
+}
+
+/*******************************************************************************
+**
+** Function        bt_timer_link
+**
+** Description     Put a timer into the slot of its expiry tick. Wheel lock
+**                 held.
+**
+** Returns         None
+**
+*******************************************************************************/
+static inline void bt_timer_link(tBT_TIMER *p_timer)
+{
+    ListAddToTail(&p_timer->node,
+                  &bt_timer_cb.wheel[p_timer->expiry & BT_TIMER_WHEEL_MASK]);
+}
+
+/*******************************************************************************
+**
+** Function        bt_timer_expire_slot
+**
+** Description     Fire every due timer in the slot of the current tick.
+**                 Callbacks run with the wheel lock released, so the slot is
+**                 rescanned from its head after each one.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void bt_timer_expire_slot(void)
+{
+    RT_LIST_HEAD *p_slot = &bt_timer_cb.wheel[bt_timer_cb.now & BT_TIMER_WHEEL_MASK];
+    RT_LIST_ENTRY *p_iter;
+    tBT_TIMER *p_timer;
+    tBT_TIMER_CBACK p_cback;
+    void *p_context;
+
+rescan:
+    LIST_FOR_EACH(p_iter, p_slot)
+    {
+        p_timer = LIST_ENTRY(p_iter, tBT_TIMER, node);
+        if (!BT_TIMER_DUE(bt_timer_cb.now, p_timer->expiry))
+            continue;
+
+        ListDeleteNode(&p_timer->node);
+        if (p_timer->period)
+        {
+            p_timer->expiry = bt_timer_cb.now + p_timer->period;
+            bt_timer_link(p_timer);
+        }
+        else
+        {
+            p_timer->active = 0;
+            bt_timer_cb.count--;
+        }
+
+        p_cback = p_timer->p_cback;
+        p_context = p_timer->p_context;
+
+        pthread_mutex_unlock(&bt_timer_cb.mutex);
+        if (p_cback && bt_timer_running)
+            p_cback(p_context);
+        pthread_mutex_lock(&bt_timer_cb.mutex);
+
+        goto rescan;
+    }
+}
+
+/*******************************************************************************
+**
+** Function        bt_timer_thread
+**
+** Description     Timer service thread, advances the wheel by however many
+**                 ticks the timerfd reports
+**
+** Returns         None
+**
+*******************************************************************************/
+static void *bt_timer_thread(void *arg)
+{
+    struct pollfd fds[2];
+    eventfd_t ev;
+
+    prctl(PR_SET_NAME, (unsigned long)"bt_timer", 0, 0, 0);
+
+    fds[0].fd = bt_timer_cb.timer_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = bt_timer_cb.event_fd;
+    fds[1].events = POLLIN;
+
+    while (bt_timer_running)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            SYSLOGE("bt_timer_thread: poll failed, errno: %d", errno);
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+            eventfd_read(bt_timer_cb.event_fd, &ev);
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        bt_timer_service();
+    }
+
+    BTTIMERDBG("bt_timer_thread exiting");
+    return NULL;
+}
+
+/*****************************************************************************
+**   Timer service API functions
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        bt_timer_get_fd
+**
+** Description     Descriptor that turns readable when bt_timer_service has
+**                 ticks to process
+**
+** Returns         File descriptor, -1 if the service is not running
+**
+*******************************************************************************/
+int bt_timer_get_fd(void)
+{
+    return bt_timer_cb.timer_fd;
+}
+
+/*******************************************************************************
+**
+** Function        bt_timer_service
+**
+** Description     Advance the wheel by however many ticks the timerfd
+**                 reports and run the expired callbacks. Does not block.
+**
+** Returns         None
+**
+*******************************************************************************/
+void bt_timer_service(void)
+{
+    uint64_t ticks;
+
+    if (read(bt_timer_cb.timer_fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+        return;
+
+    pthread_mutex_lock(&bt_timer_cb.mutex);
+
+    /* After a long stall every slot is visited once; whatever is
+     * overdue in it still compares as due. */
+    if (ticks > BT_TIMER_WHEEL_SIZE)
+    {
+        bt_timer_cb.now += (uint32_t)(ticks - BT_TIMER_WHEEL_SIZE);
+        ticks = BT_TIMER_WHEEL_SIZE;
+    }
+
+    while (ticks-- && bt_timer_running)
+    {
+        bt_timer_cb.now++;
+        bt_timer_expire_slot();
+    }
+
+    if (bt_timer_cb.count == 0 && bt_timer_cb.armed)
+        bt_timer_arm(0);
+
+    pthread_mutex_unlock(&bt_timer_cb.mutex);
+}
+
+
+/*******************************************************************************
+**
+** Function        bt_timer_init
+**
+** Description     Create the timerfd and, if own_thread, start the timer
+**                 service thread. Otherwise the caller polls bt_timer_get_fd
+**                 and calls bt_timer_service. Calling it again while the
+**                 service runs is harmless.
+**
+** Returns         0 on success, -1 otherwise
+**
+*******************************************************************************/
+int bt_timer_init(uint8_t own_thread)
+{
+    int i;
+
+    if (bt_timer_running)
+        return 0;
+
+    bt_timer_cb.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (bt_timer_cb.timer_fd < 0)
+    {
+        SYSLOGE("bt_timer_init: timerfd_create failed, errno: %d", errno);
+        return -1;
+    }
+
+    bt_timer_cb.event_fd = eventfd(0, EFD_CLOEXEC);
+    if (bt_timer_cb.event_fd < 0)
+    {
+        SYSLOGE("bt_timer_init: eventfd failed, errno: %d", errno);
+        close(bt_timer_cb.timer_fd);
+        bt_timer_cb.timer_fd = -1;
+        return -1;
+    }
+
+    for (i = 0; i < BT_TIMER_WHEEL_SIZE; i++)
+        ListInitializeHeader(&bt_timer_cb.wheel[i]);
+    bt_timer_cb.now = 0;
+    bt_timer_cb.count = 0;
+    bt_timer_cb.armed = 0;
+
+    bt_timer_running = 1;
+    bt_timer_cb.own_thread = own_thread;
+    if (!own_thread)
+        return 0;
+
+    if (pthread_create(&bt_timer_cb.thread, NULL, bt_timer_thread, NULL) != 0)
+    {
+        SYSLOGE("bt_timer_init: pthread_create failed");
+        bt_timer_running = 0;
+        close(bt_timer_cb.event_fd);
+        close(bt_timer_cb.timer_fd);
+        bt_timer_cb.event_fd = bt_timer_cb.timer_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        bt_timer_cleanup
+**
+** Description     Stop the timer service thread. Timers still armed are
+**                 dropped without firing.
+**
+** Returns         None
+**
+*******************************************************************************/
+void bt_timer_cleanup(void)
+{
+    RT_LIST_ENTRY *p_iter, *p_temp;
+    int i;
+
+    if (!bt_timer_running)
+        return;
+
+    bt_timer_running = 0;
+    if (bt_timer_cb.own_thread)
+    {
+        eventfd_write(bt_timer_cb.event_fd, 1);
+        pthread_join(bt_timer_cb.thread, NULL);
+    }
+
+    pthread_mutex_lock(&bt_timer_cb.mutex);
+    for (i = 0; i < BT_TIMER_WHEEL_SIZE; i++)
+    {
+        LIST_FOR_EACH_SAFELY(p_iter, p_temp, &bt_timer_cb.wheel[i])
+        {
+            ListDeleteNode(p_iter);
+            LIST_ENTRY(p_iter, tBT_TIMER, node)->active = 0;
+        }
+    }
+    bt_timer_cb.count = 0;
+    bt_timer_cb.armed = 0;
+
+    close(bt_timer_cb.event_fd);
+    close(bt_timer_cb.timer_fd);
+    bt_timer_cb.event_fd = bt_timer_cb.timer_fd = -1;
+    pthread_mutex_unlock(&bt_timer_cb.mutex);
+}
+
+/*******************************************************************************
+**
+** Function        bt_timer_setup
+**
+** Description     Bind a callback to a timer. The callback runs on the timer
+**                 service thread and may start or stop any timer, including
+**                 its own.
+**
+** Returns         None
+**
+*******************************************************************************/
+void bt_timer_setup(tBT_TIMER *p_timer, tBT_TIMER_CBACK p_cback, void *p_context)
+{
+    memset(p_timer, 0, sizeof(tBT_TIMER));
+    p_timer->p_cback = p_cback;
+    p_timer->p_context = p_context;
+}
+
+/*******************************************************************************
+**
+** Function        bt_timer_start
+**
+** Description     (Re)arm a timer to expire after timeout_ms. A periodic
+**                 timer reloads with the same timeout until stopped.
+**
+** Returns         0 on success, -1 otherwise
+**
+*******************************************************************************/
+int bt_timer_start(tBT_TIMER *p_timer, uint32_t timeout_ms, uint8_t periodic)
+{
+    uint32_t ticks = (timeout_ms + BT_TIMER_TICK_MS - 1) / BT_TIMER_TICK_MS;
+
+    if (ticks == 0)
+        ticks = 1;
+
+    pthread_mutex_lock(&bt_timer_cb.mutex);
+
+    if (bt_timer_cb.timer_fd < 0)
+    {
+        pthread_mutex_unlock(&bt_timer_cb.mutex);
+        SYSLOGE("bt_timer_start: timer service not running");
+        return -1;
+    }
+
+    if (p_timer->active)
+        ListDeleteNode(&p_timer->node);
+    else
+        bt_timer_cb.count++;
+
+    /* A running tick is already part way through its period, so count one
+     * more to never expire early. */
+    p_timer->expiry = bt_timer_cb.now + ticks + (bt_timer_cb.armed ? 1 : 0);
+    p_timer->period = periodic ? ticks : 0;
+    p_timer->active = 1;
+    bt_timer_link(p_timer);
+
+    if (!bt_timer_cb.armed)
+        bt_timer_arm(1);
+
+    pthread_mutex_unlock(&bt_timer_cb.mutex);
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        bt_timer_stop
+**
+** Description     Disarm a timer. Does nothing if it is not armed.
+**
+** Returns         None
+**
+*******************************************************************************/
+void bt_timer_stop(tBT_TIMER *p_timer)
+{
+    pthread_mutex_lock(&bt_timer_cb.mutex);
+    if (p_timer->active)
+    {
+        ListDeleteNode(&p_timer->node);
+        p_timer->active = 0;
+        bt_timer_cb.count--;
+    }
+    pthread_mutex_unlock(&bt_timer_cb.mutex);
+}
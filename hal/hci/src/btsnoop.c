@@ -22,6 +22,11 @@
  *
  *  Function:   this file contains functions to generate a BTSNOOP file
  *
+ *              Records are staged in memory and written by a background
+ *              thread in large batches, rotating by size. In flight
+ *              recorder mode only the most recent traffic is kept in
+ *              memory and goes to disk on btsnoop_dump, from the same
+ *              background thread.
  *
  ****************************************************************************/
 #define LOG_TAG "BTSNOOP-DISP"
@@ -42,12 +47,19 @@
 #include <netinet/in.h>
 #include <netdb.h>
 
+/* for clock_gettime */
+#include <time.h>
 /* for gettimeofday */
 #include <sys/time.h>
 /* for the S_* open parameters */
 #include <sys/stat.h>
 /* for write */
 #include <unistd.h>
+/* for writev */
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 /* for O_* open parameters */
 #include <fcntl.h>
 /* defines the O_* open parameters */
@@ -70,6 +82,48 @@
 /* file descriptor of the BT snoop file (by default, -1 means disabled) */
 int hci_btsnoop_fd = -1;
 
+#define BTSNOOP_FILE_HDR_LEN    16
+#define BTSNOOP_REC_HDR_LEN     24
+
+#define HCIT_TYPE_COMMAND   1
+#define HCIT_TYPE_ACL_DATA  2
+#define HCIT_TYPE_SCO_DATA  3
+#define HCIT_TYPE_EVENT     4
+
+#define BTSNOOP_MODE_OFF    0
+#define BTSNOOP_MODE_FILE   1   /* staged in memory, written by btsnoop_writer */
+#define BTSNOOP_MODE_FLIGHT 2   /* memory only until btsnoop_dump, written by btsnoop_writer */
+
+#if (BTSNOOP_BUF_SIZE & (BTSNOOP_BUF_SIZE - 1)) || (BTSNOOP_FLIGHT_SIZE & (BTSNOOP_FLIGHT_SIZE - 1))
+#error BTSNOOP_BUF_SIZE and BTSNOOP_FLIGHT_SIZE must be powers of 2
+#endif
+
+/* Snoop records are staged whole in a byte ring: head and tail run free and
+ * are masked with size - 1 on access. */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t       writer;
+    uint8_t         *p_buf;
+    uint32_t        size;
+    uint32_t        head;
+    uint32_t        tail;
+    uint32_t        drops;          /* cumulative, as the file format wants */
+    uint32_t        file_size;
+    uint32_t        dump_count;
+    uint64_t        dump_last_ms;   /* CLOCK_MONOTONIC of the last dump asked for */
+    char            path[256];
+    char            dump_path[256 + 12];
+    uint8_t         mode;
+    uint8_t         initialized;
+    uint8_t         writer_stop;
+    uint8_t         writer_sleeping;
+    uint8_t         dump_pending;
+} tBTSNOOP_CB;
+
+static tBTSNOOP_CB btsnoop_cb;
+
 /* Macro to perform a multiplication of 2 unsigned 32bit values and store the result
  * in an unsigned 64 bit value (as two 32 bit variables):
  * u64 = u32In1 * u32In2
@@ -169,6 +223,341 @@ static uint32_t l_to_be(uint32_t x)
     return x;
 }
 
+/*******************************************************************************
+ **
+ ** Function         btsnoop_ring_copy
+ **
+ ** Description      Copy len bytes in or out of the record ring at offset
+ **                  pos, wrapping at the end of the buffer
+ **
+ ** Returns          None
+*******************************************************************************/
+static void btsnoop_ring_copy(uint32_t pos, uint8_t *p, uint32_t len, uint8_t to_ring)
+{
+    uint32_t off = pos & (btsnoop_cb.size - 1);
+    uint32_t first = btsnoop_cb.size - off;
+
+    if (first > len)
+        first = len;
+
+    if (to_ring)
+    {
+        memcpy(btsnoop_cb.p_buf + off, p, first);
+        memcpy(btsnoop_cb.p_buf, p + first, len - first);
+    }
+    else
+    {
+        memcpy(p, btsnoop_cb.p_buf + off, first);
+        memcpy(p + first, btsnoop_cb.p_buf, len - first);
+    }
+}
+
+/* Size of the record starting at pos, taken from its included length field */
+static uint32_t btsnoop_ring_rec_len(uint32_t pos)
+{
+    uint8_t be[4];
+
+    btsnoop_ring_copy(pos + 4, be, 4, FALSE);
+
+    return BTSNOOP_REC_HDR_LEN + ((be[0] << 24) | (be[1] << 16) | (be[2] << 8) | be[3]);
+}
+
+/*******************************************************************************
+ **
+ ** Function         btsnoop_write_file_hdr
+ **
+ ** Description      Create the file at p_path and write the BT snoop header
+ **
+ ** Returns          File descriptor, -1 if the file can not be created
+*******************************************************************************/
+static int btsnoop_write_file_hdr(const char *p_path)
+{
+    int fd;
+
+    fd = open(p_path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH);
+    if (fd == -1)
+    {
+        SYSLOGE("btsnoop: unable to create %s (%s)", p_path, strerror(errno));
+        return -1;
+    }
+
+    write(fd, "btsnoop\0\0\0\0\1\0\0\x3\xea", BTSNOOP_FILE_HDR_LEN);
+
+    return fd;
+}
+
+/*******************************************************************************
+ **
+ ** Function         btsnoop_rotate
+ **
+ ** Description      Shift <file>.1 .. <file>.N-1 up by one, move the current
+ **                  file to <file>.1 and start a new one
+ **
+ ** Returns          None
+*******************************************************************************/
+static void btsnoop_rotate(void)
+{
+    char from[sizeof(btsnoop_cb.path) + 8];
+    char to[sizeof(btsnoop_cb.path) + 8];
+    int i;
+
+    close(hci_btsnoop_fd);
+
+    for (i = BTSNOOP_ROTATE_FILES; i > 1; i--)
+    {
+        snprintf(from, sizeof(from), "%s.%d", btsnoop_cb.path, i - 1);
+        snprintf(to, sizeof(to), "%s.%d", btsnoop_cb.path, i);
+        rename(from, to);
+    }
+
+    if (BTSNOOP_ROTATE_FILES > 0)
+    {
+        snprintf(to, sizeof(to), "%s.1", btsnoop_cb.path);
+        rename(btsnoop_cb.path, to);
+    }
+
+    hci_btsnoop_fd = btsnoop_write_file_hdr(btsnoop_cb.path);
+    btsnoop_cb.file_size = BTSNOOP_FILE_HDR_LEN;
+}
+
+/*******************************************************************************
+ **
+ ** Function         btsnoop_flush
+ **
+ ** Description      Write the whole records between tail and head to the file,
+ **                  rotating at a record boundary when the file is full.
+ **                  Only the writer thread moves tail in file mode, and
+ **                  producers never touch bytes before head, so the ring is
+ **                  read without the lock.
+ **
+ ** Returns          None
+*******************************************************************************/
+static void btsnoop_flush(uint32_t tail, uint32_t head)
+{
+    struct iovec iov[2];
+    uint32_t n, off, rec_len = 0;
+
+    while (tail != head)
+    {
+        n = head - tail;
+
+        if ((BTSNOOP_ROTATE_SIZE > 0) && (btsnoop_cb.file_size + n > BTSNOOP_ROTATE_SIZE))
+        {
+            /* as many whole records as still fit the current file */
+            for (n = 0; tail + n != head; n += rec_len)
+            {
+                rec_len = btsnoop_ring_rec_len(tail + n);
+                if (btsnoop_cb.file_size + n + rec_len > BTSNOOP_ROTATE_SIZE)
+                    break;
+            }
+
+            if ((n == 0) && (btsnoop_cb.file_size > BTSNOOP_FILE_HDR_LEN))
+            {
+                btsnoop_rotate();
+                continue;
+            }
+
+            /* a record larger than a whole file goes out on its own */
+            if (n == 0)
+                n = rec_len;
+        }
+
+        off = tail & (btsnoop_cb.size - 1);
+        iov[0].iov_base = btsnoop_cb.p_buf + off;
+        iov[0].iov_len = (n < btsnoop_cb.size - off) ? n : btsnoop_cb.size - off;
+        iov[1].iov_base = btsnoop_cb.p_buf;
+        iov[1].iov_len = n - iov[0].iov_len;
+
+        if (hci_btsnoop_fd != -1)
+            writev(hci_btsnoop_fd, iov, iov[1].iov_len ? 2 : 1);
+
+        btsnoop_cb.file_size += n;
+        tail += n;
+    }
+}
+
+/*******************************************************************************
+ **
+ ** Function         btsnoop_writer_thread
+ **
+ ** Description      Put staged records to the file once the ring is half full,
+ **                  BTSNOOP_FLUSH_MS after the last flush, or on close
+ **
+ ** Returns          None
+*******************************************************************************/
+static void *btsnoop_writer_thread(void *arg)
+{
+    struct timespec ts;
+    uint32_t tail, head;
+    uint8_t stop;
+
+    prctl(PR_SET_NAME, (unsigned long)"btsnoop_writer", 0, 0, 0);
+
+    pthread_mutex_lock(&btsnoop_cb.mutex);
+
+    do
+    {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += BTSNOOP_FLUSH_MS / 1000;
+        ts.tv_nsec += (BTSNOOP_FLUSH_MS % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        btsnoop_cb.writer_sleeping = TRUE;
+        while (!btsnoop_cb.writer_stop &&
+               (btsnoop_cb.head - btsnoop_cb.tail < btsnoop_cb.size / 2))
+        {
+            if (pthread_cond_timedwait(&btsnoop_cb.cond, &btsnoop_cb.mutex, &ts) == ETIMEDOUT)
+                break;
+        }
+        btsnoop_cb.writer_sleeping = FALSE;
+
+        stop = btsnoop_cb.writer_stop;
+        tail = btsnoop_cb.tail;
+        head = btsnoop_cb.head;
+        pthread_mutex_unlock(&btsnoop_cb.mutex);
+
+        btsnoop_flush(tail, head);
+
+        pthread_mutex_lock(&btsnoop_cb.mutex);
+        btsnoop_cb.tail = head;
+    } while (!stop);
+
+    pthread_mutex_unlock(&btsnoop_cb.mutex);
+
+    return NULL;
+}
+
+/*******************************************************************************
+ **
+ ** Function         btsnoop_dump_thread
+ **
+ ** Description      Flight recorder writer: put a copy of the recorded
+ **                  traffic to dump_path each time btsnoop_dump asks for it,
+ **                  and once more on close if a dump is still pending
+ **
+ ** Returns          None
+*******************************************************************************/
+static void *btsnoop_dump_thread(void *arg)
+{
+    char path[sizeof(btsnoop_cb.dump_path)];
+    uint8_t *p_copy;
+    uint32_t len;
+    int fd;
+
+    prctl(PR_SET_NAME, (unsigned long)"btsnoop_writer", 0, 0, 0);
+
+    pthread_mutex_lock(&btsnoop_cb.mutex);
+
+    while (1)
+    {
+        while (!btsnoop_cb.writer_stop && !btsnoop_cb.dump_pending)
+            pthread_cond_wait(&btsnoop_cb.cond, &btsnoop_cb.mutex);
+
+        if (!btsnoop_cb.dump_pending)
+            break;
+
+        /* copy out under the lock, write to disk without it */
+        p_copy = malloc(btsnoop_cb.size);
+        len = btsnoop_cb.head - btsnoop_cb.tail;
+        if (p_copy != NULL)
+            btsnoop_ring_copy(btsnoop_cb.tail, p_copy, len, FALSE);
+        snprintf(path, sizeof(path), "%s", btsnoop_cb.dump_path);
+        btsnoop_cb.dump_pending = FALSE;
+        pthread_mutex_unlock(&btsnoop_cb.mutex);
+
+        if (p_copy != NULL)
+        {
+            SYSLOGI("btsnoop_dump: %u bytes of HCI traffic to %s", len, path);
+
+            fd = btsnoop_write_file_hdr(path);
+            if (fd != -1)
+            {
+                write(fd, p_copy, len);
+                close(fd);
+            }
+            free(p_copy);
+        }
+
+        pthread_mutex_lock(&btsnoop_cb.mutex);
+    }
+
+    pthread_mutex_unlock(&btsnoop_cb.mutex);
+
+    return NULL;
+}
+
+/*******************************************************************************
+ **
+ ** Function         btsnoop_write_rec
+ **
+ ** Description      Stage one record in the ring. In file mode a full ring
+ **                  drops the record and counts it in the drops field of
+ **                  the following ones; the flight recorder overwrites the
+ **                  oldest records instead.
+ **
+ ** Returns          None
+*******************************************************************************/
+static void btsnoop_write_rec(uint8_t type, uint32_t flags, uint8_t *p, uint32_t len)
+{
+    uint8_t hdr[BTSNOOP_REC_HDR_LEN + 1];
+    uint32_t value, value_hi, rec_len;
+    struct timeval tv;
+
+    rec_len = BTSNOOP_REC_HDR_LEN + 1 + len;
+
+    pthread_mutex_lock(&btsnoop_cb.mutex);
+
+    if ((btsnoop_cb.mode == BTSNOOP_MODE_OFF) || (rec_len > btsnoop_cb.size))
+    {
+        pthread_mutex_unlock(&btsnoop_cb.mutex);
+        return;
+    }
+
+    if (btsnoop_cb.mode == BTSNOOP_MODE_FLIGHT)
+    {
+        while (btsnoop_cb.size - (btsnoop_cb.head - btsnoop_cb.tail) < rec_len)
+            btsnoop_cb.tail += btsnoop_ring_rec_len(btsnoop_cb.tail);
+    }
+    else if (btsnoop_cb.size - (btsnoop_cb.head - btsnoop_cb.tail) < rec_len)
+    {
+        btsnoop_cb.drops++;
+        pthread_mutex_unlock(&btsnoop_cb.mutex);
+        return;
+    }
+
+    /* store the length in both original and included fields */
+    value = l_to_be(len + 1);
+    memcpy(hdr, &value, 4);
+    memcpy(hdr + 4, &value, 4);
+    value = l_to_be(flags);
+    memcpy(hdr + 8, &value, 4);
+    value = l_to_be(btsnoop_cb.drops);
+    memcpy(hdr + 12, &value, 4);
+    /* time */
+    gettimeofday(&tv, NULL);
+    tv_to_btsnoop_ts(&value, &value_hi, &tv);
+    value_hi = l_to_be(value_hi);
+    value = l_to_be(value);
+    memcpy(hdr + 16, &value_hi, 4);
+    memcpy(hdr + 20, &value, 4);
+    /* packet type ahead of the data */
+    hdr[BTSNOOP_REC_HDR_LEN] = type;
+
+    btsnoop_ring_copy(btsnoop_cb.head, hdr, sizeof(hdr), TRUE);
+    btsnoop_ring_copy(btsnoop_cb.head + sizeof(hdr), p, len, TRUE);
+    btsnoop_cb.head += rec_len;
+
+    if ((btsnoop_cb.mode == BTSNOOP_MODE_FILE) && btsnoop_cb.writer_sleeping &&
+        (btsnoop_cb.head - btsnoop_cb.tail >= btsnoop_cb.size / 2))
+        pthread_cond_signal(&btsnoop_cb.cond);
+
+    pthread_mutex_unlock(&btsnoop_cb.mutex);
+}
+
 /*******************************************************************************
  **
  ** Function         btsnoop_is_open
@@ -180,9 +569,9 @@ static uint32_t l_to_be(uint32_t x)
 int btsnoop_is_open(void)
 {
 #if defined(BTSNOOPDISP_INCLUDED) && (BTSNOOPDISP_INCLUDED == TRUE)
-    SNOOPDBG("btsnoop_is_open: snoop fd = %d\n", hci_btsnoop_fd);
+    SNOOPDBG("btsnoop_is_open: snoop mode = %d\n", btsnoop_cb.mode);
 
-    if (hci_btsnoop_fd != -1)
+    if (btsnoop_cb.mode != BTSNOOP_MODE_OFF)
     {
         return 1;
     }
@@ -194,59 +583,194 @@ int btsnoop_is_open(void)
 
 /*******************************************************************************
  **
- ** Function         btsnoop_log_open
+ ** Function         btsnoop_log_close
  **
- ** Description      Function to open the BTSNOOP file
+ ** Description      Function to close the BTSNOOP file or drop the flight
+ **                  recorder. Records staged for the file are written first.
  **
  ** Returns          None
 *******************************************************************************/
-static int btsnoop_log_open(char *btsnoop_logfile)
+static int btsnoop_log_close(void)
 {
 #if defined(BTSNOOPDISP_INCLUDED) && (BTSNOOPDISP_INCLUDED == TRUE)
-    hci_btsnoop_fd = -1;
+    uint8_t mode;
+
+    pthread_mutex_lock(&btsnoop_cb.mutex);
+    mode = btsnoop_cb.mode;
+    btsnoop_cb.mode = BTSNOOP_MODE_OFF;
+    btsnoop_cb.writer_stop = TRUE;
+    pthread_cond_signal(&btsnoop_cb.cond);
+    pthread_mutex_unlock(&btsnoop_cb.mutex);
+
+    if (mode == BTSNOOP_MODE_OFF)
+        return 0;
+
+    SNOOPDBG("btsnoop_log_close: Closing snoop log\n");
+
+    pthread_join(btsnoop_cb.writer, NULL);
+
+    if (hci_btsnoop_fd != -1)
+    {
+        close(hci_btsnoop_fd);
+        hci_btsnoop_fd = -1;
+    }
+
+    free(btsnoop_cb.p_buf);
+    btsnoop_cb.p_buf = NULL;
+    return 1;
+#else
+    return 2;  /* Snoop not available  */
+#endif
+}
+
+/*******************************************************************************
+ **
+ ** Function         btsnoop_log_open
+ **
+ ** Description      Function to open the BTSNOOP file, or with mode
+ **                  BTSNOOP_MODE_FLIGHT to start the in-memory flight
+ **                  recorder that dumps next to btsnoop_logfile
+ **
+ ** Returns          1 on success, 0 on failure
+*******************************************************************************/
+static int btsnoop_log_open(char *btsnoop_logfile, uint8_t mode)
+{
+#if defined(BTSNOOPDISP_INCLUDED) && (BTSNOOPDISP_INCLUDED == TRUE)
+    pthread_condattr_t cond_attr;
+    uint32_t size = (mode == BTSNOOP_MODE_FLIGHT) ? BTSNOOP_FLIGHT_SIZE : BTSNOOP_BUF_SIZE;
 
     SNOOPDBG("btsnoop_log_open: snoop log file = %s\n", btsnoop_logfile);
 
-    /* write the BT snoop header */
-    if ((btsnoop_logfile != NULL) && (strlen(btsnoop_logfile) != 0))
+    if ((btsnoop_logfile == NULL) || (strlen(btsnoop_logfile) == 0))
+        return 0;
+
+    btsnoop_log_close();
+
+    if (!btsnoop_cb.initialized)
     {
-        hci_btsnoop_fd = open(btsnoop_logfile, \
-                              O_WRONLY|O_CREAT|O_TRUNC, \
-                              S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH);
+        pthread_mutex_init(&btsnoop_cb.mutex, NULL);
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&btsnoop_cb.cond, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+        btsnoop_cb.initialized = TRUE;
+    }
+
+    snprintf(btsnoop_cb.path, sizeof(btsnoop_cb.path), "%s", btsnoop_logfile);
+
+    btsnoop_cb.p_buf = malloc(size);
+    if (btsnoop_cb.p_buf == NULL)
+    {
+        SYSLOGE("btsnoop_log_open: no memory for %u bytes of records", size);
+        return 0;
+    }
+    btsnoop_cb.size = size;
+    btsnoop_cb.head = btsnoop_cb.tail = 0;
+    btsnoop_cb.drops = 0;
+    btsnoop_cb.writer_stop = FALSE;
+    btsnoop_cb.writer_sleeping = FALSE;
+    btsnoop_cb.dump_pending = FALSE;
+
+    if (mode == BTSNOOP_MODE_FILE)
+    {
+        hci_btsnoop_fd = btsnoop_write_file_hdr(btsnoop_logfile);
         if (hci_btsnoop_fd == -1)
         {
-            perror("open");
-            SNOOPDBG("btsnoop_log_open: Unable to open snoop log file\n");
+            free(btsnoop_cb.p_buf);
+            btsnoop_cb.p_buf = NULL;
+            return 0;
+        }
+        btsnoop_cb.file_size = BTSNOOP_FILE_HDR_LEN;
+
+        if (pthread_create(&btsnoop_cb.writer, NULL, btsnoop_writer_thread, NULL) != 0)
+        {
+            SYSLOGE("btsnoop_log_open: writer thread not created");
+            close(hci_btsnoop_fd);
             hci_btsnoop_fd = -1;
+            free(btsnoop_cb.p_buf);
+            btsnoop_cb.p_buf = NULL;
             return 0;
         }
-        write(hci_btsnoop_fd, "btsnoop\0\0\0\0\1\0\0\x3\xea", 16);
-        return 1;
     }
+    else if (pthread_create(&btsnoop_cb.writer, NULL, btsnoop_dump_thread, NULL) != 0)
+    {
+        SYSLOGE("btsnoop_log_open: writer thread not created");
+        free(btsnoop_cb.p_buf);
+        btsnoop_cb.p_buf = NULL;
+        return 0;
+    }
+
+    pthread_mutex_lock(&btsnoop_cb.mutex);
+    btsnoop_cb.mode = mode;
+    pthread_mutex_unlock(&btsnoop_cb.mutex);
+
+    return 1;
 #endif
     return 2;  /* Snoop not available  */
 }
 
 /*******************************************************************************
  **
- ** Function         btsnoop_log_close
+ ** Function         btsnoop_dump
  **
- ** Description      Function to close the BTSNOOP file
+ ** Description      Have the writer thread put what the flight recorder
+ **                  holds to p_path, or to <flight recorder path>.<n> when
+ **                  p_path is NULL. Those numbered dumps cycle through
+ **                  BTSNOOP_DUMP_FILES names and come at most once every
+ **                  BTSNOOP_DUMP_MIN_MS. The recorder keeps running and
+ **                  keeps its contents.
  **
- ** Returns          None
+ ** Returns          1 if a dump is on its way, 0 otherwise
 *******************************************************************************/
-static int btsnoop_log_close(void)
+int btsnoop_dump(char *p_path)
 {
 #if defined(BTSNOOPDISP_INCLUDED) && (BTSNOOPDISP_INCLUDED == TRUE)
-    /* write the BT snoop header */
-    if (hci_btsnoop_fd != -1)
+    struct timespec ts;
+    uint64_t now_ms;
+
+    if (btsnoop_cb.mode != BTSNOOP_MODE_FLIGHT)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    pthread_mutex_lock(&btsnoop_cb.mutex);
+
+    if (btsnoop_cb.mode != BTSNOOP_MODE_FLIGHT)
     {
-        SNOOPDBG("btsnoop_log_close: Closing snoop log file\n");
-        close(hci_btsnoop_fd);
-        hci_btsnoop_fd = -1;
+        pthread_mutex_unlock(&btsnoop_cb.mutex);
+        return 0;
+    }
+
+    /* a queued dump already covers it */
+    if (btsnoop_cb.dump_pending)
+    {
+        pthread_mutex_unlock(&btsnoop_cb.mutex);
         return 1;
     }
-    return 0;
+
+    if (p_path != NULL)
+        snprintf(btsnoop_cb.dump_path, sizeof(btsnoop_cb.dump_path), "%s", p_path);
+    else
+    {
+        if (btsnoop_cb.dump_count && (now_ms - btsnoop_cb.dump_last_ms < BTSNOOP_DUMP_MIN_MS))
+        {
+            pthread_mutex_unlock(&btsnoop_cb.mutex);
+            SNOOPDBG("btsnoop_dump: skipped, last dump %llu ms ago",
+                     (unsigned long long)(now_ms - btsnoop_cb.dump_last_ms));
+            return 0;
+        }
+        btsnoop_cb.dump_last_ms = now_ms;
+        snprintf(btsnoop_cb.dump_path, sizeof(btsnoop_cb.dump_path), "%s.%u", btsnoop_cb.path,
+                 (btsnoop_cb.dump_count++ % BTSNOOP_DUMP_FILES) + 1);
+    }
+
+    btsnoop_cb.dump_pending = TRUE;
+    pthread_cond_signal(&btsnoop_cb.cond);
+
+    pthread_mutex_unlock(&btsnoop_cb.mutex);
+
+    return 1;
 #else
     return 2;  /* Snoop not available  */
 #endif
@@ -262,40 +786,10 @@ static int btsnoop_log_close(void)
 *******************************************************************************/
 void btsnoop_hci_cmd(uint8_t *p)
 {
-    SNOOPDBG("btsnoop_hci_cmd: fd = %d", hci_btsnoop_fd);
+    SNOOPDBG("btsnoop_hci_cmd: mode = %d", btsnoop_cb.mode);
 
-    if (hci_btsnoop_fd != -1)
-    {
-        uint32_t value, value_hi;
-        struct timeval tv;
-
-        /* since these display functions are called from different contexts */
-        utils_lock();
-
-        /* store the length in both original and included fields */
-        value = l_to_be(p[2] + 4);
-        write(hci_btsnoop_fd, &value, 4);
-        write(hci_btsnoop_fd, &value, 4);
-        /* flags: command sent from the host */
-        value = l_to_be(2);
-        write(hci_btsnoop_fd, &value, 4);
-        /* drops: none */
-        value = 0;
-        write(hci_btsnoop_fd, &value, 4);
-        /* time */
-        gettimeofday(&tv, NULL);
-        tv_to_btsnoop_ts(&value, &value_hi, &tv);
-        value_hi = l_to_be(value_hi);
-        value = l_to_be(value);
-        write(hci_btsnoop_fd, &value_hi, 4);
-        write(hci_btsnoop_fd, &value, 4);
-        /* data */
-        write(hci_btsnoop_fd, "\x1", 1);
-        write(hci_btsnoop_fd, p, p[2] + 3);
-
-        /* since these display functions are called from different contexts */
-        utils_unlock();
-    }
+    /* flags: command sent from the host */
+    btsnoop_write_rec(HCIT_TYPE_COMMAND, 2, p, p[2] + 3);
 }
 
 /*******************************************************************************
@@ -308,40 +802,10 @@ void btsnoop_hci_cmd(uint8_t *p)
 *******************************************************************************/
 void btsnoop_hci_evt(uint8_t *p)
 {
-    SNOOPDBG("btsnoop_hci_evt: fd = %d", hci_btsnoop_fd);
+    SNOOPDBG("btsnoop_hci_evt: mode = %d", btsnoop_cb.mode);
 
-    if (hci_btsnoop_fd != -1)
-    {
-        uint32_t value, value_hi;
-        struct timeval tv;
-
-        /* since these display functions are called from different contexts */
-        utils_lock();
-
-        /* store the length in both original and included fields */
-        value = l_to_be(p[1] + 3);
-        write(hci_btsnoop_fd, &value, 4);
-        write(hci_btsnoop_fd, &value, 4);
-        /* flags: event received in the host */
-        value = l_to_be(3);
-        write(hci_btsnoop_fd, &value, 4);
-        /* drops: none */
-        value = 0;
-        write(hci_btsnoop_fd, &value, 4);
-        /* time */
-        gettimeofday(&tv, NULL);
-        tv_to_btsnoop_ts(&value, &value_hi, &tv);
-        value_hi = l_to_be(value_hi);
-        value = l_to_be(value);
-        write(hci_btsnoop_fd, &value_hi, 4);
-        write(hci_btsnoop_fd, &value, 4);
-        /* data */
-        write(hci_btsnoop_fd, "\x4", 1);
-        write(hci_btsnoop_fd, p, p[1] + 2);
-
-        /* since these display functions are called from different contexts */
-        utils_unlock();
-    }
+    /* flags: event received in the host */
+    btsnoop_write_rec(HCIT_TYPE_EVENT, 3, p, p[1] + 2);
 }
 
 /*******************************************************************************
@@ -354,40 +818,10 @@ void btsnoop_hci_evt(uint8_t *p)
 *******************************************************************************/
 void btsnoop_sco_data(uint8_t *p, uint8_t is_rcvd)
 {
-    SNOOPDBG("btsnoop_sco_data: fd = %d", hci_btsnoop_fd);
+    SNOOPDBG("btsnoop_sco_data: mode = %d", btsnoop_cb.mode);
 
-    if (hci_btsnoop_fd != -1)
-    {
-        uint32_t value, value_hi;
-        struct timeval tv;
-
-        /* since these display functions are called from different contexts */
-        utils_lock();
-
-        /* store the length in both original and included fields */
-        value = l_to_be(p[2] + 4);
-        write(hci_btsnoop_fd, &value, 4);
-        write(hci_btsnoop_fd, &value, 4);
-        /* flags: data can be sent or received */
-        value = l_to_be(is_rcvd?1:0);
-        write(hci_btsnoop_fd, &value, 4);
-        /* drops: none */
-        value = 0;
-        write(hci_btsnoop_fd, &value, 4);
-        /* time */
-        gettimeofday(&tv, NULL);
-        tv_to_btsnoop_ts(&value, &value_hi, &tv);
-        value_hi = l_to_be(value_hi);
-        value = l_to_be(value);
-        write(hci_btsnoop_fd, &value_hi, 4);
-        write(hci_btsnoop_fd, &value, 4);
-        /* data */
-        write(hci_btsnoop_fd, "\x3", 1);
-        write(hci_btsnoop_fd, p, p[2] + 3);
-
-        /* since these display functions are called from different contexts */
-        utils_unlock();
-    }
+    /* flags: data can be sent or received */
+    btsnoop_write_rec(HCIT_TYPE_SCO_DATA, is_rcvd ? 1 : 0, p, p[2] + 3);
 }
 
 /*******************************************************************************
@@ -400,41 +834,11 @@ void btsnoop_sco_data(uint8_t *p, uint8_t is_rcvd)
 *******************************************************************************/
 void btsnoop_acl_data(uint8_t *p, uint8_t is_rcvd)
 {
-    SNOOPDBG("btsnoop_acl_data: fd = %d", hci_btsnoop_fd);
-    if (hci_btsnoop_fd != -1)
-    {
-        uint32_t value, value_hi;
-        struct timeval tv;
-
-        /* since these display functions are called from different contexts */
-        utils_lock();
-
-        /* store the length in both original and included fields */
-        value = l_to_be((p[3]<<8) + p[2] + 5);
-        write(hci_btsnoop_fd, &value, 4);
-        write(hci_btsnoop_fd, &value, 4);
-        /* flags: data can be sent or received */
-        value = l_to_be(is_rcvd?1:0);
-        write(hci_btsnoop_fd, &value, 4);
-        /* drops: none */
-        value = 0;
-        write(hci_btsnoop_fd, &value, 4);
-        /* time */
-        gettimeofday(&tv, NULL);
-        tv_to_btsnoop_ts(&value, &value_hi, &tv);
-        value_hi = l_to_be(value_hi);
-        value = l_to_be(value);
-        write(hci_btsnoop_fd, &value_hi, 4);
-        write(hci_btsnoop_fd, &value, 4);
-        /* data */
-        write(hci_btsnoop_fd, "\x2", 1);
-        write(hci_btsnoop_fd, p, (p[3]<<8) + p[2] + 4);
-
-        /* since these display functions are called from different contexts */
-        utils_unlock();
-    }
-}
+    SNOOPDBG("btsnoop_acl_data: mode = %d", btsnoop_cb.mode);
 
+    /* flags: data can be sent or received */
+    btsnoop_write_rec(HCIT_TYPE_ACL_DATA, is_rcvd ? 1 : 0, p, (p[3]<<8) + p[2] + 4);
+}
 
 /********************************************************************************
  ** API allow external realtime parsing of output using e.g hcidump
@@ -442,12 +846,43 @@ void btsnoop_acl_data(uint8_t *p, uint8_t is_rcvd)
 
 #define EXT_PARSER_PORT 4330
 
+/* Slots handed to one sendmsg call */
+#define EXT_PARSER_IOV_MAX  16
+
+#if (BTSNOOP_EXT_SLOTS & (BTSNOOP_EXT_SLOTS - 1))
+#error BTSNOOP_EXT_SLOTS must be a power of 2
+#endif
+
 static pthread_t thread_id;
 static int s_listen = -1;
 static int ext_parser_fd = -1;
 
 static void ext_parser_detached(void);
 
+#if defined(BTSNOOP_EXT_PARSER_INCLUDED) && (BTSNOOP_EXT_PARSER_INCLUDED == TRUE)
+/* Packets on their way to the external parser, H4 type byte first. A
+ * bounded multi-producer ring: a slot is free for position pos when its
+ * seq equals pos and holds a packet when it equals pos + 1. */
+typedef struct
+{
+    volatile uint32_t seq;
+    uint16_t          len;
+    uint8_t           data[BTSNOOP_EXT_SLOT_SIZE];
+} tEXT_PARSER_SLOT;
+
+static tEXT_PARSER_SLOT ext_slots[BTSNOOP_EXT_SLOTS];
+static volatile uint32_t ext_enq;
+static uint32_t ext_deq;
+static uint32_t ext_sent_off;       /* bytes of the slot at ext_deq already sent */
+static volatile int ext_sleeping;
+static int ext_wake_fd = -1;
+
+/* counters, reported when the parser detaches */
+static volatile uint32_t ext_sent;
+static volatile uint32_t ext_drop_full;
+static volatile uint32_t ext_drop_long;
+#endif
+
 #if defined(BTSNOOP_EXT_PARSER_INCLUDED) && (BTSNOOP_EXT_PARSER_INCLUDED == TRUE)
 static int ext_parser_accept(int port)
 {
@@ -508,24 +943,213 @@ static int ext_parser_accept(int port)
     return s;
 }
 
-static int send_ext_parser(char *p, int len)
+/*******************************************************************************
+ **
+ ** Function         ext_parser_enqueue
+ **
+ ** Description      Queue one packet for the external parser. Never blocks:
+ **                  a full ring or an oversized packet is dropped and
+ **                  counted.
+ **
+ ** Returns          None
+*******************************************************************************/
+static void ext_parser_enqueue(uint8_t type, uint8_t *p, uint16_t len)
+{
+    tEXT_PARSER_SLOT *p_slot;
+    uint32_t pos;
+    int32_t dif;
+    uint64_t one = 1;
+
+    if (len + 1 > BTSNOOP_EXT_SLOT_SIZE)
+    {
+        __sync_fetch_and_add(&ext_drop_long, 1);
+        return;
+    }
+
+    pos = ext_enq;
+    for (;;)
+    {
+        p_slot = &ext_slots[pos & (BTSNOOP_EXT_SLOTS - 1)];
+        dif = (int32_t)(p_slot->seq - pos);
+
+        if (dif == 0)
+        {
+            if (__sync_bool_compare_and_swap(&ext_enq, pos, pos + 1))
+                break;
+        }
+        else if (dif < 0)
+        {
+            /* the parser is behind by a whole ring */
+            __sync_fetch_and_add(&ext_drop_full, 1);
+            return;
+        }
+
+        pos = ext_enq;
+    }
+
+    p_slot->data[0] = type;
+    memcpy(p_slot->data + 1, p, len);
+    p_slot->len = len + 1;
+
+    __sync_synchronize();
+    p_slot->seq = pos + 1;
+
+    if (ext_sleeping && __sync_bool_compare_and_swap(&ext_sleeping, 1, 0))
+        write(ext_wake_fd, &one, sizeof(one));
+}
+
+/*******************************************************************************
+ **
+ ** Function         ext_parser_drain
+ **
+ ** Description      Send the queued packets to the external parser, several
+ **                  per sendmsg. A slow parser only makes this thread wait,
+ **                  producers keep dropping into the ring meanwhile.
+ **
+ ** Returns          0 once the ring is empty, -1 if the parser went away
+*******************************************************************************/
+static int ext_parser_drain(void)
 {
+    struct iovec iov[EXT_PARSER_IOV_MAX];
+    struct msghdr msg;
+    struct pollfd pfd;
+    tEXT_PARSER_SLOT *p_slot;
+    uint32_t pos, rem;
+    ssize_t sent;
     int n;
 
-    /* check if io socket is connected */
-    if (ext_parser_fd == -1)
-        return 0;
+    while (ext_parser_fd != -1)
+    {
+        for (n = 0, pos = ext_deq; n < EXT_PARSER_IOV_MAX; n++, pos++)
+        {
+            p_slot = &ext_slots[pos & (BTSNOOP_EXT_SLOTS - 1)];
+            if (p_slot->seq != pos + 1)
+                break;
+            __sync_synchronize();
+
+            iov[n].iov_base = p_slot->data + (n ? 0 : ext_sent_off);
+            iov[n].iov_len = p_slot->len - (n ? 0 : ext_sent_off);
+        }
+
+        if (n == 0)
+            return 0;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+
+        sent = sendmsg(ext_parser_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+                return -1;
+
+            pfd.fd = ext_parser_fd;
+            pfd.events = POLLOUT;
+            if ((poll(&pfd, 1, BTSNOOP_FLUSH_MS) > 0) && (pfd.revents & (POLLERR | POLLHUP)))
+                return -1;
+            continue;
+        }
+
+        /* hand fully sent slots back to the producers */
+        while (sent > 0)
+        {
+            p_slot = &ext_slots[ext_deq & (BTSNOOP_EXT_SLOTS - 1)];
+            rem = p_slot->len - ext_sent_off;
+
+            if (sent < (ssize_t)rem)
+            {
+                ext_sent_off += sent;
+                break;
+            }
+
+            sent -= rem;
+            ext_sent_off = 0;
+            __sync_synchronize();
+            p_slot->seq = ext_deq + BTSNOOP_EXT_SLOTS;
+            ext_deq++;
+            ext_sent++;
+        }
+    }
+
+    return -1;
+}
+
+/*******************************************************************************
+ **
+ ** Function         ext_parser_reset
+ **
+ ** Description      Start a new parser on an empty ring: hand back every
+ **                  packet still queued for the last one, including one it
+ **                  got only part of, and clear the counters
+ **
+ ** Returns          None
+*******************************************************************************/
+static void ext_parser_reset(void)
+{
+    tEXT_PARSER_SLOT *p_slot;
 
-    SNOOPDBG("write %d to snoop socket\n", len);
+    for (;;)
+    {
+        p_slot = &ext_slots[ext_deq & (BTSNOOP_EXT_SLOTS - 1)];
+        if (p_slot->seq != ext_deq + 1)
+            break;
+
+        __sync_synchronize();
+        p_slot->seq = ext_deq + BTSNOOP_EXT_SLOTS;
+        ext_deq++;
+    }
+
+    ext_sent_off = 0;
+    ext_sent = 0;
+    ext_drop_full = 0;
+    ext_drop_long = 0;
+}
+
+/*******************************************************************************
+ **
+ ** Function         ext_parser_wait
+ **
+ ** Description      Sleep until a packet is queued or the parser closes the
+ **                  connection
+ **
+ ** Returns          0, -1 if the parser went away
+*******************************************************************************/
+static int ext_parser_wait(void)
+{
+    struct pollfd pfd[2];
+    uint64_t value;
+    char junk[64];
 
-    n = write(ext_parser_fd, p, len);
+    ext_sleeping = 1;
+    __sync_synchronize();
 
-    if (n<=0)
+    /* recheck after announcing the sleep, a producer may have just missed it */
+    if (ext_slots[ext_deq & (BTSNOOP_EXT_SLOTS - 1)].seq == ext_deq + 1)
     {
-        ext_parser_detached();
+        ext_sleeping = 0;
+        return 0;
     }
 
-    return n;
+    pfd[0].fd = ext_wake_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = ext_parser_fd;
+    pfd[1].events = POLLIN;
+
+    poll(pfd, 2, -1);
+    ext_sleeping = 0;
+
+    if (pfd[0].revents & POLLIN)
+        read(ext_wake_fd, &value, sizeof(value));
+
+    if (pfd[1].revents & (POLLERR | POLLHUP))
+        return -1;
+
+    /* the parser has nothing to say, end of stream means it closed */
+    if ((pfd[1].revents & POLLIN) && (recv(ext_parser_fd, junk, sizeof(junk), MSG_DONTWAIT) == 0))
+        return -1;
+
+    return 0;
 }
 #endif
 
@@ -533,6 +1157,11 @@ static void ext_parser_detached(void)
 {
     SYSLOGD("ext parser detached");
 
+#if defined(BTSNOOP_EXT_PARSER_INCLUDED) && (BTSNOOP_EXT_PARSER_INCLUDED == TRUE)
+    SYSLOGI("ext parser: %u packets sent, %u dropped with the ring full, %u too long",
+            ext_sent, ext_drop_full, ext_drop_long);
+#endif
+
     if (ext_parser_fd>0)
         close(ext_parser_fd);
 
@@ -572,9 +1201,21 @@ static void ext_parser_thread(void* param)
     {
         fd = ext_parser_accept(EXT_PARSER_PORT);
 
+        /* what was queued for the last parser would garble the stream */
+        ext_parser_reset();
+
         ext_parser_fd = fd;
 
         SYSLOGD("ext parser attached on fd %d\n", ext_parser_fd);
+
+        while (ext_parser_fd != -1)
+        {
+            if ((ext_parser_drain() < 0) || (ext_parser_wait() < 0))
+            {
+                ext_parser_detached();
+                break;
+            }
+        }
     } while (1);
 }
 #endif
@@ -588,8 +1229,18 @@ void btsnoop_stop_listener(void)
 void btsnoop_init(void)
 {
 #if defined(BTSNOOP_EXT_PARSER_INCLUDED) && (BTSNOOP_EXT_PARSER_INCLUDED == TRUE)
+    uint32_t i;
+
     SYSLOGD("btsnoop_init");
 
+    for (i = 0; i < BTSNOOP_EXT_SLOTS; i++)
+        ext_slots[i].seq = i;
+    ext_enq = ext_deq = 0;
+    ext_sent_off = 0;
+
+    if (ext_wake_fd == -1)
+        ext_wake_fd = eventfd(0, EFD_NONBLOCK);
+
     /* always setup ext listener port */
     if (pthread_create(&thread_id, NULL,
                        (void*)ext_parser_thread,NULL)!=0)
@@ -601,7 +1252,15 @@ void btsnoop_open(char *p_path)
 {
 #if defined(BTSNOOPDISP_INCLUDED) && (BTSNOOPDISP_INCLUDED == TRUE)
     SYSLOGD("btsnoop_open");
-    btsnoop_log_open(p_path);
+    btsnoop_log_open(p_path, BTSNOOP_MODE_FILE);
+#endif // BTSNOOPDISP_INCLUDED
+}
+
+void btsnoop_open_flight(char *p_path)
+{
+#if defined(BTSNOOPDISP_INCLUDED) && (BTSNOOPDISP_INCLUDED == TRUE)
+    SYSLOGD("btsnoop_open_flight");
+    btsnoop_log_open(p_path, BTSNOOP_MODE_FLIGHT);
 #endif // BTSNOOPDISP_INCLUDED
 }
 
@@ -624,52 +1283,44 @@ void btsnoop_cleanup (void)
 }
 
 
-#define HCIT_TYPE_COMMAND   1
-#define HCIT_TYPE_ACL_DATA  2
-#define HCIT_TYPE_SCO_DATA  3
-#define HCIT_TYPE_EVENT     4
-
 void btsnoop_capture(HC_BT_HDR *p_buf, uint8_t is_rcvd)
 {
     uint8_t *p = (uint8_t *)(p_buf + 1) + p_buf->offset;
 
-    SNOOPDBG("btsnoop_capture: fd = %d, type %x, rcvd %d, ext %d", \
-             hci_btsnoop_fd, p_buf->event, is_rcvd, ext_parser_fd);
+    SNOOPDBG("btsnoop_capture: mode = %d, type %x, rcvd %d, ext %d", \
+             btsnoop_cb.mode, p_buf->event, is_rcvd, ext_parser_fd);
 
 #if defined(BTSNOOP_EXT_PARSER_INCLUDED) && (BTSNOOP_EXT_PARSER_INCLUDED == TRUE)
     if (ext_parser_fd > 0)
     {
-        uint8_t tmp = *p;
-
-        /* borrow one byte for H4 packet type indicator */
-        p--;
+        uint8_t type = 0;
 
         switch (p_buf->event & MSG_EVT_MASK)
         {
               case MSG_HC_TO_STACK_HCI_EVT:
-                  *p = HCIT_TYPE_EVENT;
+                  type = HCIT_TYPE_EVENT;
                   break;
               case MSG_HC_TO_STACK_HCI_ACL:
               case MSG_STACK_TO_HC_HCI_ACL:
-                  *p = HCIT_TYPE_ACL_DATA;
+                  type = HCIT_TYPE_ACL_DATA;
                   break;
               case MSG_HC_TO_STACK_HCI_SCO:
               case MSG_STACK_TO_HC_HCI_SCO:
-                  *p = HCIT_TYPE_SCO_DATA;
+                  type = HCIT_TYPE_SCO_DATA;
                   break;
               case MSG_STACK_TO_HC_HCI_CMD:
-                  *p = HCIT_TYPE_COMMAND;
+                  type = HCIT_TYPE_COMMAND;
                   break;
         }
 
-        send_ext_parser((char*)p, p_buf->len+1);
-        *(++p) = tmp;
+        /* copied into the ring, the ext_parser_thread does the sending */
+        ext_parser_enqueue(type, p, p_buf->len);
         return;
     }
 #endif
 
 #if defined(BTSNOOPDISP_INCLUDED) && (BTSNOOPDISP_INCLUDED == TRUE)
-    if (hci_btsnoop_fd == -1)
+    if (btsnoop_cb.mode == BTSNOOP_MODE_OFF)
         return;
 
     switch (p_buf->event & MSG_EVT_MASK)
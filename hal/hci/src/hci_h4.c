@@ -50,6 +50,11 @@
 #define HCIDBG(param, ...) {}
 #endif
 
+/* Max messages framed into one userial_write_batch */
+#ifndef H4_TX_BATCH_MAX
+#define H4_TX_BATCH_MAX 64
+#endif
+
 /* Preamble length for HCI Commands:
 **      2-bytes for opcode and 1 byte for length
 */
@@ -580,6 +585,89 @@ void hci_h4_cleanup(void)
     btsnoop_cleanup();
 }
 
+/*******************************************************************************
+**
+** Function        h4_tx_done
+**
+** Description     Finish a message once it has been handed to USERIAL:
+**                 restore the borrowed layer_specific byte, account the Cmd
+**                 credit, capture it to btsnoop and return the buffer. A
+**                 message that did not make it out is returned with
+**                 BT_HC_TX_FAIL and takes no credit.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void h4_tx_done(HC_BT_HDR *p_msg, uint16_t lay_spec,
+                       bt_hc_transmit_result_t result)
+{
+    uint16_t event = p_msg->event & MSG_EVT_MASK;
+    uint8_t *p;
+
+    p_msg->layer_specific = lay_spec;
+
+    if (event == MSG_STACK_TO_HC_HCI_CMD)
+    {
+        if (result == BT_HC_TX_SUCCESS)
+            H4_num_hci_cmd_pkts--;
+
+        /* If this is an internal Cmd packet, the layer_specific field would
+         * have stored with the opcode of HCI command.
+         * Retrieve the opcode from the Cmd packet.
+         */
+        p = ((uint8_t *)(p_msg + 1)) + p_msg->offset;
+        STREAM_TO_UINT16(lay_spec, p);
+    }
+
+    /* generate snoop trace message */
+    if (result == BT_HC_TX_SUCCESS)
+        btsnoop_capture(p_msg, FALSE);
+
+    if (bt_hc_cbacks)
+    {
+        if ((event == MSG_STACK_TO_HC_HCI_CMD) && \
+            (h4_cb.int_cmd_rsp_pending > 0) && \
+            (p_msg->layer_specific == lay_spec))
+        {
+            /* dealloc buffer of internal command */
+            bt_hc_cbacks->dealloc((TRANSAC) p_msg, (char *) (p_msg + 1));
+        }
+        else
+        {
+            bt_hc_cbacks->tx_result((TRANSAC) p_msg, (char *) (p_msg + 1), \
+                                        result);
+        }
+    }
+}
+
+/*******************************************************************************
+**
+** Function        h4_flush_batch
+**
+** Description     Write the framed messages of a batch with one
+**                 userial_write_batch and complete them, the ones a short
+**                 write left behind as failed
+**
+** Returns         None
+**
+*******************************************************************************/
+static void h4_flush_batch(HC_BT_HDR **pp_msg, struct iovec *iov,
+                           uint16_t *lay_spec, int n)
+{
+    int i, sent;
+
+    if (n == 0)
+        return;
+
+    sent = userial_write_batch(MSG_STACK_TO_HC_HCI_CMD, iov, n);
+    if (sent < n)
+        SYSLOGE("h4_flush_batch: short write, %d of %d packets failed", n - sent, n);
+
+    for (i = 0; i < n; i++)
+        h4_tx_done(pp_msg[i], lay_spec[i],
+                   (i < sent) ? BT_HC_TX_SUCCESS : BT_HC_TX_FAIL);
+}
+
 /*******************************************************************************
 **
 ** Function        hci_h4_send_msg
@@ -697,40 +785,77 @@ void hci_h4_send_msg(HC_BT_HDR *p_msg)
 
     bytes_sent = userial_write(event,(uint8_t *) p, bytes_to_send);
 
-    p_msg->layer_specific = lay_spec;
+    h4_tx_done(p_msg, lay_spec, BT_HC_TX_SUCCESS);
 
-    if (event == MSG_STACK_TO_HC_HCI_CMD)
-    {
-        H4_num_hci_cmd_pkts--;
+    return;
+}
 
-        /* If this is an internal Cmd packet, the layer_specific field would
-         * have stored with the opcode of HCI command.
-         * Retrieve the opcode from the Cmd packet.
-         */
-         p++;
-        STREAM_TO_UINT16(lay_spec, p);
-    }
+/*******************************************************************************
+**
+** Function        hci_h4_send_batch
+**
+** Description     Set the H4 packet indicator on every message of a tx batch
+**                 and flush them all with one userial_write_batch. ACL data
+**                 that needs fragmenting still goes through hci_h4_send_msg,
+**                 as its chunks are rewritten in place between writes.
+**
+** Returns         None
+**
+*******************************************************************************/
+void hci_h4_send_batch(HC_BT_HDR **pp_msg, int count)
+{
+    struct iovec iov[H4_TX_BATCH_MAX];
+    uint16_t lay_spec[H4_TX_BATCH_MAX];
+    HC_BT_HDR *p_msg;
+    uint16_t event, acl_pkt_size;
+    uint8_t *p;
+    int i, n = 0, first = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        p_msg = pp_msg[i];
+        event = p_msg->event & MSG_EVT_MASK;
 
-    /* generate snoop trace message */
-    btsnoop_capture(p_msg, FALSE);
+        if ((p_msg->event & MSG_SUB_EVT_MASK) == LOCAL_BR_EDR_CONTROLLER_ID)
+            acl_pkt_size = h4_cb.hc_acl_data_size + HCI_ACL_PREAMBLE_SIZE;
+        else
+            acl_pkt_size = h4_cb.hc_ble_acl_data_size + HCI_ACL_PREAMBLE_SIZE;
 
-    if (bt_hc_cbacks)
-    {
-        if ((event == MSG_STACK_TO_HC_HCI_CMD) && \
-            (h4_cb.int_cmd_rsp_pending > 0) && \
-            (p_msg->layer_specific == lay_spec))
+        if (((event == MSG_STACK_TO_HC_HCI_ACL) && (p_msg->len > acl_pkt_size)) ||
+            (n == H4_TX_BATCH_MAX))
         {
-            /* dealloc buffer of internal command */
-            bt_hc_cbacks->dealloc((TRANSAC) p_msg, (char *) (p_msg + 1));
+            h4_flush_batch(&pp_msg[first], iov, lay_spec, n);
+            n = 0;
+            first = i;
+
+            if (event == MSG_STACK_TO_HC_HCI_ACL && p_msg->len > acl_pkt_size)
+            {
+                hci_h4_send_msg(p_msg);
+                first = i + 1;
+                continue;
+            }
         }
+
+        /* remember layer_specific because uart borrow
+           one byte from layer_specific for packet type */
+        lay_spec[n] = p_msg->layer_specific;
+
+        p = ((uint8_t *)(p_msg + 1)) + p_msg->offset - 1;
+        if (event == MSG_STACK_TO_HC_HCI_ACL)
+            *p = H4_TYPE_ACL_DATA;
+        else if (event == MSG_STACK_TO_HC_HCI_SCO)
+            *p = H4_TYPE_SCO_DATA;
+        else if (event == MSG_STACK_TO_HC_HCI_CMD)
+            *p = H4_TYPE_COMMAND;
         else
-        {
-            bt_hc_cbacks->tx_result((TRANSAC) p_msg, (char *) (p_msg + 1), \
-                                        BT_HC_TX_SUCCESS);
-        }
+            *p = 0;
+
+        iov[n].iov_base = p;
+        iov[n].iov_len = p_msg->len + 1;    /* message_size + message type */
+        n++;
     }
 
-    return;
+    h4_flush_batch(&pp_msg[first], iov, lay_spec, n);
 }
 
 
@@ -1070,6 +1195,7 @@ const tHCI_IF hci_h4_func_table =
     hci_h4_init,
     hci_h4_cleanup,
     hci_h4_send_msg,
+    hci_h4_send_batch,
     hci_h4_send_int_cmd,
     hci_h4_get_acl_data_length,
     hci_h4_receive_msg
@@ -46,6 +46,7 @@
 #include "utils.h"
 #include "bt_skbuff.h"
 #include "bt_list.h"
+#include "bt_timer.h"
 
 /******************************************************************************
 **  Constants & Macros
@@ -55,11 +56,10 @@
 
 uint8_t h5_log_enable = 0;
 
-#define TIMER_H5_DATA_RETRANS (SIGRTMAX)
-#define TIMER_H5_SYNC_RETRANS (SIGRTMAX -1)
-#define TIMER_H5_CONF_RETRANS (SIGRTMAX -2)
-#define TIMER_H5_WAIT_CT_BAUDRATE_READY (SIGRTMAX -3)
-#define TIMER_H5_HW_INIT_READY        (SIGRTMAX -4)
+/* Staging buffer to flush consecutive SLIP frames with one write */
+#ifndef H5_TX_COALESCE_SIZE
+#define H5_TX_COALESCE_SIZE 4096
+#endif
 
 #define DATA_RETRANS_COUNT  40  //40*100 = 4000ms(4s)
 #define SYNC_RETRANS_COUNT  20  //20*250 = 5000ms(5s)
@@ -262,11 +262,11 @@ typedef struct HCI_H5_CB
     sk_buff *rx_skb;
     sk_buff* host_last_cmd;
 
-    timer_t  timer_data_retrans;
-    timer_t  timer_sync_retrans;
-    timer_t  timer_conf_retrans;
-    timer_t  timer_wait_ct_baudrate_ready;
-    timer_t  timer_h5_hw_init_ready;
+    tBT_TIMER timer_data_retrans;
+    tBT_TIMER timer_sync_retrans;
+    tBT_TIMER timer_conf_retrans;
+    tBT_TIMER timer_wait_ct_baudrate_ready;
+    tBT_TIMER timer_h5_hw_init_ready;
 
     uint32_t data_retrans_count;
     uint32_t sync_retrans_count;
@@ -285,6 +285,8 @@ typedef struct HCI_H5_CB
 
 static tHCI_H5_CB rtk_h5;
 static pthread_mutex_t h5_wakeup_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* SLIP frames of one h5_wake_up, guarded by h5_wakeup_mutex */
+static uint8_t h5_tx_buf[H5_TX_COALESCE_SIZE];
 
 /******************************************************************************
 **  Variables
@@ -1421,6 +1423,7 @@ static void h5_wake_up()
     sk_buff *skb = NULL;
     uint8_t * data = NULL;
     uint32_t data_len = 0;
+    uint32_t tx_len = 0;
 
     pthread_mutex_lock(&h5_wakeup_mutex);
     LogMsg("h5_wake_up++");
@@ -1428,9 +1431,6 @@ static void h5_wake_up()
     {
         data = skb_get_data(skb);
         data_len = skb_get_data_length(skb);
-        bytes_sent = userial_write(0, data, data_len);
-
-        LogMsg("bytes_sent(%d)", bytes_sent);
 
 #if H5_TRACE_DATA_ENABLE
         {
@@ -1447,8 +1447,34 @@ static void h5_wake_up()
             }
         }
 #endif
+        /* SLIP frames are self delimiting, so back-to-back frames can go
+         * out in one userial_write */
+        if (tx_len + data_len > H5_TX_COALESCE_SIZE)
+        {
+            bytes_sent = userial_write(0, h5_tx_buf, tx_len);
+            LogMsg("bytes_sent(%d)", bytes_sent);
+            tx_len = 0;
+        }
+
+        if (data_len > H5_TX_COALESCE_SIZE)
+        {
+            bytes_sent = userial_write(0, data, data_len);
+            LogMsg("bytes_sent(%d)", bytes_sent);
+        }
+        else
+        {
+            memcpy(h5_tx_buf + tx_len, data, data_len);
+            tx_len += data_len;
+        }
+
         skb_free(&skb);
     }
+
+    if (tx_len)
+    {
+        bytes_sent = userial_write(0, h5_tx_buf, tx_len);
+        LogMsg("bytes_sent(%d)", bytes_sent);
+    }
     LogMsg("h5_wake_up--");
 
     pthread_mutex_unlock(&h5_wakeup_mutex);
@@ -2706,6 +2732,8 @@ void hci_h5_cleanup(void)
     RtbQueueFree(rtk_h5.unrel);
     ConnHashFlush(&rtk_h5);
 
+    RtbPoolDumpStats();
+
     LogMsg("hci_h5_cleanup--");
 
 }
@@ -2716,15 +2744,16 @@ void hci_h5_cleanup(void)
 
 /*******************************************************************************
 **
-** Function        hci_h5_send_msg
+** Function        h5_queue_msg
 **
 ** Description     Determine message type, set HCI H5 packet indicator, and
-**                 send message through USERIAL driver
+**                 queue the message to the H5 link. Nothing is written to
+**                 USERIAL until h5_wake_up.
 **
 ** Returns         None
 **
 *******************************************************************************/
-void hci_h5_send_msg(HC_BT_HDR *p_msg)
+static void h5_queue_msg(HC_BT_HDR *p_msg)
 {
     uint8_t type = 0;
     uint16_t handle;
@@ -2937,10 +2966,46 @@ void hci_h5_send_msg(HC_BT_HDR *p_msg)
         }
     }
 
-    h5_wake_up();
     return;
 }
 
+/*******************************************************************************
+**
+** Function        hci_h5_send_msg
+**
+** Description     Queue one message to the H5 link and push out whatever the
+**                 sliding window allows
+**
+** Returns         None
+**
+*******************************************************************************/
+void hci_h5_send_msg(HC_BT_HDR *p_msg)
+{
+    h5_queue_msg(p_msg);
+    h5_wake_up();
+}
+
+/*******************************************************************************
+**
+** Function        hci_h5_send_batch
+**
+** Description     Queue a whole tx batch to the H5 link before waking the
+**                 transmitter, so the resulting SLIP frames leave in one
+**                 contiguous userial_write
+**
+** Returns         None
+**
+*******************************************************************************/
+void hci_h5_send_batch(HC_BT_HDR **pp_msg, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        h5_queue_msg(pp_msg[i]);
+
+    h5_wake_up();
+}
+
 
 /*******************************************************************************
 **
@@ -3091,79 +3156,13 @@ void hci_h5_get_acl_data_length(void)
 
 /***
     Timer related functions
-*/
-static timer_t OsAllocateTimer(int signo)
-{
-    struct sigevent sigev;
-    timer_t timerid;
-
-    // Create the POSIX timer to generate signo
-    sigev.sigev_notify = SIGEV_SIGNAL;
-    sigev.sigev_signo = signo;
-    sigev.sigev_value.sival_ptr = &timerid;
-
-    //Create the Timer using timer_create signal
-
-    if (timer_create(CLOCK_REALTIME, &sigev, &timerid) == 0)
-    {
-            return timerid;
-    }
-    else
-    {
-        SYSLOGE("timer_create error!");
-        return (timer_t)-1;
-    }
-}
-
- int OsFreeTimer(timer_t timerid)
-{
-    int ret = 0;
-    ret = timer_delete(timerid);
-    if(ret != 0)
-        SYSLOGE("timer_delete fail with errno(%d)", errno);
-
-    return ret;
-}
-
-
- static int OsStartTimer(timer_t timerid, int msec, int mode)
- {
-    struct itimerspec itval;
-
-    itval.it_value.tv_sec = msec / 1000;
-    itval.it_value.tv_nsec = (long)(msec % 1000) * (1000000L);
-
-    if (mode == 1)
-
-    {
-        itval.it_interval.tv_sec    = itval.it_value.tv_sec;
-        itval.it_interval.tv_nsec = itval.it_value.tv_nsec;
-    }
-    else
-    {
-        itval.it_interval.tv_sec = 0;
-        itval.it_interval.tv_nsec = 0;
-    }
-
-    //Set the Timer when to expire through timer_settime
-
-    if (timer_settime(timerid, 0, &itval, NULL) != 0)
-    {
-        SYSLOGE("time_settime error!");
-        return -1;
-    }
-
-    return 0;
-
-}
-
- static int OsStopTimer(timer_t timerid)
- {
-    return OsStartTimer(timerid, 0, 0);
- }
 
-static void h5_timeout_handler(int signo, siginfo_t * info, void *context)
+    All H5 timers run on the shared bt_timer wheel; the expiry callback gets
+    the timer itself as context and dispatches on it.
+*/
+static void h5_timeout_handler(void *p_context)
  {
+    tBT_TIMER *p_timer = (tBT_TIMER *)p_context;
 
     SYSLOGE("h5_timeout_handler");
     if(rtk_h5.cleanuping)
@@ -3171,12 +3170,12 @@ static void h5_timeout_handler(int signo, siginfo_t * info, void *context)
         SYSLOGE("H5 is cleanuping, EXIT here!");
         return;
     }
-    if (signo == TIMER_H5_DATA_RETRANS)
+    if (p_timer == &rtk_h5.timer_data_retrans)
     {
         h5_retransfer_signal_event(H5_EVENT_RX);
     }
     else
-    if (signo == TIMER_H5_SYNC_RETRANS)
+    if (p_timer == &rtk_h5.timer_sync_retrans)
     {
         SYSLOGE("Wait H5 Sync Resp timeout, %d times", rtk_h5.sync_retrans_count);
         if(rtk_h5.sync_retrans_count < SYNC_RETRANS_COUNT)
@@ -3190,7 +3189,7 @@ static void h5_timeout_handler(int signo, siginfo_t * info, void *context)
         }
     }
     else
-    if (signo == TIMER_H5_CONF_RETRANS)
+    if (p_timer == &rtk_h5.timer_conf_retrans)
     {
         SYSLOGE("Wait H5 Conf Resp timeout, %d times", rtk_h5.conf_retrans_count);
         if(rtk_h5.conf_retrans_count < CONF_RETRANS_COUNT)
@@ -3203,7 +3202,7 @@ static void h5_timeout_handler(int signo, siginfo_t * info, void *context)
             h5_stop_conf_retrans_timer();
         }
     }
-    else if (signo == TIMER_H5_WAIT_CT_BAUDRATE_READY) {
+    else if (p_timer == &rtk_h5.timer_wait_ct_baudrate_ready) {
         SYSLOGI("No Controller retransfer, baudrate of controller ready");
         if (rtk_h5.cback_h5sync) {
             rtk_h5.cback_h5sync(rtk_h5.p_rcv_msg);
@@ -3217,7 +3216,7 @@ static void h5_timeout_handler(int signo, siginfo_t * info, void *context)
         }
     }
     else
-    if (signo == TIMER_H5_HW_INIT_READY)
+    if (p_timer == &rtk_h5.timer_h5_hw_init_ready)
     {
         LogMsg("TIMER_H5_HW_INIT_READY timeout, kill restart BT");
         kill(getpid(), SIGKILL);
@@ -3225,213 +3224,124 @@ static void h5_timeout_handler(int signo, siginfo_t * info, void *context)
     }
     else
     {
-        SYSLOGE("H5 timer rx unspported signo(%d)", signo);
+        SYSLOGE("H5 timer rx unspported timer(%p)", p_timer);
     }
 }
 
 int h5_alloc_data_retrans_timer()
- {
-    struct sigaction sigact;
-
-    sigemptyset(&sigact.sa_mask);
-    sigact.sa_flags = SA_SIGINFO;
-
-    //register the Signal Handler
-    sigact.sa_sigaction = h5_timeout_handler;
-
-    // Set up sigaction to catch signal first timer
-    if (sigaction(TIMER_H5_DATA_RETRANS, &sigact, NULL) == -1)
-    {
-        LogMsg("sigaction failed");
-        return -1;
-    }
-
-    // Create and set the timer when to expire
-    rtk_h5.timer_data_retrans = OsAllocateTimer(TIMER_H5_DATA_RETRANS);
-
+{
+    bt_timer_setup(&rtk_h5.timer_data_retrans, h5_timeout_handler, &rtk_h5.timer_data_retrans);
     return 0;
-
- }
-
+}
 
 int h5_free_data_retrans_timer()
 {
-    return OsFreeTimer(rtk_h5.timer_data_retrans);
+    bt_timer_stop(&rtk_h5.timer_data_retrans);
+    return 0;
 }
 
-
 int h5_start_data_retrans_timer()
 {
-    return OsStartTimer(rtk_h5.timer_data_retrans, DATA_RETRANS_TIMEOUT_VALUE, 0);
+    return bt_timer_start(&rtk_h5.timer_data_retrans, DATA_RETRANS_TIMEOUT_VALUE, 0);
 }
 
 int h5_stop_data_retrans_timer()
 {
-    return OsStopTimer(rtk_h5.timer_data_retrans);
+    bt_timer_stop(&rtk_h5.timer_data_retrans);
+    return 0;
 }
 
 int h5_alloc_sync_retrans_timer()
- {
-    struct sigaction sigact;
-
-    sigemptyset(&sigact.sa_mask);
-    sigact.sa_flags = SA_SIGINFO;
-
-    //register the Signal Handler
-    sigact.sa_sigaction = h5_timeout_handler;
-
-    // Set up sigaction to catch signal first timer
-    if (sigaction(TIMER_H5_SYNC_RETRANS, &sigact, NULL) == -1)
-    {
-        LogMsg("sigaction failed");
-        return -1;
-    }
-
-    // Create and set the timer when to expire
-    rtk_h5.timer_sync_retrans = OsAllocateTimer(TIMER_H5_SYNC_RETRANS);
-
+{
+    bt_timer_setup(&rtk_h5.timer_sync_retrans, h5_timeout_handler, &rtk_h5.timer_sync_retrans);
     return 0;
-
- }
+}
 
 int h5_free_sync_retrans_timer()
 {
-    return OsFreeTimer(rtk_h5.timer_sync_retrans);
+    bt_timer_stop(&rtk_h5.timer_sync_retrans);
+    return 0;
 }
 
-
 int h5_start_sync_retrans_timer()
 {
-    return OsStartTimer(rtk_h5.timer_sync_retrans, SYNC_RETRANS_TIMEOUT_VALUE, 1);
+    return bt_timer_start(&rtk_h5.timer_sync_retrans, SYNC_RETRANS_TIMEOUT_VALUE, 1);
 }
 
 int h5_stop_sync_retrans_timer()
 {
-    return OsStopTimer(rtk_h5.timer_sync_retrans);
+    bt_timer_stop(&rtk_h5.timer_sync_retrans);
+    return 0;
 }
 
-
 int h5_alloc_conf_retrans_timer()
- {
-    struct sigaction sigact;
-
-    sigemptyset(&sigact.sa_mask);
-    sigact.sa_flags = SA_SIGINFO;
-
-    //register the Signal Handler
-    sigact.sa_sigaction = h5_timeout_handler;
-
-    // Set up sigaction to catch signal first timer
-    if (sigaction(TIMER_H5_CONF_RETRANS, &sigact, NULL) == -1)
-    {
-        LogMsg("sigaction failed");
-        return -1;
-    }
-
-    // Create and set the timer when to expire
-    rtk_h5.timer_conf_retrans = OsAllocateTimer(TIMER_H5_CONF_RETRANS);
-
+{
+    bt_timer_setup(&rtk_h5.timer_conf_retrans, h5_timeout_handler, &rtk_h5.timer_conf_retrans);
     return 0;
-
- }
+}
 
 int h5_free_conf_retrans_timer()
 {
-    return OsFreeTimer(rtk_h5.timer_conf_retrans);
+    bt_timer_stop(&rtk_h5.timer_conf_retrans);
+    return 0;
 }
 
-
 int h5_start_conf_retrans_timer()
 {
-    return OsStartTimer(rtk_h5.timer_conf_retrans, CONF_RETRANS_TIMEOUT_VALUE, 1);
+    return bt_timer_start(&rtk_h5.timer_conf_retrans, CONF_RETRANS_TIMEOUT_VALUE, 1);
 }
 
 int h5_stop_conf_retrans_timer()
 {
-    return OsStopTimer(rtk_h5.timer_conf_retrans);
+    bt_timer_stop(&rtk_h5.timer_conf_retrans);
+    return 0;
 }
 
-
-
 int h5_alloc_wait_controller_baudrate_ready_timer()
- {
-    struct sigaction sigact;
-
-    sigemptyset(&sigact.sa_mask);
-    sigact.sa_flags = SA_SIGINFO;
-
-    //register the Signal Handler
-    sigact.sa_sigaction = h5_timeout_handler;
-
-    // Set up sigaction to catch signal first timer
-    if (sigaction(TIMER_H5_WAIT_CT_BAUDRATE_READY, &sigact, NULL) == -1)
-    {
-        LogMsg("sigaction failed");
-        return -1;
-    }
-
-    // Create and set the timer when to expire
-    rtk_h5.timer_wait_ct_baudrate_ready = OsAllocateTimer(TIMER_H5_WAIT_CT_BAUDRATE_READY);
-
+{
+    bt_timer_setup(&rtk_h5.timer_wait_ct_baudrate_ready, h5_timeout_handler,
+                   &rtk_h5.timer_wait_ct_baudrate_ready);
     return 0;
-
- }
+}
 
 int h5_free_wait_controller_baudrate_ready_timer()
 {
-    return OsFreeTimer(rtk_h5.timer_wait_ct_baudrate_ready);
+    bt_timer_stop(&rtk_h5.timer_wait_ct_baudrate_ready);
+    return 0;
 }
 
-
 int h5_start_wait_controller_baudrate_ready_timer()
 {
-    return OsStartTimer(rtk_h5.timer_wait_ct_baudrate_ready, WAIT_CT_BAUDRATE_READY_TIMEOUT_VALUE, 0);
+    return bt_timer_start(&rtk_h5.timer_wait_ct_baudrate_ready, WAIT_CT_BAUDRATE_READY_TIMEOUT_VALUE, 0);
 }
 
 int h5_stop_wait_controller_baudrate_ready_timer()
 {
-    return OsStopTimer(rtk_h5.timer_wait_ct_baudrate_ready);
+    bt_timer_stop(&rtk_h5.timer_wait_ct_baudrate_ready);
+    return 0;
 }
 
-
 int h5_alloc_hw_init_ready_timer()
- {
-    struct sigaction sigact;
-
-    sigemptyset(&sigact.sa_mask);
-    sigact.sa_flags = SA_SIGINFO;
-
-    //register the Signal Handler
-    sigact.sa_sigaction = h5_timeout_handler;
-
-    // Set up sigaction to catch signal first timer
-    if (sigaction(TIMER_H5_HW_INIT_READY, &sigact, NULL) == -1)
-    {
-        LogMsg("sigaction failed");
-        return -1;
-    }
-
-    // Create and set the timer when to expire
-    rtk_h5.timer_h5_hw_init_ready = OsAllocateTimer(TIMER_H5_HW_INIT_READY);
-
+{
+    bt_timer_setup(&rtk_h5.timer_h5_hw_init_ready, h5_timeout_handler, &rtk_h5.timer_h5_hw_init_ready);
     return 0;
-
- }
+}
 
 int h5_free_hw_init_ready_timer()
 {
-    return OsFreeTimer(rtk_h5.timer_h5_hw_init_ready);
+    bt_timer_stop(&rtk_h5.timer_h5_hw_init_ready);
+    return 0;
 }
 
-
 int h5_start_hw_init_ready_timer()
 {
-    return OsStartTimer(rtk_h5.timer_h5_hw_init_ready, H5_HW_INIT_READY_TIMEOUT_VALUE, 0);
+    return bt_timer_start(&rtk_h5.timer_h5_hw_init_ready, H5_HW_INIT_READY_TIMEOUT_VALUE, 0);
 }
 
 int h5_stop_hw_init_ready_timer()
 {
-    return OsStopTimer(rtk_h5.timer_h5_hw_init_ready);
+    bt_timer_stop(&rtk_h5.timer_h5_hw_init_ready);
+    return 0;
 }
 
 
@@ -3444,6 +3354,7 @@ const tHCI_IF hci_h5_func_table =
     hci_h5_init,
     hci_h5_cleanup,
     hci_h5_send_msg,
+    hci_h5_send_batch,
     hci_h5_send_int_cmd,
     hci_h5_get_acl_data_length,
     hci_h5_receive_msg
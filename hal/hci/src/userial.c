@@ -32,7 +32,11 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <errno.h>
-#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <sys/prctl.h>
 #include <linux/sched.h>
 
@@ -59,11 +63,18 @@
 
 #define READ_LIMIT (BTHC_USERIAL_READ_MEM_SIZE - BT_HC_HDR_SIZE)
 
-enum {
-    USERIAL_RX_EXIT,
-    USERIAL_RX_FLOW_OFF,
-    USERIAL_RX_FLOW_ON
-};
+/* Number of preallocated rx buffers, must be a power of 2 */
+#ifndef USERIAL_RX_RING_SIZE
+#define USERIAL_RX_RING_SIZE 16
+#endif
+#define USERIAL_RX_RING_MASK (USERIAL_RX_RING_SIZE - 1)
+
+/* Max read() calls drained per wakeup before signalling the worker */
+#ifndef USERIAL_RX_BATCH_MAX
+#define USERIAL_RX_BATCH_MAX 8
+#endif
+
+#define USERIAL_EPOLL_MAX_EVENTS 2
 
 /******************************************************************************
 **  Externs
@@ -75,11 +86,22 @@ extern bt_vendor_interface_t *bt_vnd_if;
 **  Local type definitions
 ******************************************************************************/
 
+typedef struct {
+    HC_BT_HDR       hdr;
+    uint8_t         data[READ_LIMIT];
+} tUSERIAL_RX_BUF;
+
 typedef struct {
     int             fd;
+    int             epoll_fd;
+    int             event_fd;
     pthread_t       read_thread;
-    BUFFER_Q        rx_q;
-    HC_BT_HDR      *p_rx_hdr;
+    uint32_t        fd_events;      /* epoll interest currently set on fd */
+    uint8_t         is_sock;        /* packet socket (bluez USB), batch reads */
+    volatile uint8_t rx_flow_on;    /* requested by userial_ioctl */
+    volatile uint8_t rx_starved;    /* reader parked on a full ring */
+    volatile uint32_t rx_head;      /* next slot to fill, reader only */
+    volatile uint32_t rx_tail;      /* next slot to drain, consumer only */
 } tUSERIAL_CB;
 
 /******************************************************************************
@@ -88,117 +110,259 @@ typedef struct {
 
 static tUSERIAL_CB userial_cb;
 static volatile uint8_t userial_running = 0;
+static tUSERIAL_RX_BUF userial_rx_ring[USERIAL_RX_RING_SIZE];
 
 /******************************************************************************
 **  Static functions
 ******************************************************************************/
 
 /*****************************************************************************
-**   Socket signal functions to wake up userial_read_thread for termination
+**   Eventfd doorbell to wake up userial_read_thread
 **
-**   creating an unnamed pair of connected sockets
-**      - signal_fds[0]: join fd_set in select call of userial_read_thread
-**      - signal_fds[1]: trigger from userial_close
+**   The requested state (userial_running, rx_flow_on, ring space) is kept in
+**   userial_cb; the doorbell only makes the reader re-evaluate it.
 *****************************************************************************/
-static int signal_fds[2]={0,1};
-static uint8_t rx_flow_on = TRUE;
-static inline int create_signal_fds(fd_set* set)
+static inline void userial_kick(void)
 {
-    if(signal_fds[0]==0 && socketpair(AF_UNIX, SOCK_STREAM, 0, signal_fds)<0)
-    {
-        SYSLOGE("create_signal_sockets:socketpair failed, errno: %d", errno);
-        return -1;
-    }
-    FD_SET(signal_fds[0], set);
-    return signal_fds[0];
+    if (userial_cb.event_fd >= 0 && eventfd_write(userial_cb.event_fd, 1) < 0)
+        SYSLOGE("userial_kick: eventfd_write failed, errno: %d", errno);
 }
-static inline int send_wakeup_signal(char sig_cmd)
+
+/*******************************************************************************
+**
+** Function        userial_update_fd_events
+**
+** Description     Arm or disarm EPOLLIN on the port according to rx flow
+**                 control and ring occupancy
+**
+** Returns         None
+**
+*******************************************************************************/
+static void userial_update_fd_events(void)
 {
-    return send(signal_fds[1], &sig_cmd, sizeof(sig_cmd), 0);
+    struct epoll_event ev;
+    uint32_t events = 0;
+
+    if (userial_cb.rx_flow_on == TRUE && !userial_cb.rx_starved)
+        events = EPOLLIN;
+
+    if (events == userial_cb.fd_events)
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = userial_cb.fd;
+    if (epoll_ctl(userial_cb.epoll_fd, EPOLL_CTL_MOD, userial_cb.fd, &ev) < 0)
+    {
+        SYSLOGE("userial: epoll_ctl MOD failed, errno: %d", errno);
+        return;
+    }
+
+    USERIALDBG("RX %s", events ? "armed" : "parked");
+    userial_cb.fd_events = events;
 }
-static inline char reset_signal()
+
+/*******************************************************************************
+**
+** Function        userial_ring_full
+**
+** Description     Check for a free rx slot. If there is none, mark the reader
+**                 as starved so that userial_read kicks it once a slot is
+**                 released.
+**
+** Returns         TRUE if the ring is full
+**
+*******************************************************************************/
+static uint8_t userial_ring_full(void)
 {
-    char sig_recv = -1;
-    recv(signal_fds[0], &sig_recv, sizeof(sig_recv), MSG_WAITALL);
-    return sig_recv;
+    if (userial_cb.rx_head - userial_cb.rx_tail < USERIAL_RX_RING_SIZE)
+        return FALSE;
+
+    userial_cb.rx_starved = TRUE;
+    __sync_synchronize();
+
+    /* Consumer may have drained a slot before it could see rx_starved */
+    if (userial_cb.rx_head - userial_cb.rx_tail < USERIAL_RX_RING_SIZE)
+    {
+        userial_cb.rx_starved = FALSE;
+        return FALSE;
+    }
+
+    return TRUE;
 }
-static inline int is_signaled(fd_set* set)
+
+/*******************************************************************************
+**
+** Function        userial_fill_ring_batch
+**
+** Description     Pull up to max queued packets off a packet socket into free
+**                 ring slots with a single syscall, one packet per slot
+**
+** Returns         -1: error, errno set (EAGAIN when nothing is queued)
+**                 >0: numbers of slots filled
+**
+*******************************************************************************/
+static int userial_fill_ring_batch(int max)
 {
-    return FD_ISSET(signal_fds[0], set);
-}
+    struct iovec iov[USERIAL_RX_BATCH_MAX];
+    uint16_t lens[USERIAL_RX_BATCH_MAX];
+    tUSERIAL_RX_BUF *p_slot;
+    uint32_t head = userial_cb.rx_head;
+    int room, i, ret;
+
+    room = USERIAL_RX_RING_SIZE - (int)(head - userial_cb.rx_tail);
+    if (max > room)
+        max = room;
+    if (max > USERIAL_RX_BATCH_MAX)
+        max = USERIAL_RX_BATCH_MAX;
+
+    for (i = 0; i < max; i++)
+    {
+        iov[i].iov_base = userial_rx_ring[(head + i) & USERIAL_RX_RING_MASK].data;
+        iov[i].iov_len = READ_LIMIT;
+    }
+
+    ret = hci_bluez_read_batch(userial_cb.fd, iov, lens, max);
+    if (ret <= 0)
+        return -1;
+
+    for (i = 0; i < ret; i++)
+    {
+        p_slot = &userial_rx_ring[(head + i) & USERIAL_RX_RING_MASK];
+        p_slot->hdr.offset = 0;
+        p_slot->hdr.layer_specific = 0;
+        p_slot->hdr.len = lens[i];
+    }
 
+    /* Publish slot contents before the new head */
+    __sync_synchronize();
+    userial_cb.rx_head = head + ret;
+
+    return ret;
+}
 
 /*******************************************************************************
 **
-** Function        select_read
+** Function        userial_fill_ring
 **
-** Description     check if fd is ready for reading and listen for termination
-**                  signal. need to use select in order to avoid collision
-**                  between read and close on the same fd
+** Description     Drain the port into free ring slots until it would block,
+**                 the ring is full or the batch limit is reached
 **
-** Returns         -1: termination
-**                 >=0: numbers of bytes read back from fd
+** Returns         -1: port error or closed
+**                 >=0: numbers of slots filled
 **
 *******************************************************************************/
-static int select_read(int fd, uint8_t *pbuf, int len)
+static int userial_fill_ring(void)
 {
-    fd_set input;
-    int n = 0, ret = -1;
-    char reason = 0;
+    tUSERIAL_RX_BUF *p_slot;
+    int filled = 0;
+    ssize_t ret;
 
-    while (userial_running)
+    while (filled < USERIAL_RX_BATCH_MAX)
     {
-        /* Initialize the input fd set */
-        FD_ZERO(&input);
-        if (rx_flow_on == TRUE)
-        {
-            FD_SET(fd, &input);
-        }
-        int fd_max = create_signal_fds(&input);
-        fd_max = fd_max > fd ? fd_max : fd;
+        if (userial_ring_full())
+            break;
 
-        /* Do the select */
-        n = select(fd_max+1, &input, NULL, NULL, NULL);
-        if(is_signaled(&input))
+        if (userial_cb.is_sock)
         {
-            reason = reset_signal();
-            if (reason == USERIAL_RX_EXIT)
+            ret = userial_fill_ring_batch(USERIAL_RX_BATCH_MAX - filled);
+            if (ret > 0)
             {
-                USERIALDBG("RX termination");
-                return -1;
-            }
-            else if (reason == USERIAL_RX_FLOW_OFF)
-            {
-                USERIALDBG("RX flow OFF");
-                rx_flow_on = FALSE;
+                filled += ret;
+                continue;
             }
-            else if (reason == USERIAL_RX_FLOW_ON)
+        }
+        else
+        {
+            p_slot = &userial_rx_ring[userial_cb.rx_head & USERIAL_RX_RING_MASK];
+
+            ret = read(userial_cb.fd, p_slot->data, READ_LIMIT);
+            if (ret > 0)
             {
-                USERIALDBG("RX flow ON");
-                rx_flow_on = TRUE;
+                p_slot->hdr.offset = 0;
+                p_slot->hdr.layer_specific = 0;
+                p_slot->hdr.len = (uint16_t)ret;
+
+                /* Publish slot contents before the new head */
+                __sync_synchronize();
+                userial_cb.rx_head++;
+                filled++;
+                continue;
             }
         }
 
-        if (n > 0)
+        if (ret < 0 && errno == EINTR)
+            continue;
+
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        if (ret == 0)
+            SYSLOGW("read() returned 0!");
+        else
+            SYSLOGE("read() failed, errno: %d", errno);
+
+        return -1;
+    }
+
+    return filled;
+}
+
+/*******************************************************************************
+**
+** Function        userial_service
+**
+** Description     Wait up to timeout_ms for the port or the doorbell, drain
+**                 the port into the ring and re-arm the port events
+**
+** Returns         -1: port error or closed
+**                 >=0: numbers of slots filled
+**
+*******************************************************************************/
+static int userial_service(int timeout_ms)
+{
+    struct epoll_event events[USERIAL_EPOLL_MAX_EVENTS];
+    eventfd_t val;
+    int n, i, filled = 0;
+
+    n = epoll_wait(userial_cb.epoll_fd, events, USERIAL_EPOLL_MAX_EVENTS, timeout_ms);
+    if (n < 0)
+    {
+        if (errno == EINTR)
+            return 0;
+        SYSLOGE("epoll_wait() failed, errno: %d", errno);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (events[i].data.fd == userial_cb.event_fd)
+        {
+            eventfd_read(userial_cb.event_fd, &val);
+            continue;
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
         {
-            /* We might have input */
-            if (FD_ISSET(fd, &input))
+            filled = userial_fill_ring();
+            if (filled < 0)
             {
-                ret = hci_bluez_read(fd, pbuf, (size_t)len);
-                if (0 == ret)
-                    SYSLOGW( "read() returned 0!" );
-
-                return ret;
+                userial_running = 0;
+                return -1;
             }
         }
-        else if (n < 0)
-            SYSLOGW( "select() Failed");
-        else if (n == 0)
-            SYSLOGW( "Got a select() TIMEOUT");
-
     }
 
-    return ret;
+    if (!userial_running)
+        return filled;
+
+    if (userial_cb.rx_starved &&
+        userial_cb.rx_head - userial_cb.rx_tail < USERIAL_RX_RING_SIZE)
+        userial_cb.rx_starved = FALSE;
+
+    userial_update_fd_events();
+
+    return filled;
 }
 
 /*******************************************************************************
@@ -212,60 +376,24 @@ static int select_read(int fd, uint8_t *pbuf, int len)
 *******************************************************************************/
 static void *userial_read_thread(void *arg)
 {
-    int rx_length = 0;
-    HC_BT_HDR *p_buf = NULL;
-    uint8_t *p;
+    int filled;
 
     USERIALDBG("Entering userial_read_thread()");
     prctl(PR_SET_NAME, (unsigned long)"userial_read", 0, 0, 0);
 
-    rx_flow_on = TRUE;
-    userial_running = 1;
-
-
     while (userial_running)
     {
-        if (bt_hc_cbacks)
+        filled = userial_service(-1);
+        if (filled < 0)
         {
-            p_buf = (HC_BT_HDR *) bt_hc_cbacks->alloc( \
-                                                BTHC_USERIAL_READ_MEM_SIZE);
-        }
-        else
-            p_buf = NULL;
-
-        if (p_buf != NULL)
-        {
-            p_buf->offset = 0;
-            p_buf->layer_specific = 0;
-
-            p = (uint8_t *) (p_buf + 1);
-            rx_length = select_read(userial_cb.fd, p, READ_LIMIT);
-        }
-        else
-        {
-            rx_length = 0;
-            utils_delay(100);
-            SYSLOGW("userial_read_thread() failed to gain buffers");
-            continue;
+            SYSLOGW("exiting userial_read_thread");
+            break;
         }
 
-
-        if (rx_length > 0)
-        {
-            p_buf->len = (uint16_t)rx_length;
-            utils_enqueue(&(userial_cb.rx_q), p_buf);
+        /* One worker wakeup per batch of reads */
+        if (filled > 0)
             bthc_signal_event(HC_EVENT_RX);
-        }
-        else /* either 0 or < 0 */
-        {
-            SYSLOGW("select_read return size <=0:%d, exiting userial_read_thread",
-                    rx_length);
-            /* if we get here, we should have a buffer */
-            bt_hc_cbacks->dealloc((TRANSAC) p_buf, (char *) (p_buf + 1));
-            /* negative value means exit thread */
-            break;
-        }
-    } /* for */
+    }
 
     userial_running = 0;
     USERIALDBG("Leaving userial_read_thread()");
@@ -274,6 +402,85 @@ static void *userial_read_thread(void *arg)
     return NULL;    // Compiler friendly
 }
 
+/*******************************************************************************
+**
+** Function        userial_poll_setup
+**
+** Description     Create the epoll set and eventfd doorbell for the port
+**
+** Returns         TRUE/FALSE
+**
+*******************************************************************************/
+static uint8_t userial_poll_setup(void)
+{
+    struct epoll_event ev;
+    int flags;
+
+    /* Reader drains the port until EAGAIN */
+    flags = fcntl(userial_cb.fd, F_GETFL);
+    if (flags < 0 || fcntl(userial_cb.fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        SYSLOGE("userial_open: failed to set O_NONBLOCK, errno: %d", errno);
+        return FALSE;
+    }
+
+    userial_cb.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (userial_cb.epoll_fd < 0)
+    {
+        SYSLOGE("userial_open: epoll_create1 failed, errno: %d", errno);
+        return FALSE;
+    }
+
+    userial_cb.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (userial_cb.event_fd < 0)
+    {
+        SYSLOGE("userial_open: eventfd failed, errno: %d", errno);
+        return FALSE;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = userial_cb.event_fd;
+    if (epoll_ctl(userial_cb.epoll_fd, EPOLL_CTL_ADD, userial_cb.event_fd, &ev) < 0)
+    {
+        SYSLOGE("userial_open: epoll_ctl(event_fd) failed, errno: %d", errno);
+        return FALSE;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = userial_cb.fd;
+    if (epoll_ctl(userial_cb.epoll_fd, EPOLL_CTL_ADD, userial_cb.fd, &ev) < 0)
+    {
+        SYSLOGE("userial_open: epoll_ctl(fd) failed, errno: %d", errno);
+        return FALSE;
+    }
+    userial_cb.fd_events = EPOLLIN;
+
+    return TRUE;
+}
+
+/*******************************************************************************
+**
+** Function        userial_poll_teardown
+**
+** Description     Release the epoll set and eventfd doorbell
+**
+** Returns         None
+**
+*******************************************************************************/
+static void userial_poll_teardown(void)
+{
+    if (userial_cb.event_fd >= 0)
+        close(userial_cb.event_fd);
+    if (userial_cb.epoll_fd >= 0)
+        close(userial_cb.epoll_fd);
+
+    userial_cb.event_fd = -1;
+    userial_cb.epoll_fd = -1;
+    userial_cb.fd_events = 0;
+}
+
 
 /*****************************************************************************
 **   Userial API Functions
@@ -293,7 +500,8 @@ uint8_t userial_init(void)
     USERIALDBG("userial_init");
     memset(&userial_cb, 0, sizeof(tUSERIAL_CB));
     userial_cb.fd = -1;
-    utils_queue_init(&(userial_cb.rx_q));
+    userial_cb.epoll_fd = -1;
+    userial_cb.event_fd = -1;
     return TRUE;
 }
 
@@ -313,6 +521,7 @@ uint8_t userial_open(void)
     int policy, result;
     pthread_attr_t thread_attr;
     int fd_array[CH_MAX];
+    struct stat st;
 
     USERIALDBG("userial_open");
 
@@ -348,11 +557,33 @@ uint8_t userial_open(void)
 
     USERIALDBG("fd = %d", userial_cb.fd);
 
+    /* bluez hands out one HCI packet per datagram, fetch them in batches */
+    userial_cb.is_sock = (fstat(userial_cb.fd, &st) == 0 && S_ISSOCK(st.st_mode));
+
+    userial_cb.rx_head = 0;
+    userial_cb.rx_tail = 0;
+    userial_cb.rx_starved = FALSE;
+    userial_cb.rx_flow_on = TRUE;
+
+    if (userial_poll_setup() == FALSE) {
+        userial_poll_teardown();
+        return FALSE;
+    }
+
+#if (BTHC_EVENT_LOOP == TRUE)
+    /* bt_hc_worker polls the port through userial_poll() */
+    userial_running = 1;
+    return TRUE;
+#endif
+
     pthread_attr_init(&thread_attr);
 
+    userial_running = 1;
     if (pthread_create(&(userial_cb.read_thread), &thread_attr, \
                        userial_read_thread, NULL) != 0 ) {
         SYSLOGE("pthread_create failed!");
+        userial_running = 0;
+        userial_poll_teardown();
         return FALSE;
     }
 
@@ -385,46 +616,77 @@ uint16_t userial_read(uint16_t msg_id, uint8_t *p_buffer, uint16_t len)
 {
     uint16_t total_len = 0;
     uint16_t copy_len = 0;
-    uint8_t *p_data = NULL;
+    HC_BT_HDR *p_hdr;
 
-    do
+    while ((total_len < len) && (userial_cb.rx_tail != userial_cb.rx_head))
     {
-        if(userial_cb.p_rx_hdr != NULL)
-        {
-            p_data = ((uint8_t *)(userial_cb.p_rx_hdr + 1)) + \
-                     (userial_cb.p_rx_hdr->offset);
+        /* Pairs with the barrier before rx_head is advanced */
+        __sync_synchronize();
 
-            if((userial_cb.p_rx_hdr->len) <= (len - total_len))
-                copy_len = userial_cb.p_rx_hdr->len;
-            else
-                copy_len = (len - total_len);
+        p_hdr = &userial_rx_ring[userial_cb.rx_tail & USERIAL_RX_RING_MASK].hdr;
 
-            memcpy((p_buffer + total_len), p_data, copy_len);
+        if (p_hdr->len <= (len - total_len))
+            copy_len = p_hdr->len;
+        else
+            copy_len = (len - total_len);
 
-            total_len += copy_len;
+        memcpy((p_buffer + total_len), (uint8_t *)(p_hdr + 1) + p_hdr->offset,
+               copy_len);
 
-            userial_cb.p_rx_hdr->offset += copy_len;
-            userial_cb.p_rx_hdr->len -= copy_len;
+        total_len += copy_len;
 
-            if(userial_cb.p_rx_hdr->len == 0)
-            {
-                if (bt_hc_cbacks)
-                    bt_hc_cbacks->dealloc((TRANSAC) userial_cb.p_rx_hdr, \
-                                              (char *) (userial_cb.p_rx_hdr+1));
-
-                userial_cb.p_rx_hdr = NULL;
-            }
-        }
+        p_hdr->offset += copy_len;
+        p_hdr->len -= copy_len;
 
-        if(userial_cb.p_rx_hdr == NULL)
+        if (p_hdr->len == 0)
         {
-            userial_cb.p_rx_hdr=(HC_BT_HDR *)utils_dequeue(&(userial_cb.rx_q));
+            /* Release the slot, then wake the reader if it ran out */
+            __sync_synchronize();
+            userial_cb.rx_tail++;
+            __sync_synchronize();
+
+            if (userial_cb.rx_starved)
+                userial_kick();
         }
-    } while ((userial_cb.p_rx_hdr != NULL) && (total_len < len));
+    }
 
     return total_len;
 }
 
+/*******************************************************************************
+**
+** Function        userial_get_poll_fd
+**
+** Description     Pollable descriptor that turns readable when userial_poll
+**                 has work to do
+**
+** Returns         File descriptor, -1 if the port is not open
+**
+*******************************************************************************/
+int userial_get_poll_fd(void)
+{
+    return userial_cb.epoll_fd;
+}
+
+/*******************************************************************************
+**
+** Function        userial_poll
+**
+** Description     Non-blocking single pass of the reader for callers that
+**                 run their own event loop (BTHC_EVENT_LOOP)
+**
+** Returns         -1: port error or closed
+**                 >=0: numbers of packets added to the rx ring
+**
+*******************************************************************************/
+int userial_poll(void)
+{
+    if (!userial_running)
+        return -1;
+
+    return userial_service(0);
+}
+
 /*******************************************************************************
 **
 ** Function        userial_write
@@ -448,6 +710,70 @@ uint16_t userial_write(uint16_t msg_id, uint8_t *p_data, uint16_t len)
     return ((uint16_t)ret);
 }
 
+/*******************************************************************************
+**
+** Function        userial_write_batch
+**
+** Description     Write count framed packets, one per iovec, with a single
+**                 gathered write where the port allows it. Packet sockets
+**                 keep every iovec a separate packet.
+**
+** Returns         Number of packets completely written to the userial port.
+**                 This may be less than count.
+**
+*******************************************************************************/
+int userial_write_batch(uint16_t msg_id, struct iovec *iov, int count)
+{
+    struct pollfd pfd;
+    ssize_t ret;
+    int done = 0;
+
+    if (count <= 0)
+        return 0;
+
+    if (userial_cb.is_sock)
+    {
+        ret = hci_bluez_write_batch(userial_cb.fd, iov, count);
+        if (ret < 0)
+        {
+            SYSLOGE("userial_write_batch: fd %d, errno %d", userial_cb.fd, errno);
+            return 0;
+        }
+        return (int)ret;
+    }
+
+    /* Byte stream: one writev for the lot, resume after short writes */
+    while (done < count)
+    {
+        ret = writev(userial_cb.fd, &iov[done], count - done);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+            {
+                pfd.fd = userial_cb.fd;
+                pfd.events = POLLOUT;
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            SYSLOGE("userial_write_batch: fd %d, errno %d", userial_cb.fd, errno);
+            break;
+        }
+
+        while (done < count && (size_t)ret >= iov[done].iov_len)
+            ret -= iov[done++].iov_len;
+
+        if (done < count)
+        {
+            iov[done].iov_base = (uint8_t *)iov[done].iov_base + ret;
+            iov[done].iov_len -= ret;
+        }
+    }
+
+    return done;
+}
+
 /*******************************************************************************
 **
 ** Function        userial_close
@@ -460,15 +786,19 @@ uint16_t userial_write(uint16_t msg_id, uint8_t *p_data, uint16_t len)
 void userial_close(void)
 {
     int result;
-    TRANSAC p_buf;
 
     USERIALDBG("userial_close(fd:%d)", userial_cb.fd);
 
     if (userial_running)
-        send_wakeup_signal(USERIAL_RX_EXIT);
+    {
+        userial_running = 0;
+        userial_kick();
+    }
 
+#if (BTHC_EVENT_LOOP == FALSE)
     if ((result=pthread_join(userial_cb.read_thread, NULL)) < 0)
         SYSLOGE( "pthread_join() FAILED result:%d", result);
+#endif
 
     /* Calling vendor-specific part */
     if (bt_vnd_if)
@@ -476,13 +806,11 @@ void userial_close(void)
 
     userial_cb.fd = -1;
 
-    if (bt_hc_cbacks)
-    {
-        while ((p_buf = utils_dequeue (&(userial_cb.rx_q))) != NULL)
-        {
-            bt_hc_cbacks->dealloc(p_buf, (char *) ((HC_BT_HDR *)p_buf+1));
-        }
-    }
+    userial_poll_teardown();
+
+    /* Drop whatever was left unread in the ring */
+    userial_cb.rx_tail = userial_cb.rx_head;
+    userial_cb.rx_starved = FALSE;
 }
 
 /*******************************************************************************
@@ -499,13 +827,15 @@ void userial_ioctl(userial_ioctl_op_t op, void *p_data)
     switch(op)
     {
         case USERIAL_OP_RXFLOW_ON:
+            userial_cb.rx_flow_on = TRUE;
             if (userial_running)
-                send_wakeup_signal(USERIAL_RX_FLOW_ON);
+                userial_kick();
             break;
 
         case USERIAL_OP_RXFLOW_OFF:
+            userial_cb.rx_flow_on = FALSE;
             if (userial_running)
-                send_wakeup_signal(USERIAL_RX_FLOW_OFF);
+                userial_kick();
             break;
 
         case USERIAL_OP_INIT:
@@ -153,6 +153,13 @@
 #define GKI_USE_DYNAMIC_BUFFERS     FALSE
 #endif
 
+/* Depth of the per-thread buffer cache kept for each pool, 0 disables the
+** caches. A thread never caches more than 1/16 of a pool, so small pools are
+** not cached at all. */
+#ifndef GKI_BUF_MAG_SIZE
+#define GKI_BUF_MAG_SIZE            8
+#endif
+
 /* The size of the buffers in pool 0. */
 #ifndef GKI_BUF0_SIZE
 #define GKI_BUF0_SIZE               64
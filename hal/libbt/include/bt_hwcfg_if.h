@@ -34,6 +34,7 @@
 #include <unistd.h>
 
 #include "bt_hci_bdroid.h"
+#include "bt_timer.h"
 
 #define BT_FIRMWARE_DIRECTORY       "/lib/firmware/%s"
 #define HCI_CMD_MAX_LEN             258
@@ -164,7 +165,7 @@ typedef struct {
     uint8_t  rom_ver;         /* ROM echo version */
     uint16_t lmp_subver;      /* LMP sub version */
     uint16_t hci_subver;      /* HCI sub version */
-    timer_t  timer_id;        /* hw cfg specified timer */
+    tBT_TIMER timer;          /* hw cfg specified timer */
     int      fw_len;          /* FW patch file len */
     int      config_len;      /* Config patch file len */
     int      total_len;       /* FW & config extracted buf len */
@@ -185,9 +186,9 @@ typedef struct {
 void ms_delay(uint32_t timeout);
 
 int hw_cfg_set_timer(bt_hw_cfg_cb_t *cfg_cb,
-        void (*bt_hw_notify_func)(union sigval arg), uint32_t to_ms);
+        void (*bt_hw_notify_func)(void *arg), uint32_t to_ms);
 
-void hw_cfg_clear_timer(timer_t timer_id);
+void hw_cfg_clear_timer(bt_hw_cfg_cb_t *cfg_cb);
 
 patch_item *bt_hw_get_patch_item(uint16_t lmp_subver, uint16_t hci_subver);
 
@@ -104,39 +104,26 @@ void ms_delay(uint32_t timeout)
 }
 
 int hw_cfg_set_timer(bt_hw_cfg_cb_t *cfg_cb,
-        void (*bt_hw_notify_func)(union sigval arg), uint32_t to_ms)
+        void (*bt_hw_notify_func)(void *arg), uint32_t to_ms)
 {
     int err;
-    struct itimerspec ts;
-    struct sigevent se;
-
-    se.sigev_notify = SIGEV_THREAD;
-    se.sigev_value.sival_ptr = &cfg_cb->timer_id;
-    se.sigev_notify_function = bt_hw_notify_func;
-    se.sigev_notify_attributes = NULL;
-
-    err = timer_create(CLOCK_MONOTONIC, &se, &cfg_cb->timer_id);
-    if (err == -1) {
-        SYSLOGE("hw_cfg_set_timer: failed to create timer");
-        return err;
-    }
-
-    ts.it_value.tv_sec = to_ms / 1000;
-    ts.it_value.tv_nsec = 1000000 * (to_ms % 1000);
-    ts.it_interval.tv_sec = 0;
-    ts.it_interval.tv_nsec = 0;
 
-    err = timer_settime(cfg_cb->timer_id, 0, &ts, 0);
+    /* one-shot on the shared transport timer wheel, the callback gets the
+     * cfg control block. Setup clears the wheel links, so unlink a timer
+     * that is still armed first. */
+    bt_timer_stop(&cfg_cb->timer);
+    bt_timer_setup(&cfg_cb->timer, bt_hw_notify_func, cfg_cb);
+    err = bt_timer_start(&cfg_cb->timer, to_ms, 0);
     if (err == -1)
         SYSLOGE("hw_cfg_set_timer: failed to set timer");
 
     return err;
 }
 
-void hw_cfg_clear_timer(timer_t timer_id)
+void hw_cfg_clear_timer(bt_hw_cfg_cb_t *cfg_cb)
 {
     SYSLOGI("hw_cfg_clear_timer");
-    timer_delete(timer_id);
+    bt_timer_stop(&cfg_cb->timer);
 }
 
 patch_item *bt_hw_get_patch_item(uint16_t lmp_subver, uint16_t hci_subver)
@@ -418,6 +418,7 @@ void UART_hw_config_start(bt_hci_if_t proto)
     HC_BT_HDR *p_buf = NULL;
     uint8_t *p;
 
+    hw_cfg_clear_timer(&UART_hw_cfg_cb);
     memset(&UART_hw_cfg_cb, 0, sizeof(bt_hw_cfg_cb_t));
     UART_hw_cfg_cb.state = HW_CFG_UNINIT;
     UART_hw_cfg_cb.dl_fw_flag = 1;
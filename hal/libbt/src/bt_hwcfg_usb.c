@@ -146,9 +146,9 @@ void USB_hw_config_cback(void *p_evt_buf);
 
 static bt_hw_cfg_cb_t USB_hw_cfg_cb;
 
-static void fw_reset_timeout(union sigval arg)
+static void fw_reset_timeout(void *arg)
 {
-    SYSLOGI("fw_reset_timeout, timer id %d", *(int *)arg.sival_ptr);
+    SYSLOGI("fw_reset_timeout, hw cfg state %d", ((bt_hw_cfg_cb_t *)arg)->state);
 
     USB_hw_config_cback(NULL);
 }
@@ -271,7 +271,7 @@ void USB_hw_config_cback(void *p_mem)
         switch (USB_hw_cfg_cb.state) {
         case HW_CFG_FW_RESET:
             /* clear the fw reset completion timer */
-            hw_cfg_clear_timer(USB_hw_cfg_cb.timer_id);
+            hw_cfg_clear_timer(&USB_hw_cfg_cb);
 
             p = (uint8_t *)(p_buf + 1);
             /* read local version information, here we care LMP sub version. */
@@ -469,6 +469,7 @@ void USB_hw_config_start(void)
     uint8_t *p;
     int res;
 
+    hw_cfg_clear_timer(&USB_hw_cfg_cb);
     memset(&USB_hw_cfg_cb, 0, sizeof(bt_hw_cfg_cb_t));
     USB_hw_cfg_cb.state = HW_CFG_UNINIT;
     USB_hw_cfg_cb.dl_fw_flag = 1;
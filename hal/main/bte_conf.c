@@ -40,6 +40,7 @@
 **  Externs
 ******************************************************************************/
 extern BOOLEAN hci_logging_enabled;
+extern BOOLEAN hci_logging_flight;
 extern char hci_logfile[256];
 extern BOOLEAN trace_conf_enabled;
 extern BOOLEAN trace_h5_enabled;
@@ -159,7 +160,10 @@ int device_class_cfg(char *p_conf_name, char *p_conf_value)
 
 int logging_cfg_onoff(char *p_conf_name, char *p_conf_value)
 {
-    if (strcmp(p_conf_value, "true") == 0)
+    /* "flight" keeps the log in memory and writes it out on failures only */
+    hci_logging_flight = (strcmp(p_conf_value, "flight") == 0) ? TRUE : FALSE;
+
+    if ((strcmp(p_conf_value, "true") == 0) || (hci_logging_flight == TRUE))
         hci_logging_enabled = TRUE;
     else
         hci_logging_enabled = FALSE;
@@ -79,6 +79,7 @@ typedef struct
 **  Variables
 ******************************************************************************/
 BOOLEAN hci_logging_enabled = FALSE;    /* by default, turn hci log off */
+BOOLEAN hci_logging_flight = FALSE;     /* keep the log in memory, dump on failure */
 char hci_logfile[256] = HCI_LOGGING_FILENAME;
 
 BOOLEAN trace_h5_enabled = FALSE;    /* by default, turn hci log off */
@@ -195,7 +196,8 @@ void bte_main_enable(uint8_t *local_addr, bt_hci_if_t hci_if, const char *dev_no
         assert(result == BT_HC_STATUS_SUCCESS);
 
         if (hci_logging_enabled == TRUE)
-            bt_hc_if->logging(BT_HC_LOGGING_ON, hci_logfile);
+            bt_hc_if->logging((hci_logging_flight == TRUE) ? BT_HC_LOGGING_FLIGHT :
+                              BT_HC_LOGGING_ON, hci_logfile);
 
 
         bt_hc_if->set_power(BT_HC_CHIP_PWR_OFF);
@@ -239,6 +241,24 @@ void bte_main_disable(void)
     GKI_freeze();
 }
 
+/******************************************************************************
+**
+** Function         bte_main_hci_log_dump
+**
+** Description      BTE MAIN API - Write the HCI flight recorder out next to
+**                  the configured snoop file, e.g. after a failed test step.
+**                  The snoop writer thread does the writing; dumps close
+**                  together are skipped and only the last few are kept.
+**
+** Returns          None
+**
+******************************************************************************/
+void bte_main_hci_log_dump(void)
+{
+    if (bt_hc_if && (hci_logging_enabled == TRUE) && (hci_logging_flight == TRUE))
+        bt_hc_if->logging(BT_HC_LOGGING_DUMP, NULL);
+}
+
 /*******************************************************************************
 **
 ** Function        preload_wait_timeout
@@ -508,6 +528,9 @@ static int data_ind(TRANSAC transac, char *p_buf, int len)
     APPL_TRACE_DEBUG2("HC data_ind event=0x%04X (len=%d)", p_msg->event, len);
     */
 
+    /* Let MP events skip the task hops */
+    btu_hcif_fast_event(p_msg);
+
     GKI_send_msg (BTU_TASK, BTU_HCI_RCV_MBOX, transac);
     return BT_HC_STATUS_SUCCESS;
 }
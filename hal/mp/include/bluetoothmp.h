@@ -191,6 +191,34 @@ typedef void (*callback_thread_event)(bt_cb_thread_evt evt);
 /* Receive any HCI event from controller. Must be in DUT Mode for this callback to be received */
 typedef void (*dut_mode_recv_callback)(uint8_t opcode, char *buf);
 
+/** Payload carried by an MP operation result */
+typedef enum {
+    BT_MP_RESULT_TEXT = 0,  /* data is a preformatted, NUL terminated line */
+    BT_MP_RESULT_STATUS,    /* no data, status and item say it all */
+    BT_MP_RESULT_REPORT,    /* data is a BT_DEVICE_REPORT snapshot, see bt_mp_base.h */
+    BT_MP_RESULT_SWEEP,     /* data is an array of BT_SWEEP_POINT, see bt_mp_base.h */
+    BT_MP_RESULT_LE_CELL,   /* data is one BT_LE_MATRIX_CELL, streamed ahead of the exec status */
+    BT_MP_RESULT_THERMAL    /* data is an array of BT_THERMAL_SAMPLE, oldest first */
+} bt_mp_result_type_t;
+
+/* Room a text rendering of any result needs */
+#define BT_MP_RESULT_TEXT_MAX   1024
+
+/** Binary result of an op_send call */
+typedef struct {
+    uint16_t opcode;        /* BT_MP_OP_xxx that was executed */
+    uint8_t  type;          /* bt_mp_result_type_t */
+    uint8_t  status;        /* BT_FUNCTION_SUCCESS or the error code */
+    int32_t  item;          /* action index or report item, -1 if none */
+    uint16_t len;           /* bytes at data */
+    const void *data;       /* only valid during the callback */
+} bt_mp_result_t;
+
+/** Bluetooth Test Mode Result Callback */
+/* Receive the result of op_send as a typed record. When set, op_send results are
+ * no longer rendered to text for dut_mode_recv_cb, use op_render at the edge */
+typedef void (*dut_mode_result_callback)(const bt_mp_result_t *result);
+
 /** TODO: Add callbacks for Link Up/Down and other generic
   *  notifications/callbacks */
 
@@ -201,6 +229,7 @@ typedef struct {
     adapter_state_changed_callback adapter_state_changed_cb;
     callback_thread_event thread_evt_cb;
     dut_mode_recv_callback dut_mode_recv_cb;
+    dut_mode_result_callback dut_mode_result_cb;
 } bt_callbacks_t;
 
 
@@ -225,6 +254,10 @@ typedef struct {
 
     /** Send test HCI (vendor-specific) command to the controller. */
     int (*op_send)(uint16_t opcode, char *buf);
+
+    /** Render an op_send result as dut_mode_recv_cb would have received it.
+     *  buf must hold BT_MP_RESULT_TEXT_MAX bytes. */
+    int (*op_render)(const bt_mp_result_t *result, char *buf);
 } bt_interface_t;
 
 
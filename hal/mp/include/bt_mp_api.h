@@ -1,6 +1,7 @@
 #ifndef _BT_MP_API_H
 #define _BT_MP_API_H
 
+#include "bluetoothmp.h"
 #include "bt_mp_base.h"
 
 int BT_GetParam(BT_MODULE *pBtModule, char *p, char *buf_cb);
@@ -9,6 +10,9 @@ int BT_SetConfig(BT_MODULE *pBtModule, char *p, char *buf_cb);
 int BT_Exec(BT_MODULE *pBtModule, char *p, char *buf_cb);
 int BT_Report(BT_MODULE *pBtModule, char *p, char *buf_cb);
 int BT_RegRW(BT_MODULE *pBtModule, char *p, char *buf_cb);
+int BT_ExecResult(BT_MODULE *pBtModule, char *p, bt_mp_result_t *pResult);
+int BT_ReportResult(BT_MODULE *pBtModule, char *p, bt_mp_result_t *pResult, BT_DEVICE_REPORT *pReport);
+int BT_RenderResult(const bt_mp_result_t *pResult, char *buf_cb);
 int BT_SendHciCmd(BT_MODULE *pBtModule, char *p, char *buf_cb);
 #if (MP_TOOL_COMMAND_SEARCH_EXIST_PERMISSION == 1)
 int BT_Inquiry(BT_MODULE *pBtModule, char *p, char *buf_cb);
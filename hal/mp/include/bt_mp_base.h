@@ -111,6 +111,7 @@ typedef enum {
     REPORT_MP_DEBUG_MESSAGE,
     REPORT_MP_FT_VALUE,
     REPORT_POWER_TRACKING,
+    REPORT_THERMAL_MONITOR,
 } BT_REPORT_TAG;
 typedef enum {
     HCI_RESET = 0,                  //0
@@ -183,6 +184,9 @@ typedef enum {
     SET_ANT_DIFF_S0S1,              //41
     TX_POWER_TRACKING,              //42
     SET_K_TX_CH_PWR,                    //43
+    PACKET_TX_SWEEP,                //44
+    LE_RX_TEST_MATRIX,              //45
+    LE_TX_TEST_MATRIX,              //46
     BT_ACTION_NUM
 } BT_ACTIONCONTROL_TAG;
 
@@ -279,6 +283,69 @@ enum RTK_BT_CHIP_ID_GROUP_{
 
 
 
+// Packet TX sweep, channels x BR/EDR packet types in one action
+#define BT_SWEEP_MAX_CHANNELS       79
+#define BT_SWEEP_MAX_PKT_TYPES      (BT_PKT_3DH5 + 1)
+#define BT_SWEEP_MAX_POINTS         (BT_SWEEP_MAX_CHANNELS * BT_SWEEP_MAX_PKT_TYPES)
+
+#ifndef BT_SWEEP_DEFAULT_DWELL_MS
+#define BT_SWEEP_DEFAULT_DWELL_MS   100
+#endif
+
+// One row of the sweep results table
+typedef struct BT_SWEEP_POINT_TAG
+{
+    uint8_t  Channel;
+    uint8_t  PacketType;
+    uint8_t  Status;
+    uint8_t  Reserved;
+    uint32_t TxCounts;
+} BT_SWEEP_POINT;
+
+// LE enhanced test matrix, channels x PHY x modulation index (RX) or
+// payload (TX), each cell streamed as it completes
+#define BT_LE_MATRIX_MAX_CHANNELS   40
+#define BT_LE_MATRIX_MAX_PHYS       4
+#define BT_LE_MATRIX_MAX_MOD_IDX    2
+#define BT_LE_MATRIX_MAX_PAYLOADS   8
+
+#define BT_LE_MATRIX_PER_NONE       0xffff
+
+// One cell of the LE matrix, Per is in units of 0.01 %
+typedef struct BT_LE_MATRIX_CELL_TAG
+{
+    uint8_t  Channel;
+    uint8_t  PHY;
+    uint8_t  ModulationIndex;
+    uint8_t  PayloadType;
+    uint8_t  Status;
+    uint8_t  Reserved;
+    uint16_t Packets;           //from the LE Test End event
+    uint16_t Expected;          //packets the tester sends in the dwell
+    uint16_t Per;
+} BT_LE_MATRIX_CELL;
+
+// Thermal monitor, reads the thermal meter in the background during a TX
+// run and keeps the readings as a time series
+#ifndef BT_THERMAL_HISTORY
+#define BT_THERMAL_HISTORY          64
+#endif
+#define BT_THERMAL_MAX_SLOPE        8
+
+#define BT_THERMAL_COMP_OFF         0
+#define BT_THERMAL_COMP_FW          1   //firmware power tracking by vendor command
+#define BT_THERMAL_COMP_GAIN_INDEX  2   //gain index steps from ThermalSlope
+
+// One kept reading, ElapsedMs from the start of the TX run
+typedef struct BT_THERMAL_SAMPLE_TAG
+{
+    uint32_t ElapsedMs;
+    uint8_t  Thermal;
+    uint8_t  Step;              //gain index steps applied, COMP_GAIN_INDEX
+    uint8_t  Comp;              //gain index in use, or the firmware tracking reading
+    uint8_t  Reserved;
+} BT_THERMAL_SAMPLE;
+
 typedef struct BT_PARAMETER_TAG   BT_PARAMETER;
 typedef struct BT_DEVICE_REPORT_TAG BT_DEVICE_REPORT;
 typedef struct BT_CHIPINFO_TAG   BT_CHIPINFO;
@@ -322,6 +389,28 @@ struct BT_PARAMETER_TAG
     uint8_t ExeMode;
     uint8_t PHY;              //for Le Enhanced bt 5.0
     uint8_t ModulationIndex;  //for Le Enhanced bt 5.0
+    uint32_t RxSamplePeriodMs; //background RX counter sampling, 0 = off
+
+    uint8_t SweepChannels[BT_SWEEP_MAX_CHANNELS];   //none = all channels
+    uint8_t SweepChannelNum;
+    uint8_t SweepPktTypes[BT_SWEEP_MAX_PKT_TYPES];  //none = mPacketType
+    uint8_t SweepPktTypeNum;
+    uint16_t SweepDwellMs;
+
+    uint8_t LeMatrixPhys[BT_LE_MATRIX_MAX_PHYS];            //none = PHY
+    uint8_t LeMatrixPhyNum;
+    uint8_t LeMatrixModIdx[BT_LE_MATRIX_MAX_MOD_IDX];       //none = ModulationIndex
+    uint8_t LeMatrixModIdxNum;
+    uint8_t LeMatrixPayloads[BT_LE_MATRIX_MAX_PAYLOADS];    //none = mPayloadType
+    uint8_t LeMatrixPayloadNum;
+
+    uint8_t RxEarlyStopMode;   //BT_RX_EARLY_STOP_xxx
+    uint32_t RxBerLimitPpm;    //BER limit the early stop decides against
+
+    uint32_t ThermalPeriodMs;  //background thermal sampling during TX, 0 = off
+    uint8_t ThermalCompMode;   //BT_THERMAL_COMP_xxx
+    uint8_t ThermalSlope[BT_THERMAL_MAX_SLOPE];     //rise over the first reading for each gain index step
+    uint8_t ThermalSlopeNum;
 };
 
 
@@ -353,6 +442,7 @@ struct BT_DEVICE_REPORT_TAG {
     int      RxRssi;
     float    ber;
     float    Cfo;
+    uint8_t  RxVerdict;        //BT_RX_VERDICT_xxx
 
     uint8_t  CurrTXGainTable[MAX_TXGAIN_TABLE_SIZE];
     uint8_t  CurrTXDACTable[MAX_TXDAC_TABLE_SIZE];
@@ -369,6 +459,22 @@ struct BT_DEVICE_REPORT_TAG {
 
 
 
+// One raw read of the RX counters. Counts are as wide as Mask, Reset is set
+// when the counters were cleared after this read.
+typedef struct BT_RX_COUNTERS_TAG
+{
+    uint32_t RxCount;
+    uint32_t RxErrBits;
+    uint32_t Mask;
+    uint32_t PktBits;       //payload bits per packet of the current type
+    uint8_t  Reset;
+    int      RxRssi;
+    float    Cfo;
+} BT_RX_COUNTERS;
+
+
+
+
 //
 //Device Level::member Funcion
 //
@@ -601,6 +707,18 @@ typedef int
     );
 
 // PKT RX
+// what changed since the last sweep point
+#define BT_PKTTX_RETUNE_CHANNEL     0x01
+#define BT_PKTTX_RETUNE_PKT_TYPE    0x02
+
+typedef int
+(*BT_FP_SET_PKTTX_RETUNE)(
+    BT_DEVICE *pBtDevice,
+    BT_PARAMETER *pParam,
+    BT_DEVICE_REPORT *pBtReport,
+    uint8_t Changes
+    );
+
 typedef int
 (*BT_FP_SET_PKTRX_BEGIN)(
     BT_DEVICE *pBtDevice,
@@ -622,6 +740,13 @@ typedef int
     BT_DEVICE_REPORT *pBtReport
     );
 
+typedef int
+(*BT_FP_READ_RX_COUNTERS)(
+    BT_DEVICE *pBtDevice,
+    BT_PARAMETER *pParam,
+    BT_RX_COUNTERS *pCounters
+    );
+
 typedef int
 (*BT_FP_GET_CHIPVERSIONINFO)(
     BT_DEVICE *pBtDevice
@@ -763,6 +888,11 @@ typedef struct _EFUSE_UNIT
 
     uint8_t CurrBank;
 
+    // pEfusePhyMem holds the map read in this enable session
+    uint8_t PhyMemValid;
+    // largest read the controller took, 0 until probed
+    uint16_t BulkReadLen;
+
 } EFUSE_UNIT;
 
 
@@ -779,11 +909,60 @@ typedef enum {
 } TRXTIME_TAG;
 
 struct BT_TRX_TIME_TAG {
-    unsigned long beginTimeClockCnt;
-    unsigned long UseTimeClockCnt;
-    unsigned long endTimeClockCnt;
+    uint64_t BeginTicks;        //native clock at TX start, unwrapped model ticks
+    uint32_t CountedPkts;       //packets already reported since BeginTicks
+    uint8_t  Started;
 };
 
+// Controller native clock, 28 bits of 312.5 us half slots
+#define BT_CLOCK_NATIVE_MASK    0x0FFFFFFF
+#define BT_CLOCK_TICK_NS        312500
+
+// Re-read the native clock this often while the model is in use and fold
+// the drift back in, 0 never checks
+#ifndef BT_CLOCK_CHECK_MS
+#define BT_CLOCK_CHECK_MS       60000
+#endif
+
+// Native clock extrapolated from CLOCK_MONOTONIC so TX accounting needs no
+// Read Clock per report. Ticks are unwrapped, the 28 bit wrap never shows.
+typedef struct BT_CLOCK_MODEL_TAG
+{
+    uint8_t  Valid;
+    uint64_t CalTicks;          //native clock at calibration
+    int64_t  CalMonoNs;         //CLOCK_MONOTONIC at calibration
+    int32_t  RatePpm;           //controller clock rate against the host
+} BT_CLOCK_MODEL;
+
+// Test entry points of a chip family, bound once the chip identity is known.
+// Chips before RTL8822B run tests on modem registers, later ones through the
+// Fw* vendor commands. NULL means the family has nothing to do for the step.
+typedef struct BT_CHIP_OPS_TAG
+{
+    BT_FP_UPDATE    PktTxStart;
+    BT_FP_UPDATE    PktTxUpdate;
+    BT_FP_UPDATE    PktTxStop;
+    BT_FP_UPDATE    PktTxReport;
+
+    BT_FP_UPDATE    ContTxStart;
+    BT_FP_UPDATE    ContTxUpdate;
+    BT_FP_UPDATE    ContTxStop;
+    BT_FP_UPDATE    ContTxReport;
+
+    BT_FP_UPDATE    PktRxStart;
+    BT_FP_UPDATE    PktRxUpdate;
+    BT_FP_UPDATE    PktRxStop;
+    BT_FP_UPDATE    PktRxReport;
+
+    BT_FP_UPDATE    LeTxTest;
+    BT_FP_UPDATE    LeRxTest;
+
+    uint8_t         PktTxRetune;        //a running packet TX can be retuned in place
+    uint8_t         LeContTxPktType;    //LE continue TX forces BT_PKT_1DH1
+    uint8_t         MaxGainIndex;       //highest index SetPowerGainIndex takes
+    float           NoRxBer;            //ber before any RX bit is counted
+} BT_CHIP_OPS;
+
 struct BT_DEVICE_TAG
 {
 
@@ -835,6 +1014,7 @@ struct BT_DEVICE_TAG
 
     //Con-TX
     BT_TRX_TIME                     TRxTime[NUMOFTRXTIME_TAG];
+    BT_CLOCK_MODEL                  ClockModel;
     BT_FP_SET_CONTINUETX_BEGIN      SetContinueTxBegin;
     BT_FP_SET_CONTINUETX_STOP       SetContinueTxStop;
     BT_FP_SET_CONTINUETX_UPDATE     SetContinueTxUpdate;
@@ -846,10 +1026,12 @@ struct BT_DEVICE_TAG
     BT_FP_SET_PKTTX_BEGIN           SetPktTxBegin;
     BT_FP_SET_PKTTX_STOP            SetPktTxStop;
     BT_FP_SET_PKTTX_UPDATE          SetPktTxUpdate;
+    BT_FP_SET_PKTTX_RETUNE          SetPktTxRetune;
     //PKT-RX
     BT_FP_SET_PKTRX_BEGIN           SetPktRxBegin;
     BT_FP_SET_PKTRX_STOP            SetPktRxStop;
     BT_FP_SET_PKTRX_UPDATE          SetPktRxUpdate;
+    BT_FP_READ_RX_COUNTERS          ReadRxCounters;
 
     //interface
     uint8_t InterfaceType;
@@ -858,6 +1040,8 @@ struct BT_DEVICE_TAG
 
     BT_CHIPINFO *pBTInfo;
     BT_CHIPINFO BaseBTInfoMemory;
+    uint8_t ChipInfoValid;              //pBTInfo resolved since the last enable, reset or download
+    const BT_CHIP_OPS *pChipOps;
 
     BT_FP_GET_CHIPVERSIONINFO       GetChipVersionInfo;
     BT_FP_BT_DL_FW                  BTDlFW;
@@ -904,6 +1088,16 @@ struct BT_DEVICE_TAG
 
 typedef struct  BT_MODULE_TAG BT_MODULE;
 
+// Hand a result record to the front end before the op that makes it ends
+typedef void
+(*BT_MODULE_FP_STREAM_RESULT)(
+        BT_MODULE *pBtModule,
+        int Item,
+        uint8_t Type,
+        const void *pData,
+        uint16_t Len
+        );
+
 typedef int
 (*BT_MODULE_FP_ACTION_REPORT)(
         BT_MODULE *pBtModule,
@@ -1048,6 +1242,104 @@ typedef int
 
 //------------------------------------------------------------------------------------------------------------------
 
+// Default RX sampling period in ms, 0 leaves RX reports polled on demand
+#ifndef BT_MP_RX_SAMPLE_MS
+#define BT_MP_RX_SAMPLE_MS      100
+#endif
+
+// Default thermal sampling period in ms during TX runs, 0 leaves the
+// thermal meter read on demand only. Not available on the register chips,
+// where the read would stop the TX run
+#ifndef BT_MP_THERMAL_SAMPLE_MS
+#define BT_MP_THERMAL_SAMPLE_MS 0
+#endif
+
+// RX early stop: decide pass or fail against RxBerLimitPpm as soon as the
+// counts are statistically conclusive, by a sequential probability ratio
+// test or by a confidence interval kept valid across repeated looks
+#define BT_RX_EARLY_STOP_OFF        0
+#define BT_RX_EARLY_STOP_SPRT       1
+#define BT_RX_EARLY_STOP_CI         2
+
+#define BT_RX_VERDICT_NONE          0   //undecided or early stop off
+#define BT_RX_VERDICT_PASS          1
+#define BT_RX_VERDICT_FAIL          2
+
+// Default limit, 0.1 % is the BR receiver sensitivity criterion
+#ifndef BT_RX_BER_LIMIT_PPM
+#define BT_RX_BER_LIMIT_PPM         1000
+#endif
+
+// SPRT risks of failing a good unit (alpha) and passing a bad one (beta).
+// A good unit has a BER the ratio below the limit.
+#ifndef BT_RX_EARLY_STOP_ALPHA
+#define BT_RX_EARLY_STOP_ALPHA      0.05
+#endif
+#ifndef BT_RX_EARLY_STOP_BETA
+#define BT_RX_EARLY_STOP_BETA       0.05
+#endif
+#ifndef BT_RX_EARLY_STOP_RATIO
+#define BT_RX_EARLY_STOP_RATIO      2.0
+#endif
+
+// Total risk of a wrong CI verdict over all looks at one RX run. Look i
+// spends 6 / (pi^2 i^2) of it, so the verdict holds however often the
+// counts are checked. SPRT needs fewer bits for the same risks.
+#ifndef BT_RX_EARLY_STOP_CI_ALPHA
+#define BT_RX_EARLY_STOP_CI_ALPHA   0.05
+#endif
+
+// RX totals kept by the sampler thread, guarded by BT_MODULE HciLock
+typedef struct BT_RX_SAMPLER_TAG
+{
+    uint64_t    RxCounts;
+    uint64_t    RxErrorBits;
+    uint64_t    ReportedCounts;     //RxCounts at the last report
+    uint32_t    LastRxCount;
+    uint32_t    LastRxErrBits;
+    uint32_t    PktBits;
+    int         RxRssi;
+    float       Cfo;
+    uint32_t    Samples;
+    uint32_t    Errors;
+    uint32_t    Looks;              //early stop verdicts taken this run
+
+    uint8_t     Valid;              //totals describe the current RX run
+    uint8_t     Running;            //thread is sampling
+    uint8_t     Verdict;            //early stop decision, totals frozen once set
+    uint8_t     ThreadStarted;
+    uint32_t    PeriodMs;
+    pthread_t   Thread;
+    pthread_cond_t Cond;
+} BT_RX_SAMPLER;
+
+// Thermal time series kept by the monitor thread, guarded by BT_MODULE
+// HciLock. A full history drops every other sample and keeps one reading
+// in twice as many from then on, so a long run stays covered end to end.
+typedef struct BT_THERMAL_MONITOR_TAG
+{
+    BT_THERMAL_SAMPLE History[BT_THERMAL_HISTORY];
+    uint16_t    Count;
+    uint16_t    Stride;             //readings per kept sample
+    uint16_t    Skipped;            //readings since the last kept one
+    uint32_t    Errors;
+    int64_t     StartNs;
+    uint8_t     BaseThermal;        //first reading of the run
+    uint8_t     BaseGainIndex;      //gain index the run started on
+    uint8_t     Step;
+    uint8_t     Mode;               //BT_THERMAL_COMP_xxx of the run
+
+    uint8_t     Running;
+    uint8_t     ThreadStarted;
+    uint32_t    PeriodMs;
+    pthread_t   Thread;
+    pthread_cond_t Cond;
+
+    //copy REPORT_THERMAL_MONITOR hands out past the lock
+    BT_THERMAL_SAMPLE Report[BT_THERMAL_HISTORY];
+    uint16_t    ReportCount;
+} BT_THERMAL_MONITOR;
+
 struct BT_MODULE_TAG
 {
 
@@ -1088,6 +1380,18 @@ struct BT_MODULE_TAG
 
     BASE_INTERFACE_MODULE *pBaseInterface;
 
+    //serializes HCI traffic of MP ops and the background samplers
+    pthread_mutex_t                         HciLock;
+    BT_RX_SAMPLER                           RxSampler;
+    BT_THERMAL_MONITOR                      ThermalMonitor;
+
+    //results of the last PACKET_TX_SWEEP
+    BT_SWEEP_POINT                          SweepResult[BT_SWEEP_MAX_POINTS];
+    uint16_t                                SweepPointNum;
+
+    //set by the front end, NULL drops streamed results
+    BT_MODULE_FP_STREAM_RESULT              StreamResult;
+
 };
 
 
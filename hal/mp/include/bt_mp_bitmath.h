@@ -0,0 +1,46 @@
+#ifndef _BT_MP_BITMATH_H
+#define _BT_MP_BITMATH_H
+
+#include <stdint.h>
+
+
+// Baseband bit math on whole words. Sequences are held LSB first, bit k of a
+// word is bit k of the sequence as the core spec numbers it.
+
+// PN sequence p0..p63 overlaid on the sync word
+#define BT_BITMATH_PN               0x83848D96BBCC54FCULL
+
+// BCH(64,30) generator g(D), octal 260534236651
+#define BT_BITMATH_BCH_GEN          0x585713DA9ULL
+
+#define BT_BITMATH_PARITY_BITS      34
+#define BT_BITMATH_INFO_BITS        30
+
+
+// LAP a0..a23 with the Barker extension a24..a29 picked by a23
+uint32_t
+bt_bitmath_barker(
+        uint32_t Lap
+        );
+
+// 34 parity bits of the (already PN overlaid) 30 info bits
+uint64_t
+bt_bitmath_bch_parity(
+        uint32_t Info
+        );
+
+// 64 bit sync word of a LAP, PN overlay included
+uint64_t
+bt_bitmath_sync_word(
+        uint32_t Lap
+        );
+
+// The sync word as the four 16 bit access code registers 0x1c..0x22 take
+// it, memoized on the LAP of the last HitTarget
+void
+bt_bitmath_access_code(
+        uint64_t HitTarget,
+        uint16_t *pAccessCode
+        );
+
+#endif
@@ -301,6 +301,14 @@ BTDevice_SetPktTxUpdate(
         BT_DEVICE_REPORT *pBtReport
         );
 
+int
+BTDevice_SetPktTxRetune(
+        BT_DEVICE *pBtDevice,
+        BT_PARAMETER *pParam,
+        BT_DEVICE_REPORT *pBtReport,
+        uint8_t Changes
+        );
+
 int
 BTDevice_SetPktTxStop(
         BT_DEVICE *pBtDevice,
@@ -322,6 +330,13 @@ BTDevice_SetPktRxUpdate(
         BT_DEVICE_REPORT *pBtReport
         );
 
+int
+BTDevice_ReadRxCounters(
+        BT_DEVICE *pBtDevice,
+        BT_PARAMETER *pParam,
+        BT_RX_COUNTERS *pCounters
+        );
+
 int
 BTDevice_SetPktRxStop(
         BT_DEVICE *pBtDevice,
@@ -334,6 +349,16 @@ BTDevice_GetBTChipVersionInfo(
         BT_DEVICE *pBtDevice
         );
 
+void
+BTDevice_InvalidateChipInfo(
+        BT_DEVICE *pBtDevice
+        );
+
+void
+BTDevice_BindChipOps(
+        BT_DEVICE *pBtDevice
+        );
+
 int
 BTDevice_BTDlFW(
         BT_DEVICE *pBtDevice,
@@ -51,6 +51,11 @@ BuildEfuseLogicUnit(
         uint8_t BankNum
         );
 
+void
+BTDevice_Efuse_InvalidateCache(
+        EFUSE_UNIT *pEfuse
+        );
+
 int
 BTDevice_Efuse_LoadPhyMem(
         EFUSE_UNIT *pEfuse
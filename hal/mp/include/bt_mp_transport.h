@@ -19,6 +19,13 @@ void bt_transport_signal_event(
         unsigned short event
         );
 
+void bt_transport_post_event(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        void *pHandle,
+        uint8_t *pEvt,
+        uint16_t evtLen
+        );
+
 int bt_transport_RecvHciEvt(
         BASE_INTERFACE_MODULE *pBaseInterface,
         uint8_t *pEvtBuffer,
@@ -26,4 +33,16 @@ int bt_transport_RecvHciEvt(
         uint32_t *pRetEvtLen
         );
 
+int bt_transport_RecvHciEvtRef(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        uint8_t **ppEvt,
+        uint32_t *pRetEvtLen,
+        void **ppHandle
+        );
+
+void bt_transport_ReleaseHciEvt(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        void *pHandle
+        );
+
 #endif
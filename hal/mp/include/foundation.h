@@ -174,6 +174,24 @@ typedef int
 
 
 
+typedef int
+(*BASE_FP_RECV_REF)(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        uint8_t **ppReadingBuf,
+        uint32_t *pRetLen,
+        void **ppHandle
+        );
+
+
+
+typedef void
+(*BASE_FP_RELEASE)(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        void *pHandle
+        );
+
+
+
 typedef void
 (*BASE_FP_WAIT_MS)(
         BASE_INTERFACE_MODULE *pBaseInterface,
@@ -212,6 +230,10 @@ struct BASE_INTERFACE_MODULE_TAG
     BASE_FP_CLOSE Close;
     BASE_FP_WAIT_MS WaitMs;
 
+    // Optional in-place receive; the returned handle must go back to Release
+    BASE_FP_RECV_REF RecvRef;
+    BASE_FP_RELEASE Release;
+
     BASE_FP_SET_USER_DEFINED_DATA_POINTER SetUserDefinedDataPointer;
     BASE_FP_GET_USER_DEFINED_DATA_POINTER GetUserDefinedDataPointer;
 
@@ -233,7 +255,8 @@ struct BASE_INTERFACE_MODULE_TAG
     pthread_mutex_t mutex;
     pthread_cond_t  cond;
     uint16_t evtLen;
-    uint8_t evtBuffer[300];
+    uint8_t *pEvt;
+    void *pEvtHandle;
 };
 
 #endif
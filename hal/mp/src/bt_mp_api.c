@@ -67,7 +67,19 @@
 #define BT_PARAM_IDX16   16
 #define BT_PARAM_IDX17   17
 #define BT_PARAM_IDX18   18
-#define BT_PARAM_IDX_NUM 19
+#define BT_PARAM_IDX19   19  //RxSamplePeriodMs
+#define BT_PARAM_IDX20   20  //SweepChannels
+#define BT_PARAM_IDX21   21  //SweepPktTypes
+#define BT_PARAM_IDX22   22  //SweepDwellMs
+#define BT_PARAM_IDX23   23  //LeMatrixPhys
+#define BT_PARAM_IDX24   24  //LeMatrixModIdx
+#define BT_PARAM_IDX25   25  //LeMatrixPayloads
+#define BT_PARAM_IDX26   26  //RxEarlyStopMode
+#define BT_PARAM_IDX27   27  //RxBerLimitPpm
+#define BT_PARAM_IDX28   28  //ThermalPeriodMs
+#define BT_PARAM_IDX29   29  //ThermalCompMode
+#define BT_PARAM_IDX30   30  //ThermalSlope
+#define BT_PARAM_IDX_NUM 31
 
 
 #if (MP_TOOL_COMMAND_SEARCH_EXIST_PERMISSION == 1)
@@ -94,8 +106,47 @@ bt_device_info_t bt_device_info[BT_DEVICE_INFO_NUMBER];
 #endif
 
 
+// List params: returns the array, its fill count and its capacity, NULL for any other index
+static uint8_t *bt_index2list(BT_MODULE *pBtModule, int index, uint8_t **pp_num, uint8_t *p_max)
+{
+    BT_PARAMETER *pBtParam = pBtModule->pBtParam;
+
+    switch (index) {
+    case BT_PARAM_IDX20:
+        *pp_num = &pBtParam->SweepChannelNum;
+        *p_max = BT_SWEEP_MAX_CHANNELS;
+        return pBtParam->SweepChannels;
+    case BT_PARAM_IDX21:
+        *pp_num = &pBtParam->SweepPktTypeNum;
+        *p_max = BT_SWEEP_MAX_PKT_TYPES;
+        return pBtParam->SweepPktTypes;
+    case BT_PARAM_IDX23:
+        *pp_num = &pBtParam->LeMatrixPhyNum;
+        *p_max = BT_LE_MATRIX_MAX_PHYS;
+        return pBtParam->LeMatrixPhys;
+    case BT_PARAM_IDX24:
+        *pp_num = &pBtParam->LeMatrixModIdxNum;
+        *p_max = BT_LE_MATRIX_MAX_MOD_IDX;
+        return pBtParam->LeMatrixModIdx;
+    case BT_PARAM_IDX25:
+        *pp_num = &pBtParam->LeMatrixPayloadNum;
+        *p_max = BT_LE_MATRIX_MAX_PAYLOADS;
+        return pBtParam->LeMatrixPayloads;
+    case BT_PARAM_IDX30:
+        *pp_num = &pBtParam->ThermalSlopeNum;
+        *p_max = BT_THERMAL_MAX_SLOPE;
+        return pBtParam->ThermalSlope;
+    default:
+        *pp_num = NULL;
+        *p_max = 0;
+        return NULL;
+    }
+}
+
 static void bt_index2param(BT_MODULE *pBtModule, int index, int64_t value)
 {
+    uint8_t *p_list, *p_num, max;
+
     switch (index) {
     case BT_PARAM_IDX0:
         pBtModule->pBtParam->mPGRawData[0] = (uint8_t)value;
@@ -154,6 +205,33 @@ static void bt_index2param(BT_MODULE *pBtModule, int index, int64_t value)
     case BT_PARAM_IDX18:
          pBtModule->pBtParam->mParamData[0]= (uint8_t)value;
         break;
+    case BT_PARAM_IDX19:
+        pBtModule->pBtParam->RxSamplePeriodMs = (uint32_t)value;
+        break;
+    case BT_PARAM_IDX20:
+    case BT_PARAM_IDX21:
+    case BT_PARAM_IDX23:
+    case BT_PARAM_IDX24:
+    case BT_PARAM_IDX25:
+    case BT_PARAM_IDX30:
+        p_list = bt_index2list(pBtModule, index, &p_num, &max);
+        p_list[0] = (uint8_t)value;
+        break;
+    case BT_PARAM_IDX22:
+        pBtModule->pBtParam->SweepDwellMs = (uint16_t)value;
+        break;
+    case BT_PARAM_IDX26:
+        pBtModule->pBtParam->RxEarlyStopMode = (uint8_t)value;
+        break;
+    case BT_PARAM_IDX27:
+        pBtModule->pBtParam->RxBerLimitPpm = (uint32_t)value;
+        break;
+    case BT_PARAM_IDX28:
+        pBtModule->pBtParam->ThermalPeriodMs = (uint32_t)value;
+        break;
+    case BT_PARAM_IDX29:
+        pBtModule->pBtParam->ThermalCompMode = (uint8_t)value;
+        break;
     default:
         break;
     }
@@ -650,6 +728,7 @@ static void bt_index2print(BT_MODULE *pBtModule, int index, char *buf_cb)
 {
     char pair_str[6];
     uint8_t i, len;
+    uint8_t *p_list, *p_num, max;
 
     switch (index) {
     case BT_PARAM_IDX0:
@@ -782,6 +861,68 @@ static void bt_index2print(BT_MODULE *pBtModule, int index, char *buf_cb)
                 BT_FUNCTION_SUCCESS, STR_BT_MP_RESULT_DELIM,
                 pBtModule->pBtParam->mParamData[0]);
         break;
+    case BT_PARAM_IDX19:
+        sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                STR_BT_MP_GET_PARAM, STR_BT_MP_RESULT_DELIM,
+                index, STR_BT_MP_RESULT_DELIM,
+                BT_FUNCTION_SUCCESS, STR_BT_MP_RESULT_DELIM,
+                pBtModule->pBtParam->RxSamplePeriodMs);
+        break;
+    case BT_PARAM_IDX20:
+    case BT_PARAM_IDX21:
+    case BT_PARAM_IDX23:
+    case BT_PARAM_IDX24:
+    case BT_PARAM_IDX25:
+    case BT_PARAM_IDX30:
+        p_list = bt_index2list(pBtModule, index, &p_num, &max);
+        len = *p_num;
+
+        sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                STR_BT_MP_GET_PARAM, STR_BT_MP_RESULT_DELIM,
+                index, STR_BT_MP_RESULT_DELIM,
+                BT_FUNCTION_SUCCESS, STR_BT_MP_RESULT_DELIM,
+                len);
+
+        for (i = 0; i < len; i++) {
+            sprintf(pair_str, "%s0x%02x", STR_BT_MP_RESULT_DELIM, p_list[i]);
+            strcat(buf_cb, pair_str);
+        }
+        break;
+    case BT_PARAM_IDX22:
+        sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                STR_BT_MP_GET_PARAM, STR_BT_MP_RESULT_DELIM,
+                index, STR_BT_MP_RESULT_DELIM,
+                BT_FUNCTION_SUCCESS, STR_BT_MP_RESULT_DELIM,
+                pBtModule->pBtParam->SweepDwellMs);
+        break;
+    case BT_PARAM_IDX26:
+        sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                STR_BT_MP_GET_PARAM, STR_BT_MP_RESULT_DELIM,
+                index, STR_BT_MP_RESULT_DELIM,
+                BT_FUNCTION_SUCCESS, STR_BT_MP_RESULT_DELIM,
+                pBtModule->pBtParam->RxEarlyStopMode);
+        break;
+    case BT_PARAM_IDX27:
+        sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                STR_BT_MP_GET_PARAM, STR_BT_MP_RESULT_DELIM,
+                index, STR_BT_MP_RESULT_DELIM,
+                BT_FUNCTION_SUCCESS, STR_BT_MP_RESULT_DELIM,
+                pBtModule->pBtParam->RxBerLimitPpm);
+        break;
+    case BT_PARAM_IDX28:
+        sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                STR_BT_MP_GET_PARAM, STR_BT_MP_RESULT_DELIM,
+                index, STR_BT_MP_RESULT_DELIM,
+                BT_FUNCTION_SUCCESS, STR_BT_MP_RESULT_DELIM,
+                pBtModule->pBtParam->ThermalPeriodMs);
+        break;
+    case BT_PARAM_IDX29:
+        sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                STR_BT_MP_GET_PARAM, STR_BT_MP_RESULT_DELIM,
+                index, STR_BT_MP_RESULT_DELIM,
+                BT_FUNCTION_SUCCESS, STR_BT_MP_RESULT_DELIM,
+                pBtModule->pBtParam->ThermalCompMode);
+        break;
     default:
         break;
     }
@@ -832,6 +973,11 @@ static void bt_item2print(BT_DEVICE_REPORT *pBtDeviceReport, int item, char *buf
                 pBtDeviceReport->TotalRXBits, STR_BT_MP_RESULT_DELIM,
                 pBtDeviceReport->TotalRxCounts, STR_BT_MP_RESULT_DELIM,
                 pBtDeviceReport->TotalRxErrorBits);
+
+        // early stop verdict only once decided, older front ends see no change
+        if (pBtDeviceReport->RxVerdict != BT_RX_VERDICT_NONE)
+            sprintf(buf_cb + strlen(buf_cb), "%s0x%02x",
+                    STR_BT_MP_RESULT_DELIM, pBtDeviceReport->RxVerdict);
         break;
 
     case REPORT_TX_GAIN_TABLE:
@@ -1297,6 +1443,7 @@ int BT_SetParam(BT_MODULE *pBtModule, char *p, char *buf_cb)
     int index = -1;
     int var_pair;
     int64_t value = 0;
+    uint8_t *p_list, *p_num, max;
 
     SYSLOGI("++%s: %s", STR_BT_MP_SET_PARAM, p);
 
@@ -1318,7 +1465,8 @@ int BT_SetParam(BT_MODULE *pBtModule, char *p, char *buf_cb)
                             index, STR_BT_MP_RESULT_DELIM,
                             FUNCTION_PARAMETER_ERROR);
                     return FUNCTION_PARAMETER_ERROR;
-                } else if (index == BT_PARAM_IDX0 || index == BT_PARAM_IDX12 || index == BT_PARAM_IDX13 ||index == BT_PARAM_IDX18) {
+                } else if (index == BT_PARAM_IDX0 || index == BT_PARAM_IDX12 || index == BT_PARAM_IDX13 ||index == BT_PARAM_IDX18 ||
+                           bt_index2list(pBtModule, index, &p_num, &max) != NULL) {
                     var_pair = 1;
                 }
             } else if (param_token && params_count == 1) {
@@ -1332,12 +1480,16 @@ int BT_SetParam(BT_MODULE *pBtModule, char *p, char *buf_cb)
                     pBtModule->pBtParam->TXDACTable[params_count - 1] = (uint8_t)strtoll(param_token, NULL, 0);
                 else if (index == BT_PARAM_IDX18 && params_count <= MAX_USERAWDATA_SIZE)
                     pBtModule->pBtParam->mParamData[params_count - 1] = (uint8_t)strtoll(param_token, NULL, 0);
+                else if ((p_list = bt_index2list(pBtModule, index, &p_num, &max)) != NULL && params_count <= max)
+                    p_list[params_count - 1] = (uint8_t)strtoll(param_token, NULL, 0);
             } else if (param_token == NULL) // null token OR token parsing completed
                 break;
         }
 
         if (params_count >= 2 && var_pair == 1) {
             bt_index2param(pBtModule, index, value);
+            if (bt_index2list(pBtModule, index, &p_num, &max) != NULL)
+                *p_num = (params_count - 1 < max) ? params_count - 1 : max;
             uint16_t i = 0;
             for (i = 0; i < params_count - 1; i++) {
                 if (index == BT_PARAM_IDX0) // variable pair format<index, cmd, len, data...>
@@ -1350,6 +1502,8 @@ int BT_SetParam(BT_MODULE *pBtModule, char *p, char *buf_cb)
         } else if (params_count == 2 && var_pair == 0) { // 2-param pair format<index, value>
             SYSLOGI("Pair index %d, pair value 0x%llx", index, value);
             bt_index2param(pBtModule, index, value);
+        } else if (params_count == 1 && bt_index2list(pBtModule, index, &p_num, &max) != NULL) { // empty list
+            *p_num = 0;
         } else if (params_count == 0) { // null pair
             continue;
         } else { // wrong pair format
@@ -1619,7 +1773,7 @@ op_err:
     return FUNCTION_ERROR;
 }
 
-int BT_Exec(BT_MODULE *pBtModule, char *p, char *buf_cb)
+int BT_ExecResult(BT_MODULE *pBtModule, char *p, bt_mp_result_t *pResult)
 {
     char *token = NULL;
     char *endptr = NULL;
@@ -1658,40 +1812,40 @@ int BT_Exec(BT_MODULE *pBtModule, char *p, char *buf_cb)
     pBtParam->ParameterIndex = action_index;
 
     ret = pBtModule->ActionControlExcute(pBtModule);
-    if (ret == BT_FUNCTION_SUCCESS) {
-        SYSLOGI("%s%s%d%s0x%02x",
-                STR_BT_MP_EXEC, STR_BT_MP_RESULT_DELIM,
-                action_index, STR_BT_MP_RESULT_DELIM,
-                ret);
 
-        sprintf(buf_cb, "%s%s%d%s0x%02x",
-                STR_BT_MP_EXEC, STR_BT_MP_RESULT_DELIM,
-                action_index, STR_BT_MP_RESULT_DELIM,
-                ret);
-    } else {
-        goto exit;
+exit:
+    SYSLOGI("--%s: action index[%d], ret[0x%02x]", STR_BT_MP_EXEC, action_index, ret);
+
+    pResult->opcode = BT_MP_OP_USER_DEF_Exec;
+    pResult->type = BT_MP_RESULT_STATUS;
+    pResult->status = ret;
+    pResult->item = action_index;
+    pResult->len = 0;
+    pResult->data = NULL;
+
+    // a sweep hands back its results table
+    if (action_index == PACKET_TX_SWEEP && pBtModule->SweepPointNum) {
+        pResult->type = BT_MP_RESULT_SWEEP;
+        pResult->len = pBtModule->SweepPointNum * sizeof(BT_SWEEP_POINT);
+        pResult->data = pBtModule->SweepResult;
     }
 
-    SYSLOGI("--%s: action index[%d]", STR_BT_MP_EXEC, action_index);
     return ret;
+}
 
-exit:
-    SYSLOGI("%s%s%d%s0x%02x",
-            STR_BT_MP_EXEC, STR_BT_MP_RESULT_DELIM,
-            action_index, STR_BT_MP_RESULT_DELIM,
-            ret);
+int BT_Exec(BT_MODULE *pBtModule, char *p, char *buf_cb)
+{
+    bt_mp_result_t result;
+    int ret;
 
-    sprintf(buf_cb, "%s%s%d%s0x%02x",
-            STR_BT_MP_EXEC, STR_BT_MP_RESULT_DELIM,
-            action_index, STR_BT_MP_RESULT_DELIM,
-            ret);
+    ret = BT_ExecResult(pBtModule, p, &result);
+    BT_RenderResult(&result, buf_cb);
 
     return ret;
 }
 
-int BT_Report(BT_MODULE *pBtModule, char *p, char *buf_cb)
+int BT_ReportResult(BT_MODULE *pBtModule, char *p, bt_mp_result_t *pResult, BT_DEVICE_REPORT *pReport)
 {
-    BT_DEVICE_REPORT BtDeviceReport;
     char *token = NULL;
     char *endptr = NULL;
     int report_item = -1;
@@ -1699,45 +1853,191 @@ int BT_Report(BT_MODULE *pBtModule, char *p, char *buf_cb)
 
     SYSLOGI("++%s: %s", STR_BT_MP_REPORT, p);
 
+    pResult->opcode = BT_MP_OP_USER_DEF_Report;
+    pResult->type = BT_MP_RESULT_STATUS;
+    pResult->len = 0;
+    pResult->data = NULL;
+
     token = strtok(p, STR_BT_MP_PARAM_DELIM);
     if (token != NULL) {
         report_item = strtol(token, &endptr, 0);
         if (*endptr) {
             report_item = -1;
             ret = FUNCTION_PARAMETER_ERROR;
-            goto exit;
         }
     } else {
-        report_item = -1;
         ret = FUNCTION_PARAMETER_ERROR;
-        goto exit;
     }
 
-    ret = pBtModule->ActionReport(pBtModule, report_item, &BtDeviceReport);
+    if (ret == BT_FUNCTION_SUCCESS)
+        ret = pBtModule->ActionReport(pBtModule, report_item, pReport);
 
     if (ret == BT_FUNCTION_SUCCESS) {
-        bt_item2print(&BtDeviceReport, report_item, buf_cb);
-    } else {
-        goto exit;
+        pResult->type = BT_MP_RESULT_REPORT;
+        pResult->len = sizeof(BT_DEVICE_REPORT);
+        pResult->data = pReport;
+    }
+
+    // the thermal monitor hands back its time series
+    if (ret == BT_FUNCTION_SUCCESS && report_item == REPORT_THERMAL_MONITOR) {
+        pResult->type = BT_MP_RESULT_THERMAL;
+        pResult->len = pBtModule->ThermalMonitor.ReportCount * sizeof(BT_THERMAL_SAMPLE);
+        pResult->data = pBtModule->ThermalMonitor.Report;
     }
 
-    SYSLOGI("--%s", STR_BT_MP_REPORT);
+    pResult->status = ret;
+    pResult->item = report_item;
+
+    SYSLOGI("--%s: item[%d], ret[0x%02x]", STR_BT_MP_REPORT, report_item, ret);
     return ret;
+}
 
-exit:
-    SYSLOGI("%s%s%d%s0x%02x",
-            STR_BT_MP_REPORT, STR_BT_MP_RESULT_DELIM,
-            report_item, STR_BT_MP_RESULT_DELIM,
-            ret);
+int BT_Report(BT_MODULE *pBtModule, char *p, char *buf_cb)
+{
+    BT_DEVICE_REPORT BtDeviceReport;
+    bt_mp_result_t result;
+    int ret;
 
-    sprintf(buf_cb, "%s%s%d%s0x%02x",
-            STR_BT_MP_REPORT, STR_BT_MP_RESULT_DELIM,
-            report_item, STR_BT_MP_RESULT_DELIM,
-            ret);
+    ret = BT_ReportResult(pBtModule, p, &result, &BtDeviceReport);
+    BT_RenderResult(&result, buf_cb);
 
     return ret;
 }
 
+/* Sweep rows as channel, packet type, status, tx count quadruples after the
+ * point count, as many as fit in the text buffer */
+static void bt_sweep2print(const bt_mp_result_t *pResult, char *buf_cb)
+{
+    const uint8_t *p = (const uint8_t *)pResult->data;
+    uint16_t num = pResult->len / sizeof(BT_SWEEP_POINT);
+    BT_SWEEP_POINT point;
+    char row_str[48];
+    size_t used;
+    uint16_t i;
+
+    used = sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                   STR_BT_MP_EXEC, STR_BT_MP_RESULT_DELIM,
+                   pResult->item, STR_BT_MP_RESULT_DELIM,
+                   pResult->status, STR_BT_MP_RESULT_DELIM,
+                   num);
+
+    for (i = 0; i < num; i++) {
+        memcpy(&point, p + i * sizeof(point), sizeof(point));
+        sprintf(row_str, "%s%u%s%u%s0x%02x%s%u",
+                STR_BT_MP_RESULT_DELIM, point.Channel,
+                STR_BT_MP_RESULT_DELIM, point.PacketType,
+                STR_BT_MP_RESULT_DELIM, point.Status,
+                STR_BT_MP_RESULT_DELIM, point.TxCounts);
+        if (used + strlen(row_str) >= BT_MP_RESULT_TEXT_MAX)
+            break;
+        strcpy(buf_cb + used, row_str);
+        used += strlen(row_str);
+    }
+}
+
+/* Thermal samples as elapsed ms, thermal, step, comp quadruples after the
+ * sample count, as many as fit in the text buffer */
+static void bt_thermal2print(const bt_mp_result_t *pResult, char *buf_cb)
+{
+    const uint8_t *p = (const uint8_t *)pResult->data;
+    uint16_t num = pResult->len / sizeof(BT_THERMAL_SAMPLE);
+    BT_THERMAL_SAMPLE sample;
+    char row_str[48];
+    size_t used;
+    uint16_t i;
+
+    used = sprintf(buf_cb, "%s%s%d%s0x%02x%s%u",
+                   STR_BT_MP_REPORT, STR_BT_MP_RESULT_DELIM,
+                   pResult->item, STR_BT_MP_RESULT_DELIM,
+                   pResult->status, STR_BT_MP_RESULT_DELIM,
+                   num);
+
+    for (i = 0; i < num; i++) {
+        memcpy(&sample, p + i * sizeof(sample), sizeof(sample));
+        sprintf(row_str, "%s%u%s%u%s%u%s%u",
+                STR_BT_MP_RESULT_DELIM, sample.ElapsedMs,
+                STR_BT_MP_RESULT_DELIM, sample.Thermal,
+                STR_BT_MP_RESULT_DELIM, sample.Step,
+                STR_BT_MP_RESULT_DELIM, sample.Comp);
+        if (used + strlen(row_str) >= BT_MP_RESULT_TEXT_MAX)
+            break;
+        strcpy(buf_cb + used, row_str);
+        used += strlen(row_str);
+    }
+}
+
+/* One LE matrix cell as channel, PHY, modulation index, payload, packets,
+ * expected and PER in 0.01 %, the PER left empty for TX cells */
+static void bt_lecell2print(const bt_mp_result_t *pResult, char *buf_cb)
+{
+    BT_LE_MATRIX_CELL cell;
+    char per_str[8] = "";
+
+    memcpy(&cell, pResult->data, sizeof(cell));
+    if (cell.Per != BT_LE_MATRIX_PER_NONE)
+        sprintf(per_str, "%u", cell.Per);
+
+    sprintf(buf_cb, "%s%s%d%s0x%02x%s%u%s%u%s%u%s%u%s%u%s%u%s%s",
+            STR_BT_MP_EXEC, STR_BT_MP_RESULT_DELIM,
+            pResult->item, STR_BT_MP_RESULT_DELIM,
+            cell.Status, STR_BT_MP_RESULT_DELIM,
+            cell.Channel, STR_BT_MP_RESULT_DELIM,
+            cell.PHY, STR_BT_MP_RESULT_DELIM,
+            cell.ModulationIndex, STR_BT_MP_RESULT_DELIM,
+            cell.PayloadType, STR_BT_MP_RESULT_DELIM,
+            cell.Packets, STR_BT_MP_RESULT_DELIM,
+            cell.Expected, STR_BT_MP_RESULT_DELIM,
+            per_str);
+}
+
+/* Format a result record the way the text front end has always shown it,
+ * buf_cb holds BT_MP_RESULT_TEXT_MAX bytes */
+int BT_RenderResult(const bt_mp_result_t *pResult, char *buf_cb)
+{
+    const char *op_str;
+
+    buf_cb[0] = '\0';
+
+    switch (pResult->type) {
+    case BT_MP_RESULT_TEXT:
+        if (pResult->len) {
+            strncpy(buf_cb, (const char *)pResult->data, BT_MP_RESULT_TEXT_MAX - 1);
+            buf_cb[BT_MP_RESULT_TEXT_MAX - 1] = '\0';
+        }
+        break;
+
+    case BT_MP_RESULT_REPORT:
+        bt_item2print((BT_DEVICE_REPORT *)pResult->data, pResult->item, buf_cb);
+        break;
+
+    case BT_MP_RESULT_SWEEP:
+        bt_sweep2print(pResult, buf_cb);
+        break;
+
+    case BT_MP_RESULT_LE_CELL:
+        if (pResult->len >= sizeof(BT_LE_MATRIX_CELL))
+            bt_lecell2print(pResult, buf_cb);
+        break;
+
+    case BT_MP_RESULT_THERMAL:
+        bt_thermal2print(pResult, buf_cb);
+        break;
+
+    case BT_MP_RESULT_STATUS:
+        op_str = (pResult->opcode == BT_MP_OP_USER_DEF_Exec) ? STR_BT_MP_EXEC : STR_BT_MP_REPORT;
+        sprintf(buf_cb, "%s%s%d%s0x%02x",
+                op_str, STR_BT_MP_RESULT_DELIM,
+                pResult->item, STR_BT_MP_RESULT_DELIM,
+                pResult->status);
+        break;
+
+    default:
+        break;
+    }
+
+    return strlen(buf_cb);
+}
+
 int BT_RegRW(BT_MODULE *pBtModule, char *p, char *buf_cb)
 {
     char *token = NULL;
@@ -1874,12 +2174,17 @@ void bt_mp_module_init(BASE_INTERFACE_MODULE *pBaseInterfaceModule, BT_MODULE *p
             bt_transport_WaitMs
             );
 
+    pBaseInterfaceModule->RecvRef = bt_transport_RecvHciEvtRef;
+    pBaseInterfaceModule->Release = bt_transport_ReleaseHciEvt;
+
     BuildBluetoothModule(
             pBaseInterfaceModule,
             pBtModule
             );
 
     pBtModule->pBtDevice->pBTInfo->ChipType = RTK_BT_CHIP_ID_UNKNOWCHIP;
+    BTDevice_InvalidateChipInfo(pBtModule->pBtDevice);
+    BTDevice_BindChipOps(pBtModule->pBtDevice);
 
     pBtModule->pBtParam->mPGRawData[0] = 0;
     pBtModule->pBtParam->mChannelNumber = DEFAULT_CH_NUM;
@@ -1893,4 +2198,9 @@ void bt_mp_module_init(BASE_INTERFACE_MODULE *pBaseInterfaceModule, BT_MODULE *p
     pBtModule->pBtParam->mPacketHeader = DEFAULT_PKT_HEADER;
     pBtModule->pBtParam->bHoppingFixChannel = DEFAULT_HOPPING_CH_NUM;
     pBtModule->pBtParam->mHitTarget = DEFAULT_HIT_ADDRESS;
+    pBtModule->pBtParam->RxSamplePeriodMs = BT_MP_RX_SAMPLE_MS;
+    pBtModule->pBtParam->RxEarlyStopMode = BT_RX_EARLY_STOP_OFF;
+    pBtModule->pBtParam->RxBerLimitPpm = BT_RX_BER_LIMIT_PPM;
+    pBtModule->pBtParam->ThermalPeriodMs = BT_MP_THERMAL_SAMPLE_MS;
+    pBtModule->pBtParam->ThermalCompMode = BT_THERMAL_COMP_OFF;
 }
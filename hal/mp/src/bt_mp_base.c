@@ -40,6 +40,49 @@ error:
 
 
 
+static int
+bt_RecvPacket(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        uint8_t *pLocalBuf,
+        uint8_t **ppRecvBuf,
+        uint32_t *pRetlen,
+        void **ppHandle
+        )
+{
+    *ppHandle = NULL;
+
+    /* Prefer reading the received packet in place */
+    if (pBaseInterface->RecvRef != NULL)
+    {
+        if (pBaseInterface->RecvRef(pBaseInterface, ppRecvBuf, pRetlen, ppHandle) != BT_FUNCTION_SUCCESS)
+            return FUNCTION_ERROR;
+
+        if (*ppHandle == NULL || *pRetlen > HCI_EVT_LEN_MAX)
+            return FUNCTION_ERROR;
+
+        return BT_FUNCTION_SUCCESS;
+    }
+
+    if (pBaseInterface->Recv(pBaseInterface, pLocalBuf, HCI_EVT_LEN_MAX, pRetlen) != BT_FUNCTION_SUCCESS)
+        return FUNCTION_ERROR;
+
+    *ppRecvBuf = pLocalBuf;
+
+    return BT_FUNCTION_SUCCESS;
+}
+
+static void
+bt_ReleasePacket(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        void *pHandle
+        )
+{
+    if (pHandle != NULL && pBaseInterface->Release != NULL)
+        pBaseInterface->Release(pBaseInterface, pHandle);
+}
+
+
+
 int
 bt_Recv(
         BT_DEVICE *pBt,
@@ -50,11 +93,13 @@ bt_Recv(
 {
     BASE_INTERFACE_MODULE *pBaseInterface;
     uint8_t ucRecvBuf[HCI_EVT_LEN_MAX];
-    uint32_t Retlen;
+    uint8_t *pRecvBuf = NULL;
+    void *pHandle = NULL;
+    uint32_t Retlen = 0;
 
     pBaseInterface = pBt->pBaseInterface;
 
-    if (pBaseInterface->Recv(pBaseInterface, ucRecvBuf, HCI_EVT_LEN_MAX, &Retlen) != BT_FUNCTION_SUCCESS)
+    if (bt_RecvPacket(pBaseInterface, ucRecvBuf, &pRecvBuf, &Retlen, &pHandle) != BT_FUNCTION_SUCCESS)
         goto error;
 
     switch (PktType)
@@ -64,7 +109,7 @@ bt_Recv(
         {
             goto error;
         }
-        memcpy(pReadingBuf, ucRecvBuf, Retlen);
+        memcpy(pReadingBuf, pRecvBuf, Retlen);
         *pLen = Retlen;
         break;
 
@@ -73,7 +118,7 @@ bt_Recv(
         {
             goto error;
         }
-        memcpy(pReadingBuf, ucRecvBuf, Retlen);
+        memcpy(pReadingBuf, pRecvBuf, Retlen);
         *pLen = Retlen;
         break;
 
@@ -82,7 +127,7 @@ bt_Recv(
         {
             goto error;
         }
-        memcpy(pReadingBuf, ucRecvBuf, Retlen);
+        memcpy(pReadingBuf, pRecvBuf, Retlen);
         *pLen = Retlen;
         break;
     case HCIIO_BTCMD:
@@ -92,9 +137,11 @@ bt_Recv(
         goto error;
     }
 
+    bt_ReleasePacket(pBaseInterface, pHandle);
     return BT_FUNCTION_SUCCESS;
 
 error:
+    bt_ReleasePacket(pBaseInterface, pHandle);
     return FUNCTION_ERROR;
 }
 
@@ -161,12 +208,14 @@ bt_uart_Recv(
 {
     BASE_INTERFACE_MODULE *pBaseInterface;
     uint8_t ucRecvBuf[HCI_EVT_LEN_MAX];
-    uint32_t Retlen;
+    uint8_t *pRecvBuf = NULL;
+    void *pHandle = NULL;
+    uint32_t Retlen = 0;
     unsigned long n=0;
 
     pBaseInterface = pBt->pBaseInterface;
 
-    if (pBaseInterface->Recv(pBaseInterface, ucRecvBuf, HCI_EVT_LEN_MAX, &Retlen) != BT_FUNCTION_SUCCESS)
+    if (bt_RecvPacket(pBaseInterface, ucRecvBuf, &pRecvBuf, &Retlen, &pHandle) != BT_FUNCTION_SUCCESS)
         goto error;
 
     switch (PktType)
@@ -177,12 +226,12 @@ bt_uart_Recv(
             goto error;
         }
 
-        if (ucRecvBuf[0] != IF_UART_EVT) //Check PKT Indicator
+        if (pRecvBuf[0] != IF_UART_EVT) //Check PKT Indicator
         {
             goto error;
         }
         --Retlen;
-        memcpy(pReadingBuf, (ucRecvBuf + 1), Retlen);
+        memcpy(pReadingBuf, (pRecvBuf + 1), Retlen);
         *pLen = Retlen;
         break;
 
@@ -192,12 +241,12 @@ bt_uart_Recv(
             goto error;
         }
 
-        if (ucRecvBuf[0] != IF_UART_ACL) //Check PKT Indicator
+        if (pRecvBuf[0] != IF_UART_ACL) //Check PKT Indicator
         {
             goto error;
         }
         --Retlen;
-        memcpy(pReadingBuf, (ucRecvBuf + 1), Retlen);
+        memcpy(pReadingBuf, (pRecvBuf + 1), Retlen);
         *pLen = Retlen;
         break;
 
@@ -207,12 +256,12 @@ bt_uart_Recv(
             goto error;
         }
 
-        if (ucRecvBuf[0] != IF_UART_SCO) //Check PKT Indicator
+        if (pRecvBuf[0] != IF_UART_SCO) //Check PKT Indicator
         {
             goto error;
         }
         --Retlen;
-        memcpy(pReadingBuf, (ucRecvBuf + 1), Retlen);
+        memcpy(pReadingBuf, (pRecvBuf + 1), Retlen);
         *pLen = Retlen;
         break;
 
@@ -223,9 +272,11 @@ bt_uart_Recv(
         goto error;
     }
 
+    bt_ReleasePacket(pBaseInterface, pHandle);
     return BT_FUNCTION_SUCCESS;
 
 error:
+    bt_ReleasePacket(pBaseInterface, pHandle);
     return FUNCTION_ERROR;
 }
 
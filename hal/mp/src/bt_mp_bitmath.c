@@ -0,0 +1,101 @@
+#define LOG_TAG "bt_mp_bitmath"
+
+#include "bt_mp_bitmath.h"
+
+
+#define BT_BITMATH_LAP_MASK     0xFFFFFFULL
+
+
+uint32_t
+bt_bitmath_barker(
+        uint32_t Lap
+        )
+{
+    Lap &= BT_BITMATH_LAP_MASK;
+
+    // a24..a29 = 001101 after a23 = 0, 110010 after a23 = 1
+    return Lap | ((Lap & 0x800000) ? 0x13000000 : 0x2C000000);
+}
+
+
+
+uint64_t
+bt_bitmath_bch_parity(
+        uint32_t Info
+        )
+{
+    uint64_t Rem = (uint64_t)Info << BT_BITMATH_PARITY_BITS;
+    int i;
+
+    // D^34 * info mod g(D), one generator XOR per set bit from the top
+    for (i = 63; i >= BT_BITMATH_PARITY_BITS; i--)
+    {
+        if (Rem & (1ULL << i))
+            Rem ^= BT_BITMATH_BCH_GEN << (i - BT_BITMATH_PARITY_BITS);
+    }
+
+    return Rem;
+}
+
+
+
+uint64_t
+bt_bitmath_sync_word(
+        uint32_t Lap
+        )
+{
+    uint32_t Info = bt_bitmath_barker(Lap) ^ (uint32_t)(BT_BITMATH_PN >> BT_BITMATH_PARITY_BITS);
+    uint64_t Word = ((uint64_t)Info << BT_BITMATH_PARITY_BITS) | bt_bitmath_bch_parity(Info);
+
+    return Word ^ BT_BITMATH_PN;
+}
+
+
+
+static uint64_t
+bt_bitmath_reverse64(
+        uint64_t v
+        )
+{
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    v = ((v >> 8) & 0x00FF00FF00FF00FFULL) | ((v & 0x00FF00FF00FF00FFULL) << 8);
+    v = ((v >> 16) & 0x0000FFFF0000FFFFULL) | ((v & 0x0000FFFF0000FFFFULL) << 16);
+
+    return (v >> 32) | (v << 32);
+}
+
+
+
+void
+bt_bitmath_access_code(
+        uint64_t HitTarget,
+        uint16_t *pAccessCode
+        )
+{
+    static uint32_t MemoLap;
+    static uint64_t MemoReg;
+    static int MemoValid = 0;
+    uint32_t Lap = (uint32_t)(HitTarget & BT_BITMATH_LAP_MASK);
+    uint64_t Reg;
+    int i;
+
+    if (MemoValid && (MemoLap == Lap))
+    {
+        Reg = MemoReg;
+    }
+    else
+    {
+        // registers take s63 first, s0 last and inverted, the way the
+        // preamble was always written over it
+        Reg = bt_bitmath_reverse64(bt_bitmath_sync_word(Lap)) ^ (1ULL << 63);
+
+        MemoLap = Lap;
+        MemoReg = Reg;
+        MemoValid = 1;
+    }
+
+    for (i = 0; i < 4; i++)
+        pAccessCode[i] = (uint16_t)(Reg >> (16 * i));
+}
@@ -1,5 +1,7 @@
 #define LOG_TAG "btif_mp_build"
 
+#include <time.h>
+
 #include "bluetoothmp.h"
 #include "bt_mp_device_efuse_base.h"
 #include "bt_mp_build.h"
@@ -63,10 +65,12 @@ BuildBluetoothDevice(
     pBtDevice->SetPktTxBegin            =   BTDevice_SetPktTxBegin;
     pBtDevice->SetPktTxStop             =   BTDevice_SetPktTxStop;
     pBtDevice->SetPktTxUpdate           =   BTDevice_SetPktTxUpdate;
+    pBtDevice->SetPktTxRetune           =   BTDevice_SetPktTxRetune;
     //PKT-RX
     pBtDevice->SetPktRxBegin            =   BTDevice_SetPktRxBegin;
     pBtDevice->SetPktRxStop             =   BTDevice_SetPktRxStop;
     pBtDevice->SetPktRxUpdate           =   BTDevice_SetPktRxUpdate;
+    pBtDevice->ReadRxCounters           =   BTDevice_ReadRxCounters;
     //Base Function
     pBtDevice->GetChipVersionInfo       =   BTDevice_GetBTChipVersionInfo;
     pBtDevice->BTDlFW                   =   BTDevice_BTDlFW;
@@ -144,6 +148,30 @@ BuildBluetoothModule(
     pBtModule->SetRegMaskBits       =       BTModule_SetRegMaskBits;
     pBtModule->GetRegMaskBits       =       BTModule_GetRegMaskBits;
 
+    // the sampler threads outlive a rebuild, parked on their conditions
+    if (pBtModule->RxSampler.ThreadStarted || pBtModule->ThermalMonitor.ThreadStarted)
+    {
+        pthread_mutex_lock(&pBtModule->HciLock);
+        pBtModule->RxSampler.Running = 0;
+        pBtModule->RxSampler.Valid = 0;
+        pBtModule->ThermalMonitor.Running = 0;
+        pthread_mutex_unlock(&pBtModule->HciLock);
+    }
+    else
+    {
+        pthread_condattr_t CondAttr;
+
+        pthread_mutex_init(&pBtModule->HciLock, NULL);
+        pthread_condattr_init(&CondAttr);
+        pthread_condattr_setclock(&CondAttr, CLOCK_MONOTONIC);
+        pthread_cond_init(&pBtModule->RxSampler.Cond, &CondAttr);
+        pthread_cond_init(&pBtModule->ThermalMonitor.Cond, &CondAttr);
+        pthread_condattr_destroy(&CondAttr);
+        pBtModule->RxSampler.Running = 0;
+        pBtModule->RxSampler.Valid = 0;
+        pBtModule->ThermalMonitor.Running = 0;
+    }
+
     BuildBluetoothDevice(
             pBaseInterfaceModule,
             &pBtModule->pBtDevice,
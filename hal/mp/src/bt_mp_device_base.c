@@ -2,10 +2,12 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <time.h>
 #include "bt_syslog.h"
 #include "bluetoothmp.h"
 #include "bt_mp_device_efuse_base.h"
 #include "bt_mp_device_base.h"
+#include "bt_mp_bitmath.h"
 
 //#define RF_0379
 #define FW_TX_INTERVAL  0x01
@@ -534,232 +536,16 @@ exit:
 
 
 
-static int
-BTBASE_HitTargetAccessCodeGen(
-        BT_DEVICE *pBtDevice,
-        uint64_t HitTarget,
-        unsigned long *pAccessCode
-        )
-{
-
-#if 1
-    BOOL AccessCode[72];
-    BOOL LC_PN_SEQ_MSB[32]   = {1,0,0,0,0,0,1,1,1,0,0,0,0,1,0,0,1,0,0,0,1,1,0,1,1,0,0,1,0,1,1,0};      //LC_PN_SEQ_MSB=0x83848d96
-    BOOL LC_GEN_POLY_MSB[32] = {0,1,1,0,0,0,0,1,0,1,0,1,1,1,0,0,0,1,0,0,1,1,1,1,0,1,1,0,1,0,1,0};      //LC_GEN_POLY_MSB=0x615c4f6a
-    BOOL LC_GEN_POLY_LSB[32] = {0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};      //LC_GEN_POLY_LSB=0x40000000
-    BOOL p33_p0[34]          = {1,0,1,0,1,1,1,0,1,1,1,1,0,0,1,1,0,0,0,1,0,1,0,1,0,0,1,1,1,1,1,1,0,0};  //PN_seq(P33~P0) = 0x2bbcc54fc
-    BOOL BDAddress[48]; //6 byte  ,48bit
-    BOOL LAP_INV[25], LAP_BK[31], barker_seq[33], temp[33], mod2[33], mod1[33];
-    BOOL Parity[35], hold_mod2[33], hold_mod1[33], tmp;      //Bit0 is not valid
-
-    int i=0, j=0;
-
-    for (i=0;i<72;i++)
-    {
-        AccessCode[i]=0;
-    }
-
-    for (i=47;i>=0;i--)
-    {
-        BDAddress[i]=(int)((HitTarget>>i) &0x01);
-    }
-
-    //Extract LAP from BD Address
-    for (i=1; i<=24; i++)
-    {
-        LAP_INV[i]     =  *(BDAddress + i-1);
-        LAP_BK[i]      =  LAP_INV[i];
-    }
-    if (LAP_INV[24] == 0)
-    {
-        LAP_BK[25] =  0;
-        LAP_BK[26] =  0;
-        LAP_BK[27] =  1;
-        LAP_BK[28] =  1;
-        LAP_BK[29] =  0;
-        LAP_BK[30] =  1;
-    }
-    else
-    {
-        LAP_BK[25] =  1;
-        LAP_BK[26] =  1;
-        LAP_BK[27] =  0;
-        LAP_BK[28] =  0;
-        LAP_BK[29] =  1;
-        LAP_BK[30] =  0;
-    }
-    for (i=1; i<=30; i++)
-    {
-        barker_seq[i] = LAP_BK[31-i];
-    }
-    barker_seq[31] = 0;
-    barker_seq[32] = 0;
-
-    for (i=1; i<=30; i++)
-    {
-        mod2[i] = barker_seq[i] ^ LC_PN_SEQ_MSB[i-1];
-    }
-    mod2[31] = 0;
-    mod2[32] = 0;
-
-    for (i=1; i<=30; i++)
-    {
-        mod1[i] = 0;
-    }
-
-    for (i=1; i<=30; i++)
-    {
-        if (mod2[1] == 1)
-        {
-            if (mod1[1] == 1)
-            {
-                for (j=1; j<=31; j++)  //shift
-                    mod2[j] = mod2[j+1];
-                mod2[32] = 1;
-            }
-            else
-            {
-                for (j=1; j<=31; j++)  //shift
-                    mod2[j] = mod2[j+1];
-
-                mod2[32] = 0;
-            }//end if (mod1[1] == 1)
-
-            for (j=1; j<=31; j++)
-                mod1[j] = mod1[j+1];
-
-            mod1[32] = 0;
-
-            for (j=1; j<=32; j++)
-            {
-                mod2[j] = mod2[j] ^ LC_GEN_POLY_MSB[j-1];
-                mod1[j] = mod1[j] ^ LC_GEN_POLY_LSB[j-1];
-            }//end for (j=1; j<=32; j++)
-        }
-        else //if (mod2[1] == 1) else
-        {
-            if (mod1[1] == 1)
-            {
-                for (j=1; j<=31; j++)  //shift
-                    mod2[j] = mod2[j+1];
-
-                mod2[32] = 1;
-            }
-            else
-            {
-                for (j=1; j<=31; j++)  //shift
-                    mod2[j] = mod2[j+1];
-
-                mod2[32] = 0;
-            }//end (mod1[1] == 1)
-
-            for (j=1; j<=31; j++)
-                mod1[j] = mod1[j+1];
-
-            mod1[32] = 0;
-        }//end if (mod2[1] == 1)
-    } //end for (i=1; i<=30; i++)
-
-    for (i=1; i<=30; i++)
-        hold_mod2[i] = mod2[i+2];
-
-    hold_mod2[31] = 0;
-    hold_mod2[32] = 0;
-
-    for (i=1; i<=30; i++)
-        hold_mod1[i] = 0;
-
-    hold_mod1[31] = mod1[1];
-    hold_mod1[32] = mod1[2];
-
-    for (i=1; i<=32; i++)
-    {
-        temp[i] = hold_mod2[i] | hold_mod1[i];
-        Parity[i+2] = temp[i];
-    }
-
-    Parity[1] = mod2[1];
-    Parity[2] = mod2[2];
-
-    //assign AccessCode
-    for (i=1; i<=34; i++)
-    {
-        tmp = Parity[35-i] ^ p33_p0[34-i];
-        AccessCode[i+3] = tmp;
-    }
-
-    for (i=38; i<=67; i++)
-        AccessCode[i] = LAP_BK[i-37];
-
-
-    if (AccessCode[4] == 1)
-    {
-        AccessCode[0] = 0;
-        AccessCode[1] = 1;
-        AccessCode[2] = 0;
-        AccessCode[3] = 1;
-        AccessCode[4] = 0;
-    }
-    else
-    {
-        AccessCode[0] = 1;
-        AccessCode[1] = 0;
-        AccessCode[2] = 1;
-        AccessCode[3] = 0;
-        AccessCode[4] = 1;
-    } //end if (AccessCode[4] == 1)
-
-    if (AccessCode[67] == 1)
-    {
-        AccessCode[68] = 0;
-        AccessCode[69] = 1;
-        AccessCode[70] = 0;
-        AccessCode[71] = 1;
-    }
-    else
-    {
-        AccessCode[68] = 1;
-        AccessCode[69] = 0;
-        AccessCode[70] = 1;
-        AccessCode[71] = 0;
-    }   //end  if (AccessCode[67] == 1)
-
-    for (i=0;i<4;i++)
-    {
-        for (j=0;j<16;j++)
-        {
-            if (AccessCode[67-((i*16)+j)] == 0)
-                pAccessCode[i]=pAccessCode[i]|(0x0<<j);
-            else
-                pAccessCode[i]=pAccessCode[i]|(0x1<<j);
-        }
-
-    }
-
-#else
-
-#endif
-    return BT_FUNCTION_SUCCESS;
-}
-
-
-
 static int
 BTDevice_SetHitTarget(
         BT_DEVICE *pBtDevice,
         uint64_t HitTarget
         )
 {
-    unsigned long pAccessCode[4];
-    int i=0;
+    uint16_t pAccessCode[4];
 
-    for (i=0;i<4;i++)
-        pAccessCode[i]=0;
-
-    if (BTBASE_HitTargetAccessCodeGen(pBtDevice,HitTarget,pAccessCode) != BT_FUNCTION_SUCCESS)
-    {
-        goto exit;
-    }
+    // checked against the former bitwise generator by bt_bitmath_check
+    bt_bitmath_access_code(HitTarget, pAccessCode);
 
     if (bt_default_SetMDRegMaskBits(pBtDevice,0x1c,15,0,pAccessCode[0]) != BT_FUNCTION_SUCCESS)
     {
@@ -1579,6 +1365,83 @@ exit:
 
 
 
+int
+BTDevice_ReadRxCounters(
+        BT_DEVICE *pBtDevice,
+        BT_PARAMETER *pParam,
+        BT_RX_COUNTERS *pCounters
+        )
+{
+    unsigned char pData[LEN_512_BYTE];
+    unsigned char pEvtBuf[LEN_512_BYTE];
+    uint32_t EvtLen;
+    uint16_t rxCount = 0;
+    uint16_t rxErrbits = 0;
+    uint16_t rxPin = 0;
+    uint16_t data;
+    unsigned int j;
+    char RxRssi;
+
+    pCounters->Reset = 0;
+    pCounters->PktBits = Arrary_PayloadLength[pParam->mPacketType];
+
+    if (pBtDevice->pBTInfo->ChipType < RTK_BT_CHIP_ID_RTL8822B)
+    {
+        //16 bit modem counters, cleared here before they saturate
+        if (bt_default_GetMDRegMaskBits(pBtDevice, 0x70, 15, 10, &rxPin) != BT_FUNCTION_SUCCESS)
+            goto error;
+        if (bt_default_GetMDRegMaskBits(pBtDevice, 0x72, 15, 0, &rxCount) != BT_FUNCTION_SUCCESS)
+            goto error;
+        if (bt_default_GetMDRegMaskBits(pBtDevice, 0x78, 15, 0, &rxErrbits) != BT_FUNCTION_SUCCESS)
+            goto error;
+
+        pCounters->RxCount = rxCount;
+        pCounters->RxErrBits = rxErrbits;
+        pCounters->Mask = 0xffff;
+        pCounters->RxRssi = ((int)rxPin * 2) - 96;
+
+        if ((rxCount > MAX_RX_READ_COUNT_ADR_0X72) || (rxErrbits > MAX_RX_READ_ERRORBITS_ADR_0X78))
+        {
+            if (bt_default_SetMDRegMaskBits(pBtDevice, 0x2e, 10, 9, 0x00) != BT_FUNCTION_SUCCESS)
+                goto error;
+            if (bt_default_SetMDRegMaskBits(pBtDevice, 0x2e, 10, 9, 0x03) != BT_FUNCTION_SUCCESS)
+                goto error;
+            pCounters->Reset = 1;
+        }
+    }
+    else
+    {
+        //32 bit firmware counters, running since FwPacketRxStart
+        if (pBtDevice->SendHciCommandWithEvent(pBtDevice, HCI_VENDOR_MP_PACKET_RX_REPORT, LEN_0_BYTE, pData, 0x0E, pEvtBuf, &EvtLen))
+            goto error;
+
+        pCounters->RxCount = 0;
+        pCounters->RxErrBits = 0;
+        for (j = 0; j < LEN_4_BYTE; j++)
+        {
+            pCounters->RxCount |= (uint32_t)pEvtBuf[j+EVT_BYTE0] << (BYTE_SHIFT * j);
+            pCounters->RxErrBits |= (uint32_t)pEvtBuf[j+EVT_BYTE0+LEN_8_BYTE] << (BYTE_SHIFT * j);
+        }
+        pCounters->Mask = 0xffffffff;
+
+        RxRssi = (char)(pEvtBuf[EVT_BYTE0+LEN_16_BYTE]);
+        pCounters->RxRssi = (RxRssi & 0x80) ? (0xffffff00 | RxRssi) : RxRssi;
+    }
+
+    //Cfo
+    if (bt_default_GetMDRegMaskBits(pBtDevice, 0x6c, 8, 0, &data) != BT_FUNCTION_SUCCESS)
+        goto error;
+    pCounters->Cfo = ((float)BinToSignedInt(data, LEN_9_BYTE) / (float)4096) * 10000;
+
+    return BT_FUNCTION_SUCCESS;
+
+error:
+
+    return FUNCTION_ERROR;
+}
+
+
+
 static int
 BTDevice_GetBTClockTime(
         BT_DEVICE *pBtDevice,
@@ -1610,7 +1473,7 @@ BTDevice_GetBTClockTime(
 
         *btClockTime += (Time << (i*8));
     }
-    *btClockTime = *btClockTime & 0x1fffffff;
+    *btClockTime = *btClockTime & BT_CLOCK_NATIVE_MASK;
 exit:
 
     return rtn;
@@ -1618,6 +1481,128 @@ exit:
 
 
 
+static int64_t
+BTDevice_MonoNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Native clock the model predicts at MonoNs
+static uint64_t
+BTDevice_ClockModelTicks(
+        BT_CLOCK_MODEL *pModel,
+        int64_t MonoNs
+        )
+{
+    int64_t Ns = MonoNs - pModel->CalMonoNs;
+
+    Ns += Ns / 1000000 * pModel->RatePpm;
+
+    return pModel->CalTicks + ((Ns > 0) ? (uint64_t)(Ns / BT_CLOCK_TICK_NS) : 0);
+}
+
+// Read the native clock and tie it to CLOCK_MONOTONIC. A valid model takes
+// the read as the value nearest its prediction, which unwraps the clock
+// however many times it wrapped, and learns its rate from the offset.
+static int
+BTDevice_ClockCalibrate(
+        BT_DEVICE *pBtDevice
+        )
+{
+    BT_CLOCK_MODEL *pModel = &pBtDevice->ClockModel;
+    unsigned long Native;
+    int64_t Before, After, MonoNs, SpanMs;
+    uint64_t Predicted;
+    int32_t Diff, Ppm;
+
+    Before = BTDevice_MonoNs();
+    if (BTDevice_GetBTClockTime(pBtDevice, &Native) != BT_FUNCTION_SUCCESS)
+        return FUNCTION_ERROR;
+    After = BTDevice_MonoNs();
+
+    // the controller latched its clock somewhere in the round trip
+    MonoNs = Before + (After - Before) / 2;
+
+    if (!pModel->Valid)
+    {
+        pModel->CalTicks = Native;
+        pModel->RatePpm = 0;
+    }
+    else
+    {
+        Predicted = BTDevice_ClockModelTicks(pModel, MonoNs);
+        Diff = (int32_t)(((uint32_t)Native - (uint32_t)Predicted) << 4) >> 4;
+        SpanMs = (MonoNs - pModel->CalMonoNs) / 1000000;
+
+        // only spans long enough to drown the HCI latency say anything
+        // about the rate, a jump beyond any crystal (HCI reset) says nothing
+        if (SpanMs >= 10000)
+        {
+            Ppm = (int32_t)((int64_t)Diff * BT_CLOCK_TICK_NS / SpanMs);
+            if ((Ppm > -500) && (Ppm < 500))
+                pModel->RatePpm += Ppm;
+            else
+                pModel->RatePpm = 0;
+        }
+
+        if (Diff != 0)
+            SYSLOGI("BTDevice_ClockCalibrate: native clock %d ticks off the model after %lld ms, rate %d ppm",
+                    Diff, (long long)SpanMs, pModel->RatePpm);
+
+        pModel->CalTicks = Predicted + Diff;
+    }
+
+    pModel->CalMonoNs = MonoNs;
+    pModel->Valid = 1;
+
+    return BT_FUNCTION_SUCCESS;
+}
+
+// Native clock now, from the model alone unless a drift check is due
+static int
+BTDevice_ClockNow(
+        BT_DEVICE *pBtDevice,
+        uint64_t *pTicks
+        )
+{
+    BT_CLOCK_MODEL *pModel = &pBtDevice->ClockModel;
+    int64_t MonoNs = BTDevice_MonoNs();
+
+    if (!pModel->Valid ||
+        ((BT_CLOCK_CHECK_MS != 0) && (MonoNs - pModel->CalMonoNs >= (int64_t)BT_CLOCK_CHECK_MS * 1000000)))
+    {
+        if ((BTDevice_ClockCalibrate(pBtDevice) != BT_FUNCTION_SUCCESS) && !pModel->Valid)
+            return FUNCTION_ERROR;
+        MonoNs = BTDevice_MonoNs();
+    }
+
+    *pTicks = BTDevice_ClockModelTicks(pModel, MonoNs);
+
+    return BT_FUNCTION_SUCCESS;
+}
+
+// Count TX from now on, recalibrating the clock model once per test start
+static void
+BTDevice_TxClockStart(
+        BT_DEVICE *pBtDevice
+        )
+{
+    BT_TRX_TIME *pTxTime = &pBtDevice->TRxTime[TX_TIME_RUNING];
+
+    pTxTime->CountedPkts = 0;
+    pTxTime->Started = 0;
+
+    BTDevice_ClockCalibrate(pBtDevice);
+    if (BTDevice_ClockNow(pBtDevice, &pTxTime->BeginTicks) == BT_FUNCTION_SUCCESS)
+        pTxTime->Started = 1;
+}
+
+
+
 static int
 BTDevice_CalculatedTxBits(
         BT_DEVICE *pBtDevice,
@@ -1633,31 +1618,33 @@ BTDevice_CalculatedTxBits(
     uint32_t pkt_Interval_slot_number=0;
     uint32_t pkt_Len=0;
     BT_PKT_TYPE PacketType;
-    uint32_t use_uSec=0;
-    unsigned long btClockTime=0;
+    uint64_t use_uSec=0;
+    uint64_t NowTicks, UseTicks;
+    uint32_t TotalPkts;
 
     BT_TRX_TIME *pTxTime = &pBtDevice->TRxTime[TX_TIME_RUNING];
 
-    if (BTDevice_GetBTClockTime(pBtDevice, &pTxTime->endTimeClockCnt) == BT_FUNCTION_SUCCESS)
-    {
-        if (pTxTime->endTimeClockCnt >= pTxTime->beginTimeClockCnt)
-        {
-            pTxTime->UseTimeClockCnt = pTxTime->endTimeClockCnt - pTxTime->beginTimeClockCnt;
-        }
-        else
-        {
-            pTxTime->UseTimeClockCnt=0x1FFFFFFF - pTxTime->beginTimeClockCnt + pTxTime->endTimeClockCnt;
-        }
-    }
-
-    pTxTime->beginTimeClockCnt = pTxTime->endTimeClockCnt;
+    *txbits = 0;
+    *txpkt_cnt = 0;
 
     if ((pBtReport == NULL) || (pParam == NULL))
         goto exit;
 
+    if (BTDevice_ClockNow(pBtDevice, &NowTicks) != BT_FUNCTION_SUCCESS)
+        goto exit;
+
+    if (!pTxTime->Started)
+    {
+        pTxTime->BeginTicks = NowTicks;
+        pTxTime->CountedPkts = 0;
+        pTxTime->Started = 1;
+    }
+
+    UseTicks = (NowTicks > pTxTime->BeginTicks) ? NowTicks - pTxTime->BeginTicks : 0;
+
     PacketType = pParam->mPacketType;
 
-    use_uSec = pTxTime->UseTimeClockCnt * 3125;  // 1 clock =312.5u
+    use_uSec = UseTicks * 3125 / 10;  // 1 clock =312.5u
 
     if (pktTx_conTx == PKT_TX)
         pkt_Interval_slot_number=1 + Arrary_Interval_slot_number[PacketType];   //pkt-tx
@@ -1668,12 +1655,25 @@ BTDevice_CalculatedTxBits(
         rtn = FUNCTION_PARAMETER_ERROR;
         goto exit;
     }
-    pkt_cnt = use_uSec/ (pkt_Interval_slot_number * 6250);
+    // packets since the start, so no partial interval is lost between reports
+    TotalPkts = (uint32_t)(UseTicks / (2 * pkt_Interval_slot_number));
+    // a drift correction may step the clock model back, count nothing
+    // until it has caught up with what was already reported
+    if (TotalPkts < pTxTime->CountedPkts)
+    {
+        pkt_cnt = 0;
+    }
+    else
+    {
+        pkt_cnt = TotalPkts - pTxTime->CountedPkts;
+        pTxTime->CountedPkts = TotalPkts;
+    }
     *txpkt_cnt= pkt_cnt;
     pkt_Len= Arrary_Hopping_pkt_len[PacketType];
     *txbits=pkt_cnt * pkt_Len *8;
 
-    SYSLOGI("BTDevice_CalculatedTxBits: time= %d, txpkt_cnt = %d, txbits=%d", use_uSec, *txpkt_cnt, *txbits);
+    SYSLOGI("BTDevice_CalculatedTxBits: time= %llu, txpkt_cnt = %d, txbits=%d",
+            (unsigned long long)use_uSec, *txpkt_cnt, *txbits);
 
 exit:
     return rtn;
@@ -1790,7 +1790,6 @@ BTDevice_SetPktTxBegin(
         )
 {
     int rtn = BT_FUNCTION_SUCCESS;
-    unsigned long btClockTime = 0;
     uint16_t tmp = 0;
     BT_TRX_TIME *pTxTime = &pBtDevice->TRxTime[TX_TIME_RUNING];
     uint32_t ChipType;
@@ -1813,9 +1812,7 @@ BTDevice_SetPktTxBegin(
     }
     ChipType = pBtDevice->pBTInfo->ChipType;
 
-    pTxTime->beginTimeClockCnt=0;
-    pTxTime->UseTimeClockCnt=0;
-    pTxTime->endTimeClockCnt=0;
+    pTxTime->Started = 0;
 
     pBtDevice->TxTriggerPktCnt=0;
 
@@ -1916,10 +1913,7 @@ BTDevice_SetPktTxBegin(
     }
 
     //get begin clock
-    if (BTDevice_GetBTClockTime(pBtDevice,&btClockTime) == BT_FUNCTION_SUCCESS)
-    {
-        pTxTime->beginTimeClockCnt = btClockTime;
-    }
+    BTDevice_TxClockStart(pBtDevice);
 
     SYSLOGI("-BTDevice_SetPktTxBegin");
     return BT_FUNCTION_SUCCESS;
@@ -1931,6 +1925,67 @@ exit:
 
 
 
+// Move a running packet TX to the channel and packet type now in pParam,
+// writing only what Changes says differs from the last begin or retune
+int
+BTDevice_SetPktTxRetune(
+        BT_DEVICE *pBtDevice,
+        BT_PARAMETER *pParam,
+        BT_DEVICE_REPORT *pBtReport,
+        uint8_t Changes
+        )
+{
+    int rtn = BT_FUNCTION_SUCCESS;
+    BT_TRX_TIME *pTxTime = &pBtDevice->TRxTime[TX_TIME_RUNING];
+
+    SYSLOGI("BTDevice_SetPktTxRetune: mChannelNumber 0x%02x, mPacketType 0x%02x, Changes 0x%02x",
+            pParam->mChannelNumber, pParam->mPacketType, Changes);
+
+    if (pParam->mPacketType >= BT_PKT_LE)
+        return FUNCTION_PARAMETER_ERROR;
+
+    pTxTime->Started = 0;
+
+    pBtDevice->TxTriggerPktCnt = 0;
+
+    if (pBtReport != NULL)
+    {
+        pBtReport->TotalTXBits = 0;
+        pBtReport->TotalTxCounts = 0;
+    }
+
+    if (Changes & BT_PKTTX_RETUNE_PKT_TYPE)
+    {
+        //gain index tables are per modulation
+        if ((pParam->mTxGainIndex > 0) && (pParam->mTxGainIndex <= 7))
+        {
+            rtn = BTDevice_SetPowerGainIndex(pBtDevice, pParam->mPacketType, pParam->mTxGainIndex);
+            if (rtn != BT_FUNCTION_SUCCESS)
+                goto exit;
+        }
+
+        if (BTDevice_SetPacketType(pBtDevice, pParam->mPacketType) != BT_FUNCTION_SUCCESS)
+            goto exit;
+    }
+
+    //always retune, it puts the RF in standby which ends the current burst
+    if (BTDevice_SetTxChannel(pBtDevice, pParam->mChannelNumber) != BT_FUNCTION_SUCCESS)
+        goto exit;
+
+    if (BTDevice_SetPktTxBegin_PSEUDOMODE(pBtDevice, pParam) != BT_FUNCTION_SUCCESS)
+        goto exit;
+
+    BTDevice_TxClockStart(pBtDevice);
+
+    return BT_FUNCTION_SUCCESS;
+
+exit:
+    SYSLOGI("-BTDevice_SetPktTxRetune: ERROR");
+    return FUNCTION_ERROR;
+}
+
+
+
 int
 BTDevice_SetPktTxUpdate(
         BT_DEVICE *pBtDevice,
@@ -2194,15 +2249,12 @@ BTDevice_SetContinueTxBegin(
         )
 {
     int rtn = BT_FUNCTION_SUCCESS;
-    unsigned long btClockTime = 0;
     BT_TRX_TIME *pTxTime = &pBtDevice->TRxTime[TX_TIME_RUNING];
     uint32_t ChipType;
 
     ChipType = pBtDevice->pBTInfo->ChipType;
 
-    pTxTime->beginTimeClockCnt=0;
-    pTxTime->UseTimeClockCnt=0;
-    pTxTime->endTimeClockCnt=0;
+    pTxTime->Started = 0;
 
     if (pBtReport != NULL)
     {
@@ -2306,10 +2358,7 @@ BTDevice_SetContinueTxBegin(
     }
 
     //get begin clock
-    if (BTDevice_GetBTClockTime(pBtDevice,&btClockTime) == BT_FUNCTION_SUCCESS)
-    {
-        pTxTime->beginTimeClockCnt=btClockTime;
-    }
+    BTDevice_TxClockStart(pBtDevice);
 
     SYSLOGI("-BTDevice_SetContinueTxBegin");
     return BT_FUNCTION_SUCCESS;
@@ -2894,6 +2943,9 @@ BTDevice_SetHciReset(
         goto error;
     }
 
+    //the controller may come back as another firmware, resolve it again
+    BTDevice_InvalidateChipInfo(pBtDevice);
+
     if(ChipType == RTK_BT_CHIP_ID_RTL8763B) //LE Hopping disable
     {
         pPayLoad[0] = 1;    //LE
@@ -2927,6 +2979,9 @@ BTDevice_GetBTChipVersionInfo(
     int rtn=BT_FUNCTION_SUCCESS;
     BT_CHIPINFO *pBTInfo = pBtDevice->pBTInfo;
 
+    if (pBtDevice->ChipInfoValid)
+        return BT_FUNCTION_SUCCESS;
+
     if (bt_default_SendHciCommandWithEvent(pBtDevice,OpCode,pPayload_Len,pPayload,0x0E,pEvent, &EventLen) != BT_FUNCTION_SUCCESS)
     {
         SYSLOGE("BTDevice_GetBTChipVersionInfo\n");
@@ -2983,10 +3038,128 @@ BTDevice_GetBTChipVersionInfo(
         goto exit;
     }
 
+    pBtDevice->ChipInfoValid = 1;
+    BTDevice_BindChipOps(pBtDevice);
+
     rtn = BT_FUNCTION_SUCCESS;
 exit:
     return rtn;
 }
+
+
+
+void
+BTDevice_InvalidateChipInfo(
+        BT_DEVICE *pBtDevice
+        )
+{
+    //the ops stay bound until the next resolve replaces them
+    pBtDevice->ChipInfoValid = 0;
+
+    //a reset or patch download may change what the efuse reads back as
+    if (pBtDevice->pBtEfuse != NULL)
+        BTDevice_Efuse_InvalidateCache(pBtDevice->pBtEfuse);
+    if (pBtDevice->pSysEfuse != NULL)
+        BTDevice_Efuse_InvalidateCache(pBtDevice->pSysEfuse);
+}
+
+
+
+// Fw* stops take no parameters, fit them to the ops table
+static int
+BTDevice_FwPacketTxStopOp(
+        BT_DEVICE *pBtDevice,
+        BT_PARAMETER *pParam,
+        BT_DEVICE_REPORT *pBtReport
+        )
+{
+    return BTDevice_fw_packet_tx_stop(pBtDevice);
+}
+
+static int
+BTDevice_FwContTxStopOp(
+        BT_DEVICE *pBtDevice,
+        BT_PARAMETER *pParam,
+        BT_DEVICE_REPORT *pBtReport
+        )
+{
+    return BTDevice_fw_cont_tx_stop(pBtDevice);
+}
+
+static int
+BTDevice_FwPacketRxStopOp(
+        BT_DEVICE *pBtDevice,
+        BT_PARAMETER *pParam,
+        BT_DEVICE_REPORT *pBtReport
+        )
+{
+    return BTDevice_fw_packet_rx_stop(pBtDevice);
+}
+
+// chips before RTL8822B, tests run on the modem registers
+static const BT_CHIP_OPS gChipOpsRegister = {
+    BTDevice_SetPktTxBegin,         BTDevice_SetPktTxUpdate,
+    BTDevice_SetPktTxStop,          BTDevice_SetPktTxUpdate,
+    BTDevice_SetContinueTxBegin,    BTDevice_SetContinueTxUpdate,
+    BTDevice_SetContinueTxStop,     BTDevice_SetContinueTxUpdate,
+    BTDevice_SetPktRxBegin,         BTDevice_SetPktRxUpdate,
+    BTDevice_SetPktRxStop,          BTDevice_SetPktRxUpdate,
+    BTDevice_LeTxTestCmd,           BTDevice_LeRxTestCmd,
+    1,                              //PktTxRetune
+    1,                              //LeContTxPktType
+    MAX_TXGAIN_TABLE_SIZE,          //MaxGainIndex
+    0,                              //NoRxBer
+};
+
+// RTL8822B and later, tests run in firmware and report on request
+static const BT_CHIP_OPS gChipOpsFw = {
+    BTDevice_fw_packet_tx_start,    NULL,
+    BTDevice_FwPacketTxStopOp,      BTDevice_fw_packet_tx_report,
+    BTDevice_fw_cont_tx_start,      NULL,
+    BTDevice_FwContTxStopOp,        BTDevice_fw_cont_tx_report,
+    BTDevice_fw_packet_rx_start,    NULL,
+    BTDevice_FwPacketRxStopOp,      BTDevice_fw_packet_rx_report,
+    BTDevice_LeTxTestCmd,           BTDevice_LeRxTestCmd,
+    0,                              //PktTxRetune
+    1,                              //LeContTxPktType
+    0xff,                           //MaxGainIndex
+    -100.0,                         //NoRxBer
+};
+
+// RTL8763B (BBPro), firmware tests with the LE enhanced test commands
+static const BT_CHIP_OPS gChipOpsFwBBPro = {
+    BTDevice_fw_packet_tx_start,    NULL,
+    BTDevice_FwPacketTxStopOp,      BTDevice_fw_packet_tx_report,
+    BTDevice_fw_cont_tx_start,      NULL,
+    BTDevice_FwContTxStopOp,        BTDevice_fw_cont_tx_report,
+    BTDevice_fw_packet_rx_start,    NULL,
+    BTDevice_FwPacketRxStopOp,      BTDevice_fw_packet_rx_report,
+    BTDevice_LeTxEnhancedTest,      BTDevice_LeRxEnhancedTest,
+    0,                              //PktTxRetune
+    0,                              //LeContTxPktType
+    0xff,                           //MaxGainIndex
+    -100.0,                         //NoRxBer
+};
+
+
+
+void
+BTDevice_BindChipOps(
+        BT_DEVICE *pBtDevice
+        )
+{
+    unsigned int ChipType = pBtDevice->pBTInfo->ChipType;
+
+    if (ChipType < RTK_BT_CHIP_ID_RTL8822B)
+        pBtDevice->pChipOps = &gChipOpsRegister;
+    else if (ChipType == RTK_BT_CHIP_ID_RTL8763B)
+        pBtDevice->pChipOps = &gChipOpsFwBBPro;
+    else
+        pBtDevice->pChipOps = &gChipOpsFw;
+
+    SYSLOGI("BTDevice_BindChipOps: ChipType %u, %s ops", ChipType,
+            (pBtDevice->pChipOps == &gChipOpsRegister) ? "register" : "fw");
+}
 #define SEGMENT_LEN 252
 #define BUMBLE_BEE_SEGMENT_LEN  1000
 
@@ -3499,6 +3672,11 @@ BTDevice_PGEfuseRawData(
             rtn= FUNCTION_ERROR;
             break;
     }
+
+    // burned behind the efuse units, their cached maps are stale now
+    BTDevice_Efuse_InvalidateCache(pBtDevice->pBtEfuse);
+    BTDevice_Efuse_InvalidateCache(pBtDevice->pSysEfuse);
+
     return rtn;
 
 }
@@ -3560,8 +3738,19 @@ BTDevice_WriteEfuseLogicalData(
     }
     else if((Cmd == PHYSICAL_EFUSE_BANK_1) || (Cmd == PHYSICAL_EFUSE_BANK_2))
     {
+        pEfuse = pBtDevice->pBtEfuse;
+
         if(BTDevice_Efuse_SetBytes(pBtDevice, Bank, Addr, pBuf, Len)!=BT_FUNCTION_SUCCESS)
+        {
+            BTDevice_Efuse_InvalidateCache(pEfuse);
             goto error;
+        }
+
+        // the bytes were read back by SetBytes, patch them into the cache
+        if (pEfuse->PhyMemValid && (Addr + Len <= pEfuse->EfusePhySize))
+            memcpy(pEfuse->pEfusePhyMem+Bank*MAX_EFUSE_PHY_LEN+Addr, pBuf, Len);
+        else
+            BTDevice_Efuse_InvalidateCache(pEfuse);
 
         //if(BTDevice_PGEfuse_WriteBytes(pBtDevice, Bank, Addr, Len, pBuf)!=BT_FUNCTION_SUCCESS)
             //goto error;
@@ -3584,7 +3773,6 @@ BTDevice_ReadEfuseLogicalData(
     unsigned long EfuseAddr;
     EFUSE_UNIT *pEfuse;
     unsigned char i, Len;
-    unsigned char pBuf[LEN_32_BYTE];
     int Bank;
 
 
@@ -3633,15 +3821,18 @@ BTDevice_ReadEfuseLogicalData(
     }
     else if((Command == PHYSICAL_EFUSE_BANK_1) || (Command == PHYSICAL_EFUSE_BANK_2))
     {
-        if(BTDevice_Efuse_GetBytes(pBtDevice, Bank, EfuseAddr, pBuf, Len) != BT_FUNCTION_SUCCESS)
+        // both physical banks belong to the BT efuse, serve them from its map
+        pEfuse = pBtDevice->pBtEfuse;
+
+        if ((EfuseAddr + Len > pEfuse->EfusePhySize) || (Len > MAX_USERAWDATA_SIZE - LEN_4_BYTE))
+            goto error;
+
+        if (BTDevice_Efuse_LoadPhyMem(pEfuse))
             goto error;
 
         memcpy(pBtReport->ReportData, pParam->mPGRawData, LEN_4_BYTE);
 
-        for (i = 0; i < Len; i++)
-        {
-            pBtReport->ReportData[i+LEN_4_BYTE] = pBuf[i];
-        }
+        memcpy(pBtReport->ReportData+LEN_4_BYTE, pEfuse->pEfusePhyMem+Bank*MAX_EFUSE_PHY_LEN+EfuseAddr, Len);
     }
 
     return BT_FUNCTION_SUCCESS;
@@ -3710,14 +3901,11 @@ BTDevice_8822b_LeContTxCmd(
     unsigned char TxPowerIndex
     )
 {
-    BT_TRX_TIME   *pTxTime;
-    unsigned long btClockTime;
 
     unsigned char pPayload[HCI_CMD_LEN_MAX];
     unsigned char pEvent[HCI_EVT_LEN_MAX];
     uint32_t EvtLen;
 
-    pTxTime = &pBtDevice->TRxTime[TX_TIME_RUNING];
 
     pPayload[0] = enableLeContTx;
     pPayload[1] = Channel;
@@ -3729,14 +3917,7 @@ BTDevice_8822b_LeContTxCmd(
     if(enableLeContTx == 1)
     {
         //get begin clock
-        pTxTime->beginTimeClockCnt=0;
-        pTxTime->UseTimeClockCnt=0;
-        pTxTime->endTimeClockCnt=0;
-
-        if (BTDevice_GetBTClockTime(pBtDevice, &btClockTime) == BT_FUNCTION_SUCCESS)
-        {
-            pTxTime->beginTimeClockCnt = btClockTime;
-        }
+        BTDevice_TxClockStart(pBtDevice);
     }
     return BT_FUNCTION_SUCCESS;
 
@@ -3754,8 +3935,6 @@ BTDevice_fw_packet_tx_start(
     BT_DEVICE_REPORT *pBtReport
     )
 {
-    BT_TRX_TIME   *pTxTime;
-    unsigned long btClockTime;
     uint32_t EvtLen;
 
     unsigned char pData[LEN_512_BYTE];
@@ -3763,7 +3942,6 @@ BTDevice_fw_packet_tx_start(
     unsigned int ChipType;
 
     ChipType = pBtDevice->pBTInfo->ChipType;
-    pTxTime = &pBtDevice->TRxTime[TX_TIME_RUNING];
 
     SYSLOGI(" +BTDevice_fw_packet_tx_start");
     SYSLOGI(" mChannelNumber = 0x%x", pParam->mChannelNumber);
@@ -3832,14 +4010,7 @@ BTDevice_fw_packet_tx_start(
             goto error;
     }
     //get begin clock
-    pTxTime->beginTimeClockCnt=0;
-    pTxTime->UseTimeClockCnt=0;
-    pTxTime->endTimeClockCnt=0;
-
-    if (BTDevice_GetBTClockTime(pBtDevice,&btClockTime) == BT_FUNCTION_SUCCESS)
-    {
-        pTxTime->beginTimeClockCnt = btClockTime;
-    }
+    BTDevice_TxClockStart(pBtDevice);
 
     SYSLOGI(" -BTDevice_fw_packet_tx_start");
 
@@ -4129,8 +4300,6 @@ BTDevice_fw_cont_tx_start(
     BT_DEVICE_REPORT *pBtReport
     )
 {
-    BT_TRX_TIME   *pTxTime;
-    unsigned long btClockTime;
     uint32_t EvtLen;
 
     unsigned char pData[LEN_512_BYTE];
@@ -4138,7 +4307,6 @@ BTDevice_fw_cont_tx_start(
     unsigned int ChipType;
 
     ChipType = pBtDevice->pBTInfo->ChipType;
-    pTxTime = &pBtDevice->TRxTime[TX_TIME_RUNING];
 
     SYSLOGI(" +BTDevice_fw_cont_tx_start");
     SYSLOGI(" mChannelNumber = 0x%x", pParam->mChannelNumber);
@@ -4211,14 +4379,7 @@ BTDevice_fw_cont_tx_start(
     }
 
     //get begin clock
-    pTxTime->beginTimeClockCnt=0;
-    pTxTime->UseTimeClockCnt=0;
-    pTxTime->endTimeClockCnt=0;
-
-    if (BTDevice_GetBTClockTime(pBtDevice,&btClockTime) == BT_FUNCTION_SUCCESS)
-    {
-        pTxTime->beginTimeClockCnt = btClockTime;
-    }
+    BTDevice_TxClockStart(pBtDevice);
 
     SYSLOGI(" -BTDevice_fw_cont_tx_start");
 
@@ -341,6 +341,121 @@ error:
 
 
 
+// Command Complete carries at most 255 - 6 bytes of read data
+#define EFUSE_BULK_READ_MAX_LEN (255 - 6)
+
+// One read at a time, the MP transport holds a single received event
+static int
+BTDevice_Efuse_BulkGetBank(
+        EFUSE_UNIT *pEfuse,
+        uint8_t Bank,
+        uint8_t *pReadingBytes,
+        unsigned int ByteNum
+        )
+{
+    BT_DEVICE *pBtDevice = pEfuse->pBtDevice;
+    unsigned char pReadingCmpBuf[EFUSE_BULK_READ_MAX_LEN];
+    unsigned int ChunkLen, Len, i;
+
+    memset(pReadingCmpBuf, 0xff, EFUSE_BULK_READ_MAX_LEN);
+
+    if (BTDevice_Efuse_SetLdo225_10K15K(pBtDevice, _DO_READ_, TYPE_15K) != BT_FUNCTION_SUCCESS)
+        goto error;
+
+    // the first read of a session finds the transfer size
+    ChunkLen = pEfuse->BulkReadLen ? pEfuse->BulkReadLen : EFUSE_BULK_READ_MAX_LEN;
+    while (1)
+    {
+        Len = (ByteNum > ChunkLen) ? ChunkLen : ByteNum;
+
+        if (BTDevice_Efuse_HCIIO_GetBytes(pBtDevice, Bank, 0, pReadingBytes, Len) == BT_FUNCTION_SUCCESS)
+            break;
+
+        if (pEfuse->BulkReadLen || (ChunkLen <= READ_WRITE_EFUSE_REG_MAX_LEN))
+            goto error;
+
+        ChunkLen = (ChunkLen / 2 > READ_WRITE_EFUSE_REG_MAX_LEN) ? ChunkLen / 2 : READ_WRITE_EFUSE_REG_MAX_LEN;
+    }
+
+    if (pEfuse->BulkReadLen == 0)
+    {
+        pEfuse->BulkReadLen = ChunkLen;
+        SYSLOGI("BTDevice_Efuse_BulkGetBank: %d bytes per read", ChunkLen);
+    }
+
+    // the map is written front to back, a blank chunk ends it
+    i = 0;
+    while (memcmp(pReadingBytes + i, pReadingCmpBuf, Len) != 0)
+    {
+        i += Len;
+        if (i >= ByteNum)
+            break;
+
+        Len = (ByteNum - i > ChunkLen) ? ChunkLen : ByteNum - i;
+
+        if (BTDevice_Efuse_HCIIO_GetBytes(pBtDevice, Bank, i, pReadingBytes + i, Len) != BT_FUNCTION_SUCCESS)
+            goto error;
+    }
+
+    bt_default_SetSysRegMaskBits(pBtDevice, 0x35, 3, 0, Bank&0x07);
+
+    return BT_FUNCTION_SUCCESS;
+
+error:
+    SYSLOGE("BTDevice_Efuse_BulkGetBank: bank %d failed", Bank);
+    return FUNCTION_ERROR;
+}
+
+
+
+static int
+BTDevice_Efuse_CheckBlank(
+        BT_DEVICE *pBtDevice,
+        uint8_t Bank,
+        unsigned int RegStartAddr,
+        unsigned int ByteNum
+        )
+{
+    unsigned char pReadingBytes[READ_WRITE_EFUSE_REG_MAX_LEN];
+    unsigned int i;
+
+    if (ByteNum > READ_WRITE_EFUSE_REG_MAX_LEN)
+        goto error;
+
+    if (BTDevice_Efuse_SetLdo225_10K15K(pBtDevice, _DO_READ_, TYPE_15K) != BT_FUNCTION_SUCCESS)
+        goto error;
+
+    if (BTDevice_Efuse_IO_GetBytes(pBtDevice, Bank, RegStartAddr, pReadingBytes, ByteNum) != BT_FUNCTION_SUCCESS)
+        goto error;
+
+    for (i = 0; i < ByteNum; i++)
+    {
+        if (pReadingBytes[i] != 0xff)
+        {
+            SYSLOGE("BTDevice_Efuse_CheckBlank: bank %d 0x%x already burned", Bank, RegStartAddr + i);
+            goto error;
+        }
+    }
+
+    return BT_FUNCTION_SUCCESS;
+
+error:
+    return FUNCTION_ERROR;
+}
+
+
+
+void
+BTDevice_Efuse_InvalidateCache(
+        EFUSE_UNIT *pEfuse
+        )
+{
+    pEfuse->PhyMemValid = 0;
+    pEfuse->BulkReadLen = 0;
+}
+
+
+
 int
 BTDevice_Efuse_Log2EntryMap(
         EFUSE_UNIT *pEfuse,
@@ -459,6 +574,8 @@ BuildEfuseLogicUnit(
     pEfuse->StartBank = StartBank;
     pEfuse->BankNum = BankNum;
     pEfuse->CurrBank = pEfuse->StartBank;
+    pEfuse->PhyMemValid = 0;
+    pEfuse->BulkReadLen = 0;
 
     for (i = 0; i < pEfuse->EfuseLogSize; i++)
     {
@@ -491,20 +608,27 @@ BTDevice_Efuse_LoadPhyMem(
     uint8_t StartBank;
     uint8_t BankNum;
 
+    if (pEfuse->PhyMemValid)
+        return BT_FUNCTION_SUCCESS;
+
     StartBank = pEfuse->StartBank;
     BankNum = pEfuse->BankNum;
 
     for (Bank = StartBank; Bank < StartBank + BankNum; Bank++)
     {
-        if (BTDevice_Efuse_GetBytes(
-                    pEfuse->pBtDevice,
+        // whatever follows the first blank chunk is not read, keep it blank
+        memset(pEfuse->pEfusePhyMem+Bank*MAX_EFUSE_PHY_LEN, 0xFF, MAX_EFUSE_PHY_LEN);
+
+        if (BTDevice_Efuse_BulkGetBank(
+                    pEfuse,
                     Bank,
-                    0,
                     pEfuse->pEfusePhyMem+Bank*MAX_EFUSE_PHY_LEN,
                     pEfuse->EfusePhySize) != BT_FUNCTION_SUCCESS)
             goto error;
     }
 
+    pEfuse->PhyMemValid = 1;
+
     return BT_FUNCTION_SUCCESS;
 
 error:
@@ -547,15 +671,28 @@ re_check:
                     goto re_check;
             }
 
+            // burn only where the chip still reads blank, the cached
+            // offset may be behind a write made around the cache
+            if (BTDevice_Efuse_CheckBlank(pEfuse->pBtDevice, Bank, pEfuse->pEfusePhyDataLen[Bank], WritingLen) != BT_FUNCTION_SUCCESS)
+            {
+                BTDevice_Efuse_InvalidateCache(pEfuse);
+                goto error;
+            }
+
+            // a failed burn leaves the bank in an unknown state
             if (BTDevice_Efuse_SetBytes(pEfuse->pBtDevice, Bank, pEfuse->pEfusePhyDataLen[Bank], pWritingEntry, WritingLen) != BT_FUNCTION_SUCCESS)
+            {
+                BTDevice_Efuse_InvalidateCache(pEfuse);
                 goto error;
+            }
 
             for (j = i; j < i + LEN_8_BYTE; j++)
             {
                 pEfuse->pEfuseLogMem[j].OldValue = pEfuse->pEfuseLogMem[j].NewValue;
             }
 
-            memcpy(pEfuse->pEfusePhyMem+pEfuse->pEfusePhyDataLen[Bank], pWritingEntry, WritingLen);
+            // SetBytes read the entry back, the cache can take it as written
+            memcpy(pEfuse->pEfusePhyMem+Bank*MAX_EFUSE_PHY_LEN+pEfuse->pEfusePhyDataLen[Bank], pWritingEntry, WritingLen);
 
             pEfuse->pEfusePhyDataLen[Bank] += WritingLen;
             pEfuse->CurrBank = Bank;
@@ -1,5 +1,9 @@
 #define LOG_TAG "bt_mp_module_base"
 
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
 #include "bt_syslog.h"
 #include "bluetoothmp.h"
 #include "bt_mp_build.h"
@@ -11,6 +15,526 @@ extern uint32_t PktRxCount;
 extern uint32_t PktRxErrBits;
 
 
+#define RX_SAMPLER_CLAMP32(v)   ((v) > 0xffffffffULL ? 0xffffffff : (uint32_t)(v))
+
+// What a counter moved from Last to New. A counter that went backwards by
+// more than half its range was cleared rather than wrapped, so only New
+// counts then and *pReset is set.
+static uint32_t
+BTModule_RxCounterDelta(
+        uint32_t Last,
+        uint32_t New,
+        uint32_t Mask,
+        uint8_t *pReset
+        )
+{
+    uint32_t Delta = (New - Last) & Mask;
+
+    if ((New < Last) && (Delta > (Mask >> 1)))
+    {
+        *pReset = 1;
+        return New;
+    }
+
+    return Delta;
+}
+
+// Pass or fail ErrBits out of Bits against the BER limit, NONE until the
+// counts are conclusive either way. Look counts the verdicts taken so far
+// in this run, 1 for the first.
+static uint8_t
+BTModule_RxEarlyStopVerdict(
+        BT_PARAMETER *pBtParam,
+        uint64_t ErrBits,
+        uint64_t Bits,
+        uint32_t Look
+        )
+{
+    double Limit = (double)pBtParam->RxBerLimitPpm / 1000000.0;
+    double k = (double)ErrBits;
+    double n = (double)Bits;
+    double p0, p1, Llr, Alpha, z, z2, Center, Half;
+
+    if ((pBtParam->RxEarlyStopMode == BT_RX_EARLY_STOP_OFF) ||
+        (Limit <= 0.0) || (Limit >= 1.0) || (Bits == 0) || (ErrBits > Bits))
+        return BT_RX_VERDICT_NONE;
+
+    if (pBtParam->RxEarlyStopMode == BT_RX_EARLY_STOP_SPRT)
+    {
+        // H0 good unit at limit / ratio, H1 bad unit at the limit
+        p1 = Limit;
+        p0 = Limit / BT_RX_EARLY_STOP_RATIO;
+        Llr = k * log(p1 / p0) + (n - k) * log((1.0 - p1) / (1.0 - p0));
+
+        if (Llr >= log((1.0 - BT_RX_EARLY_STOP_BETA) / BT_RX_EARLY_STOP_ALPHA))
+            return BT_RX_VERDICT_FAIL;
+        if (Llr <= log(BT_RX_EARLY_STOP_BETA / (1.0 - BT_RX_EARLY_STOP_ALPHA)))
+            return BT_RX_VERDICT_PASS;
+    }
+    else
+    {
+        // Wilson score interval, stays sane with no errors seen yet. Each
+        // look gets its share of the risk, the shares sum to the total, and
+        // z is the Chernoff bound on the normal tail for that share.
+        if (Look == 0)
+            Look = 1;
+        Alpha = BT_RX_EARLY_STOP_CI_ALPHA * 6.0 / (M_PI * M_PI * (double)Look * (double)Look);
+        z = sqrt(2.0 * log(2.0 / Alpha));
+        z2 = z * z;
+        Center = (k + z2 / 2.0) / (n + z2);
+        Half = z * sqrt(k * (n - k) / n + z2 / 4.0) / (n + z2);
+
+        if (Center + Half < Limit)
+            return BT_RX_VERDICT_PASS;
+        if (Center - Half > Limit)
+            return BT_RX_VERDICT_FAIL;
+    }
+
+    return BT_RX_VERDICT_NONE;
+}
+
+// Read the RX counters once and add what moved since the last read to the
+// 64 bit totals, or only take the read as the new base. HciLock held.
+static int
+BTModule_RxSamplerSample(
+        BT_MODULE *pBtModule,
+        int Rebase
+        )
+{
+    BT_RX_SAMPLER *pSampler = &pBtModule->RxSampler;
+    BT_RX_COUNTERS Counters;
+    uint8_t Reset = 0;
+
+    if (pBtModule->pBtDevice->ReadRxCounters(pBtModule->pBtDevice, pBtModule->pBtParam, &Counters) != BT_FUNCTION_SUCCESS)
+    {
+        pSampler->Errors++;
+        return FUNCTION_ERROR;
+    }
+
+    // masked differences stay right across one wrap of the counters, a
+    // counter cleared behind our back is taken as the new base
+    if (!Rebase)
+    {
+        pSampler->RxCounts += BTModule_RxCounterDelta(pSampler->LastRxCount, Counters.RxCount,
+                                                      Counters.Mask, &Reset);
+        pSampler->RxErrorBits += BTModule_RxCounterDelta(pSampler->LastRxErrBits, Counters.RxErrBits,
+                                                         Counters.Mask, &Reset);
+        if (Reset)
+        {
+            pSampler->Errors++;
+            SYSLOGW("BTModule_RxSamplerSample: RX counters went back to %u/%u, rebased",
+                    Counters.RxCount, Counters.RxErrBits);
+        }
+    }
+    pSampler->LastRxCount = Counters.Reset ? 0 : Counters.RxCount;
+    pSampler->LastRxErrBits = Counters.Reset ? 0 : Counters.RxErrBits;
+    pSampler->PktBits = Counters.PktBits;
+    pSampler->RxRssi = Counters.RxRssi;
+    pSampler->Cfo = Counters.Cfo;
+    pSampler->Samples++;
+
+    return BT_FUNCTION_SUCCESS;
+}
+
+static void *
+BTModule_RxSamplerThread(
+        void *arg
+        )
+{
+    BT_MODULE *pBtModule = (BT_MODULE *)arg;
+    BT_RX_SAMPLER *pSampler = &pBtModule->RxSampler;
+    struct timespec ts;
+
+    pthread_mutex_lock(&pBtModule->HciLock);
+
+    while (1)
+    {
+        while (!pSampler->Running)
+            pthread_cond_wait(&pSampler->Cond, &pBtModule->HciLock);
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += pSampler->PeriodMs / 1000;
+        ts.tv_nsec += (pSampler->PeriodMs % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+
+        while (pSampler->Running &&
+               pthread_cond_timedwait(&pSampler->Cond, &pBtModule->HciLock, &ts) != ETIMEDOUT)
+            ;
+
+        if (!pSampler->Running || pSampler->Verdict != BT_RX_VERDICT_NONE)
+            continue;
+
+        if (BTModule_RxSamplerSample(pBtModule, 0) != BT_FUNCTION_SUCCESS)
+            continue;
+
+        pSampler->Verdict = BTModule_RxEarlyStopVerdict(pBtModule->pBtParam, pSampler->RxErrorBits,
+                                                        pSampler->RxCounts * pSampler->PktBits,
+                                                        ++pSampler->Looks);
+        if (pSampler->Verdict != BT_RX_VERDICT_NONE)
+            SYSLOGI("BTModule_RxSamplerThread: early stop %s, RxErrorBits %llu of %llu bits",
+                    (pSampler->Verdict == BT_RX_VERDICT_PASS) ? "pass" : "fail",
+                    (unsigned long long)pSampler->RxErrorBits,
+                    (unsigned long long)(pSampler->RxCounts * pSampler->PktBits));
+    }
+
+    return NULL;
+}
+
+// Begin a fresh RX run, sampled in the background when a period is set
+static void
+BTModule_RxSamplerStart(
+        BT_MODULE *pBtModule
+        )
+{
+    BT_RX_SAMPLER *pSampler = &pBtModule->RxSampler;
+    pthread_attr_t attr;
+
+    pSampler->RxCounts = 0;
+    pSampler->RxErrorBits = 0;
+    pSampler->ReportedCounts = 0;
+    pSampler->LastRxCount = 0;
+    pSampler->LastRxErrBits = 0;
+    pSampler->RxRssi = -90;
+    pSampler->Cfo = 999;
+    pSampler->Samples = 0;
+    pSampler->Errors = 0;
+    pSampler->Looks = 0;
+    pSampler->Valid = 0;
+    pSampler->Verdict = BT_RX_VERDICT_NONE;
+
+    pSampler->PeriodMs = pBtModule->pBtParam->RxSamplePeriodMs;
+    if (pSampler->PeriodMs == 0)
+        return;
+
+    if (!pSampler->ThreadStarted)
+    {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&pSampler->Thread, &attr, BTModule_RxSamplerThread, pBtModule) != 0)
+        {
+            pthread_attr_destroy(&attr);
+            SYSLOGE("BTModule_RxSamplerStart: can not create thread, RX reports polled");
+            return;
+        }
+        pthread_attr_destroy(&attr);
+        pSampler->ThreadStarted = 1;
+    }
+
+    pSampler->Valid = 1;
+    pSampler->Running = 1;
+    pthread_cond_signal(&pSampler->Cond);
+}
+
+// End the RX run with a last sample, the totals stay readable
+static void
+BTModule_RxSamplerStop(
+        BT_MODULE *pBtModule
+        )
+{
+    BT_RX_SAMPLER *pSampler = &pBtModule->RxSampler;
+
+    if (!pSampler->Running)
+        return;
+
+    // a decided run keeps the totals the verdict was taken on
+    if (pSampler->Verdict == BT_RX_VERDICT_NONE)
+        BTModule_RxSamplerSample(pBtModule, 0);
+    pSampler->Running = 0;
+    pthread_cond_signal(&pSampler->Cond);
+
+    SYSLOGI("BTModule_RxSamplerStop: RxCounts %llu, RxErrorBits %llu, samples %u, errors %u",
+            (unsigned long long)pSampler->RxCounts, (unsigned long long)pSampler->RxErrorBits,
+            pSampler->Samples, pSampler->Errors);
+}
+
+// Fill the RX fields of a report from the sampled totals
+static void
+BTModule_RxSamplerReport(
+        BT_MODULE *pBtModule,
+        BT_DEVICE_REPORT *pBtReport
+        )
+{
+    BT_RX_SAMPLER *pSampler = &pBtModule->RxSampler;
+    uint64_t RxBits = pSampler->RxCounts * pSampler->PktBits;
+
+    pBtReport->RXRecvPktCnts = RX_SAMPLER_CLAMP32(pSampler->RxCounts - pSampler->ReportedCounts);
+    pSampler->ReportedCounts = pSampler->RxCounts;
+
+    pBtReport->TotalRxCounts = RX_SAMPLER_CLAMP32(pSampler->RxCounts);
+    pBtReport->TotalRxErrorBits = RX_SAMPLER_CLAMP32(pSampler->RxErrorBits);
+    pBtReport->TotalRXBits = RX_SAMPLER_CLAMP32(RxBits);
+    pBtReport->RxRssi = pSampler->RxRssi;
+    pBtReport->Cfo = pSampler->Cfo;
+
+    if (RxBits > 0)
+        pBtReport->ber = (float)((double)pSampler->RxErrorBits / (double)RxBits);
+    else
+        pBtReport->ber = pBtModule->pBtDevice->pChipOps->NoRxBer;
+
+    pBtReport->RxVerdict = pSampler->Verdict;
+}
+
+// Early stop verdict of a report the device filled in on demand
+static void
+BTModule_RxEarlyStopReport(
+        BT_MODULE *pBtModule,
+        BT_DEVICE_REPORT *pBtReport
+        )
+{
+    pBtReport->RxVerdict = BTModule_RxEarlyStopVerdict(pBtModule->pBtParam,
+                                                       pBtReport->TotalRxErrorBits,
+                                                       pBtReport->TotalRXBits,
+                                                       ++pBtModule->RxSampler.Looks);
+}
+
+
+
+// Gain index the monitor runs at Step steps over the start of the run
+static uint8_t
+BTModule_ThermalGainIndex(
+        BT_MODULE *pBtModule,
+        uint8_t Step
+        )
+{
+    BT_THERMAL_MONITOR *pMonitor = &pBtModule->ThermalMonitor;
+    unsigned int Index = pMonitor->BaseGainIndex + Step;
+    unsigned int Max = pBtModule->pBtDevice->pChipOps->MaxGainIndex;
+
+    return (uint8_t)((Index > Max) ? Max : Index);
+}
+
+// Read the thermal meter once, follow the rise with the compensation and
+// keep the reading in the history. HciLock held.
+static int
+BTModule_ThermalSample(
+        BT_MODULE *pBtModule,
+        int First
+        )
+{
+    BT_THERMAL_MONITOR *pMonitor = &pBtModule->ThermalMonitor;
+    BT_DEVICE *pBtDevice = pBtModule->pBtDevice;
+    BT_PARAMETER *pBtParam = pBtModule->pBtParam;
+    BT_THERMAL_SAMPLE *pSample;
+    struct timespec ts;
+    uint8_t Thermal, Step, Comp = 0;
+    uint8_t Cmd[2];
+    int i;
+
+    if (pBtDevice->ReadThermal(pBtDevice, pBtParam, &Thermal) != BT_FUNCTION_SUCCESS)
+    {
+        pMonitor->Errors++;
+        return FUNCTION_ERROR;
+    }
+
+    if (First)
+        pMonitor->BaseThermal = Thermal;
+
+    if (pMonitor->Mode == BT_THERMAL_COMP_GAIN_INDEX)
+    {
+        // one step for every slope entry the rise has reached
+        Step = 0;
+        for (i = 0; i < pBtParam->ThermalSlopeNum; i++)
+        {
+            if (Thermal >= pMonitor->BaseThermal + pBtParam->ThermalSlope[i])
+                Step++;
+        }
+
+        if (Step != pMonitor->Step)
+        {
+            if (pBtDevice->SetPowerGainIndex(pBtDevice, pBtParam->mPacketType,
+                                             BTModule_ThermalGainIndex(pBtModule, Step)) == BT_FUNCTION_SUCCESS)
+            {
+                SYSLOGI("BTModule_ThermalSample: thermal %u over %u, gain index step %u -> %u",
+                        Thermal, pMonitor->BaseThermal, pMonitor->Step, Step);
+                pMonitor->Step = Step;
+            }
+            else
+            {
+                pMonitor->Errors++;
+            }
+        }
+        Comp = BTModule_ThermalGainIndex(pBtModule, pMonitor->Step);
+    }
+    else if (pMonitor->Mode == BT_THERMAL_COMP_FW)
+    {
+        Cmd[0] = 1;     //get
+        Cmd[1] = 0;
+        if (pBtDevice->TxPowerTracking(pBtDevice, Cmd, &Comp) != BT_FUNCTION_SUCCESS)
+            pMonitor->Errors++;
+    }
+
+    if (!First && (++pMonitor->Skipped < pMonitor->Stride))
+        return BT_FUNCTION_SUCCESS;
+    pMonitor->Skipped = 0;
+
+    if (pMonitor->Count == BT_THERMAL_HISTORY)
+    {
+        for (i = 0; i < BT_THERMAL_HISTORY / 2; i++)
+            pMonitor->History[i] = pMonitor->History[2 * i];
+        pMonitor->Count = BT_THERMAL_HISTORY / 2;
+        pMonitor->Stride *= 2;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pSample = &pMonitor->History[pMonitor->Count++];
+    pSample->ElapsedMs = (uint32_t)((((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec) - pMonitor->StartNs) / 1000000LL);
+    pSample->Thermal = Thermal;
+    pSample->Step = pMonitor->Step;
+    pSample->Comp = Comp;
+    pSample->Reserved = 0;
+
+    return BT_FUNCTION_SUCCESS;
+}
+
+static void *
+BTModule_ThermalThread(
+        void *arg
+        )
+{
+    BT_MODULE *pBtModule = (BT_MODULE *)arg;
+    BT_THERMAL_MONITOR *pMonitor = &pBtModule->ThermalMonitor;
+    struct timespec ts;
+
+    pthread_mutex_lock(&pBtModule->HciLock);
+
+    while (1)
+    {
+        while (!pMonitor->Running)
+            pthread_cond_wait(&pMonitor->Cond, &pBtModule->HciLock);
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += pMonitor->PeriodMs / 1000;
+        ts.tv_nsec += (pMonitor->PeriodMs % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+
+        while (pMonitor->Running &&
+               pthread_cond_timedwait(&pMonitor->Cond, &pBtModule->HciLock, &ts) != ETIMEDOUT)
+            ;
+
+        if (pMonitor->Running)
+            BTModule_ThermalSample(pBtModule, 0);
+    }
+
+    return NULL;
+}
+
+// Begin watching a fresh TX run when a period is set
+static void
+BTModule_ThermalMonitorStart(
+        BT_MODULE *pBtModule
+        )
+{
+    BT_THERMAL_MONITOR *pMonitor = &pBtModule->ThermalMonitor;
+    BT_DEVICE *pBtDevice = pBtModule->pBtDevice;
+    BT_PARAMETER *pBtParam = pBtModule->pBtParam;
+    pthread_attr_t attr;
+    struct timespec ts;
+    uint8_t Cmd[2], Reading;
+
+    if (pMonitor->Running)
+        return;
+
+    pMonitor->Count = 0;
+    pMonitor->Stride = 1;
+    pMonitor->Skipped = 0;
+    pMonitor->Errors = 0;
+    pMonitor->Step = 0;
+    pMonitor->BaseGainIndex = pBtParam->mTxGainIndex;
+    pMonitor->Mode = pBtParam->ThermalCompMode;
+
+    pMonitor->PeriodMs = pBtParam->ThermalPeriodMs;
+    if (pMonitor->PeriodMs == 0)
+        return;
+
+    // on the register chips a thermal meter read goes through the modem
+    // registers and stops the TX it is meant to watch
+    if (pBtDevice->pChipOps->PktTxRetune)
+    {
+        SYSLOGW("BTModule_ThermalMonitorStart: TX runs on the modem registers, no thermal monitor");
+        return;
+    }
+
+    if (!pMonitor->ThreadStarted)
+    {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&pMonitor->Thread, &attr, BTModule_ThermalThread, pBtModule) != 0)
+        {
+            pthread_attr_destroy(&attr);
+            SYSLOGE("BTModule_ThermalMonitorStart: can not create thread, no thermal monitor");
+            return;
+        }
+        pthread_attr_destroy(&attr);
+        pMonitor->ThreadStarted = 1;
+    }
+
+    // gain index tables count from 1, a run on index 0 is left alone
+    if ((pMonitor->Mode == BT_THERMAL_COMP_GAIN_INDEX) && (pMonitor->BaseGainIndex == 0))
+    {
+        SYSLOGW("BTModule_ThermalMonitorStart: no gain index set, compensation off");
+        pMonitor->Mode = BT_THERMAL_COMP_OFF;
+    }
+
+    if (pMonitor->Mode == BT_THERMAL_COMP_FW)
+    {
+        Cmd[0] = 0;     //set
+        Cmd[1] = 1;     //enable
+        if (pBtDevice->TxPowerTracking(pBtDevice, Cmd, &Reading) != BT_FUNCTION_SUCCESS)
+        {
+            SYSLOGE("BTModule_ThermalMonitorStart: can not enable power tracking");
+            pMonitor->Mode = BT_THERMAL_COMP_OFF;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pMonitor->StartNs = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    BTModule_ThermalSample(pBtModule, 1);
+
+    pMonitor->Running = 1;
+    pthread_cond_signal(&pMonitor->Cond);
+}
+
+// End the TX run, undo the compensation, the history stays readable
+static void
+BTModule_ThermalMonitorStop(
+        BT_MODULE *pBtModule
+        )
+{
+    BT_THERMAL_MONITOR *pMonitor = &pBtModule->ThermalMonitor;
+    BT_DEVICE *pBtDevice = pBtModule->pBtDevice;
+    uint8_t Cmd[2], Reading;
+
+    if (!pMonitor->Running)
+        return;
+
+    pMonitor->Running = 0;
+    pthread_cond_signal(&pMonitor->Cond);
+
+    if (pMonitor->Mode == BT_THERMAL_COMP_FW)
+    {
+        Cmd[0] = 0;     //set
+        Cmd[1] = 0;     //disable
+        pBtDevice->TxPowerTracking(pBtDevice, Cmd, &Reading);
+    }
+    else if ((pMonitor->Mode == BT_THERMAL_COMP_GAIN_INDEX) && pMonitor->Step)
+    {
+        pBtDevice->SetPowerGainIndex(pBtDevice, pBtModule->pBtParam->mPacketType, pMonitor->BaseGainIndex);
+        pMonitor->Step = 0;
+    }
+
+    SYSLOGI("BTModule_ThermalMonitorStop: first %u, last %u, kept %u of stride %u, errors %u",
+            pMonitor->BaseThermal, pMonitor->Count ? pMonitor->History[pMonitor->Count - 1].Thermal : 0,
+            pMonitor->Count, pMonitor->Stride, pMonitor->Errors);
+}
+
 
 int BTModule_ActionReport(
         BT_MODULE *pBtModule,
@@ -21,53 +545,39 @@ int BTModule_ActionReport(
     BT_DEVICE *pModuleBtDevice = pBtModule->pBtDevice;
     BT_PARAMETER *pModuleBtParam = pBtModule->pBtParam;
     BT_DEVICE_REPORT *pModuleBtReport = pBtModule->pModuleBtReport;
-    unsigned int ChipType;
+    const BT_CHIP_OPS *pChipOps = pModuleBtDevice->pChipOps;
     int i;
 
-    ChipType = pModuleBtDevice->pBTInfo->ChipType;
-
     switch (ActiceItem)
     {
     case REPORT_PKT_TX:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            pModuleBtDevice->SetPktTxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            pModuleBtDevice->FwPacketTxReport(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
+        pChipOps->PktTxReport(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         pReport->TotalTXBits = pModuleBtReport->TotalTXBits;
         pReport->TotalTxCounts = pModuleBtReport->TotalTxCounts;
         break;
 
     case REPORT_CON_TX:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            pModuleBtDevice->SetContinueTxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            pModuleBtDevice->FwContTxReport(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
+        pChipOps->ContTxReport(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
 
         pReport->TotalTXBits = pModuleBtReport->TotalTXBits;
         pReport->TotalTxCounts = pModuleBtReport->TotalTxCounts;
         break;
 
     case REPORT_RKT_RX:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
+        if (pBtModule->RxSampler.Valid)
         {
-            pModuleBtDevice->SetPktRxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+            BTModule_RxSamplerReport(pBtModule, pModuleBtReport);
         }
         else
         {
-            pModuleBtDevice->FwPacketRxReport(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+            pChipOps->PktRxReport(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+            BTModule_RxEarlyStopReport(pBtModule, pModuleBtReport);
         }
         pReport->TotalRXBits = pModuleBtReport->TotalRXBits;
         pReport->TotalRxCounts = pModuleBtReport->TotalRxCounts;
         pReport->TotalRxErrorBits = pModuleBtReport->TotalRxErrorBits;
         pReport->ber = pModuleBtReport->ber;
+        pReport->RxVerdict = pModuleBtReport->RxVerdict;
         pReport->RxRssi = pModuleBtReport->RxRssi;
         pReport->RXRecvPktCnts = pModuleBtReport->RXRecvPktCnts;
         pReport->Cfo=pModuleBtReport->Cfo;
@@ -103,6 +613,7 @@ int BTModule_ActionReport(
         pReport->TotalRxCounts = pModuleBtReport->TotalRxCounts;
         pReport->TotalRxErrorBits = pModuleBtReport->TotalRxErrorBits;
         pReport->ber = pModuleBtReport->ber;
+        pReport->RxVerdict = pModuleBtReport->RxVerdict;
         pReport->RxRssi = pModuleBtReport->RxRssi;
         pReport->RXRecvPktCnts = pModuleBtReport->RXRecvPktCnts;
         pReport->Cfo=pModuleBtReport->Cfo;
@@ -136,7 +647,11 @@ int BTModule_ActionReport(
         break;
 
     case REPORT_THERMAL:
-        pModuleBtDevice->ReadThermal(pModuleBtDevice, pBtModule->pBtParam, &pReport->CurrThermalValue);
+        // a watched TX run already has a fresh reading
+        if (pBtModule->ThermalMonitor.Running && pBtModule->ThermalMonitor.Count)
+            pReport->CurrThermalValue = pBtModule->ThermalMonitor.History[pBtModule->ThermalMonitor.Count - 1].Thermal;
+        else
+            pModuleBtDevice->ReadThermal(pModuleBtDevice, pBtModule->pBtParam, &pReport->CurrThermalValue);
         break;
 
     case REPORT_BT_STAGE:
@@ -161,14 +676,7 @@ int BTModule_ActionReport(
         break;
 
     case REPORT_LE_CONTINUE_TX:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            pModuleBtDevice->SetContinueTxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            pModuleBtDevice->FwContTxReport(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
+        pChipOps->ContTxReport(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         pReport->TotalTXBits=pModuleBtReport->TotalTXBits;
         pReport->TotalTxCounts=pModuleBtReport->TotalTxCounts;
         break;
@@ -234,6 +742,14 @@ int BTModule_ActionReport(
         pReport->ReportData[0] = pModuleBtReport->ReportData[0];
         break;
 
+    case REPORT_THERMAL_MONITOR:
+        memcpy(pBtModule->ThermalMonitor.Report, pBtModule->ThermalMonitor.History,
+               pBtModule->ThermalMonitor.Count * sizeof(BT_THERMAL_SAMPLE));
+        pBtModule->ThermalMonitor.ReportCount = pBtModule->ThermalMonitor.Count;
+        if (pBtModule->ThermalMonitor.Count)
+            pReport->CurrThermalValue = pBtModule->ThermalMonitor.History[pBtModule->ThermalMonitor.Count - 1].Thermal;
+        break;
+
     default:
         goto error;
 
@@ -299,23 +815,294 @@ int BTModule_UpDataParameter(
 
 
 
+// Packet TX over every channel x packet type pair in the sweep lists,
+// dwelling on each, one result row per point. The radio is programmed in
+// full once, later points only retune what changed.
+static int
+BTModule_PktTxSweep(
+        BT_MODULE *pBtModule
+        )
+{
+    BT_DEVICE *pModuleBtDevice = pBtModule->pBtDevice;
+    BT_PARAMETER *pModuleBtParam = pBtModule->pBtParam;
+    BT_DEVICE_REPORT *pModuleBtReport = pBtModule->pModuleBtReport;
+    BASE_INTERFACE_MODULE *pBaseInterface = pModuleBtDevice->pBaseInterface;
+    BT_SWEEP_POINT *pPoint;
+    const BT_CHIP_OPS *pChipOps = pModuleBtDevice->pChipOps;
+    uint8_t SavedChannel = pModuleBtParam->mChannelNumber;
+    BT_PKT_TYPE SavedPktType = pModuleBtParam->mPacketType;
+    uint8_t ChannelNum, PktTypeNum, Channel, PktType, Changes;
+    uint16_t DwellMs;
+    int Started = 0, Running = 0, Passed = 0;
+    int rtn = FUNCTION_PARAMETER_ERROR;
+    int i, j;
+
+    ChannelNum = pModuleBtParam->SweepChannelNum ? pModuleBtParam->SweepChannelNum : BT_SWEEP_MAX_CHANNELS;
+    PktTypeNum = pModuleBtParam->SweepPktTypeNum ? pModuleBtParam->SweepPktTypeNum : 1;
+    DwellMs = pModuleBtParam->SweepDwellMs ? pModuleBtParam->SweepDwellMs : BT_SWEEP_DEFAULT_DWELL_MS;
+
+    SYSLOGI("+BTModule_PktTxSweep: %u channels x %u packet types, dwell %u ms",
+            ChannelNum, PktTypeNum, DwellMs);
+
+    pBtModule->SweepPointNum = 0;
+
+    for (i = 0; i < PktTypeNum; i++)
+    {
+        PktType = pModuleBtParam->SweepPktTypeNum ? pModuleBtParam->SweepPktTypes[i] : SavedPktType;
+
+        for (j = 0; j < ChannelNum; j++)
+        {
+            Channel = pModuleBtParam->SweepChannelNum ? pModuleBtParam->SweepChannels[j] : j;
+
+            pPoint = &pBtModule->SweepResult[pBtModule->SweepPointNum++];
+            pPoint->Channel = Channel;
+            pPoint->PacketType = PktType;
+            pPoint->Reserved = 0;
+            pPoint->TxCounts = 0;
+
+            if ((PktType >= BT_SWEEP_MAX_PKT_TYPES) || (Channel >= BT_SWEEP_MAX_CHANNELS))
+            {
+                pPoint->Status = FUNCTION_PARAMETER_ERROR;
+                continue;
+            }
+
+            Changes = 0;
+            if (Channel != pModuleBtParam->mChannelNumber)
+                Changes |= BT_PKTTX_RETUNE_CHANNEL;
+            if (PktType != pModuleBtParam->mPacketType)
+                Changes |= BT_PKTTX_RETUNE_PKT_TYPE;
+
+            pModuleBtParam->mChannelNumber = Channel;
+            pModuleBtParam->mPacketType = (BT_PKT_TYPE)PktType;
+
+            if (pChipOps->PktTxRetune)
+            {
+                if (Running)
+                    rtn = pModuleBtDevice->SetPktTxRetune(pModuleBtDevice, pModuleBtParam, pModuleBtReport, Changes);
+                else
+                    rtn = pChipOps->PktTxStart(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
+                Running = (rtn == BT_FUNCTION_SUCCESS);
+                Started |= Running;
+
+                if (Running)
+                {
+                    pBaseInterface->WaitMs(pBaseInterface, DwellMs);
+                    rtn = pChipOps->PktTxReport(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
+                    if (rtn == FUNCTION_TX_FINISH)
+                        rtn = BT_FUNCTION_SUCCESS;
+                }
+            }
+            else
+            {
+                //the firmware takes the whole setup in one command
+                rtn = pChipOps->PktTxStart(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
+                if (rtn == BT_FUNCTION_SUCCESS)
+                {
+                    pBaseInterface->WaitMs(pBaseInterface, DwellMs);
+                    rtn = pChipOps->PktTxReport(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
+                    if (pChipOps->PktTxStop(pModuleBtDevice, pModuleBtParam, pModuleBtReport) != BT_FUNCTION_SUCCESS)
+                        rtn = FUNCTION_ERROR;
+                }
+            }
+
+            pPoint->Status = (uint8_t)rtn;
+            if (rtn == BT_FUNCTION_SUCCESS)
+            {
+                pPoint->TxCounts = pModuleBtReport->TotalTxCounts;
+                Passed++;
+            }
+        }
+    }
+
+    if (Started)
+        pChipOps->PktTxStop(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
+
+    pModuleBtParam->mChannelNumber = SavedChannel;
+    pModuleBtParam->mPacketType = SavedPktType;
+
+    SYSLOGI("-BTModule_PktTxSweep: %d of %u points passed", Passed, pBtModule->SweepPointNum);
+
+    return Passed ? BT_FUNCTION_SUCCESS : rtn;
+}
+
+
+
+// Air time in us of one LE test packet with Len payload bytes
+static uint32_t
+BTModule_LeTestPacketUs(
+        uint8_t Phy,
+        uint8_t Len
+        )
+{
+    switch (Phy)
+    {
+    case LE_2M_PHY:
+        return (2 + 4 + 2 + Len + 3) * 4;
+    case LE_CODED_PHY_S8:
+        return 80 + 296 + (16 + 8 * Len + 24 + 3) * 8;
+    case LE_CODED_PHY_S2:
+        return 80 + 296 + (16 + 8 * Len + 24 + 3) * 2;
+    default:
+        return (1 + 4 + 2 + Len + 3) * 8;
+    }
+}
+
+// Test packets sent in DwellMs, at the spacing the LE test mode uses
+static uint16_t
+BTModule_LeTestExpected(
+        uint8_t Phy,
+        uint8_t Len,
+        uint16_t DwellMs
+        )
+{
+    uint32_t Interval = ((BTModule_LeTestPacketUs(Phy, Len) + 249 + 624) / 625) * 625;
+    uint32_t Expected = (uint32_t)DwellMs * 1000 / Interval;
+
+    return (Expected > 0xffff) ? 0xffff : (uint16_t)Expected;
+}
+
+// LE enhanced test over every cell of the matrix lists, start and end
+// commands chained with only the dwell between them. Each cell goes to the
+// front end as soon as its LE Test End event is in.
+static int
+BTModule_LeTestMatrix(
+        BT_MODULE *pBtModule,
+        int Item
+        )
+{
+    BT_DEVICE *pModuleBtDevice = pBtModule->pBtDevice;
+    BT_PARAMETER *pModuleBtParam = pBtModule->pBtParam;
+    BT_DEVICE_REPORT *pModuleBtReport = pBtModule->pModuleBtReport;
+    BASE_INTERFACE_MODULE *pBaseInterface = pModuleBtDevice->pBaseInterface;
+    BT_LE_MATRIX_CELL Cell;
+    int Rx = (Item == LE_RX_TEST_MATRIX);
+    uint8_t SavedChannel = pModuleBtParam->mChannelNumber;
+    uint8_t SavedPhy = pModuleBtParam->PHY;
+    uint8_t SavedModIdx = pModuleBtParam->ModulationIndex;
+    BT_PAYLOAD_TYPE SavedPayload = pModuleBtParam->mPayloadType;
+    uint8_t Len = pModuleBtParam->mParamData[0];
+    uint8_t ChannelNum, PhyNum, ThirdNum;
+    uint16_t DwellMs;
+    int Cells = 0, Passed = 0;
+    int rtn = FUNCTION_PARAMETER_ERROR;
+    int i, j, k;
+
+    ChannelNum = pModuleBtParam->SweepChannelNum ? pModuleBtParam->SweepChannelNum : BT_LE_MATRIX_MAX_CHANNELS;
+    PhyNum = pModuleBtParam->LeMatrixPhyNum ? pModuleBtParam->LeMatrixPhyNum : 1;
+    //modulation index only exists on the receiver, payload only on the transmitter
+    if (Rx)
+        ThirdNum = pModuleBtParam->LeMatrixModIdxNum ? pModuleBtParam->LeMatrixModIdxNum : 1;
+    else
+        ThirdNum = pModuleBtParam->LeMatrixPayloadNum ? pModuleBtParam->LeMatrixPayloadNum : 1;
+    DwellMs = pModuleBtParam->SweepDwellMs ? pModuleBtParam->SweepDwellMs : BT_SWEEP_DEFAULT_DWELL_MS;
+
+    SYSLOGI("+BTModule_LeTestMatrix: %s, %u channels x %u PHYs x %u, dwell %u ms",
+            Rx ? "RX" : "TX", ChannelNum, PhyNum, ThirdNum, DwellMs);
+
+    for (i = 0; i < PhyNum; i++)
+    {
+        Cell.PHY = pModuleBtParam->LeMatrixPhyNum ? pModuleBtParam->LeMatrixPhys[i] : SavedPhy;
+
+        for (k = 0; k < ThirdNum; k++)
+        {
+            if (Rx)
+            {
+                Cell.ModulationIndex = pModuleBtParam->LeMatrixModIdxNum ? pModuleBtParam->LeMatrixModIdx[k] : SavedModIdx;
+                Cell.PayloadType = (uint8_t)SavedPayload;
+            }
+            else
+            {
+                Cell.ModulationIndex = SavedModIdx;
+                Cell.PayloadType = pModuleBtParam->LeMatrixPayloadNum ? pModuleBtParam->LeMatrixPayloads[k] : (uint8_t)SavedPayload;
+            }
+
+            for (j = 0; j < ChannelNum; j++)
+            {
+                Cell.Channel = pModuleBtParam->SweepChannelNum ? pModuleBtParam->SweepChannels[j] : j;
+                Cell.Reserved = 0;
+                Cell.Packets = 0;
+                Cell.Expected = BTModule_LeTestExpected(Cell.PHY, Len, DwellMs);
+                Cell.Per = BT_LE_MATRIX_PER_NONE;
+
+                if ((Cell.Channel >= BT_LE_MATRIX_MAX_CHANNELS) ||
+                    (Cell.PHY < LE_1M_PHY) || (Cell.PHY > LE_CODED_PHY_S2))
+                {
+                    rtn = FUNCTION_PARAMETER_ERROR;
+                }
+                else
+                {
+                    pModuleBtParam->mChannelNumber = Cell.Channel;
+                    pModuleBtParam->ModulationIndex = Cell.ModulationIndex;
+                    pModuleBtParam->mPayloadType = (BT_PAYLOAD_TYPE)Cell.PayloadType;
+
+                    if (Rx)
+                    {
+                        //the receiver takes either coding as coded
+                        pModuleBtParam->PHY = (Cell.PHY == LE_CODED_PHY_S2) ? LE_CODED_PHY_S8 : Cell.PHY;
+                        rtn = BTDevice_LeRxEnhancedTest(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
+                    }
+                    else
+                    {
+                        pModuleBtParam->PHY = Cell.PHY;
+                        rtn = BTDevice_LeTxEnhancedTest(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
+                    }
+
+                    if (rtn == BT_FUNCTION_SUCCESS)
+                    {
+                        pBaseInterface->WaitMs(pBaseInterface, DwellMs);
+                        rtn = pModuleBtDevice->LeTestEndCmd(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
+                    }
+
+                    if (rtn == BT_FUNCTION_SUCCESS)
+                    {
+                        Cell.Packets = (uint16_t)pModuleBtReport->TotalRxCounts;
+                        if (Rx && Cell.Expected)
+                        {
+                            if (Cell.Packets >= Cell.Expected)
+                                Cell.Per = 0;
+                            else
+                                Cell.Per = (uint16_t)(((uint32_t)(Cell.Expected - Cell.Packets) * 10000) / Cell.Expected);
+                        }
+                        Passed++;
+                    }
+                }
+
+                Cell.Status = (uint8_t)rtn;
+                Cells++;
+
+                if (pBtModule->StreamResult != NULL)
+                    pBtModule->StreamResult(pBtModule, Item, BT_MP_RESULT_LE_CELL, &Cell, sizeof(Cell));
+            }
+        }
+    }
+
+    pModuleBtParam->mChannelNumber = SavedChannel;
+    pModuleBtParam->PHY = SavedPhy;
+    pModuleBtParam->ModulationIndex = SavedModIdx;
+    pModuleBtParam->mPayloadType = SavedPayload;
+
+    SYSLOGI("-BTModule_LeTestMatrix: %d of %d cells passed", Passed, Cells);
+
+    return Passed ? BT_FUNCTION_SUCCESS : rtn;
+}
+
+
+
 int BTModule_ActionControlExcute(
     BT_MODULE *pBtModule
     )
 {
     int rtn = BT_FUNCTION_SUCCESS;
-    unsigned int ChipType;
     int Item = pBtModule->pBtParam->ParameterIndex;
     BT_DEVICE *pModuleBtDevice = pBtModule->pBtDevice;
     BT_PARAMETER *pModuleBtParam = pBtModule->pBtParam;
     BT_DEVICE_REPORT *pModuleBtReport = pBtModule->pModuleBtReport;
+    const BT_CHIP_OPS *pChipOps = pModuleBtDevice->pChipOps;
 
     SYSLOGI("BTModule_ActionControlExcute: pBtModule 0x%p, pBtDevice 0x%p, pBtParam 0x%p, "
            "pModuleBtReport 0x%p, ParameterIndex %d", pBtModule, pModuleBtDevice, pModuleBtParam,
             pModuleBtReport, Item);
 
-    ChipType = pModuleBtDevice->pBTInfo->ChipType;
-
     switch (Item)
     {
     ////////////////////////// TABLE ///////////////////////////////////////////////////////
@@ -342,6 +1129,7 @@ int BTModule_ActionControlExcute(
 
     ////////////////////////// HCI RESET /////////////////////////////////////////////////////////
     case HCI_RESET:
+        BTModule_ThermalMonitorStop(pBtModule);
         rtn = pModuleBtDevice->SetHciReset(pModuleBtDevice, 700);
         if(rtn != BT_FUNCTION_SUCCESS)
             break;
@@ -353,97 +1141,72 @@ int BTModule_ActionControlExcute(
         pModuleBtReport->TotalRxErrorBits = 0;
         pModuleBtReport->RxRssi = -90;
         pModuleBtReport->RXRecvPktCnts = 0;
+        pModuleBtReport->RxVerdict = BT_RX_VERDICT_NONE;
         PktRxCount = 0;
         PktRxErrBits = 0;
+        pBtModule->RxSampler.Running = 0;
+        pBtModule->RxSampler.Valid = 0;
         rtn = pModuleBtDevice->SetRestMDCount(pModuleBtDevice);
         break;
 
     /////////////////////////// PACKET_TX /////////////////////////////////////////////////////////
     case PACKET_TX_START:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            rtn = pModuleBtDevice->SetPktTxBegin(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->FwPacketTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
+        rtn = pChipOps->PktTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+        if (rtn == BT_FUNCTION_SUCCESS)
+            BTModule_ThermalMonitorStart(pBtModule);
         break;
 
     case PACKET_TX_UPDATE:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
+        if (pChipOps->PktTxUpdate)
         {
-            rtn = pModuleBtDevice->SetPktTxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+            rtn = pChipOps->PktTxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         }
         break;
 
     case PACKET_TX_STOP:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            rtn = pModuleBtDevice->SetPktTxStop(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->FwPacketTxStop(pModuleBtDevice);
-        }
+        BTModule_ThermalMonitorStop(pBtModule);
+        rtn = pChipOps->PktTxStop(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         break;
     ////////////////////////// PACKET_RX /////////////////////////////////////////////////////////
     case PACKET_RX_START:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            rtn = pModuleBtDevice->SetPktRxBegin(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->FwPacketRxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
+        rtn = pChipOps->PktRxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+        if (rtn == BT_FUNCTION_SUCCESS)
+            BTModule_RxSamplerStart(pBtModule);
         break;
 
     case PACKET_RX_UPDATE:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
+        if (pBtModule->RxSampler.Valid)
         {
-            rtn = pModuleBtDevice->SetPktRxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+            BTModule_RxSamplerReport(pBtModule, pModuleBtReport);
+        }
+        else if (pChipOps->PktRxUpdate)
+        {
+            rtn = pChipOps->PktRxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+            BTModule_RxEarlyStopReport(pBtModule, pModuleBtReport);
         }
         break;
 
     case PACKET_RX_STOP:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            rtn = pModuleBtDevice->SetPktRxStop(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->FwPacketRxStop(pModuleBtDevice);
-        }
+        BTModule_RxSamplerStop(pBtModule);
+        rtn = pChipOps->PktRxStop(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         break;
 
     /////////////////////////// CONTINUE_TX /////////////////////////////////////////////////////////
     case CONTINUE_TX_START:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            rtn = pModuleBtDevice->SetContinueTxBegin(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->FwContTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
+        rtn = pChipOps->ContTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+        if (rtn == BT_FUNCTION_SUCCESS)
+            BTModule_ThermalMonitorStart(pBtModule);
         break;
 
     case CONTINUE_TX_STOP:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            rtn=pModuleBtDevice->SetContinueTxStop(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->FwContTxStop(pModuleBtDevice);
-        }
+        BTModule_ThermalMonitorStop(pBtModule);
+        rtn = pChipOps->ContTxStop(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         break;
 
     case CONTINUE_TX_UPDATE:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
+        if (pChipOps->ContTxUpdate)
         {
-            rtn = pModuleBtDevice->SetContinueTxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+            rtn = pChipOps->ContTxUpdate(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         }
         break;
 
@@ -475,9 +1238,22 @@ int BTModule_ActionControlExcute(
         pModuleBtReport->TotalRxErrorBits = 0;
         pModuleBtReport->RxRssi = -90;
         pModuleBtReport->RXRecvPktCnts = 0;
+        pModuleBtReport->RxVerdict = BT_RX_VERDICT_NONE;
         PktRxCount = 0;
         PktRxErrBits = 0;
         rtn = pModuleBtDevice->SetRestMDCount(pModuleBtDevice);
+        if (pBtModule->RxSampler.Running)
+        {
+            pBtModule->RxSampler.RxCounts = 0;
+            pBtModule->RxSampler.RxErrorBits = 0;
+            pBtModule->RxSampler.ReportedCounts = 0;
+            pBtModule->RxSampler.Verdict = BT_RX_VERDICT_NONE;
+            BTModule_RxSamplerSample(pBtModule, 1);
+        }
+        else
+        {
+            pBtModule->RxSampler.Valid = 0;
+        }
         break;
 
     case SET_DEFAULT_TX_GAIN_TABLE:
@@ -497,25 +1273,11 @@ int BTModule_ActionControlExcute(
         break;
 
     case LE_TX_DUT_TEST_CMD:
-        if(ChipType == RTK_BT_CHIP_ID_RTL8763B)//BBPro
-        {
-            rtn = BTDevice_LeTxEnhancedTest(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->LeTxTestCmd(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
-        }
+        rtn = pChipOps->LeTxTest(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
         break;
 
     case LE_RX_DUT_TEST_CMD:
-        if(ChipType == RTK_BT_CHIP_ID_RTL8763B)//BBPro
-        {
-            rtn = BTDevice_LeRxEnhancedTest(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->LeRxTestCmd(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
-        }
+        rtn = pChipOps->LeRxTest(pModuleBtDevice, pModuleBtParam, pModuleBtReport);
         break;
 
     case LE_DUT_TEST_END_CMD:
@@ -536,59 +1298,53 @@ int BTModule_ActionControlExcute(
 
     // LE Cont-Tx
     case LE_CONTINUE_TX_START:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
+        pModuleBtParam->mChannelNumber = pModuleBtParam->mChannelNumber * 2;
+        pModuleBtParam->mWhiteningCoeffValue=0x7f;
+        pModuleBtParam->mPayloadType= BT_PAYLOAD_TYPE_PRBS9;
+        if (pChipOps->LeContTxPktType)
         {
-            pModuleBtParam->mChannelNumber = pModuleBtParam->mChannelNumber * 2;
-            pModuleBtParam->mWhiteningCoeffValue=0x7f;
-            pModuleBtParam->mPayloadType= BT_PAYLOAD_TYPE_PRBS9;
             pModuleBtParam->mPacketType= BT_PKT_1DH1;
-            rtn = pModuleBtDevice->SetContinueTxBegin(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            pModuleBtParam->mChannelNumber = pModuleBtParam->mChannelNumber*2;
-            pModuleBtParam->mWhiteningCoeffValue=0x7f;
-            pModuleBtParam->mPayloadType= BT_PAYLOAD_TYPE_PRBS9;
-            if(ChipType != RTK_BT_CHIP_ID_RTL8763B)//not BBPro
-            {
-                pModuleBtParam->mPacketType= BT_PKT_1DH1;
-            }
-            rtn = pModuleBtDevice->FwContTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         }
+        rtn = pChipOps->ContTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+        if (rtn == BT_FUNCTION_SUCCESS)
+            BTModule_ThermalMonitorStart(pBtModule);
         break;
 
     case LE_CONTINUE_TX_STOP:
-        if(ChipType <RTK_BT_CHIP_ID_RTL8822B)
-        {
-            rtn = pModuleBtDevice->SetContinueTxStop(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
-        }
-        else
-        {
-            rtn = pModuleBtDevice->FwContTxStop(pModuleBtDevice);
-        }
+        BTModule_ThermalMonitorStop(pBtModule);
+        rtn = pChipOps->ContTxStop(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
         break;
 
     case FW_PACKET_TX_START:
         rtn = pModuleBtDevice->FwPacketTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+        if (rtn == BT_FUNCTION_SUCCESS)
+            BTModule_ThermalMonitorStart(pBtModule);
         break;
 
     case FW_PACKET_TX_STOP:
+        BTModule_ThermalMonitorStop(pBtModule);
         rtn = pModuleBtDevice->FwPacketTxStop(pModuleBtDevice);
         break;
 
     case FW_CONTINUE_TX_START:
         rtn = pModuleBtDevice->FwContTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+        if (rtn == BT_FUNCTION_SUCCESS)
+            BTModule_ThermalMonitorStart(pBtModule);
         break;
 
     case FW_CONTINUE_TX_STOP:
+        BTModule_ThermalMonitorStop(pBtModule);
         rtn = pModuleBtDevice->FwContTxStop(pModuleBtDevice);
         break;
 
     case FW_PACKET_RX_START:
         rtn = pModuleBtDevice->FwPacketRxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+        if (rtn == BT_FUNCTION_SUCCESS)
+            BTModule_RxSamplerStart(pBtModule);
         break;
 
     case FW_PACKET_RX_STOP:
+        BTModule_RxSamplerStop(pBtModule);
         rtn = pModuleBtDevice->FwPacketRxStop(pModuleBtDevice);
         break;
 
@@ -598,9 +1354,12 @@ int BTModule_ActionControlExcute(
         pModuleBtParam->mPayloadType= BT_PAYLOAD_TYPE_PRBS9;
         pModuleBtParam->mPacketType= BT_PKT_1DH1;
         rtn = pModuleBtDevice->FwContTxStart(pModuleBtDevice,pModuleBtParam,pModuleBtReport);
+        if (rtn == BT_FUNCTION_SUCCESS)
+            BTModule_ThermalMonitorStart(pBtModule);
         break;
 
     case FW_LE_CONTINUE_TX_STOP:
+        BTModule_ThermalMonitorStop(pBtModule);
         rtn = pModuleBtDevice->FwContTxStop(pModuleBtDevice);
         break;
 
@@ -624,6 +1383,16 @@ int BTModule_ActionControlExcute(
     case SET_K_TX_CH_PWR:
         rtn = pModuleBtDevice->SetKTxChPwr(pModuleBtDevice, pModuleBtParam->mParamData[0], pModuleBtParam->mParamData[1], pModuleBtParam->mParamData[2], pModuleBtParam->mParamData[3]);
         break;
+
+    case PACKET_TX_SWEEP:
+        rtn = BTModule_PktTxSweep(pBtModule);
+        break;
+
+    case LE_RX_TEST_MATRIX:
+    case LE_TX_TEST_MATRIX:
+        rtn = BTModule_LeTestMatrix(pBtModule, Item);
+        break;
+
     default:
         rtn = FUNCTION_ERROR;
         break;
@@ -656,6 +1425,7 @@ BTModule_DownloadPatchCode(
         rtn=pModuleBtDevice->BTDlFW(pModuleBtDevice, pPatchcode, patchLength);
     }
 
+    BTDevice_InvalidateChipInfo(pModuleBtDevice);
     pModuleBtDevice->SetHciReset(pModuleBtDevice, 500);
 
     return rtn;
@@ -46,15 +46,42 @@ void bt_transport_signal_event(BASE_INTERFACE_MODULE *pBaseInterface, unsigned s
     pthread_mutex_unlock(&pBaseInterface->mutex);
 }
 
-int bt_transport_RecvHciEvt(
+void bt_transport_post_event(
         BASE_INTERFACE_MODULE *pBaseInterface,
-        uint8_t *pEvtBuffer,
-        uint32_t bufferLen,
-        uint32_t *pRetEvtLen
+        void *pHandle,
+        uint8_t *pEvt,
+        uint16_t evtLen
+        )
+{
+    void *pStale;
+
+    pthread_mutex_lock(&pBaseInterface->mutex);
+    /* Latest event wins, as with the former single event buffer */
+    pStale = pBaseInterface->pEvtHandle;
+    pBaseInterface->pEvtHandle = pHandle;
+    pBaseInterface->pEvt = pEvt;
+    pBaseInterface->evtLen = evtLen;
+    pBaseInterface->rx_ready_events |= MP_TRANSPORT_EVENT_RX_HCIEVT;
+    pthread_cond_signal(&pBaseInterface->cond);
+    pthread_mutex_unlock(&pBaseInterface->mutex);
+
+    if (pStale != NULL)
+        btif_dut_mode_release(pStale);
+}
+
+int bt_transport_RecvHciEvtRef(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        uint8_t **ppEvt,
+        uint32_t *pRetEvtLen,
+        void **ppHandle
         )
 {
     unsigned short events = 0;
 
+    *ppHandle = NULL;
+    *ppEvt = NULL;
+    *pRetEvtLen = 0;
+
     while(1)
     {
         pthread_mutex_lock(&pBaseInterface->mutex);
@@ -65,17 +92,21 @@ int bt_transport_RecvHciEvt(
 
         events = pBaseInterface->rx_ready_events;
         pBaseInterface->rx_ready_events = 0;
-        pthread_mutex_unlock(&pBaseInterface->mutex);
 
-        if(events & MP_TRANSPORT_EVENT_RX_HCIEVT)
+        if ((events & MP_TRANSPORT_EVENT_RX_HCIEVT) && pBaseInterface->pEvtHandle != NULL)
         {
+            *ppHandle = pBaseInterface->pEvtHandle;
+            *ppEvt = pBaseInterface->pEvt;
             *pRetEvtLen = pBaseInterface->evtLen;
-            SYSLOGI("pEvtBuffer %p, pBaseInterface->evtBuffer %p, pBaseInterface->evtLen %d",
-                    pEvtBuffer, pBaseInterface->evtBuffer, pBaseInterface->evtLen);
-            memcpy(pEvtBuffer, pBaseInterface->evtBuffer, pBaseInterface->evtLen);
+            pBaseInterface->pEvtHandle = NULL;
+            pBaseInterface->pEvt = NULL;
+            pthread_mutex_unlock(&pBaseInterface->mutex);
+
+            SYSLOGI("pEvt %p, evtLen %d", *ppEvt, *pRetEvtLen);
             break;
         }
-        else
+        pthread_mutex_unlock(&pBaseInterface->mutex);
+
         if(events & MP_TRANSPORT_EVENT_RX_EXIT)
         {
             break;
@@ -84,3 +115,36 @@ int bt_transport_RecvHciEvt(
     }
     return 0;
 }
+
+void bt_transport_ReleaseHciEvt(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        void *pHandle
+        )
+{
+    btif_dut_mode_release(pHandle);
+}
+
+int bt_transport_RecvHciEvt(
+        BASE_INTERFACE_MODULE *pBaseInterface,
+        uint8_t *pEvtBuffer,
+        uint32_t bufferLen,
+        uint32_t *pRetEvtLen
+        )
+{
+    uint8_t *pEvt;
+    void *pHandle;
+    uint32_t evtLen;
+
+    bt_transport_RecvHciEvtRef(pBaseInterface, &pEvt, &evtLen, &pHandle);
+
+    if (pHandle != NULL)
+    {
+        if (evtLen > bufferLen)
+            evtLen = bufferLen;
+        memcpy(pEvtBuffer, pEvt, evtLen);
+        *pRetEvtLen = evtLen;
+        bt_transport_ReleaseHciEvt(pBaseInterface, pHandle);
+    }
+
+    return 0;
+}
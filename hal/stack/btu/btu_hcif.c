@@ -40,10 +40,14 @@
 //Counter to track number of HCI command timeout
 static int num_hci_cmds_timed_out;
 
+//Hook taking MP events straight off the HCI thread
+static tBTU_HCIF_FAST_EVT_CBACK *btu_hcif_fast_evt_cback;
+
 
 static void btu_hcif_command_complete_evt (UINT8 controller_id, UINT8 *p, UINT16 evt_len);
 static void btu_hcif_command_status_evt (UINT8 controller_id, UINT8 *p, UINT16 evt_len);
 void btu_hcif_mp_test_event (UINT8 controller_id, BT_HDR *p_msg);
+static BOOLEAN btu_hcif_is_mp_event (UINT8 hci_evt_code);
 
 /*******************************************************************************
 **
@@ -167,12 +171,32 @@ void btu_hcif_process_event (UINT8 controller_id, BT_HDR *p_msg)
     {
         case HCI_COMMAND_COMPLETE_EVT:
             btu_hcif_command_complete_evt (controller_id, p, hci_evt_len);
-            btu_hcif_mp_test_event(controller_id, p_msg);
             break;
         case HCI_COMMAND_STATUS_EVT:
             btu_hcif_command_status_evt (controller_id, p, hci_evt_len);
-            btu_hcif_mp_test_event(controller_id, p_msg);
             break;
+    }
+
+    if (btu_hcif_is_mp_event (hci_evt_code))
+        btu_hcif_mp_test_event(controller_id, p_msg);
+}
+
+
+/*******************************************************************************
+**
+** Function         btu_hcif_is_mp_event
+**
+** Description      Tell whether an event is one the MP layer listens to
+**
+** Returns          TRUE if it goes to MP
+**
+*******************************************************************************/
+static BOOLEAN btu_hcif_is_mp_event (UINT8 hci_evt_code)
+{
+    switch (hci_evt_code)
+    {
+        case HCI_COMMAND_COMPLETE_EVT:
+        case HCI_COMMAND_STATUS_EVT:
 #if (MP_TOOL_COMMAND_SEARCH_EXIST_PERMISSION == 1)
         case 0x02:  // Inquiry Result Event
         case 0x22:  // Inquiry Result with RSSI Event
@@ -181,11 +205,11 @@ void btu_hcif_process_event (UINT8 controller_id, BT_HDR *p_msg)
         case 0x01:  // Inquiry Complete Event
         case 0x3d:  // Remote Host Supported Features Notification Event
         case 0x07:  // Remote Name Request Complete Event
-            btu_hcif_mp_test_event(controller_id, p_msg);
-            break;
 #endif
+            return TRUE;
     }
 
+    return FALSE;
 }
 
 
@@ -383,17 +407,60 @@ static void btu_hcif_command_status_evt (UINT8 controller_id, UINT8 *p, UINT16 e
 }
 
 
-void btu_hcif_mp_test_event (UINT8 controller_id, BT_HDR *p_msg)
+/*******************************************************************************
+**
+** Function         btu_hcif_register_fast_evt_cback
+**
+** Description      Register the hook btu_hcif_fast_event offers MP events
+**                  to. NULL removes it.
+**
+** Returns          void
+**
+*******************************************************************************/
+void btu_hcif_register_fast_evt_cback (tBTU_HCIF_FAST_EVT_CBACK *p_cback)
 {
+    btu_hcif_fast_evt_cback = p_cback;
+}
+
+/*******************************************************************************
+**
+** Function         btu_hcif_fast_event
+**
+** Description      Called on the HCI receive thread for every packet before
+**                  it is queued to btu_task. Every event MP listens to is
+**                  handed to the registered hook, so MP sees them all on
+**                  one path and in the order they arrived. The event still
+**                  goes to btu_task, which owns the command window, but
+**                  btu_hcif_mp_test_event leaves it alone.
+**
+** Returns          void
+**
+*******************************************************************************/
+void btu_hcif_fast_event (BT_HDR *p_msg)
+{
+    tBTU_HCIF_FAST_EVT_CBACK *p_cback = btu_hcif_fast_evt_cback;
     UINT8   *p = (UINT8 *)(p_msg + 1) + p_msg->offset;
-    UINT8   hci_evt_code, hci_evt_len;
 
-    STREAM_TO_UINT8  (hci_evt_code, p);
-    STREAM_TO_UINT8  (hci_evt_len, p);
+    if ((p_cback == NULL) ||
+        ((p_msg->event & BT_EVT_MASK) != BT_EVT_TO_BTU_HCI_EVT) ||
+        !btu_hcif_is_mp_event (*p))
+        return;
 
-    send_recv_evt_message(BT_EVT_RX, hci_evt_code, p, hci_evt_len);
+    (*p_cback)(p_msg);
+}
 
+void btu_hcif_mp_test_event (UINT8 controller_id, BT_HDR *p_msg)
+{
     num_hci_cmds_timed_out = 0;
+
+    /* Already with the MP layer through btu_hcif_fast_event */
+    if (btu_hcif_fast_evt_cback != NULL)
+        return;
+
+    /* Hand the received buffer itself to btif, untouched; btu_task still
+     * releases its own reference once btu_hcif_process_event returns. */
+    GKI_holdbuf(p_msg);
+    GKI_send_msg (BTIF_TASK, BTU_BTIF_MBOX, p_msg);
 }
 
 void btu_hcif_mp_notify_event (BT_HDR *p_msg)
@@ -472,7 +539,7 @@ void btu_hcif_send_cmd (UINT8 controller_id, BT_HDR *p_buf)
             else
             {
                 /* Unknown controller */
-                SYSLOGE (TRACE_LAYER_HCI, TRACE_TYPE_WARNING, "BTU HCI(ctrl id=%d) controller ID not recognized", controller_id);
+                SYSLOGE("BTU HCI(ctrl id=%d) controller ID not recognized", controller_id);
                 GKI_freebuf(p_buf);;
             }
 
@@ -287,12 +287,21 @@ BTU_API extern void btu_process_quick_timer_evt (void);
 BTU_API extern void btu_check_bt_sleep (void);
 #endif
 
+/* Fast-path hook for the events MP listens to, called on the HCI receive
+** thread before the event is queued to btu_task. While a hook is
+** registered it owns MP delivery and btu_task only does its command flow
+** bookkeeping. Register it before the HCI transport is opened.
+*/
+typedef void (tBTU_HCIF_FAST_EVT_CBACK) (BT_HDR *p_msg);
+
 /* Functions provided by btu_hcif.c
 ************************************
 */
 BTU_API extern void  btu_hcif_process_event (UINT8 controller_id, BT_HDR *p_buf);
 BTU_API extern void  btu_hcif_send_cmd (UINT8 controller_id, BT_HDR *p_msg);
 BTU_API extern void  btu_hcif_cmd_timeout (UINT8 controller_id);
+BTU_API extern void  btu_hcif_register_fast_evt_cback (tBTU_HCIF_FAST_EVT_CBACK *p_cback);
+BTU_API extern void  btu_hcif_fast_event (BT_HDR *p_msg);
 
 /* Functions provided by btu_core.c
 ************************************
@@ -20,20 +20,66 @@
  *
  *  This is the interface file for stack log in Linux
  *
+ *  SYSLOGx calls below the compile time level vanish, calls below the run
+ *  time level cost one compare. Everything else is formatted into a ring
+ *  owned by the calling thread and written out by a background thread.
+ *
  ******************************************************************************/
 
 #ifndef BT_SYSLOG_H
 #define BT_SYSLOG_H
 
+#include <stdint.h>
 #include <syslog.h>
 
 #ifndef LOG_TAG
 #define LOG_TAG NULL
 #endif
 
-void SYSLOGD(const char *format, ...);
-void SYSLOGI(const char *format, ...);
-void SYSLOGW(const char *format, ...);
-void SYSLOGE(const char *format, ...);
+/** trace level for sys log */
+#define SYS_TRACE_DEBUG     0
+#define SYS_TRACE_INFO      1
+#define SYS_TRACE_WARN      2
+#define SYS_TRACE_ERROR     3
+#define SYS_TRACE_NONE      4
+
+/* Calls below this level are not compiled in */
+#ifndef SYS_TRACE_COMPILE_LEVEL
+#define SYS_TRACE_COMPILE_LEVEL SYS_TRACE_DEBUG
+#endif
+
+/* Initial run time level, see bt_syslog_set_level */
+#ifndef SYS_TRACE_DEFAULT_LEVEL
+#define SYS_TRACE_DEFAULT_LEVEL SYS_TRACE_DEBUG
+#endif
+
+extern volatile int bt_syslog_level;
+
+#define SYS_TRACE_ON(level) \
+    (((level) >= SYS_TRACE_COMPILE_LEVEL) && ((level) >= bt_syslog_level))
+
+#define SYSLOGD(...) do { if (SYS_TRACE_ON(SYS_TRACE_DEBUG)) bt_syslog_msg(SYS_TRACE_DEBUG, __VA_ARGS__); } while (0)
+#define SYSLOGI(...) do { if (SYS_TRACE_ON(SYS_TRACE_INFO))  bt_syslog_msg(SYS_TRACE_INFO, __VA_ARGS__); } while (0)
+#define SYSLOGW(...) do { if (SYS_TRACE_ON(SYS_TRACE_WARN))  bt_syslog_msg(SYS_TRACE_WARN, __VA_ARGS__); } while (0)
+#define SYSLOGE(...) do { if (SYS_TRACE_ON(SYS_TRACE_ERROR)) bt_syslog_msg(SYS_TRACE_ERROR, __VA_ARGS__); } while (0)
+
+void bt_syslog_msg(int trace_level, const char *format, ...);
+
+/* Change the run time level, SYS_TRACE_NONE silences everything */
+void bt_syslog_set_level(int trace_level);
+
+/* Write to the given file instead of syslog, NULL goes back to syslog.
+ * Returns 0 on success, -1 if the file can not be opened. */
+int bt_syslog_set_file(const char *path);
+
+/* Record calls in binary form into the file at path, a ring of rec_count
+ * records (rounded down to a power of 2) with the raw arguments of each
+ * call and no formatting. Decode it on the host with bt_blog_decode.
+ * NULL switches back to text. Returns 0 on success, -1 on error or if a
+ * binary log was already started. */
+int bt_syslog_set_binary(const char *path, uint32_t rec_count);
+
+/* Write out everything logged so far before returning */
+void bt_syslog_flush(void);
 
 #endif  /* BT_SYSLOG_H */
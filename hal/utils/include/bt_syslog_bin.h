@@ -0,0 +1,176 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2014 Realsil Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Layout of the binary log file written by bt_syslog in binary mode and
+ *  read back by the host side decoder (hal/utils/tools/bt_blog_decode.c).
+ *
+ *  The file is mapped shared and holds three areas:
+ *    - tBT_BLOG_HDR
+ *    - the format dictionary: every format string logged, stored once,
+ *      its byte offset in the area + 1 is the format id used by records
+ *    - a ring of fixed size records carrying the raw argument values
+ *
+ *  All fields are in the byte order of the target.
+ *
+ ******************************************************************************/
+
+#ifndef BT_SYSLOG_BIN_H
+#define BT_SYSLOG_BIN_H
+
+#include <stdint.h>
+
+#define BT_BLOG_MAGIC       "BTBLOG1"
+#define BT_BLOG_VERSION     1
+
+#define BT_BLOG_REC_SIZE    128
+#define BT_BLOG_MAX_ARGS    16
+
+/* Argument classes, as pulled off the va_list and stored in a record */
+#define BT_BLOG_ARG_INT     0   /* 4 bytes */
+#define BT_BLOG_ARG_LONG    1   /* 8 bytes, sign extended from target long */
+#define BT_BLOG_ARG_LLONG   2   /* 8 bytes */
+#define BT_BLOG_ARG_DOUBLE  3   /* 8 bytes */
+#define BT_BLOG_ARG_PTR     4   /* 8 bytes, zero extended */
+#define BT_BLOG_ARG_STR     5   /* 1 byte length, then the characters */
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint32_t rec_count;
+    uint32_t dict_size;         /* bytes reserved for the dictionary */
+    volatile uint32_t dict_used;
+    uint8_t  long_size;         /* sizeof(long) on the target */
+    uint8_t  pad[3];
+    volatile uint64_t next_seq; /* records reserved so far */
+    int64_t  mono_to_real_ns;   /* add to a record time stamp for wall time */
+    uint8_t  reserved[16];
+} tBT_BLOG_HDR;
+
+typedef struct {
+    uint32_t len;               /* string length, without NUL */
+    uint8_t  level;
+    uint8_t  pad[3];
+    /* NUL terminated string follows, entries are 4 byte aligned */
+} tBT_BLOG_DICT;
+
+#define BT_BLOG_PAYLOAD_MAX (BT_BLOG_REC_SIZE - 32)
+
+typedef struct {
+    volatile uint64_t seq;      /* reservation number + 1, 0 while written */
+    uint64_t ts_ns;             /* CLOCK_MONOTONIC */
+    uint32_t fmt_id;
+    uint32_t tid;
+    uint8_t  level;
+    uint8_t  len;               /* payload bytes used */
+    uint8_t  truncated;         /* arguments missing at the end */
+    uint8_t  pad[5];
+    uint8_t  payload[BT_BLOG_PAYLOAD_MAX];
+} tBT_BLOG_REC;
+
+/*******************************************************************************
+**
+** Function        bt_blog_next_conv
+**
+** Description     Find the next conversion in a printf format. Appends the
+**                 argument classes it consumes, '*' width and precision
+**                 first, to p_types while *p_num < max.
+**
+** Returns         Pointer to the conversion character, *pp_start set to its
+**                 '%'. NULL when the format has no further conversion.
+**
+*******************************************************************************/
+static inline const char *bt_blog_next_conv(const char *p, const char **pp_start,
+                                            uint8_t *p_types, int *p_num, int max)
+{
+    int lng;
+
+    for (; *p; p++) {
+        if (*p != '%')
+            continue;
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+
+        *pp_start = p++;
+
+        while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'')
+            p++;
+        if (*p == '*') {
+            if (*p_num < max)
+                p_types[(*p_num)++] = BT_BLOG_ARG_INT;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+            p++;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                if (*p_num < max)
+                    p_types[(*p_num)++] = BT_BLOG_ARG_INT;
+                p++;
+            }
+            while (*p >= '0' && *p <= '9')
+                p++;
+        }
+
+        lng = 0;
+        for (;; p++) {
+            if (*p == 'h')
+                continue;
+            if (*p == 'l' || *p == 'z' || *p == 't')
+                lng++;
+            else if (*p == 'q' || *p == 'j' || *p == 'L')
+                lng = 2;
+            else
+                break;
+        }
+
+        if (*p == '\0')
+            return NULL;
+
+        if (*p_num >= max)
+            return p;
+
+        switch (*p) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+            p_types[(*p_num)++] = (lng == 0) ? BT_BLOG_ARG_INT :
+                                  (lng == 1) ? BT_BLOG_ARG_LONG : BT_BLOG_ARG_LLONG;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            p_types[(*p_num)++] = BT_BLOG_ARG_DOUBLE;
+            break;
+        case 's':
+            p_types[(*p_num)++] = BT_BLOG_ARG_STR;
+            break;
+        case 'p': case 'n':
+            p_types[(*p_num)++] = BT_BLOG_ARG_PTR;
+            break;
+        default:
+            break;
+        }
+        return p;
+    }
+
+    return NULL;
+}
+
+#endif  /* BT_SYSLOG_BIN_H */
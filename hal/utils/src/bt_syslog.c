@@ -22,83 +22,591 @@
  *
  *  Description:   sys log helper functions in Linux
  *
+ *                 Every logging thread owns a ring of fixed size records it
+ *                 formats into without any lock. A single writer thread
+ *                 drains all rings to syslog or a file. A full ring drops
+ *                 the record and counts it instead of blocking the caller.
+ *
+ *                 In binary mode nothing is formatted at all: the format
+ *                 string goes into a dictionary once, each call stores its
+ *                 raw arguments in a shared memory mapped record ring, see
+ *                 bt_syslog_bin.h.
  *
  ***********************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <syslog.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "bt_syslog.h"
+#include "bt_syslog_bin.h"
 
-/** trace level for sys log */
-#define SYS_TRACE_DEBUG     0
-#define SYS_TRACE_INFO      1
-#define SYS_TRACE_WARN      2
-#define SYS_TRACE_ERROR     3
+/* Records per thread ring, must be a power of 2 */
+#ifndef SYS_LOG_RING_SLOTS
+#define SYS_LOG_RING_SLOTS  32
+#endif
 
-#define SYS_LOG_BUF_SIZE    1024
+#define SYS_LOG_BUF_SIZE    512
 #define SYS_LOG_MSG_OFFSET  0
 #define SYS_LOG_MSG_MAX (SYS_LOG_BUF_SIZE - SYS_LOG_MSG_OFFSET)
 
-static void sys_log_msg(uint8_t trace_level, const char *fmt_str, va_list ap)
-{
-    static char buffer[SYS_LOG_BUF_SIZE];
-    int priority = LOG_USER;
+#if (SYS_LOG_RING_SLOTS & (SYS_LOG_RING_SLOTS - 1))
+#error SYS_LOG_RING_SLOTS must be a power of 2
+#endif
+
+/* Distinct format strings binary mode can tell apart, must be a power of 2 */
+#ifndef SYS_LOG_BIN_FMTS
+#define SYS_LOG_BIN_FMTS    2048
+#endif
+
+/* Bytes of the binary log file set aside for format strings */
+#ifndef SYS_LOG_BIN_DICT_SIZE
+#define SYS_LOG_BIN_DICT_SIZE   (128 * 1024)
+#endif
+
+/* Records in the binary log ring when started from SYS_LOG_BIN_PATH */
+#ifndef SYS_LOG_BIN_RECS
+#define SYS_LOG_BIN_RECS    (64 * 1024)
+#endif
+
+#if (SYS_LOG_BIN_FMTS & (SYS_LOG_BIN_FMTS - 1))
+#error SYS_LOG_BIN_FMTS must be a power of 2
+#endif
+
+typedef struct {
+    struct timespec ts;             /* CLOCK_REALTIME when logged */
+    uint8_t         level;
+    char            msg[SYS_LOG_MSG_MAX];
+} tSYS_LOG_REC;
+
+typedef struct sys_log_ring {
+    struct sys_log_ring *p_next;    /* all rings ever created, never unlinked */
+    volatile uint32_t   head;       /* written by the owning thread */
+    volatile uint32_t   tail;       /* written by the drain side */
+    volatile uint32_t   dropped;    /* records lost to a full ring */
+    volatile int        in_use;     /* claimed by a live thread */
+    pid_t               tid;
+    tSYS_LOG_REC        rec[SYS_LOG_RING_SLOTS];
+} tSYS_LOG_RING;
 
-    vsnprintf(&buffer[SYS_LOG_MSG_OFFSET], SYS_LOG_MSG_MAX, fmt_str, ap);
+volatile int bt_syslog_level = SYS_TRACE_DEFAULT_LEVEL;
 
+static tSYS_LOG_RING *volatile sys_log_rings;
+static __thread tSYS_LOG_RING *sys_log_my_ring;
+
+static pthread_once_t sys_log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t sys_log_key;
+static int sys_log_started;
+
+/* writer thread parks on sys_log_cond once every ring is empty */
+static pthread_mutex_t sys_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sys_log_cond = PTHREAD_COND_INITIALIZER;
+static volatile int sys_log_sleeping;
+
+/* binary mode: format strings seen so far, keyed by their address */
+typedef struct {
+    const char *volatile fmt;
+    volatile uint32_t   id;         /* dictionary id, 0 until usable */
+    uint8_t             num;
+    uint8_t             types[BT_BLOG_MAX_ARGS];
+} tSYS_BLOG_FMT;
+
+static tSYS_BLOG_FMT sys_blog_fmts[SYS_LOG_BIN_FMTS];
+static tBT_BLOG_HDR *sys_blog_hdr;
+static uint8_t *sys_blog_dict;
+static tBT_BLOG_REC *sys_blog_recs;
+static uint32_t sys_blog_mask;
+static volatile int sys_blog_on;
+static __thread uint32_t sys_blog_tid;
+
+/* serializes the drain side: writer thread and bt_syslog_flush */
+static pthread_mutex_t sys_log_drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *sys_log_file;
+
+static int sys_log_priority(uint8_t trace_level)
+{
     switch (trace_level) {
     case SYS_TRACE_DEBUG:
-        priority |= LOG_DEBUG;
-        break;
+        return LOG_USER | LOG_DEBUG;
     case SYS_TRACE_INFO:
-        priority |= LOG_INFO;
-        break;
+        return LOG_USER | LOG_INFO;
     case SYS_TRACE_WARN:
-        priority |= LOG_WARNING;
-        break;
+        return LOG_USER | LOG_WARNING;
     case SYS_TRACE_ERROR:
     default:
-        priority |= LOG_ERR;
-        break;
+        return LOG_USER | LOG_ERR;
+    }
+}
+
+static void sys_log_emit(uint8_t trace_level, pid_t tid, const struct timespec *ts, const char *msg)
+{
+    static const char level_char[] = "DIWE";
+    struct tm tm;
+
+    if (sys_log_file == NULL) {
+        syslog(sys_log_priority(trace_level), "%s", msg);
+        return;
     }
 
-    syslog(priority, "%s", buffer);
+    localtime_r(&ts->tv_sec, &tm);
+    fprintf(sys_log_file, "%02d-%02d %02d:%02d:%02d.%06ld %5d %c %s\n",
+            tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+            ts->tv_nsec / 1000, (int)tid, level_char[trace_level & 3], msg);
 }
 
-void SYSLOGD(const char *fmt_str, ...)
+/* Write out whatever the rings hold. Caller holds sys_log_drain_mutex. */
+static int sys_log_drain(void)
 {
-    va_list ap;
+    tSYS_LOG_RING *p_ring;
+    tSYS_LOG_REC *p_rec;
+    uint32_t tail, head, dropped;
+    struct timespec now;
+    char lost[64];
+    int count = 0;
 
-    va_start(ap, fmt_str);
-    sys_log_msg(SYS_TRACE_DEBUG, fmt_str, ap);
-    va_end(ap);
+    for (p_ring = sys_log_rings; p_ring != NULL; p_ring = p_ring->p_next) {
+        head = p_ring->head;
+        __sync_synchronize();
+
+        for (tail = p_ring->tail; tail != head; tail++) {
+            p_rec = &p_ring->rec[tail & (SYS_LOG_RING_SLOTS - 1)];
+            sys_log_emit(p_rec->level, p_ring->tid, &p_rec->ts, p_rec->msg);
+            count++;
+        }
+
+        __sync_synchronize();
+        p_ring->tail = tail;
+
+        if (p_ring->dropped) {
+            dropped = __sync_lock_test_and_set(&p_ring->dropped, 0);
+            snprintf(lost, sizeof(lost), "bt_syslog: %u messages lost", dropped);
+            clock_gettime(CLOCK_REALTIME, &now);
+            sys_log_emit(SYS_TRACE_WARN, p_ring->tid, &now, lost);
+        }
+    }
+
+    if (count && sys_log_file)
+        fflush(sys_log_file);
+
+    return count;
 }
 
-void SYSLOGI(const char *fmt_str, ...)
+static int sys_log_pending(void)
 {
-    va_list ap;
+    tSYS_LOG_RING *p_ring;
 
-    va_start(ap, fmt_str);
-    sys_log_msg(SYS_TRACE_INFO, fmt_str, ap);
-    va_end(ap);
+    for (p_ring = sys_log_rings; p_ring != NULL; p_ring = p_ring->p_next) {
+        if (p_ring->head != p_ring->tail || p_ring->dropped)
+            return 1;
+    }
+
+    return 0;
 }
 
-void SYSLOGW(const char *fmt_str, ...)
+static void *sys_log_thread(void *arg)
 {
-    va_list ap;
+    for (;;) {
+        pthread_mutex_lock(&sys_log_drain_mutex);
+        sys_log_drain();
+        pthread_mutex_unlock(&sys_log_drain_mutex);
 
-    va_start(ap, fmt_str);
-    sys_log_msg(SYS_TRACE_WARN, fmt_str, ap);
-    va_end(ap);
+        /* Announce the sleep before the last look at the rings, a producer
+         * publishes its record before looking at sys_log_sleeping */
+        pthread_mutex_lock(&sys_log_mutex);
+        sys_log_sleeping = 1;
+        __sync_synchronize();
+        if (!sys_log_pending())
+            pthread_cond_wait(&sys_log_cond, &sys_log_mutex);
+        sys_log_sleeping = 0;
+        pthread_mutex_unlock(&sys_log_mutex);
+    }
+
+    return NULL;
+}
+
+/* Give the ring back when its thread exits, the writer still drains it */
+static void sys_log_ring_release(void *p)
+{
+    ((tSYS_LOG_RING *)p)->in_use = 0;
+}
+
+static void sys_log_init(void)
+{
+    pthread_t thread_id;
+    pthread_attr_t attr;
+
+    pthread_key_create(&sys_log_key, sys_log_ring_release);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread_id, &attr, sys_log_thread, NULL) == 0)
+        sys_log_started = 1;
+    pthread_attr_destroy(&attr);
+
+    atexit(bt_syslog_flush);
+
+#ifdef SYS_LOG_BIN_PATH
+    bt_syslog_set_binary(SYS_LOG_BIN_PATH, SYS_LOG_BIN_RECS);
+#endif
 }
 
-void SYSLOGE(const char *fmt_str, ...)
+static tSYS_LOG_RING *sys_log_get_ring(void)
 {
+    tSYS_LOG_RING *p_ring;
+
+    /* reuse the ring of a thread that has exited */
+    for (p_ring = sys_log_rings; p_ring != NULL; p_ring = p_ring->p_next) {
+        if (!p_ring->in_use && __sync_bool_compare_and_swap(&p_ring->in_use, 0, 1))
+            break;
+    }
+
+    if (p_ring == NULL) {
+        p_ring = calloc(1, sizeof(tSYS_LOG_RING));
+        if (p_ring == NULL)
+            return NULL;
+
+        p_ring->in_use = 1;
+        do {
+            p_ring->p_next = sys_log_rings;
+        } while (!__sync_bool_compare_and_swap(&sys_log_rings, p_ring->p_next, p_ring));
+    }
+
+    p_ring->tid = (pid_t)syscall(SYS_gettid);
+    pthread_setspecific(sys_log_key, p_ring);
+    sys_log_my_ring = p_ring;
+
+    return p_ring;
+}
+
+/* Parse a new format once and give it a dictionary entry */
+static void sys_blog_add_fmt(tSYS_BLOG_FMT *p_fmt, const char *fmt_str, uint8_t trace_level)
+{
+    tBT_BLOG_DICT *p_entry;
+    const char *p = fmt_str;
+    const char *p_start;
+    uint32_t len, need, off;
+    int num = 0;
+
+    while ((p = bt_blog_next_conv(p, &p_start, p_fmt->types, &num, BT_BLOG_MAX_ARGS)) != NULL)
+        p++;
+    p_fmt->num = num;
+
+    len = strlen(fmt_str);
+    need = (sizeof(tBT_BLOG_DICT) + len + 1 + 3) & ~3;
+    off = __sync_fetch_and_add(&sys_blog_hdr->dict_used, need);
+    if (off + need > sys_blog_hdr->dict_size)
+        return;     /* dictionary full, this format stays on the text path */
+
+    p_entry = (tBT_BLOG_DICT *)(sys_blog_dict + off);
+    p_entry->len = len;
+    p_entry->level = trace_level;
+    memcpy(p_entry + 1, fmt_str, len + 1);
+
+    __sync_synchronize();
+    p_fmt->id = off + 1;
+}
+
+static tSYS_BLOG_FMT *sys_blog_lookup(const char *fmt_str, uint8_t trace_level)
+{
+    tSYS_BLOG_FMT *p_fmt;
+    uint32_t hash = (uint32_t)((uintptr_t)fmt_str >> 2) * 2654435761u;
+    uint32_t i = 0;
+
+    while (i < SYS_LOG_BIN_FMTS) {
+        p_fmt = &sys_blog_fmts[(hash + i) & (SYS_LOG_BIN_FMTS - 1)];
+
+        if (p_fmt->fmt == fmt_str)
+            return p_fmt->id ? p_fmt : NULL;
+
+        if (p_fmt->fmt != NULL) {
+            i++;
+            continue;
+        }
+
+        /* free slot: claim it, or look again if another thread got there */
+        if (__sync_bool_compare_and_swap(&p_fmt->fmt, NULL, fmt_str)) {
+            sys_blog_add_fmt(p_fmt, fmt_str, trace_level);
+            return p_fmt->id ? p_fmt : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/* Store one call as format id plus raw arguments. Returns -1 if the call has
+ * to take the text path. */
+static int sys_blog_write(uint8_t trace_level, const char *fmt_str, va_list ap)
+{
+    tSYS_BLOG_FMT *p_fmt;
+    tBT_BLOG_REC *p_rec;
+    struct timespec ts;
+    uint64_t seq;
+    uint8_t *p, *p_end;
+    const char *str;
+    int32_t i32;
+    int64_t i64;
+    uint64_t u64;
+    double dbl;
+    size_t n;
+    int i;
+
+    p_fmt = sys_blog_lookup(fmt_str, trace_level);
+    if (p_fmt == NULL)
+        return -1;
+
+    if (sys_blog_tid == 0)
+        sys_blog_tid = (uint32_t)syscall(SYS_gettid);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    seq = __sync_fetch_and_add(&sys_blog_hdr->next_seq, 1);
+    p_rec = &sys_blog_recs[seq & sys_blog_mask];
+
+    /* mark the record torn until it is complete */
+    p_rec->seq = 0;
+    __sync_synchronize();
+
+    p_rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    p_rec->fmt_id = p_fmt->id;
+    p_rec->tid = sys_blog_tid;
+    p_rec->level = trace_level;
+    p_rec->truncated = 0;
+
+    p = p_rec->payload;
+    p_end = p_rec->payload + BT_BLOG_PAYLOAD_MAX;
+
+    for (i = 0; i < p_fmt->num; i++) {
+        if (p_end - p < 8) {
+            p_rec->truncated = 1;
+            break;
+        }
+
+        switch (p_fmt->types[i]) {
+        case BT_BLOG_ARG_INT:
+            i32 = va_arg(ap, int);
+            memcpy(p, &i32, 4);
+            p += 4;
+            break;
+        case BT_BLOG_ARG_LONG:
+            i64 = va_arg(ap, long);
+            memcpy(p, &i64, 8);
+            p += 8;
+            break;
+        case BT_BLOG_ARG_LLONG:
+            i64 = va_arg(ap, long long);
+            memcpy(p, &i64, 8);
+            p += 8;
+            break;
+        case BT_BLOG_ARG_DOUBLE:
+            dbl = va_arg(ap, double);
+            memcpy(p, &dbl, 8);
+            p += 8;
+            break;
+        case BT_BLOG_ARG_PTR:
+            u64 = (uintptr_t)va_arg(ap, void *);
+            memcpy(p, &u64, 8);
+            p += 8;
+            break;
+        case BT_BLOG_ARG_STR:
+        default:
+            str = va_arg(ap, const char *);
+            if (str == NULL)
+                str = "(null)";
+            n = strnlen(str, p_end - p - 1);
+            *p++ = (uint8_t)n;
+            memcpy(p, str, n);
+            p += n;
+            if (str[n] != '\0') {
+                p_rec->truncated = 1;
+                i = p_fmt->num;
+            }
+            break;
+        }
+    }
+
+    p_rec->len = p - p_rec->payload;
+
+    __sync_synchronize();
+    p_rec->seq = seq + 1;
+
+    return 0;
+}
+
+void bt_syslog_msg(int trace_level, const char *fmt_str, ...)
+{
+    tSYS_LOG_RING *p_ring;
+    tSYS_LOG_REC *p_rec;
+    uint32_t head;
     va_list ap;
 
+    pthread_once(&sys_log_once, sys_log_init);
+
+    if (sys_blog_on) {
+        int ret;
+
+        va_start(ap, fmt_str);
+        ret = sys_blog_write(trace_level, fmt_str, ap);
+        va_end(ap);
+
+        if (ret == 0)
+            return;
+    }
+
+    p_ring = sys_log_my_ring;
+    if (p_ring == NULL)
+        p_ring = sys_log_get_ring();
+
+    if (p_ring == NULL || !sys_log_started) {
+        /* no ring or no writer: fall back to logging in place */
+        char buffer[SYS_LOG_BUF_SIZE];
+
+        va_start(ap, fmt_str);
+        vsnprintf(buffer, sizeof(buffer), fmt_str, ap);
+        va_end(ap);
+
+        syslog(sys_log_priority(trace_level), "%s", buffer);
+        return;
+    }
+
+    head = p_ring->head;
+    if (head - p_ring->tail >= SYS_LOG_RING_SLOTS) {
+        __sync_fetch_and_add(&p_ring->dropped, 1);
+        return;
+    }
+
+    p_rec = &p_ring->rec[head & (SYS_LOG_RING_SLOTS - 1)];
+    clock_gettime(CLOCK_REALTIME, &p_rec->ts);
+    p_rec->level = trace_level;
+
     va_start(ap, fmt_str);
-    sys_log_msg(SYS_TRACE_ERROR, fmt_str, ap);
+    vsnprintf(p_rec->msg, SYS_LOG_MSG_MAX, fmt_str, ap);
     va_end(ap);
+
+    /* publish, then wake the writer only if it went to sleep */
+    __sync_synchronize();
+    p_ring->head = head + 1;
+    __sync_synchronize();
+
+    if (sys_log_sleeping) {
+        pthread_mutex_lock(&sys_log_mutex);
+        pthread_cond_signal(&sys_log_cond);
+        pthread_mutex_unlock(&sys_log_mutex);
+    }
+}
+
+void bt_syslog_set_level(int trace_level)
+{
+    bt_syslog_level = trace_level;
+}
+
+int bt_syslog_set_file(const char *path)
+{
+    FILE *fp = NULL;
+
+    if (path) {
+        fp = fopen(path, "a");
+        if (fp == NULL)
+            return -1;
+    }
+
+    pthread_mutex_lock(&sys_log_drain_mutex);
+    sys_log_drain();
+    if (sys_log_file)
+        fclose(sys_log_file);
+    sys_log_file = fp;
+    pthread_mutex_unlock(&sys_log_drain_mutex);
+
+    return 0;
+}
+
+int bt_syslog_set_binary(const char *path, uint32_t rec_count)
+{
+    static pthread_mutex_t bin_mutex = PTHREAD_MUTEX_INITIALIZER;
+    struct timespec mono, real;
+    tBT_BLOG_HDR *p_hdr;
+    size_t size;
+    void *p_map;
+    int fd;
+
+    if (path == NULL) {
+        sys_blog_on = 0;
+        return 0;
+    }
+
+    /* round down to a power of 2 so a record index is a mask away */
+    while (rec_count & (rec_count - 1))
+        rec_count &= rec_count - 1;
+    if (rec_count == 0)
+        return -1;
+
+    pthread_mutex_lock(&bin_mutex);
+
+    /* the mapping stays for the life of the process, writers may still
+     * be inside it after binary mode is switched off */
+    if (sys_blog_hdr != NULL) {
+        pthread_mutex_unlock(&bin_mutex);
+        return -1;
+    }
+
+    size = sizeof(tBT_BLOG_HDR) + SYS_LOG_BIN_DICT_SIZE + (size_t)rec_count * sizeof(tBT_BLOG_REC);
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        pthread_mutex_unlock(&bin_mutex);
+        return -1;
+    }
+
+    if (ftruncate(fd, size) < 0 ||
+        (p_map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        pthread_mutex_unlock(&bin_mutex);
+        return -1;
+    }
+    close(fd);
+
+    p_hdr = p_map;
+    memcpy(p_hdr->magic, BT_BLOG_MAGIC, sizeof(p_hdr->magic));
+    p_hdr->version = BT_BLOG_VERSION;
+    p_hdr->rec_size = sizeof(tBT_BLOG_REC);
+    p_hdr->rec_count = rec_count;
+    p_hdr->dict_size = SYS_LOG_BIN_DICT_SIZE;
+    p_hdr->dict_used = 0;
+    p_hdr->long_size = sizeof(long);
+    p_hdr->next_seq = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+    p_hdr->mono_to_real_ns = ((int64_t)real.tv_sec - mono.tv_sec) * 1000000000LL +
+                             (real.tv_nsec - mono.tv_nsec);
+
+    sys_blog_dict = (uint8_t *)(p_hdr + 1);
+    sys_blog_recs = (tBT_BLOG_REC *)(sys_blog_dict + SYS_LOG_BIN_DICT_SIZE);
+    sys_blog_mask = rec_count - 1;
+    sys_blog_hdr = p_hdr;
+
+    __sync_synchronize();
+    sys_blog_on = 1;
+
+    pthread_mutex_unlock(&bin_mutex);
+
+    return 0;
+}
+
+void bt_syslog_flush(void)
+{
+    pthread_mutex_lock(&sys_log_drain_mutex);
+    sys_log_drain();
+    if (sys_log_file)
+        fflush(sys_log_file);
+    pthread_mutex_unlock(&sys_log_drain_mutex);
 }
@@ -0,0 +1,288 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2014 Realsil Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Host side equivalence check of bt_bitmath_access_code against the bit by
+ *  bit access code generator it replaced in BTDevice_SetHitTarget. Every LAP
+ *  is tried, each twice with different UAP/NAP bits so the memoized path is
+ *  checked too. Exits non zero on the first mismatch.
+ *
+ *  usage: bt_bitmath_check [lap_step]
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "bt_mp_bitmath.h"
+
+typedef unsigned char BOOL;
+
+/* The former BTBASE_HitTargetAccessCodeGen, unchanged but for the signature */
+static void ref_access_code(uint64_t HitTarget, unsigned long *pAccessCode)
+{
+    BOOL AccessCode[72];
+    BOOL LC_PN_SEQ_MSB[32]   = {1,0,0,0,0,0,1,1,1,0,0,0,0,1,0,0,1,0,0,0,1,1,0,1,1,0,0,1,0,1,1,0};      //LC_PN_SEQ_MSB=0x83848d96
+    BOOL LC_GEN_POLY_MSB[32] = {0,1,1,0,0,0,0,1,0,1,0,1,1,1,0,0,0,1,0,0,1,1,1,1,0,1,1,0,1,0,1,0};      //LC_GEN_POLY_MSB=0x615c4f6a
+    BOOL LC_GEN_POLY_LSB[32] = {0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};      //LC_GEN_POLY_LSB=0x40000000
+    BOOL p33_p0[34]          = {1,0,1,0,1,1,1,0,1,1,1,1,0,0,1,1,0,0,0,1,0,1,0,1,0,0,1,1,1,1,1,1,0,0};  //PN_seq(P33~P0) = 0x2bbcc54fc
+    BOOL BDAddress[48]; //6 byte  ,48bit
+    BOOL LAP_INV[25], LAP_BK[31], barker_seq[33], temp[33], mod2[33], mod1[33];
+    BOOL Parity[35], hold_mod2[33], hold_mod1[33], tmp;      //Bit0 is not valid
+
+    int i=0, j=0;
+
+    for (i=0;i<72;i++)
+    {
+        AccessCode[i]=0;
+    }
+
+    for (i=47;i>=0;i--)
+    {
+        BDAddress[i]=(int)((HitTarget>>i) &0x01);
+    }
+
+    //Extract LAP from BD Address
+    for (i=1; i<=24; i++)
+    {
+        LAP_INV[i]     =  *(BDAddress + i-1);
+        LAP_BK[i]      =  LAP_INV[i];
+    }
+    if (LAP_INV[24] == 0)
+    {
+        LAP_BK[25] =  0;
+        LAP_BK[26] =  0;
+        LAP_BK[27] =  1;
+        LAP_BK[28] =  1;
+        LAP_BK[29] =  0;
+        LAP_BK[30] =  1;
+    }
+    else
+    {
+        LAP_BK[25] =  1;
+        LAP_BK[26] =  1;
+        LAP_BK[27] =  0;
+        LAP_BK[28] =  0;
+        LAP_BK[29] =  1;
+        LAP_BK[30] =  0;
+    }
+    for (i=1; i<=30; i++)
+    {
+        barker_seq[i] = LAP_BK[31-i];
+    }
+    barker_seq[31] = 0;
+    barker_seq[32] = 0;
+
+    for (i=1; i<=30; i++)
+    {
+        mod2[i] = barker_seq[i] ^ LC_PN_SEQ_MSB[i-1];
+    }
+    mod2[31] = 0;
+    mod2[32] = 0;
+
+    for (i=1; i<=30; i++)
+    {
+        mod1[i] = 0;
+    }
+
+    for (i=1; i<=30; i++)
+    {
+        if (mod2[1] == 1)
+        {
+            if (mod1[1] == 1)
+            {
+                for (j=1; j<=31; j++)  //shift
+                    mod2[j] = mod2[j+1];
+                mod2[32] = 1;
+            }
+            else
+            {
+                for (j=1; j<=31; j++)  //shift
+                    mod2[j] = mod2[j+1];
+
+                mod2[32] = 0;
+            }//end if (mod1[1] == 1)
+
+            for (j=1; j<=31; j++)
+                mod1[j] = mod1[j+1];
+
+            mod1[32] = 0;
+
+            for (j=1; j<=32; j++)
+            {
+                mod2[j] = mod2[j] ^ LC_GEN_POLY_MSB[j-1];
+                mod1[j] = mod1[j] ^ LC_GEN_POLY_LSB[j-1];
+            }//end for (j=1; j<=32; j++)
+        }
+        else //if (mod2[1] == 1) else
+        {
+            if (mod1[1] == 1)
+            {
+                for (j=1; j<=31; j++)  //shift
+                    mod2[j] = mod2[j+1];
+
+                mod2[32] = 1;
+            }
+            else
+            {
+                for (j=1; j<=31; j++)  //shift
+                    mod2[j] = mod2[j+1];
+
+                mod2[32] = 0;
+            }//end (mod1[1] == 1)
+
+            for (j=1; j<=31; j++)
+                mod1[j] = mod1[j+1];
+
+            mod1[32] = 0;
+        }//end if (mod2[1] == 1)
+    } //end for (i=1; i<=30; i++)
+
+    for (i=1; i<=30; i++)
+        hold_mod2[i] = mod2[i+2];
+
+    hold_mod2[31] = 0;
+    hold_mod2[32] = 0;
+
+    for (i=1; i<=30; i++)
+        hold_mod1[i] = 0;
+
+    hold_mod1[31] = mod1[1];
+    hold_mod1[32] = mod1[2];
+
+    for (i=1; i<=32; i++)
+    {
+        temp[i] = hold_mod2[i] | hold_mod1[i];
+        Parity[i+2] = temp[i];
+    }
+
+    Parity[1] = mod2[1];
+    Parity[2] = mod2[2];
+
+    //assign AccessCode
+    for (i=1; i<=34; i++)
+    {
+        tmp = Parity[35-i] ^ p33_p0[34-i];
+        AccessCode[i+3] = tmp;
+    }
+
+    for (i=38; i<=67; i++)
+        AccessCode[i] = LAP_BK[i-37];
+
+
+    if (AccessCode[4] == 1)
+    {
+        AccessCode[0] = 0;
+        AccessCode[1] = 1;
+        AccessCode[2] = 0;
+        AccessCode[3] = 1;
+        AccessCode[4] = 0;
+    }
+    else
+    {
+        AccessCode[0] = 1;
+        AccessCode[1] = 0;
+        AccessCode[2] = 1;
+        AccessCode[3] = 0;
+        AccessCode[4] = 1;
+    } //end if (AccessCode[4] == 1)
+
+    if (AccessCode[67] == 1)
+    {
+        AccessCode[68] = 0;
+        AccessCode[69] = 1;
+        AccessCode[70] = 0;
+        AccessCode[71] = 1;
+    }
+    else
+    {
+        AccessCode[68] = 1;
+        AccessCode[69] = 0;
+        AccessCode[70] = 1;
+        AccessCode[71] = 0;
+    }   //end  if (AccessCode[67] == 1)
+
+    for (i=0;i<4;i++)
+    {
+        for (j=0;j<16;j++)
+        {
+            if (AccessCode[67-((i*16)+j)] == 0)
+                pAccessCode[i]=pAccessCode[i]|(0x0<<j);
+            else
+                pAccessCode[i]=pAccessCode[i]|(0x1<<j);
+        }
+
+    }
+
+}
+
+/* xorshift, the upper address bits only have to vary */
+static uint64_t next_rand(uint64_t *p_state)
+{
+    uint64_t x = *p_state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *p_state = x;
+
+    return x;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    uint64_t hit_target;
+    unsigned long ref[4];
+    uint16_t code[4];
+    uint32_t lap, step = 1, checked = 0;
+    int pass, i;
+
+    if (argc > 2 || (argc == 2 && (step = strtoul(argv[1], NULL, 0)) == 0)) {
+        fprintf(stderr, "usage: %s [lap_step]\n", argv[0]);
+        return 2;
+    }
+
+    for (lap = 0; lap <= 0xFFFFFF; lap += step) {
+        for (pass = 0; pass < 2; pass++) {
+            hit_target = lap | ((next_rand(&state) & 0xFFFFFFULL) << 24);
+
+            for (i = 0; i < 4; i++)
+                ref[i] = 0;
+            ref_access_code(hit_target, ref);
+            bt_bitmath_access_code(hit_target, code);
+
+            for (i = 0; i < 4; i++) {
+                if (ref[i] != code[i]) {
+                    printf("MISMATCH hit target 0x%012llx word %d: 0x%04x, bitwise 0x%04lx\n",
+                           (unsigned long long)hit_target, i, code[i], ref[i]);
+                    return 1;
+                }
+            }
+        }
+        checked++;
+        if (lap > 0xFFFFFF - step)
+            break;
+    }
+
+    printf("%u LAPs checked, no mismatch\n", checked);
+
+    return 0;
+}
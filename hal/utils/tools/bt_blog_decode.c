@@ -0,0 +1,307 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2014 Realsil Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Host side decoder for the binary log written by bt_syslog_set_binary.
+ *  Prints the surviving records oldest first, in the same layout as the
+ *  text log file.
+ *
+ *  usage: bt_blog_decode <file>
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bt_syslog_bin.h"
+
+static const tBT_BLOG_HDR *hdr;
+static const uint8_t *dict;
+static const tBT_BLOG_REC *recs;
+
+static int rec_cmp(const void *a, const void *b)
+{
+    uint64_t sa = (*(const tBT_BLOG_REC **)a)->seq;
+    uint64_t sb = (*(const tBT_BLOG_REC **)b)->seq;
+
+    return (sa > sb) - (sa < sb);
+}
+
+/* Print one record's message, pulling arguments off the payload in the order
+ * the format consumes them */
+static void print_msg(const tBT_BLOG_REC *p_rec, const char *fmt)
+{
+    const uint8_t *p = p_rec->payload;
+    const uint8_t *p_end = p_rec->payload + (p_rec->len <= BT_BLOG_PAYLOAD_MAX ? p_rec->len : BT_BLOG_PAYLOAD_MAX);
+    const char *p_conv, *p_start;
+    uint8_t types[BT_BLOG_MAX_ARGS];
+    char spec[64];
+    int64_t args[2];
+    int num, first, n_star, ok;
+    size_t spec_len;
+
+    while (1) {
+        num = 0;
+        p_conv = bt_blog_next_conv(fmt, &p_start, types, &num, BT_BLOG_MAX_ARGS);
+        if (p_conv == NULL) {
+            /* literal tail, still honouring %% */
+            for (; *fmt; fmt++) {
+                putchar(*fmt);
+                if (fmt[0] == '%' && fmt[1] == '%')
+                    fmt++;
+            }
+            break;
+        }
+
+        for (; fmt < p_start; fmt++) {
+            putchar(*fmt);
+            if (fmt[0] == '%' && fmt[1] == '%')
+                fmt++;
+        }
+
+        spec_len = p_conv + 1 - p_start;
+        if (spec_len >= sizeof(spec))
+            spec_len = sizeof(spec) - 1;
+        memcpy(spec, p_start, spec_len);
+        spec[spec_len] = '\0';
+        fmt = p_conv + 1;
+
+        if (num == 0) {
+            /* unknown conversion, print it as it stands */
+            fputs(spec, stdout);
+            continue;
+        }
+
+        /* '*' width and precision come first and are always ints */
+        ok = 1;
+        n_star = 0;
+        for (first = 0; first < num - 1; first++) {
+            int32_t v;
+
+            if (p_end - p < 4) {
+                ok = 0;
+                break;
+            }
+            memcpy(&v, p, 4);
+            p += 4;
+            if (n_star < 2)
+                args[n_star++] = v;
+        }
+
+        if (ok) {
+            uint8_t type = types[num - 1];
+            int32_t i32;
+            int64_t i64;
+            uint64_t u64;
+            double dbl;
+            uint8_t len;
+
+            ok = (type == BT_BLOG_ARG_STR) ? (p_end - p >= 1) :
+                 (type == BT_BLOG_ARG_INT) ? (p_end - p >= 4) : (p_end - p >= 8);
+
+            if (ok) {
+                switch (type) {
+                case BT_BLOG_ARG_INT:
+                    memcpy(&i32, p, 4);
+                    p += 4;
+                    if (n_star == 2)
+                        printf(spec, (int)args[0], (int)args[1], i32);
+                    else if (n_star == 1)
+                        printf(spec, (int)args[0], i32);
+                    else
+                        printf(spec, i32);
+                    break;
+
+                case BT_BLOG_ARG_LONG:
+                case BT_BLOG_ARG_LLONG:
+                    memcpy(&i64, p, 8);
+                    p += 8;
+                    /* a 32 bit target stored unsigned longs sign extended */
+                    if (type == BT_BLOG_ARG_LONG && hdr->long_size == 4 && strchr("uoxX", *p_conv))
+                        i64 &= 0xffffffffLL;
+                    /* print through long long whatever the target used */
+                    {
+                        char ll_spec[72];
+                        char *q = ll_spec;
+                        const char *s;
+
+                        for (s = spec; s < spec + spec_len - 1; s++)
+                            if (!strchr("lqjztL", *s))
+                                *q++ = *s;
+                        *q++ = 'l';
+                        *q++ = 'l';
+                        *q++ = *p_conv;
+                        *q = '\0';
+
+                        if (n_star == 2)
+                            printf(ll_spec, (int)args[0], (int)args[1], (long long)i64);
+                        else if (n_star == 1)
+                            printf(ll_spec, (int)args[0], (long long)i64);
+                        else
+                            printf(ll_spec, (long long)i64);
+                    }
+                    break;
+
+                case BT_BLOG_ARG_DOUBLE:
+                    memcpy(&dbl, p, 8);
+                    p += 8;
+                    if (n_star == 2)
+                        printf(spec, (int)args[0], (int)args[1], dbl);
+                    else if (n_star == 1)
+                        printf(spec, (int)args[0], dbl);
+                    else
+                        printf(spec, dbl);
+                    break;
+
+                case BT_BLOG_ARG_PTR:
+                    memcpy(&u64, p, 8);
+                    p += 8;
+                    if (*p_conv == 'n')
+                        break;
+                    printf("0x%llx", (unsigned long long)u64);
+                    break;
+
+                case BT_BLOG_ARG_STR:
+                default:
+                    len = *p++;
+                    if (len > p_end - p)
+                        len = p_end - p;
+                    {
+                        char str[BT_BLOG_PAYLOAD_MAX + 1];
+
+                        memcpy(str, p, len);
+                        str[len] = '\0';
+                        p += len;
+                        if (n_star == 2)
+                            printf(spec, (int)args[0], (int)args[1], str);
+                        else if (n_star == 1)
+                            printf(spec, (int)args[0], str);
+                        else
+                            printf(spec, str);
+                    }
+                    break;
+                }
+            }
+        }
+
+        if (!ok)
+            fputs("?", stdout);
+    }
+
+    if (p_rec->truncated)
+        fputs(" [truncated]", stdout);
+    putchar('\n');
+}
+
+int main(int argc, char *argv[])
+{
+    static const char level_char[] = "DIWE";
+    const tBT_BLOG_REC **p_list;
+    const tBT_BLOG_REC *p_rec;
+    const tBT_BLOG_DICT *p_entry;
+    uint64_t next_seq, oldest;
+    uint32_t i, n = 0, dict_used;
+    uint8_t *buf;
+    long size;
+    FILE *fp;
+    struct timespec ts;
+    struct tm tm;
+    int64_t real_ns;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buf = malloc(size > 0 ? size : 1);
+    if (buf == NULL || size < (long)sizeof(tBT_BLOG_HDR) || fread(buf, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "%s: can not read\n", argv[1]);
+        return 1;
+    }
+    fclose(fp);
+
+    hdr = (const tBT_BLOG_HDR *)buf;
+    if (memcmp(hdr->magic, BT_BLOG_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != BT_BLOG_VERSION || hdr->rec_size != sizeof(tBT_BLOG_REC) ||
+        (uint64_t)sizeof(tBT_BLOG_HDR) + hdr->dict_size +
+        (uint64_t)hdr->rec_count * sizeof(tBT_BLOG_REC) > (uint64_t)size) {
+        fprintf(stderr, "%s: not a binary log of version %d\n", argv[1], BT_BLOG_VERSION);
+        return 1;
+    }
+
+    dict = (const uint8_t *)(hdr + 1);
+    recs = (const tBT_BLOG_REC *)(dict + hdr->dict_size);
+    dict_used = hdr->dict_used < hdr->dict_size ? hdr->dict_used : hdr->dict_size;
+    next_seq = hdr->next_seq;
+    oldest = next_seq > hdr->rec_count ? next_seq - hdr->rec_count : 0;
+
+    /* keep complete records that are still the latest for their slot */
+    p_list = malloc(hdr->rec_count * sizeof(*p_list) + 1);
+    for (i = 0; i < hdr->rec_count; i++) {
+        p_rec = &recs[i];
+        if (p_rec->seq == 0 || p_rec->seq <= oldest || p_rec->seq > next_seq ||
+            (p_rec->seq - 1) % hdr->rec_count != i)
+            continue;
+        p_list[n++] = p_rec;
+    }
+    qsort(p_list, n, sizeof(*p_list), rec_cmp);
+
+    if (oldest)
+        printf("-- %llu older records overwritten\n", (unsigned long long)oldest);
+
+    for (i = 0; i < n; i++) {
+        p_rec = p_list[i];
+
+        real_ns = (int64_t)p_rec->ts_ns + hdr->mono_to_real_ns;
+        ts.tv_sec = real_ns / 1000000000LL;
+        ts.tv_nsec = real_ns % 1000000000LL;
+        localtime_r(&ts.tv_sec, &tm);
+        printf("%02d-%02d %02d:%02d:%02d.%06ld %5u %c ",
+               tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+               ts.tv_nsec / 1000, p_rec->tid, level_char[p_rec->level & 3]);
+
+        if (p_rec->fmt_id == 0 || p_rec->fmt_id - 1 + sizeof(tBT_BLOG_DICT) > dict_used) {
+            printf("<bad format id %u>\n", p_rec->fmt_id);
+            continue;
+        }
+        p_entry = (const tBT_BLOG_DICT *)(dict + p_rec->fmt_id - 1);
+        if (p_rec->fmt_id - 1 + sizeof(tBT_BLOG_DICT) + p_entry->len + 1 > dict_used) {
+            printf("<bad format id %u>\n", p_rec->fmt_id);
+            continue;
+        }
+
+        print_msg(p_rec, (const char *)(p_entry + 1));
+    }
+
+    free(p_list);
+    free(buf);
+
+    return 0;
+}